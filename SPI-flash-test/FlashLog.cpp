@@ -0,0 +1,440 @@
+#include "FlashLog.h"
+#include "drivers/MbedCRC.h"
+
+#include <string.h>
+#include <stddef.h>
+#include <inttypes.h>
+
+#include "mbed_trace.h"
+#define TRACE_GROUP "FLOG"
+using namespace mbed;
+
+// Marks a sector holding log records ("FLOG")
+#define FLASH_LOG_MAGIC 0x474F4C46
+// Records are padded to this, read and program sizes must divide it
+#define FLASH_LOG_ALIGN 8
+// Payload is checked through a buffer of this size when it isn't read into the caller's buffer
+#define FLASH_LOG_SCRATCH_SIZE 32
+
+FlashLog::FlashLog(BlockDevice *bd, bd_addr_t start, bd_size_t size)
+    : _bd(bd), _start(start), _size(size), _sector_size(0), _sector_count(0), _align(FLASH_LOG_ALIGN), _first_offset(0),
+      _tail_sector(0), _tail_sequence(0), _head_sector(0), _head_sequence(0), _head_offset(0),
+      _read_sector(0), _read_sequence(0), _read_offset(0), _is_mounted(false)
+{
+    memset(&_stats, 0, sizeof(_stats));
+}
+
+int FlashLog::mount()
+{
+    _mutex.lock();
+
+    if (_is_mounted) {
+        _mutex.unlock();
+        return FLASH_LOG_OK;
+    }
+
+    bd_size_t area_size = (_size != 0) ? _size : (_bd->size() - _start);
+    _sector_size = _bd->get_erase_size(_start);
+    _first_offset = _align_up(sizeof(sector_header));
+
+    if ((_sector_size == 0) || (_start % _sector_size) || (area_size % _sector_size) ||
+            ((area_size / _sector_size) < 2) || (_sector_size < (_first_offset + 2 * sizeof(record_header))) ||
+            (FLASH_LOG_ALIGN % _bd->get_read_size()) || (FLASH_LOG_ALIGN % _bd->get_program_size())) {
+        tr_error("invalid log area - start %llu, size %llu, sector size %" PRIu32, _start, area_size, _sector_size);
+        _mutex.unlock();
+        return FLASH_LOG_ERROR_INVALID_GEOMETRY;
+    }
+    _sector_count = area_size / _sector_size;
+
+    // Newest sector has the highest sequence number
+    bool found = false;
+    for (uint32_t i_ind = 0; i_ind < _sector_count; i_ind++) {
+        uint32_t sequence;
+        if (_read_sector_header(i_ind, sequence) && (!found || (sequence > _head_sequence))) {
+            _head_sector = i_ind;
+            _head_sequence = sequence;
+            found = true;
+        }
+    }
+
+    int err = FLASH_LOG_OK;
+    if (!found) {
+        tr_info("no log found, starting a new one");
+        err = _format();
+    } else {
+        // Oldest sector - walk back from the newest one while the sequence numbers follow on
+        _tail_sector = _head_sector;
+        _tail_sequence = _head_sequence;
+        while (true) {
+            uint32_t prev_sector = (_tail_sector + _sector_count - 1) % _sector_count;
+            uint32_t sequence;
+            if ((prev_sector == _head_sector) || !_read_sector_header(prev_sector, sequence) ||
+                    (sequence != (_tail_sequence - 1))) {
+                break;
+            }
+            _tail_sector = prev_sector;
+            _tail_sequence = sequence;
+        }
+
+        // Append position - after the last good record of the newest sector
+        _head_offset = _first_offset;
+        while (err == FLASH_LOG_OK) {
+            uint32_t length;
+            err = _read_record(_head_sector, _head_offset, NULL, 0, length);
+            if (err == FLASH_LOG_OK) {
+                _head_offset += _align_up(sizeof(record_header) + length);
+            }
+        }
+        if (err == FLASH_LOG_ERROR_CORRUPT) {
+            // Interrupted append, the area after it can't be programmed again so the next append opens a new sector
+            tr_warning("corrupt record in sector %" PRIu32 " at %" PRIu32 ", closing the sector", _head_sector, _head_offset);
+            _head_offset = _sector_size;
+            err = FLASH_LOG_OK;
+        } else if (err == FLASH_LOG_ERROR_EMPTY) {
+            err = FLASH_LOG_OK;
+        }
+    }
+
+    if (err == FLASH_LOG_OK) {
+        _read_sector = _tail_sector;
+        _read_sequence = _tail_sequence;
+        _read_offset = _first_offset;
+        _is_mounted = true;
+        tr_debug("log mounted - sectors %" PRIu32 " to %" PRIu32 ", append at %" PRIu32,
+                 _tail_sector, _head_sector, _head_offset);
+    }
+
+    _mutex.unlock();
+
+    return err;
+}
+
+int FlashLog::unmount()
+{
+    _mutex.lock();
+    _is_mounted = false;
+    _mutex.unlock();
+
+    return _bd->sync();
+}
+
+int FlashLog::clear()
+{
+    _mutex.lock();
+
+    if (!_is_mounted) {
+        _mutex.unlock();
+        return FLASH_LOG_ERROR_NOT_MOUNTED;
+    }
+
+    int err = _bd->erase(_start, (bd_size_t)_sector_count * _sector_size);
+    if (err == BD_ERROR_OK) {
+        err = _format();
+    }
+
+    _mutex.unlock();
+
+    return err;
+}
+
+int FlashLog::append(const void *data, uint32_t size)
+{
+    _mutex.lock();
+
+    if (!_is_mounted) {
+        _mutex.unlock();
+        return FLASH_LOG_ERROR_NOT_MOUNTED;
+    }
+
+    if (size > get_max_record_size()) {
+        _mutex.unlock();
+        return FLASH_LOG_ERROR_TOO_LARGE;
+    }
+
+    int err = FLASH_LOG_OK;
+    uint32_t span = _align_up(sizeof(record_header) + size);
+
+    if ((_head_offset + span) > _sector_size) {
+        // Open the next sector, dropping the oldest one if the log wrapped onto it
+        uint32_t next_sector = (_head_sector + 1) % _sector_count;
+        if (next_sector == _tail_sector) {
+            _tail_sector = (_tail_sector + 1) % _sector_count;
+            _tail_sequence++;
+            _stats.sectors_dropped++;
+        }
+
+        err = _open_sector(next_sector, _head_sequence + 1);
+        if (err) {
+            _mutex.unlock();
+            return err;
+        }
+        _head_sector = next_sector;
+        _head_sequence++;
+        _head_offset = _first_offset;
+    }
+
+    // CRC covers the length too, so a header with a damaged length is caught
+    record_header header;
+    MbedCRC<POLY_32BIT_ANSI, 32> ct;
+    header.length = size;
+    ct.compute_partial_start(&header.crc);
+    ct.compute_partial(&header.length, sizeof(header.length), &header.crc);
+    ct.compute_partial(data, size, &header.crc);
+    ct.compute_partial_stop(&header.crc);
+
+    // Header first - if the payload is cut short by a power failure the record fails its CRC on mount
+    bd_addr_t addr = _sector_addr(_head_sector) + _head_offset;
+    err = _bd->program(&header, addr, sizeof(header));
+
+    // Payload, its last partial program unit padded with erased bytes
+    uint32_t program_size = _bd->get_program_size();
+    uint32_t direct_size = size - (size % program_size);
+    if (!err && direct_size) {
+        err = _bd->program(data, addr + sizeof(header), direct_size);
+    }
+    if (!err && (direct_size != size)) {
+        uint8_t pad[FLASH_LOG_ALIGN];
+        memset(pad, 0xFF, sizeof(pad));
+        memcpy(pad, static_cast<const uint8_t *>(data) + direct_size, size - direct_size);
+        err = _bd->program(pad, addr + sizeof(header) + direct_size, program_size);
+    }
+
+    if (err) {
+        // Whatever got programmed can't be overwritten, continue in a new sector
+        tr_error("append at %llu failed: %d", addr, err);
+        _head_offset = _sector_size;
+    } else {
+        _head_offset += span;
+        _stats.records_written++;
+        _stats.payload_bytes += size;
+        _stats.programmed_bytes += sizeof(header) + direct_size + ((direct_size != size) ? program_size : 0);
+    }
+
+    _mutex.unlock();
+
+    return err;
+}
+
+int FlashLog::rewind()
+{
+    _mutex.lock();
+
+    if (!_is_mounted) {
+        _mutex.unlock();
+        return FLASH_LOG_ERROR_NOT_MOUNTED;
+    }
+
+    _read_sector = _tail_sector;
+    _read_sequence = _tail_sequence;
+    _read_offset = _first_offset;
+
+    _mutex.unlock();
+
+    return FLASH_LOG_OK;
+}
+
+int FlashLog::read_next(void *buffer, uint32_t size, uint32_t &record_size)
+{
+    _mutex.lock();
+
+    if (!_is_mounted) {
+        _mutex.unlock();
+        return FLASH_LOG_ERROR_NOT_MOUNTED;
+    }
+
+    if (_read_sequence < _tail_sequence) {
+        // The sector being read was recycled, continue from the oldest record
+        _read_sector = _tail_sector;
+        _read_sequence = _tail_sequence;
+        _read_offset = _first_offset;
+    }
+
+    int err;
+    while (true) {
+        if ((_read_sector == _head_sector) && (_read_offset >= _head_offset)) {
+            err = FLASH_LOG_ERROR_EMPTY;
+            break;
+        }
+
+        err = _read_record(_read_sector, _read_offset, buffer, size, record_size);
+        if (err == FLASH_LOG_OK) {
+            _read_offset += _align_up(sizeof(record_header) + record_size);
+            break;
+        }
+        if ((err != FLASH_LOG_ERROR_EMPTY) && (err != FLASH_LOG_ERROR_CORRUPT)) {
+            break;
+        }
+
+        // End of the sector's records (or a record cut short by a power failure), go on with the next sector
+        if (_read_sector == _head_sector) {
+            err = FLASH_LOG_ERROR_EMPTY;
+            break;
+        }
+        _read_sector = (_read_sector + 1) % _sector_count;
+        _read_sequence++;
+        _read_offset = _first_offset;
+    }
+
+    _mutex.unlock();
+
+    return err;
+}
+
+uint32_t FlashLog::get_max_record_size() const
+{
+    if (_sector_size == 0) {
+        return 0;
+    }
+    return _sector_size - _first_offset - sizeof(record_header);
+}
+
+void FlashLog::get_stats(flash_log_stats &stats)
+{
+    _mutex.lock();
+    stats = _stats;
+    _mutex.unlock();
+}
+
+void FlashLog::reset_stats()
+{
+    _mutex.lock();
+    memset(&_stats, 0, sizeof(_stats));
+    _mutex.unlock();
+}
+
+/*********************************************/
+/************* Utility Functions *************/
+/*********************************************/
+bool FlashLog::_read_sector_header(uint32_t sector, uint32_t &sequence)
+{
+    sector_header header;
+    MbedCRC<POLY_32BIT_ANSI, 32> ct;
+    uint32_t crc = 0;
+
+    if (_bd->read(&header, _sector_addr(sector), sizeof(header)) != BD_ERROR_OK) {
+        return false;
+    }
+    if (header.magic != FLASH_LOG_MAGIC) {
+        return false;
+    }
+    ct.compute(&header, offsetof(sector_header, crc), &crc);
+    if (crc != header.crc) {
+        return false;
+    }
+
+    sequence = header.sequence;
+    return true;
+}
+
+int FlashLog::_open_sector(uint32_t sector, uint32_t sequence)
+{
+    sector_header header;
+    MbedCRC<POLY_32BIT_ANSI, 32> ct;
+
+    int err = _bd->erase(_sector_addr(sector), _sector_size);
+    if (err) {
+        tr_error("erasing sector %" PRIu32 " failed: %d", sector, err);
+        return err;
+    }
+    _stats.sectors_erased++;
+
+    // The sector only becomes part of the log once its header is programmed
+    header.magic = FLASH_LOG_MAGIC;
+    header.sequence = sequence;
+    ct.compute(&header, offsetof(sector_header, crc), &header.crc);
+    header.reserved = 0xFFFFFFFF;
+
+    err = _bd->program(&header, _sector_addr(sector), sizeof(header));
+    if (err) {
+        tr_error("programming sector %" PRIu32 " header failed: %d", sector, err);
+        return err;
+    }
+    _stats.programmed_bytes += sizeof(header);
+
+    return FLASH_LOG_OK;
+}
+
+int FlashLog::_read_record(uint32_t sector, uint32_t offset, void *buffer, uint32_t buffer_size, uint32_t &length)
+{
+    record_header header;
+    MbedCRC<POLY_32BIT_ANSI, 32> ct;
+    uint32_t crc = 0;
+    bd_addr_t addr = _sector_addr(sector) + offset;
+
+    if ((offset + sizeof(header)) > _sector_size) {
+        return FLASH_LOG_ERROR_EMPTY;
+    }
+
+    int err = _bd->read(&header, addr, sizeof(header));
+    if (err) {
+        return err;
+    }
+
+    if ((header.length == 0xFFFFFFFF) && (header.crc == 0xFFFFFFFF)) {
+        return FLASH_LOG_ERROR_EMPTY;
+    }
+    if (header.length > (_sector_size - offset - sizeof(header))) {
+        return FLASH_LOG_ERROR_CORRUPT;
+    }
+
+    length = header.length;
+    if (buffer && (length > buffer_size)) {
+        return FLASH_LOG_ERROR_TOO_LARGE;
+    }
+
+    ct.compute_partial_start(&crc);
+    ct.compute_partial(&header.length, sizeof(header.length), &crc);
+
+    // Reads cover whole read units, the padding after the payload is inside the record
+    uint32_t done = 0;
+    if (buffer) {
+        uint32_t direct_size = length - (length % _bd->get_read_size());
+        if (direct_size) {
+            err = _bd->read(buffer, addr + sizeof(header), direct_size);
+            if (err) {
+                return err;
+            }
+            ct.compute_partial(buffer, direct_size, &crc);
+            done = direct_size;
+        }
+    }
+    while (done < length) {
+        uint8_t scratch[FLASH_LOG_SCRATCH_SIZE];
+        uint32_t chunk = ((length - done) < sizeof(scratch)) ? (length - done) : sizeof(scratch);
+        err = _bd->read(scratch, addr + sizeof(header) + done, _align_up(chunk));
+        if (err) {
+            return err;
+        }
+        ct.compute_partial(scratch, chunk, &crc);
+        if (buffer) {
+            memcpy(static_cast<uint8_t *>(buffer) + done, scratch, chunk);
+        }
+        done += chunk;
+    }
+    ct.compute_partial_stop(&crc);
+
+    if (crc != header.crc) {
+        return FLASH_LOG_ERROR_CORRUPT;
+    }
+
+    return FLASH_LOG_OK;
+}
+
+int FlashLog::_format()
+{
+    int err = _open_sector(0, 1);
+    if (err) {
+        return err;
+    }
+
+    _tail_sector = 0;
+    _tail_sequence = 1;
+    _head_sector = 0;
+    _head_sequence = 1;
+    _head_offset = _first_offset;
+    _read_sector = 0;
+    _read_sequence = 1;
+    _read_offset = _first_offset;
+
+    return FLASH_LOG_OK;
+}
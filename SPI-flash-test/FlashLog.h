@@ -0,0 +1,188 @@
+#ifndef FLASH_LOG_H
+#define FLASH_LOG_H
+
+//append only circular log stored directly on a BlockDevice (meant for SPIFBlockDevicePD)
+//for high rate telemetry where a file system would pay metadata overhead on every small append
+
+#include "BlockDevice.h"
+#include "platform/PlatformMutex.h"
+
+/** Enum flash log error codes
+ *
+ *  @enum flash_log_error
+ */
+enum flash_log_error {
+    FLASH_LOG_OK                    = 0,     /*!< no error */
+    FLASH_LOG_ERROR_EMPTY           = -4101, /*!< no more records to read */
+    FLASH_LOG_ERROR_TOO_LARGE       = -4102, /*!< record doesn't fit in a sector, or in the read buffer */
+    FLASH_LOG_ERROR_NOT_MOUNTED     = -4103, /*!< mount() wasn't called or failed */
+    FLASH_LOG_ERROR_INVALID_GEOMETRY = -4104, /*!< log area isn't at least two erase aligned sectors */
+    FLASH_LOG_ERROR_CORRUPT         = -4105, /*!< record failed its CRC check */
+};
+
+/** Counters of log activity, reset with FlashLog::reset_stats()
+ */
+struct flash_log_stats {
+    uint32_t records_written;   // records appended
+    uint32_t sectors_dropped;   // oldest sectors erased, with their records, to make room
+    uint64_t payload_bytes;     // record payload bytes appended
+    uint64_t programmed_bytes;  // bytes programmed, including record and sector headers
+    uint32_t sectors_erased;    // sectors erased to open them
+};
+
+/** Circular log of variable size records on a block device
+ *
+ *  The log area is split in erase sized sectors, each starting with a header holding a magic and
+ *  a sequence number, followed by records (length, CRC32, payload). Records are appended to the
+ *  newest sector and never span two sectors. When the area is full the oldest sector is erased,
+ *  dropping its records.
+ *
+ *  Power-fail safety: a sector is only used once its header is programmed, and a record
+ *  interrupted while being programmed fails its CRC. mount() finds the newest and oldest sector
+ *  from the sequence numbers, and if the newest sector ends with a corrupt record the next
+ *  append starts a new sector, so the corrupt area is never programmed again.
+ *
+ *  @code
+ *  SPIFBlockDevicePD spif(FLASH_MOSI, FLASH_MISO, FLASH_SCK, FLASH_CS);
+ *  FlashLog log(&spif, 0x100000, 0x40000);
+ *  spif.init();
+ *  log.mount();
+ *  log.append(&sample, sizeof(sample));
+ *  @endcode
+ */
+class FlashLog {
+public:
+    /** Create a log in an area of a block device
+     *
+     *  @param bd       Block device holding the log, must be initialized before mount()
+     *  @param start    Erase aligned start of the log area
+     *  @param size     Size of the log area, a multiple of the erase size (0 - up to the end of the device)
+     */
+    FlashLog(mbed::BlockDevice *bd, mbed::bd_addr_t start = 0, mbed::bd_size_t size = 0);
+
+    /** Find the log in the area, or start a new one if there is none
+     *
+     *  @return         0 on success or a negative error code on failure
+     */
+    int mount();
+
+    /** Stop using the log, the block device is left initialized
+     *
+     *  @return         0 on success or a negative error code on failure
+     */
+    int unmount();
+
+    /** Erase the whole log area and start a new log
+     *
+     *  @return         0 on success or a negative error code on failure
+     */
+    int clear();
+
+    /** Append a record
+     *
+     *  @param data     Record payload
+     *  @param size     Payload size in bytes, at most get_max_record_size()
+     *  @return         0 on success or a negative error code on failure
+     */
+    int append(const void *data, uint32_t size);
+
+    /** Move the read position to the oldest record
+     *
+     *  @return         0 on success or a negative error code on failure
+     */
+    int rewind();
+
+    /** Read the record at the read position and move to the next one
+     *
+     *  If the sector holding the read position was recycled by appends meanwhile,
+     *  reading continues from the oldest record.
+     *
+     *  @param buffer       Buffer for the payload
+     *  @param size         Size of buffer in bytes
+     *  @param record_size  Payload size of the record
+     *  @return             0 on success,
+     *                      FLASH_LOG_ERROR_EMPTY - no more records,
+     *                      FLASH_LOG_ERROR_TOO_LARGE - buffer too small (record_size is set, position is kept),
+     *                      or a negative error code of the block device
+     */
+    int read_next(void *buffer, uint32_t size, uint32_t &record_size);
+
+    /** Get the largest record payload that fits in a sector
+     *
+     *  @return         Size in bytes, 0 before mount()
+     */
+    uint32_t get_max_record_size() const;
+
+    /** Get the log activity counters
+     *
+     *  @param stats    Counters are copied here
+     */
+    void get_stats(flash_log_stats &stats);
+
+    /** Clear the log activity counters
+     */
+    void reset_stats();
+
+private:
+    struct sector_header {
+        uint32_t magic;
+        uint32_t sequence;  // increases by one for each sector opened
+        uint32_t crc;       // CRC32 of the fields above
+        uint32_t reserved;
+    };
+
+    struct record_header {
+        uint32_t length;    // payload size, 0xFFFFFFFF (erased) ends the sector
+        uint32_t crc;       // CRC32 of length and payload
+    };
+
+    // Read a sector header, false if the sector doesn't hold a valid one
+    bool _read_sector_header(uint32_t sector, uint32_t &sequence);
+
+    // Erase a sector and program its header with the given sequence number
+    int _open_sector(uint32_t sector, uint32_t sequence);
+
+    // Read and check the record at offset of a sector, the payload goes to buffer (NULL - only check it)
+    // FLASH_LOG_ERROR_EMPTY past the last record of the sector, FLASH_LOG_ERROR_CORRUPT if it fails its checks
+    int _read_record(uint32_t sector, uint32_t offset, void *buffer, uint32_t buffer_size, uint32_t &length);
+
+    // Start a new log in sector 0
+    int _format();
+
+    // Round a size up to the record alignment
+    uint32_t _align_up(uint32_t size) const
+    {
+        return ((size + _align - 1) / _align) * _align;
+    }
+
+    mbed::bd_addr_t _sector_addr(uint32_t sector) const
+    {
+        return _start + ((mbed::bd_addr_t)sector * _sector_size);
+    }
+
+    mbed::BlockDevice *_bd;
+    mbed::bd_addr_t _start;
+    mbed::bd_size_t _size;
+    uint32_t _sector_size;
+    uint32_t _sector_count;
+    uint32_t _align;        // records and their payload are padded to this, a multiple of the read and program sizes
+    uint32_t _first_offset; // offset of the first record in a sector
+
+    // Oldest and newest sector in use, sectors in between are used in order and wrap around
+    uint32_t _tail_sector;
+    uint32_t _tail_sequence;
+    uint32_t _head_sector;
+    uint32_t _head_sequence;
+    uint32_t _head_offset;  // where the next record goes in the head sector
+
+    // Read position
+    uint32_t _read_sector;
+    uint32_t _read_sequence;
+    uint32_t _read_offset;
+
+    flash_log_stats _stats;
+    bool _is_mounted;
+    PlatformMutex _mutex;
+};
+
+#endif
@@ -0,0 +1,398 @@
+#include "PageCacheBlockDevice.h"
+
+#include <string.h>
+#include <inttypes.h>
+
+#include "mbed_trace.h"
+#define TRACE_GROUP "PCBD"
+using namespace mbed;
+
+PageCacheBlockDevice::PageCacheBlockDevice(BlockDevice *bd, uint32_t cache_pages, uint32_t page_size,
+                                           page_cache_mode mode)
+    : _bd(bd), _cache_pages(cache_pages), _page_size(page_size), _mode(mode), _lines(NULL), _cache_buffer(NULL),
+      _use_counter(0), _is_initialized(false)
+{
+    memset(&_stats, 0, sizeof(_stats));
+}
+
+PageCacheBlockDevice::~PageCacheBlockDevice()
+{
+    deinit();
+}
+
+int PageCacheBlockDevice::init()
+{
+    _mutex.lock();
+
+    if (_is_initialized) {
+        _mutex.unlock();
+        return BD_ERROR_OK;
+    }
+
+    int err = _bd->init();
+    if (err) {
+        _mutex.unlock();
+        return err;
+    }
+
+    if ((_cache_pages == 0) || (_page_size % _bd->get_read_size()) || (_page_size % _bd->get_program_size())) {
+        tr_error("invalid cache geometry - %" PRIu32 " pages of %" PRIu32 " bytes", _cache_pages, _page_size);
+        _bd->deinit();
+        _mutex.unlock();
+        return BD_ERROR_DEVICE_ERROR;
+    }
+
+    _lines = new cache_line[_cache_pages];
+    _cache_buffer = new uint8_t[_cache_pages * _page_size];
+    for (uint32_t i_ind = 0; i_ind < _cache_pages; i_ind++) {
+        _lines[i_ind].valid = false;
+        _lines[i_ind].dirty = false;
+        _lines[i_ind].data = &_cache_buffer[i_ind * _page_size];
+    }
+    _use_counter = 0;
+    _is_initialized = true;
+
+    _mutex.unlock();
+
+    return BD_ERROR_OK;
+}
+
+int PageCacheBlockDevice::deinit()
+{
+    _mutex.lock();
+
+    if (!_is_initialized) {
+        _mutex.unlock();
+        return BD_ERROR_OK;
+    }
+
+    int err = BD_ERROR_OK;
+    for (uint32_t i_ind = 0; i_ind < _cache_pages; i_ind++) {
+        int line_err = _flush_line(&_lines[i_ind]);
+        if (line_err && !err) {
+            err = line_err;
+        }
+    }
+
+    delete[] _cache_buffer;
+    delete[] _lines;
+    _cache_buffer = NULL;
+    _lines = NULL;
+    _is_initialized = false;
+
+    _mutex.unlock();
+
+    int bd_err = _bd->deinit();
+    return err ? err : bd_err;
+}
+
+int PageCacheBlockDevice::sync()
+{
+    if (!_is_initialized) {
+        return BD_ERROR_DEVICE_ERROR;
+    }
+
+    _mutex.lock();
+    for (uint32_t i_ind = 0; i_ind < _cache_pages; i_ind++) {
+        int err = _flush_line(&_lines[i_ind]);
+        if (err) {
+            _mutex.unlock();
+            return err;
+        }
+    }
+    _mutex.unlock();
+
+    return _bd->sync();
+}
+
+int PageCacheBlockDevice::read(void *b, bd_addr_t addr, bd_size_t size)
+{
+    if (!_is_initialized) {
+        return BD_ERROR_DEVICE_ERROR;
+    }
+
+    uint8_t *buffer = static_cast<uint8_t *>(b);
+    int err = BD_ERROR_OK;
+
+    _mutex.lock();
+
+    while (size > 0) {
+        bd_addr_t page_addr = addr - (addr % _page_size);
+        uint32_t offset = addr - page_addr;
+        uint32_t chunk = ((offset + size) < _page_size) ? size : (_page_size - offset);
+
+        cache_line *line = _find_line(page_addr);
+        if (line) {
+            _stats.read_hits++;
+        } else if (chunk == _page_size) {
+            // Whole page that isn't cached, read it straight into the caller's buffer
+            _stats.read_misses++;
+            err = _bd->read(buffer, addr, chunk);
+        } else {
+            _stats.read_misses++;
+            err = _load_line(page_addr, line);
+        }
+
+        if (err) {
+            break;
+        }
+
+        if (line) {
+            line->last_use = ++_use_counter;
+            memcpy(buffer, line->data + offset, chunk);
+        }
+
+        buffer += chunk;
+        addr += chunk;
+        size -= chunk;
+    }
+
+    _mutex.unlock();
+
+    return err;
+}
+
+int PageCacheBlockDevice::program(const void *b, bd_addr_t addr, bd_size_t size)
+{
+    if (!_is_initialized) {
+        return BD_ERROR_DEVICE_ERROR;
+    }
+
+    const uint8_t *buffer = static_cast<const uint8_t *>(b);
+    int err = BD_ERROR_OK;
+
+    _mutex.lock();
+
+    if (_mode == PAGE_CACHE_WRITE_THROUGH) {
+        // One call as made, under the lock so no read caches the pages between the program and
+        // dropping them. Nothing is dirty in this mode, dropping writes nothing back
+        _stats.write_throughs++;
+        err = _bd->program(buffer, addr, size);
+        int drop_err = _invalidate_range(addr, size);
+        _mutex.unlock();
+        return err ? err : drop_err;
+    }
+
+    while (size > 0) {
+        bd_addr_t page_addr = addr - (addr % _page_size);
+        uint32_t offset = addr - page_addr;
+        uint32_t chunk = ((offset + size) < _page_size) ? size : (_page_size - offset);
+
+        cache_line *line = _find_line(page_addr);
+        if (line) {
+            _stats.program_hits++;
+        } else if (chunk == _page_size) {
+            // Whole page that isn't cached, nothing to coalesce with
+            _stats.program_misses++;
+            err = _bd->program(buffer, addr, chunk);
+        } else {
+            // Load the page so later reads of its unwritten part stay coherent
+            _stats.program_misses++;
+            err = _load_line(page_addr, line);
+        }
+
+        if (err) {
+            break;
+        }
+
+        if (line) {
+            line->last_use = ++_use_counter;
+            memcpy(line->data + offset, buffer, chunk);
+            if (!line->dirty) {
+                line->dirty = true;
+                line->dirty_start = offset;
+                line->dirty_end = offset + chunk;
+            } else {
+                line->dirty_start = (offset < line->dirty_start) ? offset : line->dirty_start;
+                line->dirty_end = ((offset + chunk) > line->dirty_end) ? (offset + chunk) : line->dirty_end;
+            }
+        }
+
+        buffer += chunk;
+        addr += chunk;
+        size -= chunk;
+    }
+
+    _mutex.unlock();
+
+    return err;
+}
+
+int PageCacheBlockDevice::erase(bd_addr_t addr, bd_size_t size)
+{
+    if (!_is_initialized) {
+        return BD_ERROR_DEVICE_ERROR;
+    }
+
+    // Pending programs to the erased range would be wiped by the erase anyway,
+    // so they are dropped rather than written back
+    _mutex.lock();
+    int err = _invalidate_range(addr, size);
+    _mutex.unlock();
+
+    if (err) {
+        return err;
+    }
+
+    return _bd->erase(addr, size);
+}
+
+int PageCacheBlockDevice::trim(bd_addr_t addr, bd_size_t size)
+{
+    if (!_is_initialized) {
+        return BD_ERROR_DEVICE_ERROR;
+    }
+
+    _mutex.lock();
+    int err = _invalidate_range(addr, size);
+    _mutex.unlock();
+
+    if (err) {
+        return err;
+    }
+
+    return _bd->trim(addr, size);
+}
+
+bd_size_t PageCacheBlockDevice::get_read_size() const
+{
+    return _bd->get_read_size();
+}
+
+bd_size_t PageCacheBlockDevice::get_program_size() const
+{
+    return _bd->get_program_size();
+}
+
+bd_size_t PageCacheBlockDevice::get_erase_size() const
+{
+    return _bd->get_erase_size();
+}
+
+bd_size_t PageCacheBlockDevice::get_erase_size(bd_addr_t addr) const
+{
+    return _bd->get_erase_size(addr);
+}
+
+int PageCacheBlockDevice::get_erase_value() const
+{
+    return _bd->get_erase_value();
+}
+
+bd_size_t PageCacheBlockDevice::size() const
+{
+    return _bd->size();
+}
+
+const char *PageCacheBlockDevice::get_type() const
+{
+    return _bd->get_type();
+}
+
+void PageCacheBlockDevice::get_cache_stats(page_cache_stats &stats)
+{
+    _mutex.lock();
+    stats = _stats;
+    _mutex.unlock();
+}
+
+void PageCacheBlockDevice::reset_cache_stats()
+{
+    _mutex.lock();
+    memset(&_stats, 0, sizeof(_stats));
+    _mutex.unlock();
+}
+
+/*********************************************/
+/************* Utility Functions *************/
+/*********************************************/
+PageCacheBlockDevice::cache_line *PageCacheBlockDevice::_find_line(bd_addr_t page_addr)
+{
+    for (uint32_t i_ind = 0; i_ind < _cache_pages; i_ind++) {
+        if (_lines[i_ind].valid && (_lines[i_ind].addr == page_addr)) {
+            return &_lines[i_ind];
+        }
+    }
+    return NULL;
+}
+
+int PageCacheBlockDevice::_load_line(bd_addr_t page_addr, cache_line *&line)
+{
+    // Prefer a free line, otherwise evict the least recently used one
+    line = &_lines[0];
+    for (uint32_t i_ind = 0; i_ind < _cache_pages; i_ind++) {
+        if (!_lines[i_ind].valid) {
+            line = &_lines[i_ind];
+            break;
+        }
+        if ((_use_counter - _lines[i_ind].last_use) > (_use_counter - line->last_use)) {
+            line = &_lines[i_ind];
+        }
+    }
+
+    if (line->valid) {
+        int err = _flush_line(line);
+        if (err) {
+            return err;
+        }
+        line->valid = false;
+        _stats.evictions++;
+    }
+
+    // The last page of the device may be shorter than a cache page
+    bd_size_t fill_size = ((page_addr + _page_size) > _bd->size()) ? (_bd->size() - page_addr) : _page_size;
+    int err = _bd->read(line->data, page_addr, fill_size);
+    if (err) {
+        return err;
+    }
+    _stats.page_fills++;
+
+    line->addr = page_addr;
+    line->valid = true;
+    line->dirty = false;
+    line->last_use = ++_use_counter;
+
+    return BD_ERROR_OK;
+}
+
+int PageCacheBlockDevice::_flush_line(cache_line *line)
+{
+    if (!line->valid || !line->dirty) {
+        return BD_ERROR_OK;
+    }
+
+    // Widen the dirty range to the underlying program size, the cached page holds the bytes around it
+    uint32_t prog_size = _bd->get_program_size();
+    uint32_t start = line->dirty_start - (line->dirty_start % prog_size);
+    uint32_t end = ((line->dirty_end + prog_size - 1) / prog_size) * prog_size;
+
+    int err = _bd->program(line->data + start, line->addr + start, end - start);
+    if (err) {
+        tr_error("page flush at %llu failed: %d", line->addr, err);
+        return err;
+    }
+
+    line->dirty = false;
+    _stats.page_flushes++;
+
+    return BD_ERROR_OK;
+}
+
+int PageCacheBlockDevice::_invalidate_range(bd_addr_t addr, bd_size_t size)
+{
+    for (uint32_t i_ind = 0; i_ind < _cache_pages; i_ind++) {
+        cache_line *line = &_lines[i_ind];
+        if (line->valid && ((line->addr + _page_size) > addr) && (line->addr < (addr + size))) {
+            // A page only partly in the range still has data to keep outside of it
+            if ((line->addr < addr) || ((line->addr + _page_size) > (addr + size))) {
+                int err = _flush_line(line);
+                if (err) {
+                    return err;
+                }
+            }
+            line->valid = false;
+            line->dirty = false;
+        }
+    }
+    return BD_ERROR_OK;
+}
@@ -0,0 +1,215 @@
+#ifndef PAGE_CACHE_BLOCK_DEVICE_H
+#define PAGE_CACHE_BLOCK_DEVICE_H
+
+//RAM page cache that sits in front of any BlockDevice (meant for SPIFBlockDevicePD)
+//small reads are served from whole cached pages and small programs are coalesced per page
+//until the page is evicted or sync() is called, or in write-through mode passed on in order
+
+#include "BlockDevice.h"
+#include "platform/PlatformMutex.h"
+
+/** Counters of cache activity, reset with PageCacheBlockDevice::reset_cache_stats()
+ */
+struct page_cache_stats {
+    uint32_t read_hits;         // read segments served from a cached page
+    uint32_t read_misses;       // read segments that went to the underlying device
+    uint32_t program_hits;      // program segments merged into a cached page
+    uint32_t program_misses;    // program segments that needed a page fill or went straight to the device
+    uint32_t page_fills;        // pages read from the underlying device into the cache
+    uint32_t page_flushes;      // dirty pages programmed to the underlying device
+    uint32_t evictions;         // pages dropped to make room for another page
+    uint32_t write_throughs;    // programs passed straight to the device (PAGE_CACHE_WRITE_THROUGH)
+};
+
+/** When programs reach the underlying device
+ */
+enum page_cache_mode {
+    PAGE_CACHE_WRITE_BACK       = 0, /*!< merged in the cache, written on eviction, sync() or deinit() */
+    PAGE_CACHE_WRITE_THROUGH    = 1, /*!< passed on as they come, only reads are cached */
+};
+
+/** Page cache in front of a block device
+ *
+ *  Holds up to cache_pages pages of page_size bytes in RAM, allocated in init().
+ *  A read or program that touches part of a page loads the whole page once (read-ahead),
+ *  later reads of that page cost no bus traffic, and programs to it are merged and only
+ *  written out when the page is evicted (least recently used first), on sync() or on deinit().
+ *  Whole uncached pages bypass the cache so large transfers don't thrash it.
+ *
+ *  In PAGE_CACHE_WRITE_THROUGH mode each program goes to the device before the call returns,
+ *  in the order and with the sizes it was made, and drops the cached pages it touches, so a
+ *  read back checks the device. Reads are cached and read ahead the same way. This mode suits
+ *  file systems that count on program order to survive power loss, like littlefs.
+ *
+ *  @note In PAGE_CACHE_WRITE_BACK mode programs are held in RAM until sync(), so data not synced
+ *        is lost on power failure, and evictions write pages in least recently used order
+ *
+ *  @code
+ *  SPIFBlockDevicePD spif(FLASH_MOSI, FLASH_MISO, FLASH_SCK, FLASH_CS);
+ *  PageCacheBlockDevice bd(&spif, 16);
+ *  bd.init();
+ *  bd.program(config, CONFIG_ADDR, sizeof(config));
+ *  bd.sync();
+ *  @endcode
+ */
+class PageCacheBlockDevice : public mbed::BlockDevice {
+public:
+    /** Create a page cache on top of a block device
+     *
+     *  @param bd           Block device to cache
+     *  @param cache_pages  Number of pages held in RAM
+     *  @param page_size    Size of a cached page in bytes, must be a multiple of the
+     *                      underlying read and program sizes (256 - SPI NOR page)
+     *  @param mode         PAGE_CACHE_WRITE_BACK or PAGE_CACHE_WRITE_THROUGH
+     */
+    PageCacheBlockDevice(mbed::BlockDevice *bd, uint32_t cache_pages = 16, uint32_t page_size = 256,
+                         page_cache_mode mode = PAGE_CACHE_WRITE_BACK);
+
+    /** Destruct the cache, writing back any dirty pages
+     */
+    virtual ~PageCacheBlockDevice();
+
+    /** Initialize the underlying block device and allocate the cache
+     *
+     *  @return         0 on success or a negative error code on failure
+     */
+    virtual int init();
+
+    /** Write back dirty pages, free the cache and deinitialize the underlying block device
+     *
+     *  @return         0 on success or a negative error code on failure
+     */
+    virtual int deinit();
+
+    /** Write back all dirty pages and sync the underlying block device
+     *
+     *  @return         0 on success or a negative error code on failure
+     */
+    virtual int sync();
+
+    /** Read blocks through the cache
+     *
+     *  @param buffer   Buffer to write blocks to
+     *  @param addr     Address of block to begin reading from
+     *  @param size     Size to read in bytes, must be a multiple of read block size
+     *  @return         0 on success or a negative error code on failure
+     */
+    virtual int read(void *buffer, mbed::bd_addr_t addr, mbed::bd_size_t size);
+
+    /** Program blocks through the cache, or straight to the device in write-through mode
+     *
+     *  @note The blocks must have been erased prior to being programmed
+     *
+     *  @param buffer   Buffer of data to write to blocks
+     *  @param addr     Address of block to begin writing to
+     *  @param size     Size to write in bytes, must be a multiple of program block size
+     *  @return         0 on success or a negative error code on failure
+     */
+    virtual int program(const void *buffer, mbed::bd_addr_t addr, mbed::bd_size_t size);
+
+    /** Erase blocks, dropping any cached pages in the erased range
+     *
+     *  @param addr     Address of block to begin erasing
+     *  @param size     Size to erase in bytes, must be a multiple of erase block size
+     *  @return         0 on success or a negative error code on failure
+     */
+    virtual int erase(mbed::bd_addr_t addr, mbed::bd_size_t size);
+
+    /** Mark blocks as no longer in use, dropping any cached pages in the range
+     *
+     *  @param addr     Address of block to mark as unused
+     *  @param size     Size to mark as unused in bytes, must be a multiple of erase block size
+     *  @return         0 on success or a negative error code on failure
+     */
+    virtual int trim(mbed::bd_addr_t addr, mbed::bd_size_t size);
+
+    /** Get the size of a readable block
+     *
+     *  @return         Size of a readable block in bytes
+     */
+    virtual mbed::bd_size_t get_read_size() const;
+
+    /** Get the size of a programable block
+     *
+     *  @return         Size of a programable block in bytes
+     */
+    virtual mbed::bd_size_t get_program_size() const;
+
+    /** Get the size of an erasable block
+     *
+     *  @return         Size of an erasable block in bytes
+     */
+    virtual mbed::bd_size_t get_erase_size() const;
+
+    /** Get the size of an erasable block given address
+     *
+     *  @param addr     Address within the erasable block
+     *  @return         Size of an erasable block in bytes
+     */
+    virtual mbed::bd_size_t get_erase_size(mbed::bd_addr_t addr) const;
+
+    /** Get the value of storage byte after it was erased
+     *
+     *  @return         The value of storage when erased, or -1 if you can't
+     *                  rely on the value of erased storage
+     */
+    virtual int get_erase_value() const;
+
+    /** Get the total size of the underlying device
+     *
+     *  @return         Size of the underlying device in bytes
+     */
+    virtual mbed::bd_size_t size() const;
+
+    /** Get the BlockDevice class type.
+     *
+     *  @return         A string representation of the BlockDevice class type.
+     */
+    virtual const char *get_type() const;
+
+    /** Get the cache hit/miss counters
+     *
+     *  @param stats    Counters are copied here
+     */
+    void get_cache_stats(page_cache_stats &stats);
+
+    /** Clear the cache hit/miss counters
+     */
+    void reset_cache_stats();
+
+private:
+    struct cache_line {
+        mbed::bd_addr_t addr;   // page aligned device address held by the line
+        uint32_t last_use;      // value of _use_counter at the last access, for LRU eviction
+        bool valid;
+        bool dirty;
+        uint32_t dirty_start;   // range of the page programmed since the last flush
+        uint32_t dirty_end;
+        uint8_t *data;
+    };
+
+    // Find the line holding the page at addr, NULL if it isn't cached
+    cache_line *_find_line(mbed::bd_addr_t page_addr);
+
+    // Get a line for the page at addr, evicting the least recently used line and filling it from the device
+    int _load_line(mbed::bd_addr_t page_addr, cache_line *&line);
+
+    // Program the dirty range of a line to the device
+    int _flush_line(cache_line *line);
+
+    // Drop all lines holding pages in the range, pages only partly in the range are written back first
+    int _invalidate_range(mbed::bd_addr_t addr, mbed::bd_size_t size);
+
+    mbed::BlockDevice *_bd;
+    uint32_t _cache_pages;
+    uint32_t _page_size;
+    page_cache_mode _mode;
+    cache_line *_lines;
+    uint8_t *_cache_buffer;
+    uint32_t _use_counter;
+    page_cache_stats _stats;
+    bool _is_initialized;
+    PlatformMutex _mutex;
+};
+
+#endif
@@ -0,0 +1,517 @@
+#include "RemappingBlockDevice.h"
+#include "SPIFBlockDevicePD.h"
+#include "drivers/MbedCRC.h"
+
+#include <string.h>
+#include <stddef.h>
+#include <inttypes.h>
+
+#include "mbed_trace.h"
+#define TRACE_GROUP "RMBD"
+using namespace mbed;
+
+// Marks a remap table copy ("RMAP")
+#define REMAP_BD_MAGIC 0x50414D52
+// Units holding the two copies of the table, the data area follows them
+#define REMAP_BD_TABLE_UNITS 2
+// Retired units are copied to their spare in chunks of this size (rounded up to the read and program sizes)
+#define REMAP_BD_COPY_SIZE 256
+
+RemappingBlockDevice::RemappingBlockDevice(BlockDevice *bd, uint32_t spare_count)
+    : _bd(bd), _spare_count(spare_count), _unit_size(0), _data_units(0), _spare_base(0),
+      _table_buffer(NULL), _table_size(0), _table(NULL), _entries(NULL), _copy_buffer(NULL), _copy_size(0),
+      _is_initialized(false)
+{
+    memset(&_stats, 0, sizeof(_stats));
+}
+
+RemappingBlockDevice::~RemappingBlockDevice()
+{
+    deinit();
+}
+
+int RemappingBlockDevice::init()
+{
+    _mutex.lock();
+
+    if (_is_initialized) {
+        _mutex.unlock();
+        return BD_ERROR_OK;
+    }
+
+    int err = _bd->init();
+    if (err) {
+        _mutex.unlock();
+        return err;
+    }
+
+    // Tables and copies are programmed and read in one go, so they are padded to the larger of the two sizes
+    uint32_t read_size = _bd->get_read_size();
+    uint32_t prog_size = _bd->get_program_size();
+    uint32_t align = (read_size > prog_size) ? read_size : prog_size;
+    uint32_t units = 0;
+
+    _unit_size = _bd->get_erase_size();
+    _table_size = sizeof(table_header) + (_spare_count * sizeof(table_entry));
+    _table_size = ((_table_size + align - 1) / align) * align;
+    _copy_size = ((REMAP_BD_COPY_SIZE + align - 1) / align) * align;
+    _copy_size = (_copy_size > _unit_size) ? _unit_size : _copy_size;
+    if (_unit_size) {
+        units = _bd->size() / _unit_size;
+    }
+
+    if ((_unit_size == 0) || (align % read_size) || (align % prog_size) || (_unit_size % align) ||
+            (_bd->get_erase_size(_bd->size() - 1) != _unit_size) || (_table_size > _unit_size) ||
+            (units <= (REMAP_BD_TABLE_UNITS + _spare_count))) {
+        tr_error("invalid remap geometry - %" PRIu32 " units of %" PRIu32 " bytes, %" PRIu32 " spares",
+                 units, _unit_size, _spare_count);
+        _bd->deinit();
+        _mutex.unlock();
+        return REMAP_BD_ERROR_INVALID_GEOMETRY;
+    }
+
+    _data_units = units - REMAP_BD_TABLE_UNITS - _spare_count;
+    _spare_base = REMAP_BD_TABLE_UNITS + _data_units;
+
+    _table_buffer = new uint8_t[_table_size];
+    _table = reinterpret_cast<table_header *>(_table_buffer);
+    _entries = reinterpret_cast<table_entry *>(_table_buffer + sizeof(table_header));
+    _copy_buffer = new uint8_t[_copy_size];
+
+    // Use the newer of the valid copies, the other one is where the next table goes
+    // A copy that can't be read may be the good one, so only two readable invalid copies format the device
+    bool valid_0 = false;
+    bool valid_1 = false;
+    uint32_t sequence_0 = 0;
+    uint32_t sequence_1 = 0;
+
+    err = _load_table(0, valid_0);
+    sequence_0 = _table->sequence;
+    if (!err) {
+        err = _load_table(1, valid_1);
+        sequence_1 = _table->sequence;
+    }
+
+    if (err) {
+        tr_error("remap table read failed: %d", err);
+    } else if (valid_1 && (!valid_0 || ((int32_t)(sequence_1 - sequence_0) > 0))) {
+        tr_info("remap table copy 1, sequence %" PRIu32, sequence_1);
+    } else if (valid_0) {
+        err = _load_table(0, valid_0);
+        if (!err && !valid_0) {
+            err = REMAP_BD_ERROR_TABLE_FAILED;
+        }
+        tr_info("remap table copy 0, sequence %" PRIu32, sequence_0);
+    } else {
+        tr_info("no remap table, formatting");
+        memset(_table_buffer, 0xFF, _table_size);
+        memset(_table, 0, sizeof(table_header));
+        _table->magic = REMAP_BD_MAGIC;
+        err = _store_table();
+    }
+
+    if (err) {
+        delete[] _copy_buffer;
+        delete[] _table_buffer;
+        _copy_buffer = NULL;
+        _table_buffer = NULL;
+        _table = NULL;
+        _entries = NULL;
+        _bd->deinit();
+        _mutex.unlock();
+        return err;
+    }
+
+    _is_initialized = true;
+
+    _mutex.unlock();
+
+    return BD_ERROR_OK;
+}
+
+int RemappingBlockDevice::deinit()
+{
+    _mutex.lock();
+
+    if (!_is_initialized) {
+        _mutex.unlock();
+        return BD_ERROR_OK;
+    }
+
+    delete[] _copy_buffer;
+    delete[] _table_buffer;
+    _copy_buffer = NULL;
+    _table_buffer = NULL;
+    _table = NULL;
+    _entries = NULL;
+    _is_initialized = false;
+
+    _mutex.unlock();
+
+    return _bd->deinit();
+}
+
+int RemappingBlockDevice::sync()
+{
+    if (!_is_initialized) {
+        return BD_ERROR_DEVICE_ERROR;
+    }
+
+    return _bd->sync();
+}
+
+int RemappingBlockDevice::read(void *b, bd_addr_t addr, bd_size_t size)
+{
+    if (!_is_initialized) {
+        return BD_ERROR_DEVICE_ERROR;
+    }
+
+    if ((addr + size) > this->size()) {
+        tr_error("read of %llu bytes at %llu past the end", size, addr);
+        return BD_ERROR_DEVICE_ERROR;
+    }
+
+    uint8_t *buffer = static_cast<uint8_t *>(b);
+    int err = BD_ERROR_OK;
+
+    _mutex.lock();
+
+    while ((size > 0) && !err) {
+        uint32_t logical = addr / _unit_size;
+        uint32_t offset = addr % _unit_size;
+        uint32_t chunk = ((offset + size) < _unit_size) ? size : (_unit_size - offset);
+
+        err = _bd->read(buffer, _unit_addr(_physical_unit(logical)) + offset, chunk);
+
+        buffer += chunk;
+        addr += chunk;
+        size -= chunk;
+    }
+
+    _mutex.unlock();
+
+    return err;
+}
+
+int RemappingBlockDevice::program(const void *b, bd_addr_t addr, bd_size_t size)
+{
+    if (!_is_initialized) {
+        return BD_ERROR_DEVICE_ERROR;
+    }
+
+    if ((addr + size) > this->size()) {
+        tr_error("program of %llu bytes at %llu past the end", size, addr);
+        return BD_ERROR_DEVICE_ERROR;
+    }
+
+    const uint8_t *buffer = static_cast<const uint8_t *>(b);
+    int err = BD_ERROR_OK;
+
+    _mutex.lock();
+
+    while ((size > 0) && !err) {
+        uint32_t logical = addr / _unit_size;
+        uint32_t offset = addr % _unit_size;
+        uint32_t chunk = ((offset + size) < _unit_size) ? size : (_unit_size - offset);
+
+        err = _bd->program(buffer, _unit_addr(_physical_unit(logical)) + offset, chunk);
+        if (_is_unit_failure(err) && _is_device_settled(err)) {
+            tr_warning("program of unit %" PRIu32 " failed: %d, retiring it", logical, err);
+            _stats.program_failures++;
+            err = _retire_unit(logical, offset, buffer, chunk);
+        }
+
+        buffer += chunk;
+        addr += chunk;
+        size -= chunk;
+    }
+
+    _mutex.unlock();
+
+    return err;
+}
+
+int RemappingBlockDevice::erase(bd_addr_t addr, bd_size_t size)
+{
+    if (!_is_initialized) {
+        return BD_ERROR_DEVICE_ERROR;
+    }
+
+    if ((addr % _unit_size) || (size % _unit_size) || ((addr + size) > this->size())) {
+        tr_error("erase of %llu bytes at %llu not unit aligned or past the end", size, addr);
+        return BD_ERROR_DEVICE_ERROR;
+    }
+
+    uint32_t logical = addr / _unit_size;
+    uint32_t end = (addr + size) / _unit_size;
+    int err = BD_ERROR_OK;
+
+    _mutex.lock();
+
+    while ((logical < end) && !err) {
+        // Units not remapped are consecutive on the device, they are erased with a single call
+        // so the device can use its larger erase types
+        uint32_t physical = _physical_unit(logical);
+        uint32_t run = 1;
+        while (((logical + run) < end) && (_physical_unit(logical + run) == (physical + run))) {
+            run++;
+        }
+
+        err = _bd->erase(_unit_addr(physical), (bd_size_t)run * _unit_size);
+
+        // Which unit failed isn't known, so the run is erased again one unit at a time
+        if (_is_unit_failure(err) && _is_device_settled(err)) {
+            err = BD_ERROR_OK;
+            for (uint32_t i_ind = 0; (i_ind < run) && !err; i_ind++) {
+                err = _bd->erase(_unit_addr(physical + i_ind), _unit_size);
+                if (_is_unit_failure(err) && _is_device_settled(err)) {
+                    tr_warning("erase of unit %" PRIu32 " failed: %d, retiring it", logical + i_ind, err);
+                    _stats.erase_failures++;
+                    err = _retire_unit(logical + i_ind, 0, NULL, 0);
+                }
+            }
+        }
+
+        logical += run;
+    }
+
+    _mutex.unlock();
+
+    return err;
+}
+
+bd_size_t RemappingBlockDevice::get_read_size() const
+{
+    return _bd->get_read_size();
+}
+
+bd_size_t RemappingBlockDevice::get_program_size() const
+{
+    return _bd->get_program_size();
+}
+
+bd_size_t RemappingBlockDevice::get_erase_size() const
+{
+    return _unit_size;
+}
+
+bd_size_t RemappingBlockDevice::get_erase_size(bd_addr_t /*addr*/) const
+{
+    return _unit_size;
+}
+
+int RemappingBlockDevice::get_erase_value() const
+{
+    return _bd->get_erase_value();
+}
+
+bd_size_t RemappingBlockDevice::size() const
+{
+    return (bd_size_t)_data_units * _unit_size;
+}
+
+const char *RemappingBlockDevice::get_type() const
+{
+    return _bd->get_type();
+}
+
+uint32_t RemappingBlockDevice::get_spares_left()
+{
+    uint32_t left = 0;
+
+    _mutex.lock();
+    if (_is_initialized) {
+        left = _spare_count - _table->spares_used;
+    }
+    _mutex.unlock();
+
+    return left;
+}
+
+void RemappingBlockDevice::get_remap_stats(remap_bd_stats &stats)
+{
+    _mutex.lock();
+    stats = _stats;
+    _mutex.unlock();
+}
+
+void RemappingBlockDevice::reset_remap_stats()
+{
+    _mutex.lock();
+    memset(&_stats, 0, sizeof(_stats));
+    _mutex.unlock();
+}
+
+/*********************************************/
+/************* Utility Functions *************/
+/*********************************************/
+int RemappingBlockDevice::_load_table(uint32_t copy, bool &valid)
+{
+    MbedCRC<POLY_32BIT_ANSI, 32> ct;
+    uint32_t crc = 0;
+
+    valid = false;
+    int err = _bd->read(_table_buffer, _unit_addr(copy), _table_size);
+    if (err) {
+        return err;
+    }
+
+    if ((_table->magic != REMAP_BD_MAGIC) || ((_table->sequence % REMAP_BD_TABLE_UNITS) != copy) ||
+            (_table->spares_used > _spare_count) || (_table->entry_count > _table->spares_used)) {
+        return BD_ERROR_OK;
+    }
+
+    ct.compute_partial_start(&crc);
+    ct.compute_partial(_table, offsetof(table_header, crc), &crc);
+    ct.compute_partial(_entries, _table->entry_count * sizeof(table_entry), &crc);
+    ct.compute_partial_stop(&crc);
+    if (crc != _table->crc) {
+        tr_warning("remap table copy %" PRIu32 " fails its CRC", copy);
+        return BD_ERROR_OK;
+    }
+
+    for (uint32_t i_ind = 0; i_ind < _table->entry_count; i_ind++) {
+        if ((_entries[i_ind].logical >= _data_units) || (_entries[i_ind].physical < _spare_base) ||
+                (_entries[i_ind].physical >= (_spare_base + _spare_count))) {
+            return BD_ERROR_OK;
+        }
+    }
+
+    valid = true;
+    return BD_ERROR_OK;
+}
+
+int RemappingBlockDevice::_store_table()
+{
+    MbedCRC<POLY_32BIT_ANSI, 32> ct;
+
+    // The buffer is written with the next sequence, the table only keeps it once that copy is complete.
+    // After a failed write the next attempt goes to the same older copy, never over the newer valid one
+    uint32_t sequence = _table->sequence;
+    _table->sequence = sequence + 1;
+    ct.compute_partial_start(&_table->crc);
+    ct.compute_partial(_table, offsetof(table_header, crc), &_table->crc);
+    ct.compute_partial(_entries, _table->entry_count * sizeof(table_entry), &_table->crc);
+    ct.compute_partial_stop(&_table->crc);
+
+    uint32_t copy = (sequence + 1) % REMAP_BD_TABLE_UNITS;
+    int err = _bd->erase(_unit_addr(copy), _unit_size);
+    if (!err) {
+        err = _bd->program(_table_buffer, _unit_addr(copy), _table_size);
+    }
+
+    if (err) {
+        _table->sequence = sequence;
+        tr_error("remap table write to copy %" PRIu32 " failed: %d", copy, err);
+        return REMAP_BD_ERROR_TABLE_FAILED;
+    }
+
+    return BD_ERROR_OK;
+}
+
+uint32_t RemappingBlockDevice::_physical_unit(uint32_t logical)
+{
+    for (uint32_t i_ind = 0; i_ind < _table->entry_count; i_ind++) {
+        if (_entries[i_ind].logical == logical) {
+            return _entries[i_ind].physical;
+        }
+    }
+    return REMAP_BD_TABLE_UNITS + logical;
+}
+
+int RemappingBlockDevice::_retire_unit(uint32_t logical, uint32_t offset, const uint8_t *data, uint32_t size)
+{
+    uint32_t from = _physical_unit(logical);
+
+    while (true) {
+        if (_table->spares_used >= _spare_count) {
+            tr_error("no spare left to retire unit %" PRIu32, logical);
+            return REMAP_BD_ERROR_NO_SPARES;
+        }
+
+        uint32_t to = _spare_base + _table->spares_used;
+        _table->spares_used++;
+
+        int err = _bd->erase(_unit_addr(to), _unit_size);
+        if (!err && data) {
+            err = _copy_unit(from, to, offset, data, size);
+        }
+
+        if (!err) {
+            uint32_t i_ind = 0;
+            while ((i_ind < _table->entry_count) && (_entries[i_ind].logical != logical)) {
+                i_ind++;
+            }
+            if (i_ind == _table->entry_count) {
+                _table->entry_count++;
+            }
+            _entries[i_ind].logical = logical;
+            _entries[i_ind].physical = to;
+
+            tr_info("unit %" PRIu32 " moved from %" PRIu32 " to spare %" PRIu32, logical, from, to);
+            return _store_table();
+        }
+
+        // A bus error would fail the next spare too, don't use the pool up on it
+        if (!_is_unit_failure(err)) {
+            return err;
+        }
+
+        // Nor on a device still busy with the operation that timed out, the spare isn't known to be bad
+        if (!_is_device_settled(err)) {
+            _table->spares_used--;
+            return err;
+        }
+
+        tr_warning("spare %" PRIu32 " failed: %d", to, err);
+        _stats.spares_failed++;
+    }
+}
+
+bool RemappingBlockDevice::_is_unit_failure(int err)
+{
+    // Only the flash itself failing, bus and driver errors would fail on any unit
+    return (err == SPIF_BD_ERROR_READY_FAILED) || (err == SPIF_BD_ERROR_VERIFY_FAILED);
+}
+
+bool RemappingBlockDevice::_is_device_settled(int err)
+{
+    // A timed out program or erase may still be running, anything sent meanwhile fails the same way
+    return (err != SPIF_BD_ERROR_READY_FAILED) || (_bd->sync() == BD_ERROR_OK);
+}
+
+int RemappingBlockDevice::_copy_unit(uint32_t from, uint32_t to, uint32_t offset, const uint8_t *data, uint32_t size)
+{
+    int erase_value = _bd->get_erase_value();
+
+    for (uint32_t pos = 0; pos < _unit_size; pos += _copy_size) {
+        int err = _bd->read(_copy_buffer, _unit_addr(from) + pos, _copy_size);
+        if (err) {
+            return err;
+        }
+
+        // The data of the failed program replaces whatever made it to the old unit
+        if ((offset < (pos + _copy_size)) && ((offset + size) > pos)) {
+            uint32_t start = (offset > pos) ? offset : pos;
+            uint32_t end = ((offset + size) < (pos + _copy_size)) ? (offset + size) : (pos + _copy_size);
+            memcpy(_copy_buffer + (start - pos), data + (start - offset), end - start);
+        }
+
+        // Chunks still erased are left erased, so they can be programmed later
+        bool erased = (erase_value >= 0);
+        for (uint32_t i_ind = 0; erased && (i_ind < _copy_size); i_ind++) {
+            erased = (_copy_buffer[i_ind] == (uint8_t)erase_value);
+        }
+        if (erased) {
+            continue;
+        }
+
+        err = _bd->program(_copy_buffer, _unit_addr(to) + pos, _copy_size);
+        if (err) {
+            return err;
+        }
+        _stats.pages_copied++;
+    }
+
+    return BD_ERROR_OK;
+}
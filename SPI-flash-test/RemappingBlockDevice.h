@@ -0,0 +1,238 @@
+#ifndef REMAPPING_BLOCK_DEVICE_H
+#define REMAPPING_BLOCK_DEVICE_H
+
+//bad block remapping layer in front of any BlockDevice (meant for SPIFBlockDevicePD)
+//erase units that fail a program or erase are retired to a spare pool, the remap table is kept on the device
+
+#include "BlockDevice.h"
+#include "platform/PlatformMutex.h"
+
+/** Enum remapping block device error codes
+ *
+ *  @enum remap_bd_error
+ */
+enum remap_bd_error {
+    REMAP_BD_ERROR_OK               = 0,     /*!< no error */
+    REMAP_BD_ERROR_NO_SPARES        = -4201, /*!< a unit failed and the spare pool is used up */
+    REMAP_BD_ERROR_INVALID_GEOMETRY = -4202, /*!< device too small for the tables and spares, or unsupported sizes */
+    REMAP_BD_ERROR_TABLE_FAILED     = -4203, /*!< remap table could not be written */
+};
+
+/** Counters of retired units, reset with RemappingBlockDevice::reset_remap_stats()
+ */
+struct remap_bd_stats {
+    uint32_t erase_failures;    // erases of a unit that failed and retired it
+    uint32_t program_failures;  // programs to a unit that failed and retired it
+    uint32_t spares_failed;     // spares that failed while taking over a unit, retired too
+    uint32_t pages_copied;      // program sized chunks copied from retired units to spares
+};
+
+/** Block device that retires failing erase units to spares
+ *
+ *  The underlying device is split in erase units: the first two hold the remap table
+ *  (alternate copies, the newer valid one is used), the last spare_count units are the spare
+ *  pool and the units in between are the data area seen by users of this block device.
+ *
+ *  When an erase of a unit fails, the unit is replaced by the next spare. When a program fails,
+ *  the data already programmed in the unit is copied page by page to the next spare along with
+ *  the data of the failed program, so the program still completes. The table is written to
+ *  the older copy before the call returns, a power failure while writing it leaves the other
+ *  copy valid. Failing spares are skipped, once the pool is used up the error is returned.
+ *
+ *  Only media failures retire a unit: SPIF_BD_ERROR_READY_FAILED (the program or erase never
+ *  completed) and SPIF_BD_ERROR_VERIFY_FAILED (the data read back differs, SPIF_BD_VERIFY mode).
+ *  Bus and driver errors are returned as they are, they would fail on any unit. After a timeout
+ *  the device is waited for with sync(), if it stays busy the error is returned and nothing is retired.
+ *
+ *  @note init() formats a device where both table copies read back but neither is valid,
+ *        contents already on it are not moved. A read error fails init() instead.
+ *
+ *  @code
+ *  SPIFBlockDevicePD spif(FLASH_MOSI, FLASH_MISO, FLASH_SCK, FLASH_CS);
+ *  RemappingBlockDevice bd(&spif, 32);
+ *  LittleFileSystem fs("fs", &bd);
+ *  @endcode
+ */
+class RemappingBlockDevice : public mbed::BlockDevice {
+public:
+    /** Create a remapping layer on top of a block device
+     *
+     *  @param bd           Block device to remap, with a uniform erase size
+     *  @param spare_count  Number of erase units kept as spares
+     */
+    RemappingBlockDevice(mbed::BlockDevice *bd, uint32_t spare_count = 16);
+
+    /** Destruct the remapping layer
+     */
+    virtual ~RemappingBlockDevice();
+
+    /** Initialize the underlying block device and load the remap table, formatting it if there is none
+     *
+     *  @return         0 on success or a negative error code on failure
+     */
+    virtual int init();
+
+    /** Deinitialize the underlying block device
+     *
+     *  @return         0 on success or a negative error code on failure
+     */
+    virtual int deinit();
+
+    /** Sync the underlying block device
+     *
+     *  @return         0 on success or a negative error code on failure
+     */
+    virtual int sync();
+
+    /** Read blocks through the remap table
+     *
+     *  @param buffer   Buffer to write blocks to
+     *  @param addr     Address of block to begin reading from
+     *  @param size     Size to read in bytes, must be a multiple of read block size
+     *  @return         0 on success or a negative error code on failure
+     */
+    virtual int read(void *buffer, mbed::bd_addr_t addr, mbed::bd_size_t size);
+
+    /** Program blocks through the remap table, retiring units that fail
+     *
+     *  @note The blocks must have been erased prior to being programmed
+     *
+     *  @param buffer   Buffer of data to write to blocks
+     *  @param addr     Address of block to begin writing to
+     *  @param size     Size to write in bytes, must be a multiple of program block size
+     *  @return         0 on success or a negative error code on failure
+     */
+    virtual int program(const void *buffer, mbed::bd_addr_t addr, mbed::bd_size_t size);
+
+    /** Erase blocks through the remap table, retiring units that fail
+     *
+     *  @param addr     Address of block to begin erasing
+     *  @param size     Size to erase in bytes, must be a multiple of erase block size
+     *  @return         0 on success or a negative error code on failure
+     */
+    virtual int erase(mbed::bd_addr_t addr, mbed::bd_size_t size);
+
+    /** Get the size of a readable block
+     *
+     *  @return         Size of a readable block in bytes
+     */
+    virtual mbed::bd_size_t get_read_size() const;
+
+    /** Get the size of a programmable block
+     *
+     *  @return         Size of a programmable block in bytes
+     */
+    virtual mbed::bd_size_t get_program_size() const;
+
+    /** Get the size of an erasable block, the erase unit of the underlying device
+     *
+     *  @return         Size of an erasable block in bytes
+     */
+    virtual mbed::bd_size_t get_erase_size() const;
+
+    /** Get the size of an erasable block at an address
+     *
+     *  @param addr     Address within the erasable block
+     *  @return         Size of an erasable block in bytes
+     */
+    virtual mbed::bd_size_t get_erase_size(mbed::bd_addr_t addr) const;
+
+    /** Get the value of storage when erased
+     *
+     *  @return         The value of storage when erased
+     */
+    virtual int get_erase_value() const;
+
+    /** Get the size of the data area
+     *
+     *  @return         Size of the data area in bytes
+     */
+    virtual mbed::bd_size_t size() const;
+
+    /** Get the BlockDevice class type
+     *
+     *  @return         A string representing the BlockDevice class type
+     */
+    virtual const char *get_type() const;
+
+    /** Get the number of spares not used yet
+     *
+     *  @return         Number of spare units left, 0 before init()
+     */
+    uint32_t get_spares_left();
+
+    /** Get the retire counters since init() or the last reset
+     *
+     *  @param stats    Counters are copied here
+     */
+    void get_remap_stats(remap_bd_stats &stats);
+
+    /** Clear the retire counters
+     */
+    void reset_remap_stats();
+
+private:
+    struct table_header {
+        uint32_t magic;
+        uint32_t sequence;      // increases by one for each table written, the copy is sequence % 2
+        uint32_t spares_used;   // spares taken from the pool, including the ones that failed
+        uint32_t entry_count;   // remapped units following the header
+        uint32_t crc;           // CRC32 of the header up to here and of the entries
+        uint32_t reserved[3];
+    };
+
+    struct table_entry {
+        uint32_t logical;       // data area unit
+        uint32_t physical;      // spare unit holding it
+    };
+
+    // Read and check a copy of the table into the table buffer, valid is false if it doesn't hold a table
+    // Returns the read error, a copy that couldn't be read isn't known to be invalid
+    int _load_table(uint32_t copy, bool &valid);
+
+    // Write the table in the buffer to the older copy
+    int _store_table();
+
+    // Physical unit holding a data area unit
+    uint32_t _physical_unit(uint32_t logical);
+
+    // Replace a data area unit by the next working spare, copying its contents, with data
+    // (size bytes at offset in the unit) written over the copy, data NULL - erase failure, nothing copied
+    int _retire_unit(uint32_t logical, uint32_t offset, const uint8_t *data, uint32_t size);
+
+    // Copy a retired unit to a freshly erased spare, with data written over it
+    int _copy_unit(uint32_t from, uint32_t to, uint32_t offset, const uint8_t *data, uint32_t size);
+
+    // Erase and program errors of the flash itself retire the unit
+    static bool _is_unit_failure(int err);
+
+    // False while the device is still busy after a timeout (sync() fails), nothing can be judged then
+    bool _is_device_settled(int err);
+
+    mbed::bd_addr_t _unit_addr(uint32_t unit) const
+    {
+        return (mbed::bd_addr_t)unit * _unit_size;
+    }
+
+    mbed::BlockDevice *_bd;
+    uint32_t _spare_count;
+    uint32_t _unit_size;
+    uint32_t _data_units;       // data area units, they follow the two table units
+    uint32_t _spare_base;       // first spare unit
+
+    // Table as stored on the device: header followed by the entries, padded to the program size
+    uint8_t *_table_buffer;
+    uint32_t _table_size;
+    table_header *_table;
+    table_entry *_entries;
+
+    // Chunk used to copy a retired unit, a multiple of the read and program sizes
+    uint8_t *_copy_buffer;
+    uint32_t _copy_size;
+
+    remap_bd_stats _stats;
+    bool _is_initialized;
+    PlatformMutex _mutex;
+};
+
+#endif
@@ -16,9 +16,15 @@
 
 #include "SPIFBlockDevicePD.h"
 #include "rtos/ThisThread.h"
+#include "rtos/Kernel.h"
+#include "drivers/Timer.h"
+#include "drivers/MbedCRC.h"
+#include "platform/mbed_wait_api.h"
 #include "mbed_critical.h"
 
+#include <stdio.h>
 #include <string.h>
+#include <stddef.h>
 #include <inttypes.h>
 
 #include "mbed_trace.h"
@@ -33,6 +39,11 @@ using namespace mbed;
 #define SPIF_DEFAULT_PAGE_SIZE  256
 #define SPIF_DEFAULT_SE_SIZE    4096
 #define SPI_MAX_STATUS_REGISTER_SIZE 2
+// Instruction (1 byte) + Address (up to 4 bytes) + Dummy Cycles Bytes
+#define SPIF_MAX_DUMMY_BYTES 8
+#define SPIF_MAX_COMMAND_HEADER_SIZE (1 + 4 + SPIF_MAX_DUMMY_BYTES)
+// Largest single data phase handed to the SPI driver's block transfer API
+#define SPIF_MAX_BLOCK_TRANSFER_SIZE 0x8000
 
 #ifndef UINT64_MAX
 #define UINT64_MAX -1
@@ -71,6 +82,33 @@ using namespace mbed;
 #define SPIF_BASIC_PARAM_ERASE_TYPE_3_SIZE_BYTE 32
 #define SPIF_BASIC_PARAM_ERASE_TYPE_4_SIZE_BYTE 34
 #define SPIF_BASIC_PARAM_4K_ERASE_TYPE_BYTE 1
+// Typical and maximum operation times (DWORDs 10-11)
+#define SPIF_BASIC_PARAM_TABLE_ERASE_TIMING_BYTE 36
+#define SPIF_BASIC_PARAM_TABLE_PROGRAM_TIMING_BYTE 40
+// Suspend/Resume (DWORDs 12-13)
+#define SPIF_BASIC_PARAM_TABLE_SUSPEND_RESUME_BYTE 44
+#define SPIF_BASIC_PARAM_TABLE_SUSPEND_RESUME_INST_BYTE 48
+// Deep Power-Down (DWORD 14)
+#define SPIF_BASIC_PARAM_TABLE_DEEP_POWER_DOWN_BYTE 52
+// Address Bytes (DWORD 1 bits 18:17) and 4-Byte Address Mode Entry (DWORD 16 bits 31:24)
+#define SPIF_BASIC_PARAM_TABLE_ADDRESS_BYTES_BYTE 2
+#define SPIF_BASIC_PARAM_TABLE_4BYTE_ENTER_BYTE 63
+
+/* 4-byte Address Instruction Table Parsing */
+/********************************************/
+#define SPIF_4BYTE_INST_TABLE_SIZE_BYTES 8 /* 2 DWORDS */
+#define SPIF_4BYTE_INST_SUPPORT_READ        0x0001 // 13h
+#define SPIF_4BYTE_INST_SUPPORT_FAST_READ   0x0002 // 0Ch
+#define SPIF_4BYTE_INST_SUPPORT_PP          0x0040 // 12h
+#define SPIF_4BYTE_INST_SUPPORT_ERASE_TYPE_1 0x0200 // Erase types 1-4 in bits 9-12
+#define SPIF_4BYTE_INST_ERASE_TYPE_1_BYTE 4
+
+/* Sector Map Table Parsing */
+/****************************/
+#define SPIF_SECTOR_MAP_CMD_DESCRIPTOR_SIZE 8 /* 2 DWORDS */
+#define SPIF_SECTOR_MAP_MAP_HEADER_SIZE 4 /* 1 DWORD followed by 1 DWORD per region */
+#define SPIF_SECTOR_MAP_DESCRIPTOR_END 0x01
+#define SPIF_SECTOR_MAP_DESCRIPTOR_TYPE_MAP 0x02
 
 // Erase Types Per Region BitMask
 #define ERASE_BITMASK_TYPE4 0x08
@@ -80,11 +118,42 @@ using namespace mbed;
 
 #define IS_MEM_READY_MAX_RETRIES 10000
 
+// Operation times used when the SFDP table doesn't specify them
+#define SPIF_DEFAULT_PROG_TYP_TIME_US         700
+#define SPIF_DEFAULT_PROG_MAX_TIME_US         5000
+#define SPIF_DEFAULT_ERASE_TYP_TIME_US        50000
+#define SPIF_DEFAULT_ERASE_MAX_TIME_US        2000000
+#define SPIF_DEFAULT_CHIP_ERASE_TYP_TIME_US   30000000
+#define SPIF_DEFAULT_CHIP_ERASE_MAX_TIME_US   400000000
+#define SPIF_DEFAULT_OTHER_TYP_TIME_US        0
+#define SPIF_DEFAULT_OTHER_MAX_TIME_US        100000
+
+// Ready polling: never poll faster than this, and give up after twice the maximum operation time
+#define SPIF_MIN_POLL_INTERVAL_US   10
+#define SPIF_MIN_READY_TIMEOUT_US   10000
+// Waits of at least one RTOS tick sleep, shorter waits spin
+#define SPIF_SLEEP_THRESHOLD_US     1000
+
+// Each queued asynchronous operation carries its arguments along with the event,
+// one more event is reserved for the idle manager
+#define SPIF_ASYNC_QUEUE_SIZE ((SPIF_ASYNC_QUEUE_DEPTH * (EVENTS_EVENT_SIZE + sizeof(async_op))) + EVENTS_EVENT_SIZE)
+
+// Program verify/skip compare device contents through a buffer of this size
+#define SPIF_COMPARE_SLICE_SIZE 32
+
+// Marks an area written by flush_erase_counters() ("SPEC")
+#define SPIF_ERASE_COUNTERS_MAGIC 0x43455053
+
+// Release from Deep Power-Down time (tRES1) used when the SFDP table doesn't specify it
+#define SPIF_DEFAULT_DPD_EXIT_DELAY_US 30
+
 enum spif_default_instructions {
     SPIF_NOP = 0x00, // No operation
     SPIF_PP = 0x02, // Page Program data
     SPIF_READ = 0x03, // Read data
+    SPIF_FAST_READ = 0x0B, // Read data at high speed (8 dummy cycles)
     SPIF_SE   = 0x20, // 4KB Sector Erase
+    SPIF_CE   = 0x60, // Chip Erase
     SPIF_SFDP = 0x5a, // Read SFDP
     SPIF_WRSR = 0x01, // Write Status/Configuration Register
     SPIF_WRDI = 0x04, // Write Disable
@@ -98,11 +167,21 @@ enum spif_default_instructions {
     SPIF_4BDIS = 0xE9, // Disable 4-byte address mode
     SPIF_PU = 0xAB,  // power up device/ID register --CHANGED FOR SPIF_PD LIBRARY
     SPIF_PD = 0xB9,   // power down device register --CHANGED FOR SPIF_PD LIBRARY
+    SPIF_4B_READ = 0x13, // Read data with 4-byte address
+    SPIF_4B_FAST_READ = 0x0C, // Read data at high speed with 4-byte address (8 dummy cycles)
+    SPIF_4B_PP = 0x12, // Page Program data with 4-byte address
+    SPIF_SUS = 0x75, // Suspend program/erase
+    SPIF_RES = 0x7A, // Resume program/erase
 };
 
-// Mutex is used for some SPI Driver commands that must be done sequentially with no other commands in between
-// e.g. (1)Set Write Enable, (2)Program, (3)Wait Memory Ready
-SingletonPtr<PlatformMutex> SPIFBlockDevicePD::_mutex;
+// How addresses above 16MB are reached
+enum spif_address_mode {
+    SPIF_ADDR_MODE_3_BYTE = 0,          // device fits in 3 byte addresses
+    SPIF_ADDR_MODE_4_BYTE_INST = 1,     // dedicated 4 byte address instructions, no mode switch
+    SPIF_ADDR_MODE_4_BYTE_ONLY = 2,     // device only accepts 4 byte addresses
+    SPIF_ADDR_MODE_ENTER_4BEN = 3,      // 4 byte address mode entered with 4BEN
+    SPIF_ADDR_MODE_ENTER_WREN_4BEN = 4, // 4 byte address mode entered with WREN then 4BEN
+};
 
 // Local Function
 static unsigned int local_math_power(int base, int exp);
@@ -112,10 +191,19 @@ static unsigned int local_math_power(int base, int exp);
 //***********************
 SPIFBlockDevicePD::SPIFBlockDevicePD(
     PinName mosi, PinName miso, PinName sclk, PinName csel, int freq)
-    : _spi(mosi, miso, sclk), _cs(csel), _read_instruction(0), _prog_instruction(0), _erase_instruction(0),
+    : _spi(mosi, miso, sclk), _cs(csel),
+      _async_queue(NULL), _async_thread(osPriorityNormal, SPIF_ASYNC_THREAD_STACK_SIZE),
+      _async_thread_started(false), _idle_timeout_ms(0), _last_access_ms(0), _idle_event_id(0),
+      _is_powered_down(false), _dpd_enter_inst(SPIF_PD), _dpd_exit_inst(SPIF_PU),
+      _dpd_exit_delay_us(SPIF_DEFAULT_DPD_EXIT_DELAY_US), _suspend_inst(0), _resume_inst(0), _suspend_latency_us(0),
+      _resume_to_suspend_us(0), _busy_op(SPIF_BD_OP_OTHER), _busy_addr(0), _busy_size(0), _suspended_us(0),
+      _busy_waiters(0), _timed_out_op(SPIF_BD_OP_OTHER), _sfdp_cache_valid(false), _read_instruction(0), _prog_instruction(0), _erase_instruction(0),
       _erase4k_inst(0), _page_size_bytes(0), _device_size_bytes(0), _init_ref_count(0), _is_initialized(false)
 {
     _address_size = SPIF_ADDR_SIZE_3_BYTES;
+    _address_mode = SPIF_ADDR_MODE_3_BYTE;
+    // Measures the time since the last resume and the time spent suspended
+    _suspend_timer.start();
     // Initial SFDP read tables are read with 8 dummy cycles
     // Default Bus Setup 1_1_1 with 0 dummy and mode cycles
     _read_dummy_and_mode_cycles = 8;
@@ -126,6 +214,27 @@ SPIFBlockDevicePD::SPIFBlockDevicePD(
     _regions_count = 1;
     _region_erase_types_bitfield[0] = ERASE_BITMASK_NONE;
 
+    // Default operation times until SFDP tables are parsed
+    _op_typ_time_us_arr[SPIF_BD_OP_PROGRAM] = SPIF_DEFAULT_PROG_TYP_TIME_US;
+    _op_max_time_us_arr[SPIF_BD_OP_PROGRAM] = SPIF_DEFAULT_PROG_MAX_TIME_US;
+    for (int i_ind = SPIF_BD_OP_ERASE_TYPE_1; i_ind <= SPIF_BD_OP_ERASE_TYPE_4; i_ind++) {
+        _op_typ_time_us_arr[i_ind] = SPIF_DEFAULT_ERASE_TYP_TIME_US;
+        _op_max_time_us_arr[i_ind] = SPIF_DEFAULT_ERASE_MAX_TIME_US;
+    }
+    _op_typ_time_us_arr[SPIF_BD_OP_CHIP_ERASE] = SPIF_DEFAULT_CHIP_ERASE_TYP_TIME_US;
+    _op_max_time_us_arr[SPIF_BD_OP_CHIP_ERASE] = SPIF_DEFAULT_CHIP_ERASE_MAX_TIME_US;
+    _op_typ_time_us_arr[SPIF_BD_OP_OTHER] = SPIF_DEFAULT_OTHER_TYP_TIME_US;
+    _op_max_time_us_arr[SPIF_BD_OP_OTHER] = SPIF_DEFAULT_OTHER_MAX_TIME_US;
+    memset(_op_latency_hist_arr, 0, sizeof(_op_latency_hist_arr));
+    memset(_call_latency_hist_arr, 0, sizeof(_call_latency_hist_arr));
+    memset(&_bus_stats, 0, sizeof(_bus_stats));
+    _program_mode = 0;
+    _is_device_idle = false;
+    memset(&_program_stats, 0, sizeof(_program_stats));
+    _erase_counters = NULL;
+    _erase_counters_count = 0;
+    _erase_counter_unit_size = 0;
+
     if (SPIF_BD_ERROR_OK != _spi_set_frequency(freq)) {
         tr_error("SPI Set Frequency Failed");
     }
@@ -142,9 +251,12 @@ int SPIFBlockDevicePD::init()
     size_t basic_table_size = 0;
     uint32_t sector_map_table_addr = 0;
     size_t sector_map_table_size = 0;
+    uint32_t four_byte_inst_table_addr = 0;
+    size_t four_byte_inst_table_size = 0;
     spif_bd_error spi_status = SPIF_BD_ERROR_OK;
+    bool warm_init = false;
 
-    _mutex->lock();
+    _mutex.lock();
 
     if (!_is_initialized) {
         _init_ref_count = 0;
@@ -156,24 +268,35 @@ int SPIFBlockDevicePD::init()
         goto exit_point;
     }
 
-    //power up device
+    //power up device, deinit() (or an earlier boot) may have left it in Deep Power-Down
+    _set_deep_power_down(false);
 
-    // Soft Reset
-    if (-1 == _reset_flash_mem()) {
-        tr_error("init - Unable to initialize flash memory, tests failed");
-        status = SPIF_BD_ERROR_DEVICE_ERROR;
-        goto exit_point;
-    } else {
-        debug_if(MBED_CONF_SPIF_DRIVER_DEBUG, "DEBUG: Initialize flash memory OK\n");
+    /* Read Manufacturer ID (1byte), and Device ID (2bytes)*/
+    if (_sfdp_cache_valid) {
+        // Warm init - if it's the same device the cached SFDP configuration is used as is
+        spi_status = _spi_send_general_command(SPIF_RDID, SPI_NO_ADDRESS_COMMAND, NULL, 0, (char *)vendor_device_ids,
+                                               data_length);
+        warm_init = (spi_status == SPIF_BD_ERROR_OK) && (0 == memcmp(vendor_device_ids, _sfdp_cache.jedec_id, 3));
+        debug_if(MBED_CONF_SPIF_DRIVER_DEBUG, "DEBUG: init - cached SFDP configuration %s\n", warm_init ? "used" : "stale");
     }
 
-    /* Read Manufacturer ID (1byte), and Device ID (2bytes)*/
-    spi_status = _spi_send_general_command(SPIF_RDID, SPI_NO_ADDRESS_COMMAND, NULL, 0, (char *)vendor_device_ids,
-                                           data_length);
-    if (spi_status != SPIF_BD_ERROR_OK) {
-        tr_error("init - Read Vendor ID Failed");
-        status = SPIF_BD_ERROR_DEVICE_ERROR;
-        goto exit_point;
+    if (!warm_init) {
+        // Soft Reset
+        if (-1 == _reset_flash_mem()) {
+            tr_error("init - Unable to initialize flash memory, tests failed");
+            status = SPIF_BD_ERROR_DEVICE_ERROR;
+            goto exit_point;
+        } else {
+            debug_if(MBED_CONF_SPIF_DRIVER_DEBUG, "DEBUG: Initialize flash memory OK\n");
+        }
+
+        spi_status = _spi_send_general_command(SPIF_RDID, SPI_NO_ADDRESS_COMMAND, NULL, 0, (char *)vendor_device_ids,
+                                               data_length);
+        if (spi_status != SPIF_BD_ERROR_OK) {
+            tr_error("init - Read Vendor ID Failed");
+            status = SPIF_BD_ERROR_DEVICE_ERROR;
+            goto exit_point;
+        }
     }
 
     switch (vendor_device_ids[0]) {
@@ -192,8 +315,17 @@ int SPIFBlockDevicePD::init()
         goto exit_point;
     }
 
+    if (warm_init) {
+        _sfdp_descriptor_load(_sfdp_cache);
+        goto init_done;
+    }
+
+    // SFDP tables are always read with 3 byte addresses
+    _address_size = SPIF_ADDR_SIZE_3_BYTES;
+
     /**************************** Parse SFDP Header ***********************************/
-    if (0 != _sfdp_parse_sfdp_headers(basic_table_addr, basic_table_size, sector_map_table_addr, sector_map_table_size)) {
+    if (0 != _sfdp_parse_sfdp_headers(basic_table_addr, basic_table_size, sector_map_table_addr, sector_map_table_size,
+                                      four_byte_inst_table_addr, four_byte_inst_table_size)) {
         tr_error("init - Parse SFDP Headers Failed");
         status = SPIF_BD_ERROR_PARSING_FAILED;
         goto exit_point;
@@ -207,6 +339,13 @@ int SPIFBlockDevicePD::init()
         goto exit_point;
     }
 
+    /**************************** Parse 4-byte Address Instruction Table ***********************************/
+    // Dedicated 4 byte instructions don't depend on a mode the device can lose (e.g. on a reset of the MCU only)
+    if (((_address_mode == SPIF_ADDR_MODE_ENTER_4BEN) || (_address_mode == SPIF_ADDR_MODE_ENTER_WREN_4BEN)) &&
+            (four_byte_inst_table_addr != 0) && (0 != four_byte_inst_table_size)) {
+        _sfdp_parse_4byte_inst_table(four_byte_inst_table_addr, four_byte_inst_table_size);
+    }
+
     /**************************** Parse Sector Map Table ***********************************/
     _region_size_bytes[0] =
         _device_size_bytes; // If there's no region map, we have a single region sized the entire device size
@@ -222,20 +361,30 @@ int SPIFBlockDevicePD::init()
         }
     }
 
+    // Keep the parsed configuration so the next init() of this device skips SFDP parsing
+    _sfdp_descriptor_store(_sfdp_cache, vendor_device_ids);
+    _sfdp_cache_valid = true;
+
+init_done:
     // Configure  BUS Mode to 1_1_1 for all commands other than Read
     // Dummy And Mode Cycles Back default 0
     _dummy_and_mode_cycles = _write_dummy_and_mode_cycles;
     _is_initialized = true;
     tr_debug("Device size: %llu Kbytes", _device_size_bytes / 1024);
 
-    if (_device_size_bytes > (1 << 24)) {
+    if (_address_mode == SPIF_ADDR_MODE_ENTER_4BEN || _address_mode == SPIF_ADDR_MODE_ENTER_WREN_4BEN) {
         tr_debug("Size is bigger than 16MB and thus address does not fit in 3 byte, switch to 4 byte address mode");
+        if (_address_mode == SPIF_ADDR_MODE_ENTER_WREN_4BEN) {
+            _set_write_enable();
+        }
         _spi_send_general_command(SPIF_4BEN, SPI_NO_ADDRESS_COMMAND, NULL, 0, NULL, 0);
+    }
+    if (_address_mode != SPIF_ADDR_MODE_3_BYTE) {
         _address_size = SPIF_ADDR_SIZE_4_BYTES;
     }
 
 exit_point:
-    _mutex->unlock();
+    _mutex.unlock();
 
     return status;
 }
@@ -245,7 +394,7 @@ int SPIFBlockDevicePD::deinit()
 {
     spif_bd_error status = SPIF_BD_ERROR_OK;
 
-    _mutex->lock();
+    _mutex.lock();
 
     if (!_is_initialized) {
         _init_ref_count = 0;
@@ -258,55 +407,89 @@ int SPIFBlockDevicePD::deinit()
         goto exit_point;
     }
 
-    // Disable Device for Writing
-    status = _spi_send_general_command(SPIF_WRDI, SPI_NO_ADDRESS_COMMAND, NULL, 0, NULL, 0);
-    if (status != SPIF_BD_ERROR_OK)  {
-        tr_error("Write Disable failed");
+    // Let an erase started by another thread finish before powering down
+    _wait_for_busy_op();
+
+    // Disable Device for Writing (the idle manager may already have powered it down)
+    if (!_is_powered_down) {
+        status = _spi_send_general_command(SPIF_WRDI, SPI_NO_ADDRESS_COMMAND, NULL, 0, NULL, 0);
+        if (status != SPIF_BD_ERROR_OK)  {
+            tr_error("Write Disable failed");
+        }
     }
 
     //power down device
-    _cs = 0;
-    _spi.write(SPIF_PD);
-    _cs = 1;
-    
-    /*
-    status = _spi_send_general_command(SPIF_PD, SPI_NO_ADDRESS_COMMAND, NULL, 0, NULL, 0);
-    if (status != SPIF_BD_ERROR_OK)  {
-        tr_error("Power down failed");
-    }
-    */
+    _set_deep_power_down(true);
 
     _is_initialized = false;
 
 exit_point:
-    _mutex->unlock();
+    _mutex.unlock();
 
     return status;
 }
 
 int SPIFBlockDevicePD::read(void *buffer, bd_addr_t addr, bd_size_t size)
+{
+    spif_bd_iovec iov = { buffer, (uint32_t)size };
+    return readv(&iov, 1, addr);
+}
+
+int SPIFBlockDevicePD::readv(const spif_bd_iovec *iov, int iovcnt, bd_addr_t addr)
 {
     if (!_is_initialized) {
         return BD_ERROR_DEVICE_ERROR;
     }
 
     int status = SPIF_BD_ERROR_OK;
+    bd_size_t size = _iov_size(iov, iovcnt);
+    iov_pos pos = { iov, 0 };
+    mbed::Timer timer;
+    timer.start();
     debug_if(MBED_CONF_SPIF_DRIVER_DEBUG, "DEBUG Read - Inst: 0x%xh", _read_instruction);
-    _mutex->lock();
+    _mutex.lock();
+
+    _power_up_for_access();
+
+    // An erase waiting with _mutex released is suspended for the read, unless the read
+    // is from the area being erased, which can't be read until the erase is done,
+    // or the device can't suspend, then the read waits for the erase to complete
+    bool suspended = false;
+    if (_busy_op != SPIF_BD_OP_OTHER) {
+        if (((addr + size) > _busy_addr) && (addr < (_busy_addr + _busy_size))) {
+            _wait_for_busy_op();
+        } else if ((_suspend_inst != 0) && (0 == _suspend_busy_op())) {
+            suspended = true;
+        } else {
+            _wait_for_busy_op();
+        }
+    }
 
     // Set Dummy Cycles for Specific Read Command Mode
     _dummy_and_mode_cycles = _read_dummy_and_mode_cycles;
 
-    status = _spi_send_read_command(_read_instruction, static_cast<uint8_t *>(buffer), addr, size);
+    status = _spi_send_readv_command(_read_instruction, pos, addr, size);
 
     // Set Dummy Cycles for all other command modes
     _dummy_and_mode_cycles = _write_dummy_and_mode_cycles;
 
-    _mutex->unlock();
+    if (suspended) {
+        _resume_busy_op();
+    }
+
+    _record_call(SPIF_BD_CALL_READ, timer, status);
+
+    _mutex.unlock();
     return status;
 }
 
 int SPIFBlockDevicePD::program(const void *buffer, bd_addr_t addr, bd_size_t size)
+{
+    spif_bd_iovec iov = { const_cast<void *>(buffer), (uint32_t)size };
+    return programv(&iov, 1, addr);
+}
+
+int SPIFBlockDevicePD::programv(const spif_bd_iovec *iov, int iovcnt, bd_addr_t addr)
 {
     if (!_is_initialized) {
         return BD_ERROR_DEVICE_ERROR;
@@ -314,10 +497,15 @@ int SPIFBlockDevicePD::program(const void *buffer, bd_addr_t addr, bd_size_t siz
 
     bool program_failed = false;
     int status = SPIF_BD_ERROR_OK;
+    bd_size_t size = _iov_size(iov, iovcnt);
+    iov_pos pos = { iov, 0 };
     uint32_t offset = 0;
     uint32_t chunk = 0;
+    bool equal = false;
+    mbed::Timer timer;
+    timer.start();
 
-    debug_if(MBED_CONF_SPIF_DRIVER_DEBUG, "DEBUG: program - Buff: 0x%" PRIx32 "h, addr: %llu, size: %llu", (uint32_t)buffer, addr, size);
+    debug_if(MBED_CONF_SPIF_DRIVER_DEBUG, "DEBUG: program - %d buffers, addr: %llu, size: %llu", iovcnt, addr, size);
 
     while (size > 0) {
 
@@ -325,7 +513,25 @@ int SPIFBlockDevicePD::program(const void *buffer, bd_addr_t addr, bd_size_t siz
         offset = addr % _page_size_bytes;
         chunk = (offset + size < _page_size_bytes) ? size : (_page_size_bytes - offset);
 
-        _mutex->lock();
+        _mutex.lock();
+
+        _wait_for_busy_op();
+        _power_up_for_access();
+
+        // A failed read back is a bus error, not a difference - the page would be reprogrammed
+        // or, with verify, its erase unit reported as failing
+        if (_program_mode & SPIF_BD_PROGRAM_SKIP_UNCHANGED) {
+            if (SPIF_BD_ERROR_OK != _compare_with_device(pos, addr, chunk, equal)) {
+                tr_error("read back before program failed at %llu", addr);
+                program_failed = true;
+                status = SPIF_BD_ERROR_DEVICE_ERROR;
+                goto exit_point;
+            }
+            if (equal) {
+                _program_stats.pages_skipped++;
+                goto next_chunk;
+            }
+        }
 
         //Send WREN
         if (_set_write_enable() != 0) {
@@ -335,25 +541,51 @@ int SPIFBlockDevicePD::program(const void *buffer, bd_addr_t addr, bd_size_t siz
             goto exit_point;
         }
 
-        _spi_send_program_command(_prog_instruction, buffer, addr, chunk);
-
-        buffer = static_cast<const uint8_t *>(buffer) + chunk;
-        addr += chunk;
-        size -= chunk;
+        _spi_send_program_command(_prog_instruction, pos, addr, chunk);
+        _program_stats.pages_programmed++;
 
-        if (false == _is_mem_ready()) {
+        if (false == _is_mem_ready(SPIF_BD_OP_PROGRAM)) {
             tr_error("Device not ready after write, failed");
             program_failed = true;
             status = SPIF_BD_ERROR_READY_FAILED;
             goto exit_point;
         }
-        _mutex->unlock();
+
+        if (_program_mode & SPIF_BD_PROGRAM_VERIFY) {
+            if (SPIF_BD_ERROR_OK != _compare_with_device(pos, addr, chunk, equal)) {
+                tr_error("program verify read failed at %llu", addr);
+                program_failed = true;
+                status = SPIF_BD_ERROR_DEVICE_ERROR;
+                goto exit_point;
+            }
+            if (!equal) {
+                tr_error("program verify failed at %llu", addr);
+                _program_stats.verify_failures++;
+                program_failed = true;
+                status = SPIF_BD_ERROR_VERIFY_FAILED;
+                goto exit_point;
+            }
+            _program_stats.pages_verified++;
+        }
+
+next_chunk:
+        for (uint32_t left = chunk; left > 0;) {
+            uint32_t piece = left;
+            _iov_next_piece(pos, piece);
+            left -= piece;
+        }
+        addr += chunk;
+        size -= chunk;
+
+        _mutex.unlock();
     }
 
 exit_point:
-    if (program_failed) {
-        _mutex->unlock();
+    if (!program_failed) {
+        _mutex.lock();
     }
+    _record_call(SPIF_BD_CALL_PROGRAM, timer, status);
+    _mutex.unlock();
 
     return status;
 }
@@ -365,12 +597,13 @@ int SPIFBlockDevicePD::erase(bd_addr_t addr, bd_size_t in_size)
     }
 
     int type = 0;
-    uint32_t offset = 0;
     uint32_t chunk = 4096;
     int cur_erase_inst = _erase_instruction;
-    int size = (int)in_size;
+    bd_size_t size = in_size;
     bool erase_failed = false;
     int status = SPIF_BD_ERROR_OK;
+    mbed::Timer timer;
+    timer.start();
     // Find region of erased address
     int region = _utils_find_addr_region(addr);
     if (region < 0) {
@@ -392,22 +625,70 @@ int SPIFBlockDevicePD::erase(bd_addr_t addr, bd_size_t in_size)
         return SPIF_BD_ERROR_INVALID_ERASE_PARAMS;
     }
 
-    // For each iteration erase the largest section supported by current region
+    if ((addr == 0) && (in_size == _device_size_bytes)) {
+        // Whole device - a single Chip Erase is much faster than erasing it block by block
+        debug_if(MBED_CONF_SPIF_DRIVER_DEBUG, "DEBUG: erase - Chip Erase, Inst: 0x%xh", SPIF_CE);
+
+        _mutex.lock();
+
+        _wait_for_busy_op();
+        _power_up_for_access();
+
+        if (_set_write_enable() != 0) {
+            tr_error("SPI Chip Erase Device not ready - failed");
+            erase_failed = true;
+            status = SPIF_BD_ERROR_READY_FAILED;
+            goto exit_point;
+        }
+
+        _spi_send_general_command(SPIF_CE, SPI_NO_ADDRESS_COMMAND, NULL, 0, NULL, 0);
+
+        // Takes seconds, _mutex is released meanwhile. The busy area is the whole device,
+        // so reads and other operations wait for the erase without holding the lock
+        _busy_op = SPIF_BD_OP_CHIP_ERASE;
+        _busy_addr = 0;
+        _busy_size = _device_size_bytes;
+
+        if (false == _is_mem_ready(SPIF_BD_OP_CHIP_ERASE, true)) {
+            tr_error("SPI After Chip Erase Device not ready - failed");
+            _busy_op = SPIF_BD_OP_OTHER;
+            erase_failed = true;
+            status = SPIF_BD_ERROR_READY_FAILED;
+            goto exit_point;
+        }
+        _busy_op = SPIF_BD_OP_OTHER;
+
+        _count_erase(0, _device_size_bytes);
+        _record_call(SPIF_BD_CALL_ERASE, timer, status);
+        _mutex.unlock();
+        return status;
+    }
+
+    // For each iteration erase the largest section supported by current region.
+    // Erase sizes are powers of 2, so greedily taking the largest aligned type that fits
+    // gives the minimal number of erase commands for the range
     while (size > 0) {
 
-        // iterate to find next Largest erase type ( a. supported by region, b. smaller than size)
-        // find the matching instruction and erase size chunk for that type.
-        type = _utils_iterate_next_largest_erase_type(bitfield, size, (unsigned int)addr, _region_high_boundary[region]);
+        // find next Largest erase type (a. supported by region, b. aligned to addr, c. fits in size and region)
+        // and the matching instruction and erase size chunk for that type.
+        type = _utils_iterate_next_largest_erase_type(bitfield, size, addr, _region_high_boundary[region]);
+        if (type < 0) {
+            tr_error("no erase type fits addr %llu, size %llu", addr, size);
+            status = SPIF_BD_ERROR_INVALID_ERASE_PARAMS;
+            goto exit_point;
+        }
         cur_erase_inst = _erase_type_inst_arr[type];
-        offset = addr % _erase_type_size_arr[type];
-        chunk = ((offset + size) < _erase_type_size_arr[type]) ? size : (_erase_type_size_arr[type] - offset);
+        chunk = _erase_type_size_arr[type];
 
-        debug_if(MBED_CONF_SPIF_DRIVER_DEBUG, "DEBUG: erase - addr: %llu, size:%d, Inst: 0x%xh, chunk: %" PRIu32 " , ",
+        debug_if(MBED_CONF_SPIF_DRIVER_DEBUG, "DEBUG: erase - addr: %llu, size:%llu, Inst: 0x%xh, chunk: %" PRIu32 " , ",
                  addr, size, cur_erase_inst, chunk);
         debug_if(MBED_CONF_SPIF_DRIVER_DEBUG, "DEBUG: erase - Region: %d, Type:%d",
                  region, type);
 
-        _mutex->lock();
+        _mutex.lock();
+
+        _wait_for_busy_op();
+        _power_up_for_access();
 
         if (_set_write_enable() != 0) {
             tr_error("SPI Erase Device not ready - failed");
@@ -416,7 +697,13 @@ int SPIFBlockDevicePD::erase(bd_addr_t addr, bd_size_t in_size)
             goto exit_point;
         }
 
-        _spi_send_erase_command(cur_erase_inst, addr, size);
+        _spi_send_erase_command(cur_erase_inst, addr, chunk);
+
+        // _mutex is released while the erase runs, so other threads aren't held for the whole chunk.
+        // Reads suspend it when the device supports it, otherwise they wait for it without the lock
+        _busy_op = (spif_bd_op)(SPIF_BD_OP_ERASE_TYPE_1 + type);
+        _busy_addr = addr;
+        _busy_size = chunk;
 
         addr += chunk;
         size -= chunk;
@@ -427,24 +714,76 @@ int SPIFBlockDevicePD::erase(bd_addr_t addr, bd_size_t in_size)
             bitfield = _region_erase_types_bitfield[region];
         }
 
-        if (false == _is_mem_ready()) {
+        if (false == _is_mem_ready((spif_bd_op)(SPIF_BD_OP_ERASE_TYPE_1 + type), true)) {
             tr_error("SPI After Erase Device not ready - failed");
+            _busy_op = SPIF_BD_OP_OTHER;
             erase_failed = true;
             status = SPIF_BD_ERROR_READY_FAILED;
             goto exit_point;
         }
-
-        _mutex->unlock();
+        _busy_op = SPIF_BD_OP_OTHER;
+
+        _count_erase(addr - chunk, chunk);
+
+        // Threads that waited for this chunk go before the next one starts,
+        // otherwise they could be kept waiting until the whole range is erased.
+        // _busy_waiters is only read under the lock
+        bool waiters = (size > 0) && (_busy_waiters > 0);
+        _mutex.unlock();
+        while (waiters) {
+            rtos::ThisThread::sleep_for(1);
+            _mutex.lock();
+            waiters = (_busy_waiters > 0);
+            _mutex.unlock();
+        }
     }
 
 exit_point:
-    if (erase_failed) {
-        _mutex->unlock();
+    if (!erase_failed) {
+        _mutex.lock();
+    }
+    _record_call(SPIF_BD_CALL_ERASE, timer, status);
+    _mutex.unlock();
+
+    return status;
+}
+
+int SPIFBlockDevicePD::sync()
+{
+    if (!_is_initialized) {
+        return BD_ERROR_DEVICE_ERROR;
+    }
+
+    int status = SPIF_BD_ERROR_OK;
+
+    _mutex.lock();
+
+    // An erase of another thread waiting with the lock released completes first
+    _wait_for_busy_op();
+
+    // Only a timed out operation can still be running, it gets the same time again
+    if (!_is_device_idle && !_is_mem_ready(_timed_out_op)) {
+        tr_error("device still busy");
+        status = SPIF_BD_ERROR_READY_FAILED;
     }
 
+    _mutex.unlock();
+
     return status;
 }
 
+int SPIFBlockDevicePD::program_async(const void *buffer, bd_addr_t addr, bd_size_t size, Callback<void(int)> done)
+{
+    async_op op = {false, buffer, addr, size, done};
+    return _async_submit(op);
+}
+
+int SPIFBlockDevicePD::erase_async(bd_addr_t addr, bd_size_t size, Callback<void(int)> done)
+{
+    async_op op = {true, NULL, addr, size, done};
+    return _async_submit(op);
+}
+
 bd_size_t SPIFBlockDevicePD::get_read_size() const
 {
     // Assuming all devices support 1byte read granularity
@@ -513,213 +852,989 @@ const char *SPIFBlockDevicePD::get_type() const
     return "SPIF";
 }
 
-/***************************************************/
-/*********** SPI Driver API Functions **************/
-/***************************************************/
-spif_bd_error SPIFBlockDevicePD::_spi_set_frequency(int freq)
+int SPIFBlockDevicePD::get_latency_histogram(spif_bd_op op, spif_bd_latency_histogram &hist)
 {
-    _spi.frequency(freq);
+    if ((op < 0) || (op >= SPIF_BD_NUM_OPS)) {
+        return SPIF_BD_ERROR_DEVICE_ERROR;
+    }
+
+    _mutex.lock();
+    hist = _op_latency_hist_arr[op];
+    _mutex.unlock();
+
     return SPIF_BD_ERROR_OK;
 }
 
-spif_bd_error SPIFBlockDevicePD::_spi_send_read_command(int read_inst, uint8_t *buffer, bd_addr_t addr, bd_size_t size)
+void SPIFBlockDevicePD::reset_latency_histograms()
 {
-    uint32_t dummy_bytes = _dummy_and_mode_cycles / 8;
-    int dummy_byte = 0;
+    _mutex.lock();
+    memset(_op_latency_hist_arr, 0, sizeof(_op_latency_hist_arr));
+    memset(_call_latency_hist_arr, 0, sizeof(_call_latency_hist_arr));
+    _mutex.unlock();
+}
 
-    // csel must go low for the entire command (Inst, Address and Data)
-    _cs = 0;
+void SPIFBlockDevicePD::get_bus_stats(spif_bd_bus_stats &stats)
+{
+    _mutex.lock();
+    stats = _bus_stats;
+    _mutex.unlock();
+}
 
-    // Write 1 byte Instruction
-    _spi.write(read_inst);
+void SPIFBlockDevicePD::reset_bus_stats()
+{
+    _mutex.lock();
+    memset(&_bus_stats, 0, sizeof(_bus_stats));
+    _mutex.unlock();
+}
 
-    // Write Address (can be either 3 or 4 bytes long)
-    for (int address_shift = ((_address_size - 1) * 8); address_shift >= 0; address_shift -= 8) {
-        _spi.write((addr >> address_shift) & 0xFF);
-    }
+void SPIFBlockDevicePD::set_program_mode(uint32_t flags)
+{
+    _mutex.lock();
+    _program_mode = flags;
+    _mutex.unlock();
+}
 
-    // Write Dummy Cycles Bytes
-    for (uint32_t i = 0; i < dummy_bytes; i++) {
-        _spi.write(dummy_byte);
-    }
+void SPIFBlockDevicePD::get_program_stats(spif_bd_program_stats &stats)
+{
+    _mutex.lock();
+    stats = _program_stats;
+    _mutex.unlock();
+}
+
+void SPIFBlockDevicePD::reset_program_stats()
+{
+    _mutex.lock();
+    memset(&_program_stats, 0, sizeof(_program_stats));
+    _mutex.unlock();
+}
 
-    // Read Data
-    for (bd_size_t i = 0; i < size; i++) {
-        buffer[i] = _spi.write(0);
+int SPIFBlockDevicePD::get_call_histogram(spif_bd_call call, spif_bd_latency_histogram &hist)
+{
+    if ((call < 0) || (call >= SPIF_BD_NUM_CALLS)) {
+        return SPIF_BD_ERROR_DEVICE_ERROR;
     }
 
-    // csel back to high
-    _cs = 1;
+    _mutex.lock();
+    hist = _call_latency_hist_arr[call];
+    _mutex.unlock();
+
     return SPIF_BD_ERROR_OK;
 }
 
-spif_bd_error SPIFBlockDevicePD::_spi_send_program_command(int prog_inst, const void *buffer, bd_addr_t addr,
-                                                         bd_size_t size)
+void SPIFBlockDevicePD::dump_stats()
 {
-    // Send Program (write) command to device driver
-    uint32_t dummy_bytes = _dummy_and_mode_cycles / 8;
-    int dummy_byte = 0;
-    uint8_t *data = (uint8_t *)buffer;
+    static const char *const op_names[SPIF_BD_NUM_OPS] = {
+        "program", "erase type 1", "erase type 2", "erase type 3", "erase type 4", "chip erase", "other"
+    };
+    static const char *const call_names[SPIF_BD_NUM_CALLS] = {"read()", "program()", "erase()"};
+    static const char *const bus_names[SPIF_BD_BUS_NUM_CMDS] = {"read", "program", "erase", "status", "other"};
+    spif_bd_latency_histogram hist;
+    spif_bd_bus_stats bus;
+
+    // Each table is copied under the lock and printed without it, printing is slow
+    printf("SPIF ready waits: count, avg us, max us, timeouts, avg polls, max polls\n");
+    for (int i_ind = 0; i_ind < SPIF_BD_NUM_OPS; i_ind++) {
+        get_latency_histogram((spif_bd_op)i_ind, hist);
+        if (hist.count == 0) {
+            continue;
+        }
+        printf("  %-12s %8" PRIu32 " %10" PRIu64 " %10" PRIu32 " %6" PRIu32 " %6" PRIu64 " %6" PRIu32 "\n", op_names[i_ind], hist.count,
+               hist.total_us / hist.count, hist.max_us, hist.timeouts, hist.total_polls / hist.count, hist.max_polls);
+        for (int b_ind = 0; b_ind < SPIF_LATENCY_HISTOGRAM_BUCKETS; b_ind++) {
+            if (hist.bucket[b_ind]) {
+                printf("    >= %8lu us: %" PRIu32 "\n", (b_ind == 0) ? 0UL : (1UL << b_ind), hist.bucket[b_ind]);
+            }
+        }
+    }
 
-    // csel must go low for the entire command (Inst, Address and Data)
-    _cs = 0;
+    printf("SPIF calls: count, avg us, max us, failed\n");
+    for (int i_ind = 0; i_ind < SPIF_BD_NUM_CALLS; i_ind++) {
+        get_call_histogram((spif_bd_call)i_ind, hist);
+        if (hist.count == 0) {
+            continue;
+        }
+        printf("  %-12s %8" PRIu32 " %10" PRIu64 " %10" PRIu32 " %6" PRIu32 "\n", call_names[i_ind], hist.count,
+               hist.total_us / hist.count, hist.max_us, hist.timeouts);
+    }
 
-    // Write 1 byte Instruction
-    _spi.write(prog_inst);
+    spif_bd_program_stats prog;
+    get_program_stats(prog);
+    printf("SPIF pages: programmed %" PRIu32 ", skipped %" PRIu32 ", verified %" PRIu32 ", verify failures %" PRIu32 "\n",
+           prog.pages_programmed, prog.pages_skipped, prog.pages_verified, prog.verify_failures);
 
-    // Write Address (can be either 3 or 4 bytes long)
-    for (int address_shift = ((_address_size - 1) * 8); address_shift >= 0; address_shift -= 8) {
-        _spi.write((addr >> address_shift) & 0xFF);
+    get_bus_stats(bus);
+    printf("SPIF bus: transactions, bytes\n");
+    for (int i_ind = 0; i_ind < SPIF_BD_BUS_NUM_CMDS; i_ind++) {
+        printf("  %-12s %8" PRIu32 " %10" PRIu64 "\n", bus_names[i_ind], bus.transactions[i_ind], bus.bytes[i_ind]);
+    }
+
+    _mutex.lock();
+    if (_erase_counters != NULL) {
+        uint64_t total = 0;
+        uint32_t max_ind = 0;
+        uint32_t unit_size = _erase_counter_unit_size;
+        uint32_t count = _erase_counters_count;
+        for (uint32_t i_ind = 0; i_ind < count; i_ind++) {
+            total += _erase_counters[i_ind];
+            if (_erase_counters[i_ind] > _erase_counters[max_ind]) {
+                max_ind = i_ind;
+            }
+        }
+        uint32_t max_count = _erase_counters[max_ind];
+        _mutex.unlock();
+
+        printf("SPIF erases: %" PRIu32 " units of %" PRIu32 " bytes, total %" PRIu64 ", avg %" PRIu64 ", max %" PRIu32 " at 0x%" PRIx32 "\n",
+               count, unit_size, total, total / count, max_count, max_ind * unit_size);
+    } else {
+        _mutex.unlock();
     }
+}
+
+/***************************************************/
+/************** Wear Statistics Functions **********/
+/***************************************************/
+int SPIFBlockDevicePD::enable_erase_counters(bd_size_t unit_size)
+{
+    int status = SPIF_BD_ERROR_OK;
+
+    _mutex.lock();
 
-    // Write Dummy Cycles Bytes
-    for (uint32_t i = 0; i < dummy_bytes; i++) {
-        _spi.write(dummy_byte);
+    if (unit_size == 0) {
+        unit_size = _min_common_erase_size;
     }
 
-    // Write Data
-    for (bd_size_t i = 0; i < size; i++) {
-        _spi.write(data[i]);
+    if (!_is_initialized || (unit_size == 0) || (_min_common_erase_size == 0) ||
+            (unit_size % _min_common_erase_size) || (unit_size > UINT32_MAX)) {
+        tr_error("invalid erase counter unit size %llu", unit_size);
+        status = SPIF_BD_ERROR_DEVICE_ERROR;
+    } else if ((_erase_counters == NULL) || (unit_size != _erase_counter_unit_size)) {
+        delete[] _erase_counters;
+        _erase_counter_unit_size = unit_size;
+        _erase_counters_count = (_device_size_bytes + unit_size - 1) / unit_size;
+        _erase_counters = new uint16_t[_erase_counters_count];
+        memset(_erase_counters, 0, _erase_counters_count * sizeof(uint16_t));
     }
 
-    // csel back to high
-    _cs = 1;
+    _mutex.unlock();
 
-    return SPIF_BD_ERROR_OK;
+    return status;
 }
 
-spif_bd_error SPIFBlockDevicePD::_spi_send_erase_command(int erase_inst, bd_addr_t addr, bd_size_t size)
+void SPIFBlockDevicePD::disable_erase_counters()
 {
-    debug_if(MBED_CONF_SPIF_DRIVER_DEBUG, "DEBUG: Erase Inst: 0x%xh, addr: %llu, size: %llu", erase_inst, addr, size);
-    addr = (((int)addr) & 0xFFFFF000);
-    _spi_send_general_command(erase_inst, addr, NULL, 0, NULL, 0);
-    return SPIF_BD_ERROR_OK;
+    _mutex.lock();
+    delete[] _erase_counters;
+    _erase_counters = NULL;
+    _erase_counters_count = 0;
+    _erase_counter_unit_size = 0;
+    _mutex.unlock();
 }
 
-spif_bd_error SPIFBlockDevicePD::_spi_send_general_command(int instruction, bd_addr_t addr, char *tx_buffer,
-                                                         size_t tx_length, char *rx_buffer, size_t rx_length)
+int SPIFBlockDevicePD::get_erase_count(bd_addr_t addr, uint32_t &count)
 {
-    // Send a general command Instruction to driver
-    uint32_t dummy_bytes = _dummy_and_mode_cycles / 8;
-    uint8_t dummy_byte = 0x00;
+    int status = SPIF_BD_ERROR_OK;
 
-    // csel must go low for the entire command (Inst, Address and Data)
-    _cs = 0;
+    _mutex.lock();
+    if ((_erase_counters == NULL) || (addr >= _device_size_bytes)) {
+        status = SPIF_BD_ERROR_DEVICE_ERROR;
+    } else {
+        count = _erase_counters[addr / _erase_counter_unit_size];
+    }
+    _mutex.unlock();
 
-    // Write 1 byte Instruction
-    _spi.write(instruction);
+    return status;
+}
 
-    // Reading SPI Bus registers does not require Flash Address
-    if (addr != SPI_NO_ADDRESS_COMMAND) {
-        // Write Address (can be either 3 or 4 bytes long)
-        for (int address_shift = ((_address_size - 1) * 8); address_shift >= 0; address_shift -= 8) {
-            _spi.write((addr >> address_shift) & 0xFF);
-        }
+bd_size_t SPIFBlockDevicePD::get_erase_counters_size()
+{
+    bd_size_t size = 0;
 
-        // Write Dummy Cycles Bytes
-        for (uint32_t i = 0; i < dummy_bytes; i++) {
-            _spi.write(dummy_byte);
-        }
+    _mutex.lock();
+    if (_erase_counters != NULL) {
+        size = sizeof(erase_counters_header) + (_erase_counters_count * sizeof(uint16_t));
+        size = ((size + _min_common_erase_size - 1) / _min_common_erase_size) * _min_common_erase_size;
     }
+    _mutex.unlock();
 
-    // Read/Write Data
-    _spi.write(tx_buffer, (int)tx_length, rx_buffer, (int)rx_length);
-
-    // csel back to high
-    _cs = 1;
-
-    return SPIF_BD_ERROR_OK;
+    return size;
 }
 
-/*********************************************************/
-/********** SFDP Parsing and Detection Functions *********/
-/*********************************************************/
-int SPIFBlockDevicePD::_sfdp_parse_sector_map_table(uint32_t sector_map_table_addr, size_t sector_map_table_size)
+int SPIFBlockDevicePD::flush_erase_counters(bd_addr_t addr)
 {
-    uint8_t sector_map_table[SFDP_DEFAULT_BASIC_PARAMS_TABLE_SIZE_BYTES]; /* Up To 16 DWORDS = 64 Bytes */
-    uint32_t tmp_region_size = 0;
-    int i_ind = 0;
-    int prev_boundary = 0;
-    // Default set to all type bits 1-4 are common
-    int min_common_erase_type_bits = ERASE_BITMASK_ALL;
+    erase_counters_header header;
+    uint8_t buffer[SPIF_DEFAULT_PAGE_SIZE];
+    mbed::MbedCRC<POLY_32BIT_ANSI, 32> ct;
+    uint32_t crc = 0;
+    bd_size_t area_size = get_erase_counters_size();
+
+    if (area_size == 0) {
+        return SPIF_BD_ERROR_DEVICE_ERROR;
+    }
 
+    _mutex.lock();
+    header.magic = SPIF_ERASE_COUNTERS_MAGIC;
+    header.unit_size = _erase_counter_unit_size;
+    header.count = _erase_counters_count;
+    _mutex.unlock();
 
-    spif_bd_error status = _spi_send_read_command(SPIF_SFDP, sector_map_table, sector_map_table_addr /*address*/,
-                                                  sector_map_table_size);
+    int status = erase(addr, area_size);
     if (status != SPIF_BD_ERROR_OK) {
-        tr_error("init - Read SFDP First Table Failed");
-        return -1;
+        return status;
     }
 
-    // Currently we support only Single Map Descriptor
-    if (!((sector_map_table[0] & 0x3) == 0x03) && (sector_map_table[1]  == 0x0)) {
-        tr_error("Sector Map - Supporting Only Single! Map Descriptor (not map commands)");
-        return -1;
+    // Counters are copied a page at a time so other threads can keep erasing (and counting),
+    // the CRC covers the copies that are programmed
+    ct.compute_partial_start(&crc);
+    uint32_t data_size = header.count * sizeof(uint16_t);
+    for (uint32_t offset = 0; offset < data_size; offset += sizeof(buffer)) {
+        uint32_t chunk = ((data_size - offset) < sizeof(buffer)) ? (data_size - offset) : sizeof(buffer);
+
+        _mutex.lock();
+        if ((_erase_counters == NULL) || (_erase_counters_count != header.count)) {
+            // Disabled or resized meanwhile
+            _mutex.unlock();
+            return SPIF_BD_ERROR_DEVICE_ERROR;
+        }
+        memcpy(buffer, reinterpret_cast<uint8_t *>(_erase_counters) + offset, chunk);
+        _mutex.unlock();
+
+        ct.compute_partial(buffer, chunk, &crc);
+        status = program(buffer, addr + sizeof(header) + offset, chunk);
+        if (status != SPIF_BD_ERROR_OK) {
+            return status;
+        }
     }
+    ct.compute_partial_stop(&crc);
 
-    _regions_count = sector_map_table[2] + 1;
-    if (_regions_count > SPIF_MAX_REGIONS) {
-        tr_error("Supporting up to %d regions, current setup to %d regions - fail",
-                 SPIF_MAX_REGIONS, _regions_count);
-        return -1;
+    // Header goes last, an interrupted flush leaves no valid header behind
+    header.crc = crc;
+    return program(&header, addr, sizeof(header));
+}
+
+int SPIFBlockDevicePD::load_erase_counters(bd_addr_t addr)
+{
+    erase_counters_header header;
+    uint8_t buffer[SPIF_DEFAULT_PAGE_SIZE];
+    mbed::MbedCRC<POLY_32BIT_ANSI, 32> ct;
+    uint32_t crc = 0;
+
+    int status = read(&header, addr, sizeof(header));
+    if (status != SPIF_BD_ERROR_OK) {
+        return status;
     }
 
-    // Loop through Regions and set for each one: size, supported erase types, high boundary offset
-    // Calculate minimum Common Erase Type for all Regions
-    for (i_ind = 0; i_ind < _regions_count; i_ind++) {
-        tmp_region_size = ((*((uint32_t *)&sector_map_table[(i_ind + 1) * 4])) >> 8) & 0x00FFFFFF; // bits 9-32
-        _region_size_bytes[i_ind] = (tmp_region_size + 1) * 256; // Region size is 0 based multiple of 256 bytes;
-        _region_erase_types_bitfield[i_ind] = sector_map_table[(i_ind + 1) * 4] & 0x0F; // bits 1-4
-        min_common_erase_type_bits &= _region_erase_types_bitfield[i_ind];
-        _region_high_boundary[i_ind] = (_region_size_bytes[i_ind] - 1) + prev_boundary;
-        prev_boundary = _region_high_boundary[i_ind] + 1;
+    _mutex.lock();
+    if (_erase_counters == NULL) {
+        status = SPIF_BD_ERROR_DEVICE_ERROR;
+    } else if ((header.magic != SPIF_ERASE_COUNTERS_MAGIC) || (header.unit_size != _erase_counter_unit_size) ||
+               (header.count != _erase_counters_count)) {
+        status = SPIF_BD_ERROR_PARSING_FAILED;
+    }
+    _mutex.unlock();
+    if (status != SPIF_BD_ERROR_OK) {
+        return status;
     }
 
-    // Calc minimum Common Erase Size from min_common_erase_type_bits
-    uint8_t type_mask = ERASE_BITMASK_TYPE1;
-    for (i_ind = 0; i_ind < 4; i_ind++) {
-        if (min_common_erase_type_bits & type_mask) {
-            _min_common_erase_size = _erase_type_size_arr[i_ind];
-            break;
+    // Verify the whole area first so a corrupt copy never replaces the counters
+    uint32_t data_size = header.count * sizeof(uint16_t);
+    ct.compute_partial_start(&crc);
+    for (uint32_t offset = 0; offset < data_size; offset += sizeof(buffer)) {
+        uint32_t chunk = ((data_size - offset) < sizeof(buffer)) ? (data_size - offset) : sizeof(buffer);
+        status = read(buffer, addr + sizeof(header) + offset, chunk);
+        if (status != SPIF_BD_ERROR_OK) {
+            return status;
         }
-        type_mask = type_mask << 1;
+        ct.compute_partial(buffer, chunk, &crc);
+    }
+    ct.compute_partial_stop(&crc);
+    if (crc != header.crc) {
+        tr_error("stored erase counters CRC mismatch");
+        return SPIF_BD_ERROR_PARSING_FAILED;
     }
 
-    if (i_ind == 4) {
-        // No common erase type was found between regions
-        _min_common_erase_size = 0;
+    // Counting went on since the flush, add the stored counts to the current ones
+    for (uint32_t offset = 0; offset < data_size; offset += sizeof(buffer)) {
+        uint32_t chunk = ((data_size - offset) < sizeof(buffer)) ? (data_size - offset) : sizeof(buffer);
+        status = read(buffer, addr + sizeof(header) + offset, chunk);
+        if (status != SPIF_BD_ERROR_OK) {
+            return status;
+        }
+
+        _mutex.lock();
+        if ((_erase_counters == NULL) || (_erase_counters_count != header.count)) {
+            _mutex.unlock();
+            return SPIF_BD_ERROR_DEVICE_ERROR;
+        }
+        const uint16_t *stored = reinterpret_cast<const uint16_t *>(buffer);
+        uint16_t *current = &_erase_counters[offset / sizeof(uint16_t)];
+        for (uint32_t i_ind = 0; i_ind < (chunk / sizeof(uint16_t)); i_ind++) {
+            uint32_t sum = (uint32_t)current[i_ind] + stored[i_ind];
+            current[i_ind] = (sum > UINT16_MAX) ? UINT16_MAX : sum;
+        }
+        _mutex.unlock();
     }
 
-    return 0;
+    return SPIF_BD_ERROR_OK;
 }
 
-int SPIFBlockDevicePD::_sfdp_parse_basic_param_table(uint32_t basic_table_addr, size_t basic_table_size)
+void SPIFBlockDevicePD::_count_erase(bd_addr_t addr, bd_size_t size)
 {
-    uint8_t param_table[SFDP_DEFAULT_BASIC_PARAMS_TABLE_SIZE_BYTES]; /* Up To 16 DWORDS = 64 Bytes */
-    //memset(param_table, 0, SFDP_DEFAULT_BASIC_PARAMS_TABLE_SIZE_BYTES);
+    if (_erase_counters == NULL) {
+        return;
+    }
+
+    uint32_t last = (addr + size - 1) / _erase_counter_unit_size;
+    for (uint32_t i_ind = addr / _erase_counter_unit_size; (i_ind <= last) && (i_ind < _erase_counters_count); i_ind++) {
+        if (_erase_counters[i_ind] < UINT16_MAX) {
+            _erase_counters[i_ind]++;
+        }
+    }
+}
+
+/***************************************************/
+/********** Asynchronous Operation Functions *******/
+/***************************************************/
+int SPIFBlockDevicePD::_async_start_thread()
+{
+    // The queue buffer and the thread stack are only allocated once something is queued
+    if (!_async_thread_started) {
+        if (_async_queue == NULL) {
+            _async_queue = new events::EventQueue(SPIF_ASYNC_QUEUE_SIZE);
+        }
+        if (osOK != _async_thread.start(mbed::callback(_async_queue, &events::EventQueue::dispatch_forever))) {
+            tr_error("Starting asynchronous operation thread failed");
+            return SPIF_BD_ERROR_DEVICE_ERROR;
+        }
+        _async_thread_started = true;
+    }
+    return SPIF_BD_ERROR_OK;
+}
+
+void SPIFBlockDevicePD::_async_stop_thread()
+{
+    if (_async_thread_started) {
+        _async_queue->break_dispatch();
+        _async_thread.join();
+        _async_thread_started = false;
+    }
+    delete _async_queue;
+    _async_queue = NULL;
+}
+
+int SPIFBlockDevicePD::_async_submit(const async_op &op)
+{
+    if (!_is_initialized) {
+        return BD_ERROR_DEVICE_ERROR;
+    }
+
+    _mutex.lock();
+    int status = _async_start_thread();
+    _mutex.unlock();
 
-    spif_bd_error status = _spi_send_read_command(SPIF_SFDP, param_table, basic_table_addr /*address*/,
-                                                  basic_table_size);
     if (status != SPIF_BD_ERROR_OK) {
-        tr_error("init - Read SFDP First Table Failed");
+        return status;
+    }
+
+    if (0 == _async_queue->call(this, &SPIFBlockDevicePD::_async_run, op)) {
+        tr_error("Asynchronous operation queue full");
+        return SPIF_BD_ERROR_ASYNC_QUEUE_FULL;
+    }
+
+    return SPIF_BD_ERROR_OK;
+}
+
+void SPIFBlockDevicePD::_async_run(async_op op)
+{
+    // program() and erase() take the mutex per page/erase chunk, so synchronous
+    // callers interleave with the queued operation rather than wait for all of it
+    int status = op.is_erase ? erase(op.addr, op.size) : program(op.buffer, op.addr, op.size);
+
+    if (op.done) {
+        op.done(status);
+    }
+}
+
+/***************************************************/
+/********* SFDP Configuration Cache Functions ******/
+/***************************************************/
+int SPIFBlockDevicePD::get_sfdp_descriptor(spif_bd_sfdp_descriptor &desc)
+{
+    int status = SPIF_BD_ERROR_OK;
+
+    _mutex.lock();
+    if (_sfdp_cache_valid) {
+        desc = _sfdp_cache;
+    } else {
+        status = SPIF_BD_ERROR_DEVICE_ERROR;
+    }
+    _mutex.unlock();
+
+    return status;
+}
+
+int SPIFBlockDevicePD::set_sfdp_descriptor(const spif_bd_sfdp_descriptor &desc)
+{
+    if ((desc.version != SPIF_SFDP_DESCRIPTOR_VERSION) || (desc.regions_count == 0) ||
+            (desc.regions_count > SPIF_MAX_REGIONS) || (desc.crc != _sfdp_descriptor_crc(desc))) {
+        tr_error("Invalid SFDP descriptor");
+        return SPIF_BD_ERROR_PARSING_FAILED;
+    }
+
+    _mutex.lock();
+    _sfdp_cache = desc;
+    _sfdp_cache_valid = true;
+    _mutex.unlock();
+
+    return SPIF_BD_ERROR_OK;
+}
+
+void SPIFBlockDevicePD::_sfdp_descriptor_store(spif_bd_sfdp_descriptor &desc, const uint8_t *jedec_id)
+{
+    // Clear padding too, the CRC covers the raw bytes
+    memset(&desc, 0, sizeof(desc));
+
+    desc.version = SPIF_SFDP_DESCRIPTOR_VERSION;
+    memcpy(desc.jedec_id, jedec_id, sizeof(desc.jedec_id));
+    desc.read_instruction = _read_instruction;
+    desc.prog_instruction = _prog_instruction;
+    desc.erase_instruction = _erase_instruction;
+    desc.erase4k_inst = _erase4k_inst;
+    desc.address_mode = _address_mode;
+    desc.read_dummy_and_mode_cycles = _read_dummy_and_mode_cycles;
+    desc.dpd_enter_inst = _dpd_enter_inst;
+    desc.dpd_exit_inst = _dpd_exit_inst;
+    desc.suspend_inst = _suspend_inst;
+    desc.resume_inst = _resume_inst;
+    desc.regions_count = _regions_count;
+    for (int i_ind = 0; i_ind < MAX_NUM_OF_ERASE_TYPES; i_ind++) {
+        desc.erase_type_inst_arr[i_ind] = _erase_type_inst_arr[i_ind];
+        desc.erase_type_size_arr[i_ind] = _erase_type_size_arr[i_ind];
+    }
+    for (int i_ind = 0; i_ind < _regions_count; i_ind++) {
+        desc.region_erase_types_bitfield[i_ind] = _region_erase_types_bitfield[i_ind];
+        desc.region_size_bytes[i_ind] = _region_size_bytes[i_ind];
+    }
+    desc.min_common_erase_size = _min_common_erase_size;
+    desc.page_size_bytes = _page_size_bytes;
+    desc.device_size_bytes = _device_size_bytes;
+    desc.dpd_exit_delay_us = _dpd_exit_delay_us;
+    desc.suspend_latency_us = _suspend_latency_us;
+    desc.resume_to_suspend_us = _resume_to_suspend_us;
+    memcpy(desc.op_typ_time_us_arr, _op_typ_time_us_arr, sizeof(desc.op_typ_time_us_arr));
+    memcpy(desc.op_max_time_us_arr, _op_max_time_us_arr, sizeof(desc.op_max_time_us_arr));
+    desc.crc = _sfdp_descriptor_crc(desc);
+}
+
+void SPIFBlockDevicePD::_sfdp_descriptor_load(const spif_bd_sfdp_descriptor &desc)
+{
+    bd_size_t prev_boundary = 0;
+
+    _read_instruction = desc.read_instruction;
+    _prog_instruction = desc.prog_instruction;
+    _erase_instruction = desc.erase_instruction;
+    _erase4k_inst = desc.erase4k_inst;
+    _address_mode = desc.address_mode;
+    _read_dummy_and_mode_cycles = desc.read_dummy_and_mode_cycles;
+    _dpd_enter_inst = desc.dpd_enter_inst;
+    _dpd_exit_inst = desc.dpd_exit_inst;
+    _suspend_inst = desc.suspend_inst;
+    _resume_inst = desc.resume_inst;
+    _regions_count = desc.regions_count;
+    for (int i_ind = 0; i_ind < MAX_NUM_OF_ERASE_TYPES; i_ind++) {
+        _erase_type_inst_arr[i_ind] = desc.erase_type_inst_arr[i_ind];
+        _erase_type_size_arr[i_ind] = desc.erase_type_size_arr[i_ind];
+    }
+    // Region boundaries follow from the region sizes
+    for (int i_ind = 0; i_ind < _regions_count; i_ind++) {
+        _region_erase_types_bitfield[i_ind] = desc.region_erase_types_bitfield[i_ind];
+        _region_size_bytes[i_ind] = desc.region_size_bytes[i_ind];
+        _region_high_boundary[i_ind] = (_region_size_bytes[i_ind] - 1) + prev_boundary;
+        prev_boundary = _region_high_boundary[i_ind] + 1;
+    }
+    _min_common_erase_size = desc.min_common_erase_size;
+    _page_size_bytes = desc.page_size_bytes;
+    _device_size_bytes = desc.device_size_bytes;
+    _dpd_exit_delay_us = desc.dpd_exit_delay_us;
+    _suspend_latency_us = desc.suspend_latency_us;
+    _resume_to_suspend_us = desc.resume_to_suspend_us;
+    memcpy(_op_typ_time_us_arr, desc.op_typ_time_us_arr, sizeof(_op_typ_time_us_arr));
+    memcpy(_op_max_time_us_arr, desc.op_max_time_us_arr, sizeof(_op_max_time_us_arr));
+}
+
+uint32_t SPIFBlockDevicePD::_sfdp_descriptor_crc(const spif_bd_sfdp_descriptor &desc)
+{
+    mbed::MbedCRC<POLY_32BIT_ANSI, 32> ct;
+    uint32_t crc = 0;
+    ct.compute((void *)&desc, offsetof(spif_bd_sfdp_descriptor, crc), &crc);
+    return crc;
+}
+
+/***************************************************/
+/************* Idle Manager Functions **************/
+/***************************************************/
+int SPIFBlockDevicePD::set_idle_timeout(uint32_t timeout_ms)
+{
+    int status = SPIF_BD_ERROR_OK;
+
+    _mutex.lock();
+
+    _idle_timeout_ms = timeout_ms;
+    if (timeout_ms != 0) {
+        status = _async_start_thread();
+        if (status == SPIF_BD_ERROR_OK) {
+            _last_access_ms = rtos::Kernel::get_ms_count();
+            _schedule_idle_check(timeout_ms);
+        }
+    }
+
+    _mutex.unlock();
+
+    return status;
+}
+
+void SPIFBlockDevicePD::_power_up_for_access()
+{
+    if (_is_powered_down) {
+        _set_deep_power_down(false);
+    }
+
+    _last_access_ms = rtos::Kernel::get_ms_count();
+    if (_idle_timeout_ms != 0) {
+        _schedule_idle_check(_idle_timeout_ms);
+    }
+}
+
+void SPIFBlockDevicePD::_schedule_idle_check(uint32_t delay_ms)
+{
+    // A single check is pending at a time, it reschedules itself while the device is in use
+    if (_idle_event_id == 0) {
+        _idle_event_id = _async_queue->call_in(delay_ms, this, &SPIFBlockDevicePD::_idle_check);
+    }
+}
+
+void SPIFBlockDevicePD::_idle_check()
+{
+    _mutex.lock();
+
+    _idle_event_id = 0;
+
+    if (_is_initialized && !_is_powered_down && (_idle_timeout_ms != 0) && (_busy_op != SPIF_BD_OP_OTHER)) {
+        // An erase is waiting with _mutex released, check again later
+        _schedule_idle_check(_idle_timeout_ms);
+    } else if (_is_initialized && !_is_powered_down && (_idle_timeout_ms != 0)) {
+        uint64_t idle_ms = rtos::Kernel::get_ms_count() - _last_access_ms;
+        if (idle_ms >= _idle_timeout_ms) {
+            // Operations wait for the device to be ready before releasing _mutex, so it is idle here
+            debug_if(MBED_CONF_SPIF_DRIVER_DEBUG, "DEBUG: idle for %llu ms, entering Deep Power-Down", idle_ms);
+            _set_deep_power_down(true);
+        } else {
+            _schedule_idle_check(_idle_timeout_ms - (uint32_t)idle_ms);
+        }
+    }
+
+    _mutex.unlock();
+}
+
+void SPIFBlockDevicePD::_set_deep_power_down(bool enable)
+{
+    // Single byte command, sent directly like the original power down in deinit()
+    _spi_count_transaction(SPIF_BD_BUS_OTHER, 1);
+    _is_device_idle = false;
+
+    _spi.lock();
+    _cs = 0;
+    _spi.write(enable ? _dpd_enter_inst : _dpd_exit_inst);
+    _cs = 1;
+    _spi.unlock();
+
+    if (!enable) {
+        // Device ignores commands until tRES1 has passed
+        wait_us(_dpd_exit_delay_us);
+    }
+    _is_powered_down = enable;
+}
+
+/***************************************************/
+/*********** SPI Driver API Functions **************/
+/***************************************************/
+spif_bd_error SPIFBlockDevicePD::_spi_set_frequency(int freq)
+{
+    _spi.frequency(freq);
+    return SPIF_BD_ERROR_OK;
+}
+
+bool SPIFBlockDevicePD::_is_erase_instruction(int instruction)
+{
+    if ((instruction == SPIF_CE) || (instruction == _erase_instruction) || (instruction == _erase4k_inst)) {
+        return true;
+    }
+    for (int i_ind = 0; i_ind < MAX_NUM_OF_ERASE_TYPES; i_ind++) {
+        if (instruction == _erase_type_inst_arr[i_ind]) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void SPIFBlockDevicePD::_spi_count_transaction(spif_bd_bus_cmd cmd, size_t bytes)
+{
+    _bus_stats.transactions[cmd]++;
+    _bus_stats.bytes[cmd] += bytes;
+}
+
+int SPIFBlockDevicePD::_spi_build_command_header(uint8_t *header, int instruction, bd_addr_t addr,
+                                                 uint32_t dummy_bytes)
+{
+    int header_length = 0;
+
+    // 1 byte Instruction
+    header[header_length++] = instruction;
+
+    // Address (can be either 3 or 4 bytes long)
+    for (int address_shift = ((_address_size - 1) * 8); address_shift >= 0; address_shift -= 8) {
+        header[header_length++] = (addr >> address_shift) & 0xFF;
+    }
+
+    // Dummy Cycles Bytes
+    if (dummy_bytes > SPIF_MAX_DUMMY_BYTES) {
+        dummy_bytes = SPIF_MAX_DUMMY_BYTES;
+    }
+    memset(&header[header_length], 0, dummy_bytes);
+    header_length += dummy_bytes;
+
+    return header_length;
+}
+
+uint8_t *SPIFBlockDevicePD::_iov_next_piece(iov_pos &pos, uint32_t &size)
+{
+    // Skip entries already consumed, including empty ones
+    while (pos.offset >= pos.iov->len) {
+        pos.iov++;
+        pos.offset = 0;
+    }
+
+    uint8_t *piece = static_cast<uint8_t *>(pos.iov->base) + pos.offset;
+    if (size > (pos.iov->len - pos.offset)) {
+        size = pos.iov->len - pos.offset;
+    }
+    pos.offset += size;
+
+    return piece;
+}
+
+spif_bd_error SPIFBlockDevicePD::_spi_send_read_command(int read_inst, uint8_t *buffer, bd_addr_t addr, bd_size_t size)
+{
+    spif_bd_iovec iov = { buffer, (uint32_t)size };
+    iov_pos pos = { &iov, 0 };
+    return _spi_send_readv_command(read_inst, pos, addr, size);
+}
+
+spif_bd_error SPIFBlockDevicePD::_spi_send_readv_command(int read_inst, iov_pos pos, bd_addr_t addr, bd_size_t size)
+{
+    uint8_t header[SPIF_MAX_COMMAND_HEADER_SIZE];
+    int header_length = _spi_build_command_header(header, read_inst, addr, _dummy_and_mode_cycles / 8);
+
+    _spi_count_transaction(SPIF_BD_BUS_READ, header_length + size);
+
+    // csel must go low for the entire command (Inst, Address and Data)
+    _spi.lock();
+    _cs = 0;
+
+    // Write Instruction, Address and Dummy Cycles Bytes in a single transfer
+    _spi.write((const char *)header, header_length, NULL, 0);
+
+    // Read Data as block transfers rather than clocking each byte separately,
+    // moving on to the next buffer without releasing csel
+    while (size > 0) {
+        uint32_t chunk = (size > SPIF_MAX_BLOCK_TRANSFER_SIZE) ? SPIF_MAX_BLOCK_TRANSFER_SIZE : (uint32_t)size;
+        uint8_t *buffer = _iov_next_piece(pos, chunk);
+        _spi.write(NULL, 0, (char *)buffer, chunk);
+        size -= chunk;
+    }
+
+    // csel back to high
+    _cs = 1;
+    _spi.unlock();
+    return SPIF_BD_ERROR_OK;
+}
+
+spif_bd_error SPIFBlockDevicePD::_spi_send_program_command(int prog_inst, iov_pos pos, bd_addr_t addr,
+                                                         bd_size_t size)
+{
+    // Send Program (write) command to device driver
+    uint8_t header[SPIF_MAX_COMMAND_HEADER_SIZE];
+    int header_length = _spi_build_command_header(header, prog_inst, addr, _dummy_and_mode_cycles / 8);
+
+    _spi_count_transaction(SPIF_BD_BUS_PROGRAM, header_length + size);
+    _is_device_idle = false;
+
+    // csel must go low for the entire command (Inst, Address and Data)
+    _spi.lock();
+    _cs = 0;
+
+    // Write Instruction, Address and Dummy Cycles Bytes in a single transfer
+    _spi.write((const char *)header, header_length, NULL, 0);
+
+    // Write Data (a program never exceeds a single page, so this is usually one transfer per buffer),
+    // the device only starts programming once csel goes high, so buffers can be streamed back to back
+    while (size > 0) {
+        uint32_t chunk = (size > SPIF_MAX_BLOCK_TRANSFER_SIZE) ? SPIF_MAX_BLOCK_TRANSFER_SIZE : (uint32_t)size;
+        const uint8_t *data = _iov_next_piece(pos, chunk);
+        _spi.write((const char *)data, chunk, NULL, 0);
+        size -= chunk;
+    }
+
+    // csel back to high
+    _cs = 1;
+    _spi.unlock();
+
+    return SPIF_BD_ERROR_OK;
+}
+
+spif_bd_error SPIFBlockDevicePD::_spi_send_erase_command(int erase_inst, bd_addr_t addr, bd_size_t size)
+{
+    // addr is aligned to the erase type size by erase(), so it is sent as is
+    debug_if(MBED_CONF_SPIF_DRIVER_DEBUG, "DEBUG: Erase Inst: 0x%xh, addr: %llu, size: %llu", erase_inst, addr, size);
+    _spi_send_general_command(erase_inst, addr, NULL, 0, NULL, 0);
+    return SPIF_BD_ERROR_OK;
+}
+
+spif_bd_error SPIFBlockDevicePD::_spi_send_general_command(int instruction, bd_addr_t addr, char *tx_buffer,
+                                                         size_t tx_length, char *rx_buffer, size_t rx_length)
+{
+    // Send a general command Instruction to driver
+    uint8_t header[SPIF_MAX_COMMAND_HEADER_SIZE];
+    int header_length = 1;
+
+    // Reading SPI Bus registers does not require Flash Address
+    if (addr != SPI_NO_ADDRESS_COMMAND) {
+        header_length = _spi_build_command_header(header, instruction, addr, _dummy_and_mode_cycles / 8);
+    } else {
+        header[0] = instruction;
+    }
+
+    // Anything but status/ID reads and write enable/disable may start an internal operation
+    if ((instruction != SPIF_RDSR) && (instruction != SPIF_RDID) && (instruction != SPIF_WREN) &&
+            (instruction != SPIF_WRDI)) {
+        _is_device_idle = false;
+    }
+
+    if (instruction == SPIF_RDSR) {
+        _spi_count_transaction(SPIF_BD_BUS_STATUS, header_length + tx_length + rx_length);
+    } else if (_is_erase_instruction(instruction)) {
+        _spi_count_transaction(SPIF_BD_BUS_ERASE, header_length + tx_length + rx_length);
+    } else {
+        _spi_count_transaction(SPIF_BD_BUS_OTHER, header_length + tx_length + rx_length);
+    }
+
+    // csel must go low for the entire command (Inst, Address and Data)
+    _spi.lock();
+    _cs = 0;
+
+    // Write Instruction (and Address and Dummy Cycles Bytes if any) in a single transfer
+    _spi.write((const char *)header, header_length, NULL, 0);
+
+    // Read/Write Data
+    _spi.write(tx_buffer, (int)tx_length, rx_buffer, (int)rx_length);
+
+    // csel back to high
+    _cs = 1;
+    _spi.unlock();
+
+    return SPIF_BD_ERROR_OK;
+}
+
+/*********************************************************/
+/********** SFDP Parsing and Detection Functions *********/
+/*********************************************************/
+int SPIFBlockDevicePD::_sfdp_parse_sector_map_table(uint32_t sector_map_table_addr, size_t sector_map_table_size)
+{
+    uint8_t descriptor[SPIF_SECTOR_MAP_CMD_DESCRIPTOR_SIZE];
+    uint32_t addr = sector_map_table_addr;
+    uint32_t table_end = sector_map_table_addr + sector_map_table_size;
+    uint8_t config_id = 0;
+    int detection_commands_count = 0;
+    int i_ind = 0;
+    bd_size_t prev_boundary = 0;
+    // Default set to all type bits 1-4 are common
+    int min_common_erase_type_bits = ERASE_BITMASK_ALL;
+    spif_bd_error status = SPIF_BD_ERROR_OK;
+
+    // Configuration Detection Command Descriptors come first, each one reads a register bit
+    // and the concatenated results (first command is the MSB) form the current Configuration ID
+    while ((addr + SPIF_SECTOR_MAP_CMD_DESCRIPTOR_SIZE) <= table_end) {
+        status = _spi_send_read_command(SPIF_SFDP, descriptor, addr, SPIF_SECTOR_MAP_CMD_DESCRIPTOR_SIZE);
+        if (status != SPIF_BD_ERROR_OK) {
+            tr_error("init - Read Sector Map Descriptor Failed");
+            return -1;
+        }
+
+        if (descriptor[0] & SPIF_SECTOR_MAP_DESCRIPTOR_TYPE_MAP) {
+            break;
+        }
+
+        uint8_t detection_value = 0;
+        if (0 != _sfdp_run_detection_command(descriptor, detection_value)) {
+            tr_error("init - Sector Map Configuration Detection Command Failed");
+            return -1;
+        }
+        config_id = (config_id << 1) | ((detection_value & descriptor[3]) ? 1 : 0);
+        detection_commands_count++;
+        addr += SPIF_SECTOR_MAP_CMD_DESCRIPTOR_SIZE;
+    }
+
+    debug_if(MBED_CONF_SPIF_DRIVER_DEBUG, "DEBUG: Sector Map - %d detection commands, Configuration ID: %d",
+             detection_commands_count, config_id);
+
+    // Map Descriptors follow, use the one matching the Configuration ID (the only one if there are no commands)
+    while (true) {
+        if ((addr + SPIF_SECTOR_MAP_MAP_HEADER_SIZE) > table_end) {
+            tr_error("Sector Map - no Map Descriptor for Configuration ID %d", config_id);
+            return -1;
+        }
+
+        status = _spi_send_read_command(SPIF_SFDP, descriptor, addr, SPIF_SECTOR_MAP_MAP_HEADER_SIZE);
+        if ((status != SPIF_BD_ERROR_OK) || !(descriptor[0] & SPIF_SECTOR_MAP_DESCRIPTOR_TYPE_MAP)) {
+            tr_error("init - Read Sector Map Descriptor Failed");
+            return -1;
+        }
+
+        int regions_count = descriptor[2] + 1;
+        if ((detection_commands_count == 0) || (descriptor[1] == config_id)) {
+            _regions_count = regions_count;
+            addr += SPIF_SECTOR_MAP_MAP_HEADER_SIZE;
+            break;
+        }
+
+        if (descriptor[0] & SPIF_SECTOR_MAP_DESCRIPTOR_END) {
+            tr_error("Sector Map - no Map Descriptor for Configuration ID %d", config_id);
+            return -1;
+        }
+        addr += SPIF_SECTOR_MAP_MAP_HEADER_SIZE + (regions_count * 4);
+    }
+
+    if (_regions_count > SPIF_MAX_REGIONS) {
+        tr_error("Supporting up to %d regions, current setup to %d regions - fail",
+                 SPIF_MAX_REGIONS, _regions_count);
         return -1;
     }
 
-    // Check address size, currently only supports 3byte addresses
-    if ((param_table[2] & 0x4) != 0 || (param_table[7] & 0x80) != 0) {
-        tr_error("init - verify 3byte addressing Failed");
+    // Loop through Regions and set for each one: size, supported erase types, high boundary offset
+    // Calculate minimum Common Erase Type for all Regions
+    for (i_ind = 0; i_ind < _regions_count; i_ind++) {
+        status = _spi_send_read_command(SPIF_SFDP, descriptor, addr, 4);
+        if (status != SPIF_BD_ERROR_OK) {
+            tr_error("init - Read Sector Map Region %d Failed", i_ind);
+            return -1;
+        }
+        addr += 4;
+
+        // Region size is 0 based multiple of 256 bytes (bits 31-8)
+        uint32_t tmp_region_size = (descriptor[3] << 16) | (descriptor[2] << 8) | descriptor[1];
+        _region_size_bytes[i_ind] = (tmp_region_size + 1) * 256;
+        _region_erase_types_bitfield[i_ind] = descriptor[0] & ERASE_BITMASK_ALL; // bits 3-0
+        min_common_erase_type_bits &= _region_erase_types_bitfield[i_ind];
+        _region_high_boundary[i_ind] = (_region_size_bytes[i_ind] - 1) + prev_boundary;
+        prev_boundary = _region_high_boundary[i_ind] + 1;
+        debug_if(MBED_CONF_SPIF_DRIVER_DEBUG, "DEBUG: Region %d - Size: %d, Erase Types: 0x%x", i_ind,
+                 _region_size_bytes[i_ind], _region_erase_types_bitfield[i_ind]);
+    }
+
+    if (prev_boundary != _device_size_bytes) {
+        tr_warning("Sector Map regions cover %llu bytes, device size is %llu bytes", prev_boundary, _device_size_bytes);
+    }
+
+    // Calc minimum Common Erase Size from min_common_erase_type_bits
+    uint8_t type_mask = ERASE_BITMASK_TYPE1;
+    for (i_ind = 0; i_ind < 4; i_ind++) {
+        if (min_common_erase_type_bits & type_mask) {
+            _min_common_erase_size = _erase_type_size_arr[i_ind];
+            break;
+        }
+        type_mask = type_mask << 1;
+    }
+
+    if (i_ind == 4) {
+        // No common erase type was found between regions
+        _min_common_erase_size = 0;
+    }
+
+    return 0;
+}
+
+int SPIFBlockDevicePD::_sfdp_run_detection_command(uint8_t *cmd_descriptor, uint8_t &value)
+{
+    // Command descriptor: instruction (bits 15-8), read latency (bits 19-16, 0xF - variable),
+    // address length (bits 23-22: none / 3 bytes / 4 bytes / variable) and address (second DWORD)
+    int instruction = cmd_descriptor[1];
+    uint8_t latency_cycles = cmd_descriptor[2] & 0x0F;
+    uint8_t address_length = (cmd_descriptor[2] >> 6) & 0x03;
+    bd_addr_t cmd_addr = ((uint32_t)cmd_descriptor[7] << 24) | (cmd_descriptor[6] << 16) |
+                         (cmd_descriptor[5] << 8) | cmd_descriptor[4];
+    unsigned int prev_address_size = _address_size;
+    uint8_t header[SPIF_MAX_COMMAND_HEADER_SIZE];
+    int header_length = 1;
+
+    if (latency_cycles == 0x0F) {
+        // Variable latency, use the default used for SFDP reads
+        latency_cycles = 8;
+    }
+
+    header[0] = instruction;
+    if (address_length != 0) {
+        if (address_length == 1) {
+            _address_size = SPIF_ADDR_SIZE_3_BYTES;
+        } else if (address_length == 2) {
+            _address_size = SPIF_ADDR_SIZE_4_BYTES;
+        }
+        header_length = _spi_build_command_header(header, instruction, cmd_addr, (latency_cycles + 7) / 8);
+        _address_size = prev_address_size;
+    }
+
+    _spi_count_transaction(SPIF_BD_BUS_READ, header_length + 1);
+
+    _spi.lock();
+    _cs = 0;
+    _spi.write((const char *)header, header_length, NULL, 0);
+    _spi.write(NULL, 0, (char *)&value, 1);
+    _cs = 1;
+    _spi.unlock();
+
+    debug_if(MBED_CONF_SPIF_DRIVER_DEBUG, "DEBUG: Detection Command 0x%xh, addr: 0x%llx, value: 0x%x, mask: 0x%x",
+             instruction, cmd_addr, value, cmd_descriptor[3]);
+    return 0;
+}
+
+int SPIFBlockDevicePD::_sfdp_parse_basic_param_table(uint32_t basic_table_addr, size_t basic_table_size)
+{
+    uint8_t param_table[SFDP_DEFAULT_BASIC_PARAMS_TABLE_SIZE_BYTES]; /* Up To 16 DWORDS = 64 Bytes */
+    //memset(param_table, 0, SFDP_DEFAULT_BASIC_PARAMS_TABLE_SIZE_BYTES);
+
+    spif_bd_error status = _spi_send_read_command(SPIF_SFDP, param_table, basic_table_addr /*address*/,
+                                                  basic_table_size);
+    if (status != SPIF_BD_ERROR_OK) {
+        tr_error("init - Read SFDP First Table Failed");
         return -1;
     }
 
-    // Get device density (stored in bits - 1)
+    // Get device density, stored in bits - 1, or as 2^N bits when bit 31 is set (devices above 2Gbit)
     uint32_t density_bits = (
                                 (param_table[7] << 24) |
                                 (param_table[6] << 16) |
                                 (param_table[5] << 8) |
                                 param_table[4]);
-    _device_size_bytes = (density_bits + 1) / 8;
+    if (density_bits & 0x80000000) {
+        _device_size_bytes = ((bd_size_t)1 << (density_bits & 0x7FFFFFFF)) / 8;
+    } else {
+        _device_size_bytes = ((bd_size_t)density_bits + 1) / 8;
+    }
     tr_debug("Density bits: %" PRIu32 " , device size: %llu bytes", density_bits, _device_size_bytes);
 
+    // Detect how the whole device is addressed
+    if (0 != _sfdp_detect_address_mode(param_table, basic_table_size)) {
+        return -1;
+    }
+
     // Set Default read/program/erase Instructions
     _read_instruction = SPIF_READ;
     _prog_instruction = SPIF_PP;
@@ -733,6 +1848,15 @@ int SPIFBlockDevicePD::_sfdp_parse_basic_param_table(uint32_t basic_table_addr,
                                            _erase_type_size_arr);
     _erase_instruction = _erase4k_inst;
 
+    // Detect typical and maximum program/erase times used when waiting for the device
+    _sfdp_detect_op_timing(param_table, basic_table_size);
+
+    // Detect Deep Power-Down instructions and release time used by the idle manager
+    _sfdp_detect_deep_power_down(param_table, basic_table_size);
+
+    // Detect erase suspend/resume used to let reads in during long erases
+    _sfdp_detect_suspend_resume(param_table, basic_table_size);
+
     // Detect and Set fastest Bus mode (default 1-1-1)
     _sfdp_detect_best_bus_read_mode(param_table, basic_table_size, _read_instruction);
 
@@ -740,7 +1864,8 @@ int SPIFBlockDevicePD::_sfdp_parse_basic_param_table(uint32_t basic_table_addr,
 }
 
 int SPIFBlockDevicePD::_sfdp_parse_sfdp_headers(uint32_t &basic_table_addr, size_t &basic_table_size,
-                                              uint32_t &sector_map_table_addr, size_t &sector_map_table_size)
+                                              uint32_t &sector_map_table_addr, size_t &sector_map_table_size,
+                                              uint32_t &four_byte_inst_table_addr, size_t &four_byte_inst_table_size)
 {
     uint8_t sfdp_header[16];
     uint8_t param_header[SPIF_SFDP_HEADER_SIZE];
@@ -797,12 +1922,18 @@ int SPIFBlockDevicePD::_sfdp_parse_sfdp_headers(uint32_t &basic_table_addr, size
             // Supporting up to 64 Bytes Table (16 DWORDS)
             basic_table_size = ((param_header[3] * 4) < SFDP_DEFAULT_BASIC_PARAMS_TABLE_SIZE_BYTES) ? (param_header[3] * 4) : 64;
 
-        } else if ((param_header[0] == 81) && (param_header[7] == 0xFF)) {
+        } else if ((param_header[0] == 0x81) && (param_header[7] == 0xFF)) {
             // Found Sector Map Table: LSB=0x81, MSB=0xFF
             debug_if(MBED_CONF_SPIF_DRIVER_DEBUG, "DEBUG: Found Sector Map Table at Table: %d", i_ind + 1);
             sector_map_table_addr = ((param_header[6] << 16) | (param_header[5] << 8) | (param_header[4]));
             sector_map_table_size = param_header[3] * 4;
 
+        } else if ((param_header[0] == 0x84) && (param_header[7] == 0xFF)) {
+            // Found 4-byte Address Instruction Table: LSB=0x84, MSB=0xFF
+            debug_if(MBED_CONF_SPIF_DRIVER_DEBUG, "DEBUG: Found 4-byte Address Instruction Table at Table: %d", i_ind + 1);
+            four_byte_inst_table_addr = ((param_header[6] << 16) | (param_header[5] << 8) | (param_header[4]));
+            four_byte_inst_table_size = param_header[3] * 4;
+
         }
         addr += SPIF_PARAM_HEADER_SIZE;
 
@@ -877,46 +2008,263 @@ int SPIFBlockDevicePD::_sfdp_detect_erase_types_inst_and_size(uint8_t *basic_par
     return 0;
 }
 
-int SPIFBlockDevicePD::_sfdp_detect_best_bus_read_mode(uint8_t *basic_param_table_ptr, int basic_param_table_size,
-                                                     int &read_inst)
+int SPIFBlockDevicePD::_sfdp_detect_op_timing(uint8_t *basic_param_table_ptr, int basic_param_table_size)
 {
-    do {
+    // Units of the typical erase time fields, in us
+    static const uint32_t erase_time_units_us[4] = {1000, 16000, 128000, 1000000};
+    // Units of the typical chip erase time field, in us
+    static const uint32_t chip_erase_time_units_us[4] = {16000, 256000, 4000000, 64000000};
 
-        // TBD - SPIF Dual Read Modes Require SPI driver support
-        /*
-        uint8_t examined_byte;
-        if (basic_param_table_size > SPIF_BASIC_PARAM_TABLE_QPI_READ_SUPPORT_BYTE) {
-            examined_byte = basic_param_table_ptr[SPIF_BASIC_PARAM_TABLE_QPI_READ_SUPPORT_BYTE];
-            if (examined_byte & 0x01) {
-                //  Fast Read 2-2-2 Supported
-                read_inst = basic_param_table_ptr[SPIF_BASIC_PARAM_TABLE_222_READ_INST_BYTE];
-                _read_dummy_and_mode_cycles = (basic_param_table_ptr[SPIF_BASIC_PARAM_TABLE_222_READ_INST_BYTE - 1] >> 5)
-                                         + (basic_param_table_ptr[SPIF_BASIC_PARAM_TABLE_222_READ_INST_BYTE - 1] & 0x1F);
-                debug_if(MBED_CONF_SPIF_DRIVER_DEBUG, "\nDEBUG: Read Bus Mode set to 2-2-2, Instruction: 0x%xh", read_inst);
-                break;
-            }
+    if (basic_param_table_size < (SPIF_BASIC_PARAM_TABLE_PROGRAM_TIMING_BYTE + 4)) {
+        debug_if(MBED_CONF_SPIF_DRIVER_DEBUG, "DEBUG: Using Default Program/Erase Times");
+        return 0;
+    }
+
+    uint32_t erase_timing = (
+                                (basic_param_table_ptr[SPIF_BASIC_PARAM_TABLE_ERASE_TIMING_BYTE + 3] << 24) |
+                                (basic_param_table_ptr[SPIF_BASIC_PARAM_TABLE_ERASE_TIMING_BYTE + 2] << 16) |
+                                (basic_param_table_ptr[SPIF_BASIC_PARAM_TABLE_ERASE_TIMING_BYTE + 1] << 8) |
+                                basic_param_table_ptr[SPIF_BASIC_PARAM_TABLE_ERASE_TIMING_BYTE]);
+    uint32_t program_timing = (
+                                  (basic_param_table_ptr[SPIF_BASIC_PARAM_TABLE_PROGRAM_TIMING_BYTE + 3] << 24) |
+                                  (basic_param_table_ptr[SPIF_BASIC_PARAM_TABLE_PROGRAM_TIMING_BYTE + 2] << 16) |
+                                  (basic_param_table_ptr[SPIF_BASIC_PARAM_TABLE_PROGRAM_TIMING_BYTE + 1] << 8) |
+                                  basic_param_table_ptr[SPIF_BASIC_PARAM_TABLE_PROGRAM_TIMING_BYTE]);
+
+    // Maximum time is given as a multiplier of the typical time: 2 * (N + 1)
+    uint32_t erase_max_multiplier = 2 * ((erase_timing & 0x0F) + 1);
+    uint32_t program_max_multiplier = 2 * ((program_timing & 0x0F) + 1);
+    uint64_t typ_time_us;
+
+    // Erase Types 1-4, 7 bits each: 5 bits count and 2 bits units
+    for (int i_ind = 0; i_ind < 4; i_ind++) {
+        uint32_t type_timing = erase_timing >> (4 + (7 * i_ind));
+        typ_time_us = (uint64_t)((type_timing & 0x1F) + 1) * erase_time_units_us[(type_timing >> 5) & 0x03];
+        _op_typ_time_us_arr[SPIF_BD_OP_ERASE_TYPE_1 + i_ind] = (uint32_t)typ_time_us;
+        _op_max_time_us_arr[SPIF_BD_OP_ERASE_TYPE_1 + i_ind] = (uint32_t)(typ_time_us * erase_max_multiplier);
+    }
+
+    // Page Program: 5 bits count, 1 bit units (8us / 64us)
+    typ_time_us = (uint64_t)(((program_timing >> 8) & 0x1F) + 1) * (((program_timing >> 13) & 0x01) ? 64 : 8);
+    _op_typ_time_us_arr[SPIF_BD_OP_PROGRAM] = (uint32_t)typ_time_us;
+    _op_max_time_us_arr[SPIF_BD_OP_PROGRAM] = (uint32_t)(typ_time_us * program_max_multiplier);
+
+    // Chip Erase: 5 bits count, 2 bits units, saturate the maximum at UINT32_MAX us
+    typ_time_us = (uint64_t)(((program_timing >> 24) & 0x1F) + 1) * chip_erase_time_units_us[(program_timing >> 29) & 0x03];
+    _op_typ_time_us_arr[SPIF_BD_OP_CHIP_ERASE] = (uint32_t)typ_time_us;
+    typ_time_us *= program_max_multiplier;
+    _op_max_time_us_arr[SPIF_BD_OP_CHIP_ERASE] = (typ_time_us > UINT32_MAX) ? UINT32_MAX : (uint32_t)typ_time_us;
+
+    for (int i_ind = 0; i_ind < SPIF_BD_NUM_OPS; i_ind++) {
+        debug_if(MBED_CONF_SPIF_DRIVER_DEBUG, "DEBUG: Op %d - Typical: %" PRIu32 "us, Max: %" PRIu32 "us", i_ind,
+                 _op_typ_time_us_arr[i_ind], _op_max_time_us_arr[i_ind]);
+    }
+
+    return 0;
+}
+
+int SPIFBlockDevicePD::_sfdp_detect_deep_power_down(uint8_t *basic_param_table_ptr, int basic_param_table_size)
+{
+    // Units of the exit delay field, in ns
+    static const uint32_t exit_delay_units_ns[4] = {128, 1000, 8000, 64000};
+
+    if (basic_param_table_size < (SPIF_BASIC_PARAM_TABLE_DEEP_POWER_DOWN_BYTE + 4)) {
+        debug_if(MBED_CONF_SPIF_DRIVER_DEBUG, "DEBUG: Using Default Deep Power-Down Instructions");
+        return 0;
+    }
+
+    uint32_t dpd_params = (
+                              (basic_param_table_ptr[SPIF_BASIC_PARAM_TABLE_DEEP_POWER_DOWN_BYTE + 3] << 24) |
+                              (basic_param_table_ptr[SPIF_BASIC_PARAM_TABLE_DEEP_POWER_DOWN_BYTE + 2] << 16) |
+                              (basic_param_table_ptr[SPIF_BASIC_PARAM_TABLE_DEEP_POWER_DOWN_BYTE + 1] << 8) |
+                              basic_param_table_ptr[SPIF_BASIC_PARAM_TABLE_DEEP_POWER_DOWN_BYTE]);
+
+    // Bit 31 is 0 when Deep Power-Down is supported
+    if (dpd_params & 0x80000000) {
+        tr_warning("Device doesn't report Deep Power-Down support, using default instructions");
+        return 0;
+    }
+
+    _dpd_enter_inst = (dpd_params >> 23) & 0xFF;
+    _dpd_exit_inst = (dpd_params >> 15) & 0xFF;
+    // Exit delay: 5 bits count (0 based), 2 bits units, rounded up to us
+    uint32_t exit_delay_ns = (((dpd_params >> 8) & 0x1F) + 1) * exit_delay_units_ns[(dpd_params >> 13) & 0x03];
+    _dpd_exit_delay_us = (exit_delay_ns + 999) / 1000;
+
+    debug_if(MBED_CONF_SPIF_DRIVER_DEBUG, "DEBUG: Deep Power-Down - Enter: 0x%xh, Exit: 0x%xh, tRES1: %" PRIu32 "us",
+             _dpd_enter_inst, _dpd_exit_inst, _dpd_exit_delay_us);
+
+    return 0;
+}
+
+int SPIFBlockDevicePD::_sfdp_detect_suspend_resume(uint8_t *basic_param_table_ptr, int basic_param_table_size)
+{
+    // Units of the suspend latency field, in ns
+    static const uint32_t latency_units_ns[4] = {128, 1000, 8000, 64000};
+
+    _suspend_inst = 0;
+    _resume_inst = 0;
+
+    if (basic_param_table_size < (SPIF_BASIC_PARAM_TABLE_SUSPEND_RESUME_INST_BYTE + 4)) {
+        debug_if(MBED_CONF_SPIF_DRIVER_DEBUG, "DEBUG: Suspend/Resume not reported, erases are not suspended");
+        return 0;
+    }
+
+    uint32_t suspend_params = (
+                                  (basic_param_table_ptr[SPIF_BASIC_PARAM_TABLE_SUSPEND_RESUME_BYTE + 3] << 24) |
+                                  (basic_param_table_ptr[SPIF_BASIC_PARAM_TABLE_SUSPEND_RESUME_BYTE + 2] << 16) |
+                                  (basic_param_table_ptr[SPIF_BASIC_PARAM_TABLE_SUSPEND_RESUME_BYTE + 1] << 8) |
+                                  basic_param_table_ptr[SPIF_BASIC_PARAM_TABLE_SUSPEND_RESUME_BYTE]);
+
+    // Bit 31 is 0 when Suspend/Resume is supported
+    if (suspend_params & 0x80000000) {
+        debug_if(MBED_CONF_SPIF_DRIVER_DEBUG, "DEBUG: Suspend/Resume not supported, erases are not suspended");
+        return 0;
+    }
+
+    // Erase suspend latency (tSUS): 5 bits count (0 based), 2 bits units, rounded up to us
+    uint32_t latency_ns = (((suspend_params >> 24) & 0x1F) + 1) * latency_units_ns[(suspend_params >> 29) & 0x03];
+    _suspend_latency_us = (latency_ns + 999) / 1000;
+    // Erase resume to suspend interval: 4 bits count (0 based) of 64us
+    _resume_to_suspend_us = (((suspend_params >> 20) & 0x0F) + 1) * 64;
+
+    // DWORD 13 - Resume instruction in bits 23:16, Suspend instruction in bits 31:24
+    _resume_inst = basic_param_table_ptr[SPIF_BASIC_PARAM_TABLE_SUSPEND_RESUME_INST_BYTE + 2];
+    _suspend_inst = basic_param_table_ptr[SPIF_BASIC_PARAM_TABLE_SUSPEND_RESUME_INST_BYTE + 3];
+    if ((_suspend_inst == 0) || (_suspend_inst == 0xFF) || (_resume_inst == 0) || (_resume_inst == 0xFF)) {
+        _suspend_inst = SPIF_SUS;
+        _resume_inst = SPIF_RES;
+    }
+
+    debug_if(MBED_CONF_SPIF_DRIVER_DEBUG, "DEBUG: Suspend: 0x%xh, Resume: 0x%xh, tSUS: %" PRIu32 "us, resume to suspend: %" PRIu32 "us",
+             _suspend_inst, _resume_inst, _suspend_latency_us, _resume_to_suspend_us);
+
+    return 0;
+}
+
+int SPIFBlockDevicePD::_sfdp_detect_address_mode(uint8_t *basic_param_table_ptr, int basic_param_table_size)
+{
+    // Address Bytes: 0 - 3 byte only, 1 - 3 or 4 byte, 2 - 4 byte only
+    uint8_t address_bytes = (basic_param_table_ptr[SPIF_BASIC_PARAM_TABLE_ADDRESS_BYTES_BYTE] >> 1) & 0x03;
+
+    if (address_bytes == 2) {
+        _address_mode = SPIF_ADDR_MODE_4_BYTE_ONLY;
+    } else if (_device_size_bytes <= (1 << 24)) {
+        _address_mode = SPIF_ADDR_MODE_3_BYTE;
+    } else if (address_bytes == 0) {
+        // Only reachable through a bank/extended address register, which this driver doesn't drive
+        tr_error("init - device above 16MB without 4 byte addressing isn't supported");
+        return -1;
+    } else {
+        // Enter 4-Byte Addressing methods were added in JESD216A (16 DWORD table), plain 4BEN otherwise
+        uint8_t enter_methods = 0x01;
+        if (basic_param_table_size > SPIF_BASIC_PARAM_TABLE_4BYTE_ENTER_BYTE) {
+            enter_methods = basic_param_table_ptr[SPIF_BASIC_PARAM_TABLE_4BYTE_ENTER_BYTE];
         }
-        examined_byte = basic_param_table_ptr[SPIF_BASIC_PARAM_TABLE_FAST_READ_SUPPORT_BYTE];
-        if (examined_byte & 0x20) {
-            //  Fast Read 1-2-2 Supported
-            read_inst = basic_param_table_ptr[SPIF_BASIC_PARAM_TABLE_122_READ_INST_BYTE];
-            _read_dummy_and_mode_cycles = (basic_param_table_ptr[SPIF_BASIC_PARAM_TABLE_122_READ_INST_BYTE - 1] >> 5)
-                                     + (basic_param_table_ptr[SPIF_BASIC_PARAM_TABLE_122_READ_INST_BYTE - 1] & 0x1F);
-            debug_if(MBED_CONF_SPIF_DRIVER_DEBUG, "\nDEBUG: Read Bus Mode set to 1-2-2, Instruction: 0x%xh", read_inst);
-            break;
+
+        if (enter_methods & 0x01) {
+            _address_mode = SPIF_ADDR_MODE_ENTER_4BEN;
+        } else if (enter_methods & 0x02) {
+            _address_mode = SPIF_ADDR_MODE_ENTER_WREN_4BEN;
+        } else {
+            tr_warning("No supported 4 byte address mode entry method (0x%x), trying 4BEN", enter_methods);
+            _address_mode = SPIF_ADDR_MODE_ENTER_4BEN;
         }
-        if (examined_byte & 0x01) {
-            // Fast Read 1-1-2 Supported
-            read_inst = basic_param_table_ptr[SPIF_BASIC_PARAM_TABLE_112_READ_INST_BYTE];
-            _read_dummy_and_mode_cycles = (basic_param_table_ptr[SPIF_BASIC_PARAM_TABLE_112_READ_INST_BYTE - 1] >> 5)
-                                     + (basic_param_table_ptr[SPIF_BASIC_PARAM_TABLE_112_READ_INST_BYTE - 1] & 0x1F);
-            debug_if(MBED_CONF_SPIF_DRIVER_DEBUG, "\nDEBUG: Read Bus Mode set to 1-1-2, Instruction: 0x%xh", _read_instruction);
-            break;
+    }
+
+    debug_if(MBED_CONF_SPIF_DRIVER_DEBUG, "DEBUG: Address Bytes: %d, address mode: %d", address_bytes, _address_mode);
+
+    return 0;
+}
+
+int SPIFBlockDevicePD::_sfdp_parse_4byte_inst_table(uint32_t four_byte_inst_table_addr, size_t four_byte_inst_table_size)
+{
+    uint8_t inst_table[SPIF_4BYTE_INST_TABLE_SIZE_BYTES];
+
+    if (four_byte_inst_table_size < SPIF_4BYTE_INST_TABLE_SIZE_BYTES) {
+        return -1;
+    }
+
+    spif_bd_error status = _spi_send_read_command(SPIF_SFDP, inst_table, four_byte_inst_table_addr,
+                                                  SPIF_4BYTE_INST_TABLE_SIZE_BYTES);
+    if (status != SPIF_BD_ERROR_OK) {
+        tr_error("init - Read 4-byte Address Instruction Table Failed");
+        return -1;
+    }
+
+    uint32_t support = (inst_table[1] << 8) | inst_table[0];
+
+    // All instructions in use need a 4 byte version, otherwise keep switching the device to 4 byte mode
+    if (!(support & (SPIF_4BYTE_INST_SUPPORT_READ | SPIF_4BYTE_INST_SUPPORT_FAST_READ)) ||
+            !(support & SPIF_4BYTE_INST_SUPPORT_PP)) {
+        tr_debug("4 byte read/program instructions not supported, using 4 byte address mode");
+        return -1;
+    }
+    for (int i_ind = 0; i_ind < MAX_NUM_OF_ERASE_TYPES; i_ind++) {
+        if ((_erase_type_inst_arr[i_ind] != 0xff) && !(support & (SPIF_4BYTE_INST_SUPPORT_ERASE_TYPE_1 << i_ind))) {
+            tr_debug("4 byte erase type %d instruction not supported, using 4 byte address mode", i_ind + 1);
+            return -1;
         }
-         */
+    }
+
+    if (support & SPIF_4BYTE_INST_SUPPORT_FAST_READ) {
+        _read_instruction = SPIF_4B_FAST_READ;
+        _read_dummy_and_mode_cycles = 8;
+    } else {
+        _read_instruction = SPIF_4B_READ;
         _read_dummy_and_mode_cycles = 0;
-        debug_if(MBED_CONF_SPIF_DRIVER_DEBUG, "\nDEBUG: Read Bus Mode set to 1-1-1, Instruction: 0x%xh", read_inst);
-    } while (false);
+    }
+    _prog_instruction = SPIF_4B_PP;
+    for (int i_ind = 0; i_ind < MAX_NUM_OF_ERASE_TYPES; i_ind++) {
+        if (_erase_type_inst_arr[i_ind] == 0xff) {
+            continue;
+        }
+        // The legacy 4K erase maps to the 4 byte version of the 4K erase type
+        int erase_inst = inst_table[SPIF_4BYTE_INST_ERASE_TYPE_1_BYTE + i_ind];
+        if (_erase4k_inst == _erase_type_inst_arr[i_ind]) {
+            _erase4k_inst = erase_inst;
+        }
+        if (_erase_instruction == _erase_type_inst_arr[i_ind]) {
+            _erase_instruction = erase_inst;
+        }
+        _erase_type_inst_arr[i_ind] = erase_inst;
+    }
+    _address_mode = SPIF_ADDR_MODE_4_BYTE_INST;
+
+    debug_if(MBED_CONF_SPIF_DRIVER_DEBUG, "DEBUG: Using 4 byte instructions - Read: 0x%xh, Program: 0x%xh, Erase: 0x%xh",
+             _read_instruction, _prog_instruction, _erase_instruction);
+
+    return 0;
+}
+
+int SPIFBlockDevicePD::_sfdp_detect_best_bus_read_mode(uint8_t *basic_param_table_ptr, int basic_param_table_size,
+                                                     int &read_inst)
+{
+    uint8_t examined_byte = basic_param_table_ptr[SPIF_BASIC_PARAM_TABLE_FAST_READ_SUPPORT_BYTE];
+
+    // Multi I/O read modes need more than the single MOSI/MISO pair driven by mbed::SPI,
+    // they are reported for reference but never selected by this driver
+    if (examined_byte & 0x01) {
+        debug_if(MBED_CONF_SPIF_DRIVER_DEBUG, "DEBUG: Device supports Fast Read 1-1-2, Instruction: 0x%xh",
+                 basic_param_table_ptr[SPIF_BASIC_PARAM_TABLE_112_READ_INST_BYTE]);
+    }
+    if (examined_byte & 0x10) {
+        debug_if(MBED_CONF_SPIF_DRIVER_DEBUG, "DEBUG: Device supports Fast Read 1-2-2, Instruction: 0x%xh",
+                 basic_param_table_ptr[SPIF_BASIC_PARAM_TABLE_122_READ_INST_BYTE]);
+    }
+    if (examined_byte & 0x60) {
+        debug_if(MBED_CONF_SPIF_DRIVER_DEBUG, "DEBUG: Device supports Quad Fast Read (1-1-4 / 1-4-4)");
+    }
+    if ((basic_param_table_size > SPIF_BASIC_PARAM_TABLE_QPI_READ_SUPPORT_BYTE) &&
+            (basic_param_table_ptr[SPIF_BASIC_PARAM_TABLE_QPI_READ_SUPPORT_BYTE] & 0x11)) {
+        debug_if(MBED_CONF_SPIF_DRIVER_DEBUG, "DEBUG: Device supports Fast Read 2-2-2 / 4-4-4");
+    }
+
+    // Fast Read 1-1-1 (0x0B with 8 dummy cycles) is supported by every SFDP device and,
+    // unlike the legacy Read (0x03), is specified up to the device's maximum clock frequency
+    read_inst = SPIF_FAST_READ;
+    _read_dummy_and_mode_cycles = 8;
+    debug_if(MBED_CONF_SPIF_DRIVER_DEBUG, "\nDEBUG: Read Bus Mode set to 1-1-1 Fast Read, Instruction: 0x%xh", read_inst);
 
     return 0;
 }
@@ -965,30 +2313,188 @@ int SPIFBlockDevicePD::_reset_flash_mem()
     return status;
 }
 
-bool SPIFBlockDevicePD::_is_mem_ready()
+bool SPIFBlockDevicePD::_is_mem_ready(spif_bd_op op, bool release_lock)
 {
     // Check Status Register Busy Bit to Verify the Device isn't Busy
-    char status_value[2];
+    char status_value[2] = {0};
     int retries = 0;
     bool mem_ready = true;
+    uint32_t typ_time_us = _op_typ_time_us_arr[op];
+    uint64_t timeout_us = (uint64_t)_op_max_time_us_arr[op] * 2;
+    uint64_t poll_interval_us = typ_time_us / 8;
+    uint64_t elapsed_us = 0;
+    mbed::Timer timer;
+
+    if (timeout_us < SPIF_MIN_READY_TIMEOUT_US) {
+        timeout_us = SPIF_MIN_READY_TIMEOUT_US;
+    }
+    if (poll_interval_us < SPIF_MIN_POLL_INTERVAL_US) {
+        poll_interval_us = SPIF_MIN_POLL_INTERVAL_US;
+    }
 
-    do {
-        rtos::ThisThread::sleep_for(1);
+    // Time the operation spends suspended by readers doesn't count towards its timeout
+    if (release_lock) {
+        _suspended_us = 0;
+    }
+
+    timer.start();
+
+    // Poll right away (the operation may already be done), then sleep through most of the typical
+    // operation time and finally poll at a fraction of it, spinning when the interval is under a tick
+    while (true) {
         retries++;
         //Read the Status Register from device
         if (SPIF_BD_ERROR_OK != _spi_send_general_command(SPIF_RDSR, SPI_NO_ADDRESS_COMMAND, NULL, 0, status_value,
                                                           1)) {   // store received values in status_value
             tr_error("Reading Status Register failed");
         }
-    } while ((status_value[0] & SPIF_STATUS_BIT_WIP) != 0 && retries < IS_MEM_READY_MAX_RETRIES);
+
+        elapsed_us = timer.read_high_resolution_us() - (release_lock ? _suspended_us : 0);
+        if (((status_value[0] & SPIF_STATUS_BIT_WIP) == 0) || (elapsed_us > timeout_us) ||
+                (retries >= IS_MEM_READY_MAX_RETRIES)) {
+            break;
+        }
+
+        uint64_t wait_time_us = (elapsed_us < typ_time_us) ? (typ_time_us - elapsed_us) : poll_interval_us;
+        if (release_lock) {
+            _mutex.unlock();
+        }
+        if (wait_time_us >= SPIF_SLEEP_THRESHOLD_US) {
+            rtos::ThisThread::sleep_for(wait_time_us / 1000);
+        } else {
+            // Too short to sleep, spin but let other threads of the same priority run meanwhile,
+            // e.g. the worker of another chip of a StripedBlockDevice starting its own page program
+            uint64_t until_us = timer.read_high_resolution_us() + wait_time_us;
+            while (timer.read_high_resolution_us() < until_us) {
+                rtos::ThisThread::yield();
+            }
+        }
+        if (release_lock) {
+            _mutex.lock();
+        }
+    }
 
     if ((status_value[0] & SPIF_STATUS_BIT_WIP) != 0) {
         tr_error("_is_mem_ready FALSE");
         mem_ready = false;
+        _timed_out_op = op;
+    }
+    _is_device_idle = mem_ready;
+
+    spif_bd_latency_histogram &hist = _op_latency_hist_arr[op];
+    _record_latency(hist, (elapsed_us > UINT32_MAX) ? UINT32_MAX : (uint32_t)elapsed_us, !mem_ready);
+    hist.total_polls += retries;
+    if ((uint32_t)retries > hist.max_polls) {
+        hist.max_polls = retries;
     }
+
     return mem_ready;
 }
 
+void SPIFBlockDevicePD::_wait_for_busy_op()
+{
+    // The thread that started the operation clears _busy_op once the device is ready
+    _busy_waiters++;
+    while (_busy_op != SPIF_BD_OP_OTHER) {
+        _mutex.unlock();
+        rtos::ThisThread::sleep_for(1);
+        _mutex.lock();
+    }
+    _busy_waiters--;
+}
+
+int SPIFBlockDevicePD::_suspend_busy_op()
+{
+    // A resumed erase has to run for a while before it can be suspended again, or it never completes
+    uint64_t since_resume_us = _suspend_timer.read_high_resolution_us();
+    if (since_resume_us < _resume_to_suspend_us) {
+        wait_us((int)(_resume_to_suspend_us - since_resume_us));
+    }
+
+    _spi_send_general_command(_suspend_inst, SPI_NO_ADDRESS_COMMAND, NULL, 0, NULL, 0);
+    _suspend_timer.reset();
+
+    // WIP clears once the device is suspended, at most tSUS later
+    wait_us(_suspend_latency_us);
+    if (false == _is_mem_ready()) {
+        tr_error("Device not suspended, resuming");
+        _resume_busy_op();
+        return -1;
+    }
+
+    return 0;
+}
+
+void SPIFBlockDevicePD::_resume_busy_op()
+{
+    _spi_send_general_command(_resume_inst, SPI_NO_ADDRESS_COMMAND, NULL, 0, NULL, 0);
+    _suspended_us += _suspend_timer.read_high_resolution_us();
+    _suspend_timer.reset();
+}
+
+int SPIFBlockDevicePD::_compare_with_device(iov_pos pos, bd_addr_t addr, uint32_t size, bool &equal)
+{
+    uint8_t slice[SPIF_COMPARE_SLICE_SIZE];
+    spif_bd_error status = SPIF_BD_ERROR_OK;
+
+    equal = true;
+    _dummy_and_mode_cycles = _read_dummy_and_mode_cycles;
+
+    // Stops at the first difference, a page that differs early costs little to check
+    while (equal && (size > 0)) {
+        uint32_t chunk = (size < sizeof(slice)) ? size : sizeof(slice);
+        const uint8_t *data = _iov_next_piece(pos, chunk);
+        status = _spi_send_read_command(_read_instruction, slice, addr, chunk);
+        if (status != SPIF_BD_ERROR_OK) {
+            equal = false;
+            break;
+        }
+        equal = (0 == memcmp(slice, data, chunk));
+        addr += chunk;
+        size -= chunk;
+    }
+
+    _dummy_and_mode_cycles = _write_dummy_and_mode_cycles;
+
+    return status;
+}
+
+bd_size_t SPIFBlockDevicePD::_iov_size(const spif_bd_iovec *iov, int iovcnt)
+{
+    bd_size_t size = 0;
+    for (int i_ind = 0; i_ind < iovcnt; i_ind++) {
+        size += iov[i_ind].len;
+    }
+    return size;
+}
+
+void SPIFBlockDevicePD::_record_latency(spif_bd_latency_histogram &hist, uint32_t wait_us, bool timed_out)
+{
+    int bucket = 0;
+
+    // Bucket index is floor(log2(wait_us)), clamped to the last bucket
+    while ((wait_us >> (bucket + 1)) && (bucket < (SPIF_LATENCY_HISTOGRAM_BUCKETS - 1))) {
+        bucket++;
+    }
+
+    hist.bucket[bucket]++;
+    hist.count++;
+    hist.total_us += wait_us;
+    if (wait_us > hist.max_us) {
+        hist.max_us = wait_us;
+    }
+    if (timed_out) {
+        hist.timeouts++;
+    }
+}
+
+void SPIFBlockDevicePD::_record_call(spif_bd_call call, mbed::Timer &timer, int status)
+{
+    uint64_t elapsed_us = timer.read_high_resolution_us();
+    _record_latency(_call_latency_hist_arr[call], (elapsed_us > UINT32_MAX) ? UINT32_MAX : (uint32_t)elapsed_us,
+                    status != SPIF_BD_ERROR_OK);
+}
+
 int SPIFBlockDevicePD::_set_write_enable()
 {
     // Check Status Register Busy Bit to Verify the Device isn't Busy
@@ -996,13 +2502,15 @@ int SPIFBlockDevicePD::_set_write_enable()
     int status = -1;
 
     do {
-        if (SPIF_BD_ERROR_OK !=  _spi_send_general_command(SPIF_WREN, SPI_NO_ADDRESS_COMMAND, NULL, 0, NULL, 0)) {
-            tr_error("Sending WREN command FAILED");
+        // Last operation was seen complete and nothing was started since - WREN is taken right away,
+        // the ready wait is skipped. WEL is still checked, a lost WREN would leave the page unprogrammed
+        if (!_is_device_idle && (false == _is_mem_ready())) {
+            tr_error("Device not ready, write failed");
             break;
         }
 
-        if (false == _is_mem_ready()) {
-            tr_error("Device not ready, write failed");
+        if (SPIF_BD_ERROR_OK !=  _spi_send_general_command(SPIF_WREN, SPI_NO_ADDRESS_COMMAND, NULL, 0, NULL, 0)) {
+            tr_error("Sending WREN command FAILED");
             break;
         }
 
@@ -1042,35 +2550,30 @@ int SPIFBlockDevicePD::_utils_find_addr_region(bd_size_t offset) const
             return (i_ind + 1);
         }
     }
-    return -1;
+    // Not above any boundary, so in the first region
+    return 0;
 
 }
 
-int SPIFBlockDevicePD::_utils_iterate_next_largest_erase_type(uint8_t &bitfield, int size, int offset, int boundry)
+int SPIFBlockDevicePD::_utils_iterate_next_largest_erase_type(uint8_t bitfield, bd_size_t size, bd_addr_t offset,
+                                                            bd_size_t boundry)
 {
     // Iterate on all supported Erase Types of the Region to which the offset belong to.
-    // Iterates from highest type to lowest
+    // Iterates from highest type to lowest, returns the first one that is aligned to offset
+    // and fits both in size and in the region, or -1 if none does
     uint8_t type_mask = ERASE_BITMASK_TYPE4;
-    int i_ind  = 0;
-    int largest_erase_type = 0;
-    for (i_ind = 3; i_ind >= 0; i_ind--) {
+    for (int i_ind = 3; i_ind >= 0; i_ind--) {
         if (bitfield & type_mask) {
-            largest_erase_type = i_ind;
-            if ((size > (int)(_erase_type_size_arr[largest_erase_type])) &&
-                    ((boundry - offset) > (int)(_erase_type_size_arr[largest_erase_type]))) {
-                break;
-            } else {
-                bitfield &= ~type_mask;
+            bd_size_t type_size = _erase_type_size_arr[i_ind];
+            if (((offset % type_size) == 0) && (size >= type_size) && ((offset + type_size - 1) <= boundry)) {
+                return i_ind;
             }
         }
         type_mask = type_mask >> 1;
     }
 
-    if (i_ind == 4) {
-        tr_error("no erase type was found for current region addr");
-    }
-    return largest_erase_type;
-
+    tr_error("no erase type was found for current region addr");
+    return -1;
 }
 
 /*********************************************/
@@ -19,7 +19,11 @@
 //library is effectively identical to normal SPIFBlockDevice library
 //it just powers up and down the flash memory on the init() and deinit() calls respectively
 
-#include "platform/SingletonPtr.h"
+#include "platform/PlatformMutex.h"
+#include "platform/Callback.h"
+#include "rtos/Thread.h"
+#include "events/EventQueue.h"
+#include "drivers/Timer.h"
 #include "SPI.h"
 #include "DigitalOut.h"
 #include "BlockDevice.h"
@@ -35,12 +39,145 @@ enum spif_bd_error {
     SPIF_BD_ERROR_READY_FAILED          = -4003, /* Wait for Memory Ready failed */
     SPIF_BD_ERROR_WREN_FAILED           = -4004, /* Write Enable Failed */
     SPIF_BD_ERROR_INVALID_ERASE_PARAMS  = -4005, /* Erase command not on sector aligned addresses or exceeds device size */
+    SPIF_BD_ERROR_ASYNC_QUEUE_FULL      = -4006, /* Asynchronous operation could not be queued */
+    SPIF_BD_ERROR_VERIFY_FAILED         = -4007, /* Programmed data read back different */
 };
 
+/** Flags of SPIFBlockDevicePD::set_program_mode()
+ */
+#define SPIF_BD_PROGRAM_SKIP_UNCHANGED  0x01 /* pages already holding the data aren't programmed */
+#define SPIF_BD_PROGRAM_VERIFY          0x02 /* programmed pages are read back and compared */
+
+/** Counters of pages handled by program(), reset with SPIFBlockDevicePD::reset_program_stats()
+ */
+struct spif_bd_program_stats {
+    uint32_t pages_programmed;  // page program commands sent
+    uint32_t pages_skipped;     // pages already holding the data (SPIF_BD_PROGRAM_SKIP_UNCHANGED)
+    uint32_t pages_verified;    // pages read back identical (SPIF_BD_PROGRAM_VERIFY)
+    uint32_t verify_failures;   // pages read back different (SPIF_BD_PROGRAM_VERIFY)
+};
+
+/** One buffer of a scatter/gather transfer, see SPIFBlockDevicePD::readv() and programv()
+ */
+struct spif_bd_iovec {
+    void *base;     // start of the buffer (only read from by programv())
+    uint32_t len;   // size of the buffer in bytes, may be 0
+};
+
+
+/** Enum spif operation types that leave the device busy (Write In Progress)
+ *
+ *  @enum spif_bd_op
+ */
+enum spif_bd_op {
+    SPIF_BD_OP_PROGRAM          = 0, /*!< page program */
+    SPIF_BD_OP_ERASE_TYPE_1     = 1, /*!< erase using SFDP erase type 1 (types 2-4 follow) */
+    SPIF_BD_OP_ERASE_TYPE_2     = 2,
+    SPIF_BD_OP_ERASE_TYPE_3     = 3,
+    SPIF_BD_OP_ERASE_TYPE_4     = 4,
+    SPIF_BD_OP_CHIP_ERASE       = 5, /*!< whole chip erase */
+    SPIF_BD_OP_OTHER            = 6, /*!< reset, write enable, status register writes */
+    SPIF_BD_NUM_OPS             = 7,
+};
+
+#define SPIF_LATENCY_HISTOGRAM_BUCKETS 24
+
+/** Enum spif block device calls timed from entry to return
+ *
+ *  @enum spif_bd_call
+ */
+enum spif_bd_call {
+    SPIF_BD_CALL_READ       = 0,
+    SPIF_BD_CALL_PROGRAM    = 1,
+    SPIF_BD_CALL_ERASE      = 2,
+    SPIF_BD_NUM_CALLS       = 3,
+};
+
+/** Histogram of the time spent waiting for the device to become ready, or spent in a call
+ *
+ *  Bucket 0 counts waits shorter than 2us, bucket n counts waits in [2^n, 2^(n+1)) us,
+ *  the last bucket also counts everything longer.
+ */
+struct spif_bd_latency_histogram {
+    uint32_t bucket[SPIF_LATENCY_HISTOGRAM_BUCKETS];
+    uint32_t count;     // number of recorded waits
+    uint32_t timeouts;  // number of waits that gave up before the device was ready (calls: that failed)
+    uint32_t max_us;    // longest recorded wait
+    uint64_t total_us;  // sum of all recorded waits
+    uint32_t max_polls; // most status register polls in a single wait (ready waits only)
+    uint64_t total_polls; // sum of status register polls of all waits (ready waits only)
+};
 
 #define SPIF_MAX_REGIONS    10
 #define MAX_NUM_OF_ERASE_TYPES 4
 
+/** Enum spif bus command classes counted in spif_bd_bus_stats
+ *
+ *  @enum spif_bd_bus_cmd
+ */
+enum spif_bd_bus_cmd {
+    SPIF_BD_BUS_READ        = 0, /*!< data and SFDP reads */
+    SPIF_BD_BUS_PROGRAM     = 1, /*!< page programs */
+    SPIF_BD_BUS_ERASE       = 2, /*!< sector, block and chip erases */
+    SPIF_BD_BUS_STATUS      = 3, /*!< status register polls */
+    SPIF_BD_BUS_OTHER       = 4, /*!< write enable, reset, ID, power down and other commands */
+    SPIF_BD_BUS_NUM_CMDS    = 5,
+};
+
+/** SPI transactions (chip select assertions) and bytes clocked per command class
+ */
+struct spif_bd_bus_stats {
+    uint32_t transactions[SPIF_BD_BUS_NUM_CMDS];
+    uint64_t bytes[SPIF_BD_BUS_NUM_CMDS];
+};
+
+#define SPIF_SFDP_DESCRIPTOR_VERSION 3
+
+/** Parsed SFDP configuration of a device
+ *
+ *  Captured on the first init() and reused by later init() calls of the same device,
+ *  can also be saved (e.g. to backup RAM) and restored across resets
+ *  with SPIFBlockDevicePD::get_sfdp_descriptor() / set_sfdp_descriptor()
+ */
+struct spif_bd_sfdp_descriptor {
+    uint32_t version;           // SPIF_SFDP_DESCRIPTOR_VERSION
+    uint8_t jedec_id[3];        // Manufacturer ID and Device ID the configuration belongs to
+    uint8_t read_instruction;
+    uint8_t prog_instruction;
+    uint8_t erase_instruction;
+    uint8_t erase4k_inst;
+    uint8_t address_mode;       // how 4 byte addresses are used, see spif_address_mode
+    uint8_t read_dummy_and_mode_cycles;
+    uint8_t dpd_enter_inst;
+    uint8_t dpd_exit_inst;
+    uint8_t suspend_inst;       // 0 if erases aren't suspended
+    uint8_t resume_inst;
+    uint8_t regions_count;
+    uint8_t erase_type_inst_arr[MAX_NUM_OF_ERASE_TYPES];
+    uint8_t region_erase_types_bitfield[SPIF_MAX_REGIONS];
+    uint32_t erase_type_size_arr[MAX_NUM_OF_ERASE_TYPES];
+    uint32_t region_size_bytes[SPIF_MAX_REGIONS];
+    uint32_t min_common_erase_size;
+    uint32_t page_size_bytes;
+    uint64_t device_size_bytes;
+    uint32_t dpd_exit_delay_us;
+    uint32_t suspend_latency_us;
+    uint32_t resume_to_suspend_us;
+    uint32_t op_typ_time_us_arr[SPIF_BD_NUM_OPS];
+    uint32_t op_max_time_us_arr[SPIF_BD_NUM_OPS];
+    uint32_t crc;               // CRC32 of all the fields above
+};
+
+// Number of asynchronous operations that can be pending at once
+#ifndef SPIF_ASYNC_QUEUE_DEPTH
+#define SPIF_ASYNC_QUEUE_DEPTH 8
+#endif
+
+// Stack size of the thread running asynchronous operations
+#ifndef SPIF_ASYNC_THREAD_STACK_SIZE
+#define SPIF_ASYNC_THREAD_STACK_SIZE 2048
+#endif
+
 /** BlockDevice for SFDP based flash devices over SPI bus
  *
  *  @code
@@ -108,6 +245,8 @@ public:
     ~SPIFBlockDevicePD()
     {
         deinit();
+        disable_erase_counters();
+        _async_stop_thread();
     }
 
     /** Read blocks from a block device
@@ -135,6 +274,9 @@ public:
     virtual int program(const void *buffer, mbed::bd_addr_t addr, mbed::bd_size_t size);
 
     /** Erase blocks on a block device
+     *
+     *  erase(0, size()) issues a single Chip Erase and waits for it with the SFDP chip erase time,
+     *  other ranges are erased with the largest erase types that fit
      *
      *  @note The state of an erased block is undefined until it has been programmed
      *
@@ -147,6 +289,80 @@ public:
      */
     virtual int erase(mbed::bd_addr_t addr, mbed::bd_size_t size);
 
+    /** Wait for the device to complete the operation it is running
+     *
+     *  An operation that timed out (SPIF_BD_ERROR_READY_FAILED) may still be running, it is given
+     *  the same time again. Until it completes the device ignores programs and erases
+     *
+     *  @return         SPIF_BD_ERROR_OK(0) - device ready
+     *                  SPIF_BD_ERROR_DEVICE_ERROR - device not initialized
+     *                  SPIF_BD_ERROR_READY_FAILED - device still busy
+     */
+    virtual int sync();
+
+    /** Read a contiguous area of the device into several buffers
+     *
+     *  The buffers are filled in order within a single read command, as if they were one buffer
+     *
+     *  @param iov      Buffers to read into
+     *  @param iovcnt   Number of buffers
+     *  @param addr     Address of block to begin reading from
+     *  @return         SPIF_BD_ERROR_OK(0) - success
+     *                  SPIF_BD_ERROR_DEVICE_ERROR - device driver transaction failed
+     */
+    int readv(const spif_bd_iovec *iov, int iovcnt, mbed::bd_addr_t addr);
+
+    /** Program several buffers to a contiguous area of the device
+     *
+     *  The buffers are streamed in order as if they were one buffer, without copying them,
+     *  each page program command gathers the parts of the buffers falling in its page.
+     *  Follows the program mode set with set_program_mode(), like program()
+     *
+     *  @note The blocks must have been erased prior to being programmed
+     *
+     *  @param iov      Buffers of data to write, the total size must be a multiple of program block size
+     *  @param iovcnt   Number of buffers
+     *  @param addr     Address of block to begin writing to
+     *  @return         SPIF_BD_ERROR_OK(0) - success
+     *                  SPIF_BD_ERROR_DEVICE_ERROR - device driver transaction failed
+     *                  SPIF_BD_ERROR_READY_FAILED - Waiting for Memory ready failed or timed out
+     *                  SPIF_BD_ERROR_WREN_FAILED - Write Enable failed
+     *                  SPIF_BD_ERROR_VERIFY_FAILED - Programmed data read back different
+     */
+    int programv(const spif_bd_iovec *iov, int iovcnt, mbed::bd_addr_t addr);
+
+    /** Program blocks to a block device without blocking the caller
+     *
+     *  The operation is queued and run in order with other asynchronous operations
+     *  on a worker thread, done is called from that thread with the result of program()
+     *
+     *  @note The buffer must remain valid until done is called
+     *
+     *  @param buffer   Buffer of data to write to blocks
+     *  @param addr     Address of block to begin writing to
+     *  @param size     Size to write in bytes, must be a multiple of program block size
+     *  @param done     Called with the operation status once the program completed
+     *  @return         SPIF_BD_ERROR_OK(0) - operation queued
+     *                  SPIF_BD_ERROR_DEVICE_ERROR - device not initialized
+     *                  SPIF_BD_ERROR_ASYNC_QUEUE_FULL - too many operations pending
+     */
+    int program_async(const void *buffer, mbed::bd_addr_t addr, mbed::bd_size_t size,
+                      mbed::Callback<void(int)> done);
+
+    /** Erase blocks on a block device without blocking the caller
+     *
+     *  The operation is queued and run in order with other asynchronous operations
+     *  on a worker thread, done is called from that thread with the result of erase()
+     *
+     *  @param addr     Address of block to begin erasing
+     *  @param size     Size to erase in bytes, must be a multiple of erase block size
+     *  @param done     Called with the operation status once the erase completed
+     *  @return         SPIF_BD_ERROR_OK(0) - operation queued
+     *                  SPIF_BD_ERROR_DEVICE_ERROR - device not initialized
+     *                  SPIF_BD_ERROR_ASYNC_QUEUE_FULL - too many operations pending
+     */
+    int erase_async(mbed::bd_addr_t addr, mbed::bd_size_t size, mbed::Callback<void(int)> done);
+
     /** Get the size of a readable block
      *
      *  @return         Size of a readable block in bytes
@@ -198,6 +414,142 @@ public:
      */
     virtual const char *get_type() const;
 
+    /** Get the histogram of device ready wait times for an operation type
+     *
+     *  @param op       Operation type
+     *  @param hist     Histogram to copy the recorded wait times into
+     *  @return         SPIF_BD_ERROR_OK(0) - success
+     *                  SPIF_BD_ERROR_DEVICE_ERROR - invalid operation type
+     */
+    int get_latency_histogram(spif_bd_op op, spif_bd_latency_histogram &hist);
+
+    /** Clear the recorded wait time histograms of all operation types
+     */
+    void reset_latency_histograms();
+
+    /** Select how program() writes pages
+     *
+     *  With SPIF_BD_PROGRAM_SKIP_UNCHANGED each page is read first and not programmed if it already
+     *  holds the data (saves program time and wear on rewrites of the same data),
+     *  with SPIF_BD_PROGRAM_VERIFY each programmed page is read back and program() fails with
+     *  SPIF_BD_ERROR_VERIFY_FAILED if it differs. A read back that fails is SPIF_BD_ERROR_DEVICE_ERROR
+     *  in both modes, it says nothing about the page
+     *
+     *  @param flags    Combination of SPIF_BD_PROGRAM_ flags, 0 - plain program (default)
+     */
+    void set_program_mode(uint32_t flags);
+
+    /** Get the program page counters
+     *
+     *  @param stats    Counters are copied here
+     */
+    void get_program_stats(spif_bd_program_stats &stats);
+
+    /** Clear the program page counters
+     */
+    void reset_program_stats();
+
+    /** Put the device in deep power-down after a period without read/program/erase
+     *
+     *  The device is released from deep power-down transparently by the next access,
+     *  parsed SFDP state is kept so waking only costs the release command and tRES1
+     *
+     *  @param timeout_ms   Idle time before entering deep power-down, 0 disables (default)
+     *  @return             SPIF_BD_ERROR_OK(0) - success
+     *                      SPIF_BD_ERROR_DEVICE_ERROR - idle check couldn't be scheduled
+     */
+    int set_idle_timeout(uint32_t timeout_ms);
+
+    /** Get the SFDP configuration parsed by init()
+     *
+     *  @param desc     Descriptor to copy the configuration into
+     *  @return         SPIF_BD_ERROR_OK(0) - success
+     *                  SPIF_BD_ERROR_DEVICE_ERROR - no configuration parsed yet
+     */
+    int get_sfdp_descriptor(spif_bd_sfdp_descriptor &desc);
+
+    /** Provide a previously saved SFDP configuration
+     *
+     *  The next init() uses it instead of parsing SFDP tables if the device JEDEC ID matches
+     *
+     *  @param desc     Descriptor from get_sfdp_descriptor()
+     *  @return         SPIF_BD_ERROR_OK(0) - success
+     *                  SPIF_BD_ERROR_PARSING_FAILED - wrong version or corrupted descriptor
+     */
+    int set_sfdp_descriptor(const spif_bd_sfdp_descriptor &desc);
+
+    /** Get the SPI bus traffic counters, to compare the command cost of workloads
+     *
+     *  @param stats    Counters are copied here
+     */
+    void get_bus_stats(spif_bd_bus_stats &stats);
+
+    /** Clear the SPI bus traffic counters
+     */
+    void reset_bus_stats();
+
+    /** Get the histogram of durations of read(), program() or erase() calls
+     *
+     *  @param call     Call type
+     *  @param hist     Histogram to copy the recorded durations into
+     *  @return         SPIF_BD_ERROR_OK(0) - success
+     *                  SPIF_BD_ERROR_DEVICE_ERROR - invalid call type
+     */
+    int get_call_histogram(spif_bd_call call, spif_bd_latency_histogram &hist);
+
+    /** Start counting erases in RAM, per unit of unit_size bytes
+     *
+     *  An erase covering several units counts once for each of them, an erase smaller than
+     *  a unit counts once for the unit. Counters saturate at 65535.
+     *
+     *  @param unit_size    Bytes covered by each counter, a multiple of the erase size
+     *                      (0 - minimal common erase size)
+     *  @return             SPIF_BD_ERROR_OK(0) - success
+     *                      SPIF_BD_ERROR_DEVICE_ERROR - not initialized or invalid unit size
+     */
+    int enable_erase_counters(bd_size_t unit_size = 0);
+
+    /** Stop counting erases and free the counters
+     */
+    void disable_erase_counters();
+
+    /** Get the erase count of the unit holding an address
+     *
+     *  @param addr     Address within the unit
+     *  @param count    Erase count of the unit
+     *  @return         SPIF_BD_ERROR_OK(0) - success
+     *                  SPIF_BD_ERROR_DEVICE_ERROR - counters not enabled or address out of range
+     */
+    int get_erase_count(bd_addr_t addr, uint32_t &count);
+
+    /** Get the size of the area flush_erase_counters() writes, a multiple of the erase size
+     *
+     *  @return         Size in bytes, 0 if the counters aren't enabled
+     */
+    bd_size_t get_erase_counters_size();
+
+    /** Write the erase counters to an area reserved for them (not used by a file system)
+     *
+     *  @param addr     Erase aligned start of the area, get_erase_counters_size() bytes long
+     *  @return         0 on success or a negative error code on failure
+     */
+    int flush_erase_counters(bd_addr_t addr);
+
+    /** Restore the erase counters written by flush_erase_counters()
+     *
+     *  The stored counts are added to the current ones, call once after enable_erase_counters()
+     *
+     *  @param addr     Start of the area the counters were written to
+     *  @return         SPIF_BD_ERROR_OK(0) - success
+     *                  SPIF_BD_ERROR_PARSING_FAILED - no valid counters for the current unit size stored
+     *                  SPIF_BD_ERROR_DEVICE_ERROR - counters not enabled
+     */
+    int load_erase_counters(bd_addr_t addr);
+
+    /** Print the latency histograms, bus traffic and erase counters summary with printf
+     */
+    void dump_stats();
+
 private:
 
     // Internal functions
@@ -207,14 +559,21 @@ private:
     /****************************************/
     // Parse SFDP Headers and retrieve Basic Param and Sector Map Tables (if exist)
     int _sfdp_parse_sfdp_headers(uint32_t &basic_table_addr, size_t &basic_table_size,
-                                 uint32_t &sector_map_table_addr, size_t &sector_map_table_size);
+                                 uint32_t &sector_map_table_addr, size_t &sector_map_table_size,
+                                 uint32_t &four_byte_inst_table_addr, size_t &four_byte_inst_table_size);
 
     // Parse and Detect required Basic Parameters from Table
     int _sfdp_parse_basic_param_table(uint32_t basic_table_addr, size_t basic_table_size);
 
+    // Switch to the dedicated 4 byte address instructions if the 4-byte Address Instruction Table has them all
+    int _sfdp_parse_4byte_inst_table(uint32_t four_byte_inst_table_addr, size_t four_byte_inst_table_size);
+
     // Parse and read information required by Regions Sector Map
     int _sfdp_parse_sector_map_table(uint32_t sector_map_table_addr, size_t sector_map_table_size);
 
+    // Run a Sector Map Configuration Detection Command and read back its register value
+    int _sfdp_run_detection_command(uint8_t *cmd_descriptor, uint8_t &value);
+
     // Detect fastest read Bus mode supported by device
     int _sfdp_detect_best_bus_read_mode(uint8_t *basic_param_table_ptr, int basic_param_table_size, int &read_inst);
 
@@ -226,6 +585,27 @@ private:
                                                int &erase4k_inst,
                                                int *erase_type_inst_arr, unsigned int *erase_type_size_arr);
 
+    // Detect typical and maximum program/erase times (Basic Param Table DWORDs 10-11)
+    int _sfdp_detect_op_timing(uint8_t *basic_param_table_ptr, int basic_param_table_size);
+
+    // Detect 3/4 byte address support, and how 4 byte address mode is entered (Basic Param Table DWORDs 1 and 16)
+    int _sfdp_detect_address_mode(uint8_t *basic_param_table_ptr, int basic_param_table_size);
+
+    // Detect erase suspend/resume instructions and timing (Basic Param Table DWORDs 12-13)
+    int _sfdp_detect_suspend_resume(uint8_t *basic_param_table_ptr, int basic_param_table_size);
+
+    // Detect Deep Power-Down enter/exit instructions and exit delay (Basic Param Table DWORD 14)
+    int _sfdp_detect_deep_power_down(uint8_t *basic_param_table_ptr, int basic_param_table_size);
+
+    // Capture the parsed configuration into a descriptor
+    void _sfdp_descriptor_store(spif_bd_sfdp_descriptor &desc, const uint8_t *jedec_id);
+
+    // Restore the configuration from a descriptor
+    void _sfdp_descriptor_load(const spif_bd_sfdp_descriptor &desc);
+
+    // CRC32 of a descriptor, not including its crc field
+    uint32_t _sfdp_descriptor_crc(const spif_bd_sfdp_descriptor &desc);
+
     /***********************/
     /* Utilities Functions */
     /***********************/
@@ -233,19 +613,35 @@ private:
     int _utils_find_addr_region(bd_size_t offset) const;
 
     // Iterate on all supported Erase Types of the Region to which the offset belongs to.
-    // Iterates from highest type to lowest
-    int _utils_iterate_next_largest_erase_type(uint8_t &bitfield, int size, int offset, int boundry);
+    // Iterates from highest type to lowest, returns the largest one aligned to offset that fits size and region
+    int _utils_iterate_next_largest_erase_type(uint8_t bitfield, mbed::bd_size_t size, mbed::bd_addr_t offset,
+                                               mbed::bd_size_t boundry);
 
     /********************************/
     /*   Calls to SPI Driver APIs   */
     /********************************/
-    // Send Program => Write command to Driver
-    spif_bd_error _spi_send_program_command(int prog_inst, const void *buffer, mbed::bd_addr_t addr, mbed::bd_size_t size);
+    // Build Instruction, Address and Dummy bytes into header, returns the header length in bytes
+    int _spi_build_command_header(uint8_t *header, int instruction, mbed::bd_addr_t addr, uint32_t dummy_bytes);
+
+    // Position in a scatter/gather list, past the end of an entry it moves on to the next one
+    struct iov_pos {
+        const spif_bd_iovec *iov;
+        uint32_t offset;
+    };
+
+    // Get the next piece of at most size bytes at pos and move past it
+    static uint8_t *_iov_next_piece(iov_pos &pos, uint32_t &size);
+
+    // Send Program => Write command to Driver, the data is gathered from the buffers at pos
+    spif_bd_error _spi_send_program_command(int prog_inst, iov_pos pos, mbed::bd_addr_t addr, mbed::bd_size_t size);
 
     // Send Read command to Driver
     //spif_bd_error _spi_send_read_command(uint8_t read_inst, void *buffer, bd_addr_t addr, bd_size_t size);
     spif_bd_error _spi_send_read_command(int read_inst, uint8_t *buffer, mbed::bd_addr_t addr, mbed::bd_size_t size);
 
+    // Send Read command to Driver, the data is scattered to the buffers at pos
+    spif_bd_error _spi_send_readv_command(int read_inst, iov_pos pos, mbed::bd_addr_t addr, mbed::bd_size_t size);
+
     // Send Erase Instruction using command_transfer command to Driver
     spif_bd_error _spi_send_erase_command(int erase_inst, mbed::bd_addr_t addr, mbed::bd_size_t size);
 
@@ -255,16 +651,92 @@ private:
 
     // Send set_frequency command to Driver
     spif_bd_error _spi_set_frequency(int freq);
+
+    // Count a transaction of the given class in the bus traffic counters
+    void _spi_count_transaction(spif_bd_bus_cmd cmd, size_t bytes);
+
+    // True for the chip erase and any of the detected erase instructions
+    bool _is_erase_instruction(int instruction);
     /********************************/
 
+    /********************************/
+    /*   Asynchronous Operations    */
+    /********************************/
+    struct async_op {
+        bool is_erase;
+        const void *buffer;
+        mbed::bd_addr_t addr;
+        mbed::bd_size_t size;
+        mbed::Callback<void(int)> done;
+    };
+
+    // Start the worker thread on first use
+    int _async_start_thread();
+
+    // Stop the worker thread after the operation it runs and free the queue
+    void _async_stop_thread();
+
+    // Queue an operation on the worker thread, starting the thread on first use
+    int _async_submit(const async_op &op);
+
+    // Run a queued operation and report its status, called on the worker thread
+    void _async_run(async_op op);
+
     // Soft Reset Flash Memory
     int _reset_flash_mem();
 
     // Configure Write Enable in Status Register
+    // Waits for ready unless the device is known to be idle, then sends WREN and checks WEL
     int _set_write_enable();
 
+    // Enter or release Deep Power-Down
+    void _set_deep_power_down(bool enable);
+
+    // Release Deep Power-Down if needed and note the access for the idle manager, call with _mutex held
+    void _power_up_for_access();
+
+    // Schedule an idle check on the worker thread, call with _mutex held
+    void _schedule_idle_check(uint32_t delay_ms);
+
+    // Enter Deep Power-Down if the device was idle for the idle timeout, runs on the worker thread
+    void _idle_check();
+
     // Wait on status register until write not-in-progress
-    bool _is_mem_ready();
+    // Spins or sleeps according to the typical and maximum time of the operation in progress,
+    // with release_lock _mutex is released while sleeping, other threads get the lock and reads can suspend the operation
+    bool _is_mem_ready(spif_bd_op op = SPIF_BD_OP_OTHER, bool release_lock = false);
+
+    // Wait for an operation started by another thread to finish, call with _mutex held
+    void _wait_for_busy_op();
+
+    // Suspend the erase in progress, call with _mutex held
+    int _suspend_busy_op();
+
+    // Resume the suspended erase, call with _mutex held
+    void _resume_busy_op();
+
+    // Compare device contents with data, in slices so no page sized buffer is needed, call with _mutex held
+    int _compare_with_device(iov_pos pos, bd_addr_t addr, uint32_t size, bool &equal);
+
+    // Total size of a scatter/gather list
+    static mbed::bd_size_t _iov_size(const spif_bd_iovec *iov, int iovcnt);
+
+    // Add a ready wait or call time to a histogram
+    void _record_latency(spif_bd_latency_histogram &hist, uint32_t wait_us, bool timed_out);
+
+    // Add the duration of a call to its histogram, call with _mutex held
+    void _record_call(spif_bd_call call, mbed::Timer &timer, int status);
+
+    // Count an erase of the range, call with _mutex held
+    void _count_erase(bd_addr_t addr, bd_size_t size);
+
+    // Erase counters as written by flush_erase_counters(), followed by the counters
+    struct erase_counters_header {
+        uint32_t magic;
+        uint32_t unit_size;
+        uint32_t count;
+        uint32_t crc;   // CRC32 of the counters
+    };
 
 private:
     // Master side hardware
@@ -274,7 +746,41 @@ private:
 
     // Mutex is used to protect Flash device for some SPI Driver commands that must be done sequentially with no other commands in between
     // e.g. (1)Set Write Enable, (2)Program, (3)Wait Memory Ready
-    static SingletonPtr<PlatformMutex> _mutex;
+    // One per device, each SPI transaction also locks the bus so devices can share it
+    PlatformMutex _mutex;
+
+    // Asynchronous program/erase operations are run in submission order by this queue and thread,
+    // both created on first use
+    events::EventQueue *_async_queue;
+    rtos::Thread _async_thread;
+    bool _async_thread_started;
+
+    // Idle manager: Deep Power-Down after _idle_timeout_ms without access (0 - disabled)
+    uint32_t _idle_timeout_ms;
+    uint64_t _last_access_ms;
+    int _idle_event_id;
+    bool _is_powered_down;
+    int _dpd_enter_inst;
+    int _dpd_exit_inst;
+    uint32_t _dpd_exit_delay_us; // tRES1
+
+    // Erase suspend/resume, _suspend_inst is 0 if the device doesn't support it
+    int _suspend_inst;
+    int _resume_inst;
+    uint32_t _suspend_latency_us; // tSUS
+    uint32_t _resume_to_suspend_us; // minimum time a resumed erase runs before the next suspend
+    // Erase waiting for the device with _mutex released (SPIF_BD_OP_OTHER - none) and the area it erases
+    spif_bd_op _busy_op;
+    bd_addr_t _busy_addr;
+    bd_size_t _busy_size;
+    uint64_t _suspended_us; // time the waiting erase spent suspended
+    uint32_t _busy_waiters; // threads in _wait_for_busy_op(), let in before the next erase chunk starts
+    spif_bd_op _timed_out_op; // operation of the last ready wait that timed out, sync() waits for it again
+    mbed::Timer _suspend_timer; // time since the last suspend or resume
+
+    // SFDP configuration parsed by the first init(), reused while the JEDEC ID matches
+    spif_bd_sfdp_descriptor _sfdp_cache;
+    bool _sfdp_cache_valid;
 
     // Command Instructions
     int _read_instruction;
@@ -295,10 +801,30 @@ private:
     unsigned int _min_common_erase_size; // minimal common erase size for all regions (0 if none exists)
 
     unsigned int _page_size_bytes; // Page size - 256 Bytes default
+
+    // Typical and maximum duration of each operation type, taken from SFDP when available
+    uint32_t _op_typ_time_us_arr[SPIF_BD_NUM_OPS];
+    uint32_t _op_max_time_us_arr[SPIF_BD_NUM_OPS];
+    // Ready wait times measured per operation type
+    spif_bd_latency_histogram _op_latency_hist_arr[SPIF_BD_NUM_OPS];
+    // Set when a ready wait saw the device idle, cleared by any command that may start an internal operation
+    bool _is_device_idle;
+    // SPIF_BD_PROGRAM_ flags and page counters of program()
+    uint32_t _program_mode;
+    spif_bd_program_stats _program_stats;
+    // Durations of read/program/erase calls
+    spif_bd_latency_histogram _call_latency_hist_arr[SPIF_BD_NUM_CALLS];
+    // SPI bus traffic per command class
+    spif_bd_bus_stats _bus_stats;
+    // Erase counters per unit (NULL - not counting)
+    uint16_t *_erase_counters;
+    uint32_t _erase_counters_count;
+    bd_size_t _erase_counter_unit_size;
     bd_size_t _device_size_bytes;
 
     // Bus configuration
     unsigned int _address_size; // number of bytes for address
+    int _address_mode; // how addresses above 16MB are reached, see spif_address_mode
     unsigned int _read_dummy_and_mode_cycles; // Number of Dummy and Mode Bits required by Read Bus Mode
     unsigned int _write_dummy_and_mode_cycles; // Number of Dummy and Mode Bits required by Write Bus Mode
     unsigned int _dummy_and_mode_cycles; // Number of Dummy and Mode Bits required by Current Bus Mode
@@ -0,0 +1,335 @@
+#include "StripedBlockDevice.h"
+
+#include <inttypes.h>
+
+#include "mbed_trace.h"
+#define TRACE_GROUP "STBD"
+using namespace mbed;
+
+StripedBlockDevice::StripedBlockDevice(SPIFBlockDevicePD **bds, uint32_t count, bd_size_t stripe_size)
+    : _count(count), _stripe_size(0), _requested_stripe_size(stripe_size), _read_size(0), _program_size(0),
+      _size(0), _is_initialized(false)
+{
+    if (_count > STRIPED_BD_MAX_DEVICES) {
+        _count = 0;
+    }
+    for (uint32_t i_ind = 0; i_ind < _count; i_ind++) {
+        _bds[i_ind] = bds[i_ind];
+        _ops[i_ind].flags = &_flags;
+        _ops[i_ind].flag = 1UL << i_ind;
+        _ops[i_ind].status = BD_ERROR_OK;
+    }
+}
+
+StripedBlockDevice::~StripedBlockDevice()
+{
+    deinit();
+}
+
+int StripedBlockDevice::init()
+{
+    int err = BD_ERROR_OK;
+    uint32_t initialized = 0;
+
+    _mutex.lock();
+
+    if (_is_initialized) {
+        goto exit_point;
+    }
+
+    if (_count == 0) {
+        tr_error("no devices to stripe across (at most %d)", STRIPED_BD_MAX_DEVICES);
+        err = BD_ERROR_DEVICE_ERROR;
+        goto exit_point;
+    }
+
+    _read_size = 0;
+    _program_size = 0;
+    _stripe_size = _requested_stripe_size;
+    for (uint32_t i_ind = 0; i_ind < _count; i_ind++) {
+        err = _bds[i_ind]->init();
+        if (err) {
+            goto exit_point;
+        }
+        initialized++;
+        _read_size = (_bds[i_ind]->get_read_size() > _read_size) ? _bds[i_ind]->get_read_size() : _read_size;
+        _program_size = (_bds[i_ind]->get_program_size() > _program_size) ? _bds[i_ind]->get_program_size() : _program_size;
+        if ((_requested_stripe_size == 0) && (_bds[i_ind]->get_erase_size() > _stripe_size)) {
+            _stripe_size = _bds[i_ind]->get_erase_size();
+        }
+    }
+
+    // A stripe must be erasable on its own on every device
+    _size = 0;
+    for (uint32_t i_ind = 0; i_ind < _count; i_ind++) {
+        if ((_stripe_size == 0) || (_stripe_size % _bds[i_ind]->get_erase_size()) ||
+                (_stripe_size % _read_size) || (_stripe_size % _program_size)) {
+            tr_error("stripe size %llu doesn't fit the geometry of device %" PRIu32, _stripe_size, i_ind);
+            err = BD_ERROR_DEVICE_ERROR;
+            goto exit_point;
+        }
+        bd_size_t device_size = _bds[i_ind]->size() - (_bds[i_ind]->size() % _stripe_size);
+        if ((_size == 0) || (device_size < _size)) {
+            _size = device_size;
+        }
+    }
+    _size *= _count;
+
+    _is_initialized = true;
+
+exit_point:
+    // Devices initialized before a failure are left as they were found
+    if (err) {
+        for (uint32_t i_ind = 0; i_ind < initialized; i_ind++) {
+            _bds[i_ind]->deinit();
+        }
+    }
+
+    _mutex.unlock();
+
+    return err;
+}
+
+int StripedBlockDevice::deinit()
+{
+    int err = BD_ERROR_OK;
+
+    _mutex.lock();
+
+    if (!_is_initialized) {
+        _mutex.unlock();
+        return BD_ERROR_OK;
+    }
+
+    for (uint32_t i_ind = 0; i_ind < _count; i_ind++) {
+        int device_err = _bds[i_ind]->deinit();
+        if (device_err && !err) {
+            err = device_err;
+        }
+    }
+    _is_initialized = false;
+
+    _mutex.unlock();
+
+    return err;
+}
+
+int StripedBlockDevice::sync()
+{
+    if (!_is_initialized) {
+        return BD_ERROR_DEVICE_ERROR;
+    }
+
+    int err = BD_ERROR_OK;
+    for (uint32_t i_ind = 0; i_ind < _count; i_ind++) {
+        int device_err = _bds[i_ind]->sync();
+        if (device_err && !err) {
+            err = device_err;
+        }
+    }
+    return err;
+}
+
+int StripedBlockDevice::read(void *b, bd_addr_t addr, bd_size_t size)
+{
+    if (!_is_initialized) {
+        return BD_ERROR_DEVICE_ERROR;
+    }
+
+    if ((addr + size) > _size) {
+        tr_error("read of %llu bytes at %llu past the end", size, addr);
+        return BD_ERROR_DEVICE_ERROR;
+    }
+
+    uint8_t *buffer = static_cast<uint8_t *>(b);
+    int err = BD_ERROR_OK;
+
+    // Reads are short compared to programs and erases, they go to the devices one stripe after the other
+    while ((size > 0) && !err) {
+        uint32_t device = 0;
+        bd_addr_t device_addr = 0;
+        bd_size_t offset = addr % _stripe_size;
+        bd_size_t chunk = ((offset + size) < _stripe_size) ? size : (_stripe_size - offset);
+
+        _map_addr(addr, device, device_addr);
+        err = _bds[device]->read(buffer, device_addr, chunk);
+
+        buffer += chunk;
+        addr += chunk;
+        size -= chunk;
+    }
+
+    return err;
+}
+
+int StripedBlockDevice::program(const void *b, bd_addr_t addr, bd_size_t size)
+{
+    if (!_is_initialized) {
+        return BD_ERROR_DEVICE_ERROR;
+    }
+
+    if ((addr + size) > _size) {
+        tr_error("program of %llu bytes at %llu past the end", size, addr);
+        return BD_ERROR_DEVICE_ERROR;
+    }
+
+    const uint8_t *buffer = static_cast<const uint8_t *>(b);
+    int err = BD_ERROR_OK;
+
+    _mutex.lock();
+
+    // Each round hands the next stripe to every device, consecutive stripes are on different devices
+    while ((size > 0) && !err) {
+        uint32_t pending = 0;
+
+        for (uint32_t i_ind = 0; (i_ind < _count) && (size > 0); i_ind++) {
+            uint32_t device = 0;
+            bd_addr_t device_addr = 0;
+            bd_size_t offset = addr % _stripe_size;
+            bd_size_t chunk = ((offset + size) < _stripe_size) ? size : (_stripe_size - offset);
+
+            _map_addr(addr, device, device_addr);
+            err = _bds[device]->program_async(buffer, device_addr, chunk,
+                                              Callback<void(int)>(&_ops[device], &device_op::done));
+            if (err) {
+                break;
+            }
+            pending |= _ops[device].flag;
+
+            buffer += chunk;
+            addr += chunk;
+            size -= chunk;
+        }
+
+        // Programs already queued use the buffer, so they are waited for even after an error
+        int wait_err = _wait_devices(pending);
+        err = err ? err : wait_err;
+    }
+
+    _mutex.unlock();
+
+    if (err) {
+        tr_error("striped program at %llu failed: %d", addr, err);
+    }
+    return err;
+}
+
+int StripedBlockDevice::erase(bd_addr_t addr, bd_size_t size)
+{
+    if (!_is_initialized) {
+        return BD_ERROR_DEVICE_ERROR;
+    }
+
+    if ((addr % _stripe_size) || (size % _stripe_size) || ((addr + size) > _size)) {
+        tr_error("erase of %llu bytes at %llu not stripe aligned", size, addr);
+        return BD_ERROR_DEVICE_ERROR;
+    }
+
+    // The stripes of a device within the range are contiguous on that device,
+    // so each device gets a single erase covering its part of the range
+    bd_addr_t device_start[STRIPED_BD_MAX_DEVICES];
+    bd_size_t device_size[STRIPED_BD_MAX_DEVICES] = { 0 };
+    for (bd_addr_t stripe_addr = addr; stripe_addr < (addr + size); stripe_addr += _stripe_size) {
+        uint32_t device = 0;
+        bd_addr_t device_addr = 0;
+
+        _map_addr(stripe_addr, device, device_addr);
+        if (device_size[device] == 0) {
+            device_start[device] = device_addr;
+        }
+        device_size[device] += _stripe_size;
+    }
+
+    int err = BD_ERROR_OK;
+    uint32_t pending = 0;
+
+    _mutex.lock();
+
+    for (uint32_t i_ind = 0; i_ind < _count; i_ind++) {
+        if (device_size[i_ind] == 0) {
+            continue;
+        }
+        err = _bds[i_ind]->erase_async(device_start[i_ind], device_size[i_ind],
+                                       Callback<void(int)>(&_ops[i_ind], &device_op::done));
+        if (err) {
+            break;
+        }
+        pending |= _ops[i_ind].flag;
+    }
+
+    int wait_err = _wait_devices(pending);
+    err = err ? err : wait_err;
+
+    _mutex.unlock();
+
+    if (err) {
+        tr_error("striped erase at %llu failed: %d", addr, err);
+    }
+    return err;
+}
+
+bd_size_t StripedBlockDevice::get_read_size() const
+{
+    return _read_size;
+}
+
+bd_size_t StripedBlockDevice::get_program_size() const
+{
+    return _program_size;
+}
+
+bd_size_t StripedBlockDevice::get_erase_size() const
+{
+    return _stripe_size;
+}
+
+bd_size_t StripedBlockDevice::get_erase_size(bd_addr_t /*addr*/) const
+{
+    // Stripes are the same size everywhere
+    return _stripe_size;
+}
+
+int StripedBlockDevice::get_erase_value() const
+{
+    return (_count > 0) ? _bds[0]->get_erase_value() : -1;
+}
+
+bd_size_t StripedBlockDevice::size() const
+{
+    return _size;
+}
+
+const char *StripedBlockDevice::get_type() const
+{
+    return "STRIPED";
+}
+
+/*********************************************/
+/************* Utility Functions *************/
+/*********************************************/
+void StripedBlockDevice::_map_addr(bd_addr_t addr, uint32_t &device, bd_addr_t &device_addr) const
+{
+    bd_addr_t stripe = addr / _stripe_size;
+
+    device = stripe % _count;
+    device_addr = ((stripe / _count) * _stripe_size) + (addr % _stripe_size);
+}
+
+int StripedBlockDevice::_wait_devices(uint32_t pending)
+{
+    int err = BD_ERROR_OK;
+
+    if (pending == 0) {
+        return err;
+    }
+
+    _flags.wait_all(pending);
+
+    for (uint32_t i_ind = 0; i_ind < _count; i_ind++) {
+        if ((pending & _ops[i_ind].flag) && _ops[i_ind].status && !err) {
+            err = _ops[i_ind].status;
+        }
+    }
+
+    return err;
+}
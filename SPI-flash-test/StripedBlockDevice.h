@@ -0,0 +1,171 @@
+#ifndef STRIPED_BLOCK_DEVICE_H
+#define STRIPED_BLOCK_DEVICE_H
+
+//block device striped across several SPI NOR chips (SPIFBlockDevicePD)
+//consecutive stripes go to different chips so a program or erase keeps every chip busy at once
+
+#include "BlockDevice.h"
+#include "SPIFBlockDevicePD.h"
+#include "platform/PlatformMutex.h"
+#include "rtos/EventFlags.h"
+
+#define STRIPED_BD_MAX_DEVICES  8
+
+/** Block device striped across several SPI NOR flash devices
+ *
+ *  The address space is split in stripes of stripe_size bytes, stripe n is held by device
+ *  n % count. Every device holds the same number of stripes, so the size is the size of the
+ *  smallest device (rounded down to whole stripes) times the number of devices.
+ *
+ *  Programs and erases use the asynchronous API of the devices, each device works on its own
+ *  part of the request on its worker thread and the call returns once all of them are done.
+ *  With the devices on separate chip selects (or separate SPI buses) one chip erases or waits
+ *  for a page program while the other is being written, so sustained writes scale with the
+ *  number of chips.
+ *
+ *  @code
+ *  SPIFBlockDevicePD flash0(FLASH_MOSI, FLASH_MISO, FLASH_SCK, PA_10);
+ *  SPIFBlockDevicePD flash1(FLASH_MOSI, FLASH_MISO, FLASH_SCK, PC_7);
+ *  SPIFBlockDevicePD *chips[] = {&flash0, &flash1};
+ *  StripedBlockDevice bd(chips, 2);
+ *  LittleFileSystem fs("fs", &bd);
+ *  @endcode
+ */
+class StripedBlockDevice : public mbed::BlockDevice {
+public:
+    /** Create a striped block device
+     *
+     *  @param bds          Devices to stripe across, the array is copied
+     *  @param count        Number of devices, at most STRIPED_BD_MAX_DEVICES
+     *  @param stripe_size  Size of a stripe in bytes, a multiple of the erase size of every
+     *                      device (0 - largest erase size of the devices)
+     */
+    StripedBlockDevice(SPIFBlockDevicePD **bds, uint32_t count, mbed::bd_size_t stripe_size = 0);
+
+    /** Destruct the striped block device
+     */
+    virtual ~StripedBlockDevice();
+
+    /** Initialize all devices and check that they can be striped
+     *
+     *  @return         0 on success or a negative error code on failure
+     */
+    virtual int init();
+
+    /** Deinitialize all devices
+     *
+     *  @return         0 on success or a negative error code on failure
+     */
+    virtual int deinit();
+
+    /** Sync all devices
+     *
+     *  @return         0 on success or a negative error code on failure
+     */
+    virtual int sync();
+
+    /** Read blocks from the devices
+     *
+     *  @param buffer   Buffer to write blocks to
+     *  @param addr     Address of block to begin reading from
+     *  @param size     Size to read in bytes, must be a multiple of read block size
+     *  @return         0 on success or a negative error code on failure
+     */
+    virtual int read(void *buffer, mbed::bd_addr_t addr, mbed::bd_size_t size);
+
+    /** Program blocks to the devices, the devices are programmed in parallel
+     *
+     *  @note The blocks must have been erased prior to being programmed
+     *
+     *  @param buffer   Buffer of data to write to blocks
+     *  @param addr     Address of block to begin writing to
+     *  @param size     Size to write in bytes, must be a multiple of program block size
+     *  @return         0 on success or a negative error code on failure
+     */
+    virtual int program(const void *buffer, mbed::bd_addr_t addr, mbed::bd_size_t size);
+
+    /** Erase blocks on the devices, the devices are erased in parallel
+     *
+     *  @param addr     Address of block to begin erasing, must be stripe aligned
+     *  @param size     Size to erase in bytes, must be a multiple of the stripe size
+     *  @return         0 on success or a negative error code on failure
+     */
+    virtual int erase(mbed::bd_addr_t addr, mbed::bd_size_t size);
+
+    /** Get the size of a readable block, the largest of the devices
+     *
+     *  @return         Size of a readable block in bytes
+     */
+    virtual mbed::bd_size_t get_read_size() const;
+
+    /** Get the size of a programmable block, the largest of the devices
+     *
+     *  @return         Size of a programmable block in bytes
+     */
+    virtual mbed::bd_size_t get_program_size() const;
+
+    /** Get the size of an erasable block, the stripe size
+     *
+     *  @return         Size of an erasable block in bytes
+     */
+    virtual mbed::bd_size_t get_erase_size() const;
+
+    /** Get the size of an erasable block at an address, the stripe size
+     *
+     *  @param addr     Address within the erasable block
+     *  @return         Size of an erasable block in bytes
+     */
+    virtual mbed::bd_size_t get_erase_size(mbed::bd_addr_t addr) const;
+
+    /** Get the value of storage when erased
+     *
+     *  @return         The value of storage when erased
+     */
+    virtual int get_erase_value() const;
+
+    /** Get the total size of the striped device
+     *
+     *  @return         Size of the device in bytes
+     */
+    virtual mbed::bd_size_t size() const;
+
+    /** Get the BlockDevice class type
+     *
+     *  @return         A string representing the BlockDevice class type
+     */
+    virtual const char *get_type() const;
+
+private:
+    // Completion of the asynchronous operation of one device
+    struct device_op {
+        rtos::EventFlags *flags;
+        uint32_t flag;
+        int status;
+
+        void done(int op_status)
+        {
+            status = op_status;
+            flags->set(flag);
+        }
+    };
+
+    // Map an address to the device holding it and the address within that device
+    void _map_addr(mbed::bd_addr_t addr, uint32_t &device, mbed::bd_addr_t &device_addr) const;
+
+    // Wait for the operations of the devices in pending, returns the first error of those operations
+    int _wait_devices(uint32_t pending);
+
+    SPIFBlockDevicePD *_bds[STRIPED_BD_MAX_DEVICES];
+    device_op _ops[STRIPED_BD_MAX_DEVICES];
+    uint32_t _count;
+    mbed::bd_size_t _stripe_size;
+    mbed::bd_size_t _requested_stripe_size;
+    mbed::bd_size_t _read_size;
+    mbed::bd_size_t _program_size;
+    mbed::bd_size_t _size;
+    rtos::EventFlags _flags;
+    bool _is_initialized;
+    PlatformMutex _mutex;
+};
+
+#endif
@@ -1,11 +1,16 @@
 #include "mbed.h"
 #include "LittleFileSystem.h"
 #include "SPIFBlockDevicePD.h"
+#include "PageCacheBlockDevice.h"
 
 #include "pindefs.h"
 
 // Physical block device, can be any device that supports the BlockDevice API
-SPIFBlockDevicePD bd(FLASH_MOSI, FLASH_MISO, FLASH_SCK, FLASH_CS, 24000000);
+SPIFBlockDevicePD spif(FLASH_MOSI, FLASH_MISO, FLASH_SCK, FLASH_CS, 24000000);
+
+// littlefs relies on each program being on the device, in order, when the call returns:
+// the cache only keeps read pages (write-through), its metadata fetches hit them
+PageCacheBlockDevice bd(&spif, 16, 256, PAGE_CACHE_WRITE_THROUGH);
 
 // Storage for the littlefs
 LittleFileSystem fs("fs");
@@ -0,0 +1,508 @@
+#include "STUSB4500.h"
+#include "pd_spec_defines.h"
+#include "pd_codec.h"
+
+#define STUSB_I2C_ADDR (0x28 << 1) //8-bit
+
+#define STUSB_DEVICE_ID_REG 0x2F
+#define STUSB_CC_STATUS_REG 0x11
+#define STUSB_ALERT_STATUS_1_MASK_REG 0x0C
+#define STUSB_CMD_CTRL_REG 0x1A         //STUSB_GEN1S_CMD_CTRL, not in datasheet
+#define STUSB_RX_BYTE_CNT_REG 0x30      //followed by RX_HEADER (2 bytes) and the data objects
+#define STUSB_RX_DATA_OBJ_REG 0x33
+#define STUSB_TX_HEADER_REG 0x51        //not in datasheet
+#define STUSB_DPM_PDO_NUMB_REG 0x70
+#define STUSB_DPM_SNK_PDO1_REG 0x85     //3 PDOs of 4 bytes
+#define STUSB_RDO_STATUS_REG 0x91
+
+#define STUSB_DEVICE_ID_A 0x21
+#define STUSB_DEVICE_ID_B 0x25
+#define STUSB_SEND_MESSAGE_CMD 0x26     //CMD_CTRL value sending the message in TX_HEADER
+
+#define STUSB_PORT_STATUS_1_ATTACHED (1 << 0)
+#define STUSB_PRT_STATUS_MSG_RECEIVED (1 << 2)
+
+#define STUSB_PDO1_VOLTAGE_MV 5000
+#define STUSB_ALERT_RETRY_MS 10         //ALERT still low after a failed burst read or after the burst
+
+//event flags of the blocking calls
+#define PD_EVENT_CAPS       (1 << 0)    //Source_Capabilities received
+#define PD_EVENT_CONTRACT   (1 << 1)    //PS_RDY received
+#define PD_EVENT_REJECTED   (1 << 2)
+#define PD_EVENT_DETACHED   (1 << 3)
+#define PD_EVENT_ALL        (PD_EVENT_CAPS | PD_EVENT_CONTRACT | PD_EVENT_REJECTED | PD_EVENT_DETACHED)
+
+STUSB4500::STUSB4500(I2C &i2c, PinName alert_pin, EventQueue *event_queue) :
+    bus(i2c),
+    alert(alert_pin, PullUp),
+    queue(event_queue),
+    state(PD_DETACHED),
+    src_pdo_count(0),
+    snk_pdo_count(0),
+    limits(pd_charger_limits()),
+    requested_mv(0)
+{
+    memset(src_pdos, 0, sizeof(src_pdos));
+    memset(snk_pdos, 0, sizeof(snk_pdos));
+}
+
+//check the device ID, unmask the alerts we handle and read the port state
+bool STUSB4500::init() {
+    uint8_t id;
+    if(!read_regs(STUSB_DEVICE_ID_REG, &id, 1) || (id != STUSB_DEVICE_ID_A && id != STUSB_DEVICE_ID_B)) {
+        return false;
+    }
+
+    //0 unmasks
+    Alt_S1Reg_Map mask;
+    mask.data = 0xFF;
+    mask.map.prt_mask = 0;
+    mask.map.tcstat_mask = 0;
+    mask.map.ccdetect_mask = 0;
+    mask.map.hreset_mask = 0;
+    if(!write_regs(STUSB_ALERT_STATUS_1_MASK_REG, &mask.data, 1) || !read_sink_pdos()) {
+        return false;
+    }
+
+    alert.fall(queue->event(this, &STUSB4500::handle_alert));
+
+    //picks up the attach state and clears any alert raised before the handler was there
+    queue->call(this, &STUSB4500::handle_alert);
+    return true;
+}
+
+void STUSB4500::set_limits(const pd_sink_limits &sink_limits) {
+    lock.lock();
+    limits = sink_limits;
+    lock.unlock();
+}
+
+void STUSB4500::attach(Callback<void(pd_state)> state_changed) {
+    lock.lock();
+    on_state_change = state_changed;
+    lock.unlock();
+}
+
+//reset the contract, VBUS stays up and the source resends its capabilities
+bool STUSB4500::send_soft_reset() {
+    return send_control_message(USBPD_CTRLMSG_Soft_Reset);
+}
+
+//ask the source to resend its capabilities, the contract stays as is
+bool STUSB4500::send_get_source_cap() {
+    return send_control_message(USBPD_CTRLMSG_Get_Source_Cap);
+}
+
+bool STUSB4500::read_sink_pdos() {
+    uint8_t count;
+    uint8_t raw[STUSB_MAX_SNK_PDOS * 4];
+
+    if(!read_regs(STUSB_DPM_PDO_NUMB_REG, &count, 1) || !read_regs(STUSB_DPM_SNK_PDO1_REG, raw, sizeof(raw))) {
+        return false;
+    }
+
+    lock.lock();
+    snk_pdo_count = count & 0x03;
+    for(int i = 0; i < STUSB_MAX_SNK_PDOS; i++) {
+        snk_pdos[i] = pd::le32(&raw[i * 4]);
+    }
+    lock.unlock();
+    return true;
+}
+
+//overwrite sink PDO 1-3, only the voltage and current fields change
+bool STUSB4500::update_pdo(uint8_t pdo_number, uint32_t voltage_mv, uint32_t current_ma) {
+    if(pdo_number < 1 || pdo_number > STUSB_MAX_SNK_PDOS) {
+        return false;
+    }
+
+    //PDO1 has to stay at 5V, only its current can change
+    if(pdo_number == 1) {
+        voltage_mv = STUSB_PDO1_VOLTAGE_MV;
+    }
+
+    lock.lock();
+    uint32_t pdo = pd::fixed::with(snk_pdos[pdo_number - 1], voltage_mv, current_ma);
+
+    uint8_t raw[4];
+    pd::put_le32(raw, pdo);
+    bool ok = write_regs(STUSB_DPM_SNK_PDO1_REG + (pdo_number - 1) * 4, raw, sizeof(raw));
+    if(ok) {
+        snk_pdos[pdo_number - 1] = pdo;
+    }
+    lock.unlock();
+    return ok;
+}
+
+//sink PDOs the chip may request with, 1 - only 5V
+bool STUSB4500::update_active_pdos(uint8_t count) {
+    if(count < 1 || count > STUSB_MAX_SNK_PDOS) {
+        return false;
+    }
+
+    lock.lock();
+    bool ok = write_regs(STUSB_DPM_PDO_NUMB_REG, &count, 1);
+    if(ok) {
+        snk_pdo_count = count;
+    }
+    lock.unlock();
+    return ok;
+}
+
+//CC_STATUS isn't latched, reading it doesn't take anything from the alert handling
+bool STUSB4500::read_cc_status(CC_Reg_Map &cc) {
+    return read_regs(STUSB_CC_STATUS_REG, &cc.data, 1);
+}
+
+bool STUSB4500::read_rdo(uint32_t &rdo) {
+    uint8_t raw[4];
+    if(!read_regs(STUSB_RDO_STATUS_REG, raw, sizeof(raw))) {
+        return false;
+    }
+    rdo = pd::le32(raw);
+    return true;
+}
+
+//source PDO to request within the limits, false if none is acceptable
+bool STUSB4500::find_high_power_pdo(pd_choice &choice) {
+    lock.lock();
+    pd_sink_limits fixed_limits = limits;
+    fixed_limits.type_mask &= PD_ACCEPT_FIXED;
+
+    //narrow the charger limits to the requested voltage, outside of them nothing is acceptable
+    if(requested_mv) {
+        fixed_limits.min_voltage_mv = requested_mv > limits.min_voltage_mv ? requested_mv : limits.min_voltage_mv;
+        fixed_limits.max_voltage_mv = requested_mv < limits.max_voltage_mv ? requested_mv : limits.max_voltage_mv;
+    }
+    bool found = pd_select_pdo(src_pdos, src_pdo_count, fixed_limits, choice);
+    lock.unlock();
+
+    return found;
+}
+
+//move the contract to a fixed PDO at voltage_mv without dropping VBUS (0 - back to the most power)
+int STUSB4500::change_pdo(uint32_t voltage_mv, uint32_t timeout_ms) {
+    pd_state s = get_state();
+    if(s == PD_DETACHED) {
+        return STUSB_ERROR_DETACHED;
+    }
+
+    //without capabilities there's nothing to pick from
+    if(s == PD_ATTACHED) {
+        int err = get_source_caps(timeout_ms);
+        if(err) {
+            return err;
+        }
+    }
+
+    lock.lock();
+    uint32_t previous_mv = requested_mv;
+    requested_mv = voltage_mv;
+
+    pd_choice choice;
+    if(voltage_mv && !find_high_power_pdo(choice)) {
+        requested_mv = previous_mv;
+        lock.unlock();
+        return STUSB_ERROR_NOT_OFFERED;
+    }
+
+    events.clear(PD_EVENT_ALL);
+    bool renegotiating;
+    int err = update_sink_pdos(renegotiating);
+    if(renegotiating) {
+        set_state(PD_RENEGOTIATING);
+    }
+    s = state;
+    lock.unlock();
+
+    if(err) {
+        return err;
+    }
+
+    //in PD_CONTRACT the sink PDOs already ask for it, the contract stays as is
+    if(s == PD_REJECTED) {
+        //the source already turned these PDOs down, asking again won't help
+        err = STUSB_ERROR_REJECTED;
+    } else if(s != PD_CONTRACT) {
+        err = wait_for_contract(timeout_ms);
+    }
+
+    if(err == STUSB_OK || err == STUSB_ERROR_DETACHED) {
+        return err;
+    }
+
+    //deterministic fallback, 5V is offered by every source
+    lock.lock();
+    requested_mv = STUSB_PDO1_VOLTAGE_MV;
+    events.clear(PD_EVENT_ALL);
+    if(update_sink_pdos(renegotiating) == STUSB_OK && !renegotiating && state == PD_REJECTED) {
+        //5V PDOs were already in place and rejected, start over from the source capabilities
+        renegotiating = send_soft_reset();
+    }
+    if(renegotiating) {
+        set_state(PD_RENEGOTIATING);
+    }
+    lock.unlock();
+
+    if(renegotiating) {
+        wait_for_contract(timeout_ms);
+    }
+    return err;
+}
+
+//soft reset and wait for the new contract
+int STUSB4500::soft_reset(uint32_t timeout_ms) {
+    if(get_state() == PD_DETACHED) {
+        return STUSB_ERROR_DETACHED;
+    }
+
+    lock.lock();
+    events.clear(PD_EVENT_ALL);
+    bool sent = send_soft_reset();
+    if(sent) {
+        set_state(PD_RENEGOTIATING);
+    }
+    lock.unlock();
+
+    return sent ? wait_for_contract(timeout_ms) : STUSB_ERROR_I2C;
+}
+
+//get_source_pdos() holds fresh capabilities once this returns STUSB_OK
+int STUSB4500::get_source_caps(uint32_t timeout_ms) {
+    if(get_state() == PD_DETACHED) {
+        return STUSB_ERROR_DETACHED;
+    }
+
+    events.clear(PD_EVENT_CAPS | PD_EVENT_DETACHED);
+    if(!send_get_source_cap()) {
+        return STUSB_ERROR_I2C;
+    }
+
+    uint32_t result = events.wait_any(PD_EVENT_CAPS | PD_EVENT_DETACHED, timeout_ms);
+    if(result & osFlagsError) {
+        return STUSB_ERROR_TIMEOUT;
+    }
+    return (result & PD_EVENT_CAPS) ? STUSB_OK : STUSB_ERROR_DETACHED;
+}
+
+STUSB4500::pd_state STUSB4500::get_state() {
+    lock.lock();
+    pd_state s = state;
+    lock.unlock();
+    return s;
+}
+
+//copies the last received source PDOs, returns how many
+uint8_t STUSB4500::get_source_pdos(uint32_t *pdos) {
+    lock.lock();
+    uint8_t count = src_pdo_count;
+    memcpy(pdos, src_pdos, count * sizeof(uint32_t));
+    lock.unlock();
+    return count;
+}
+
+//contract voltage from the requested source PDO, current from the RDO
+bool STUSB4500::get_contract(uint32_t &voltage_mv, uint32_t &current_ma) {
+    uint32_t rdo;
+    if(get_state() != PD_CONTRACT || !read_rdo(rdo)) {
+        return false;
+    }
+
+    lock.lock();
+    uint8_t position = pd::rdo::object_position::get(rdo);
+    bool ok = position >= 1 && position <= src_pdo_count;
+    if(ok) {
+        voltage_mv = pd::fixed::voltage_mv(src_pdos[position - 1]);
+        current_ma = pd::rdo::operating_current_ma(rdo);
+    }
+    lock.unlock();
+    return ok;
+}
+
+//alert service routine, runs on the event queue
+void STUSB4500::handle_alert() {
+    Alert_Block_Map regs;
+
+    lock.lock();
+
+    //the burst clears the alert line, the line stays low until it's read so try again a bit later
+    if(!read_regs(ALERT_BLOCK_START_REG, regs.data, ALERT_BLOCK_LEN)) {
+        lock.unlock();
+        queue->call_in(STUSB_ALERT_RETRY_MS, this, &STUSB4500::handle_alert);
+        return;
+    }
+
+    //only the alerts we unmasked
+    uint8_t pending = regs.map.alert_status.data & ~regs.map.alert_mask.data;
+    Alt_S1Reg_Map active;
+    active.data = pending;
+
+    if(active.map.ccdetect_mask || state == PD_DETACHED) {
+        if(regs.map.port_status_1 & STUSB_PORT_STATUS_1_ATTACHED) {
+            if(state == PD_DETACHED) {
+                set_state(PD_ATTACHED);
+            }
+        } else {
+            src_pdo_count = 0;
+            set_state(PD_DETACHED);
+        }
+    }
+
+    //the source starts over with its capabilities after a hard reset
+    if(active.map.hreset_mask && state != PD_DETACHED) {
+        src_pdo_count = 0;
+        set_state(PD_ATTACHED);
+    }
+
+    if(active.map.prt_mask && (regs.map.prt_status & STUSB_PRT_STATUS_MSG_RECEIVED)) {
+        handle_message();
+    }
+
+    lock.unlock();
+
+    //ALERT is a level, an alert raised during the burst keeps it low and there's no new falling edge.
+    //Checked again after a delay so a line stuck low doesn't keep the queue busy
+    if(alert.read() == 0) {
+        queue->call_in(STUSB_ALERT_RETRY_MS, this, &STUSB4500::handle_alert);
+    }
+}
+
+//read the PD message the chip received, call with lock held
+void STUSB4500::handle_message() {
+    uint8_t rx[3]; //RX_BYTE_CNT, RX_HEADER (2 bytes)
+    if(!read_regs(STUSB_RX_BYTE_CNT_REG, rx, sizeof(rx))) {
+        return;
+    }
+
+    uint16_t header = pd::le16(&rx[1]);
+    uint8_t type = pd::header::message_type::get(header);
+    uint8_t objects = pd::header::number_of_data_objects::get(header);
+
+    if(pd::header::is_control(header)) {
+        if(type == USBPD_CTRLMSG_PS_RDY && state == PD_NEGOTIATING) {
+            set_state(PD_CONTRACT);
+        } else if(type == USBPD_CTRLMSG_Reject && state == PD_NEGOTIATING) {
+            set_state(PD_REJECTED);
+        }
+        return;
+    }
+
+    //extended messages reuse the data message types
+    if(pd::header::extended::get(header) || type != USBPD_DATAMSG_Source_Capabilities) {
+        return;
+    }
+
+    uint8_t raw[STUSB_MAX_SRC_PDOS * 4];
+    if(objects > STUSB_MAX_SRC_PDOS || !read_regs(STUSB_RX_DATA_OBJ_REG, raw, objects * 4)) {
+        return;
+    }
+    for(int i = 0; i < objects; i++) {
+        src_pdos[i] = pd::le32(&raw[i * 4]);
+    }
+    src_pdo_count = objects;
+
+    evaluate_capabilities();
+    events.set(PD_EVENT_CAPS);
+}
+
+//pick a source PDO and update the sink PDOs if they don't ask for it already, call with lock held
+void STUSB4500::evaluate_capabilities() {
+    //if the update failed the chip requests with the PDOs it has
+    bool renegotiating;
+    update_sink_pdos(renegotiating);
+    set_state(renegotiating ? PD_RENEGOTIATING : PD_NEGOTIATING);
+}
+
+//point the sink PDOs at the chosen source PDO, renegotiating is set if they changed and a soft reset went out
+int STUSB4500::update_sink_pdos(bool &renegotiating) {
+    renegotiating = false;
+
+    pd_choice choice;
+    uint8_t wanted_count = 1;
+    uint32_t wanted_pdo = 0;
+
+    //PDO1 is always 5V, anything higher goes in PDO2, asking for the current the charger will draw
+    if(find_high_power_pdo(choice) && choice.voltage_mv > STUSB_PDO1_VOLTAGE_MV) {
+        wanted_count = 2;
+        wanted_pdo = pd::fixed::with(0, choice.voltage_mv, choice.current_ma);
+    }
+
+    //the chip already answered these capabilities with the PDOs we want
+    if(wanted_count == snk_pdo_count &&
+            (wanted_count == 1 || pd::fixed::with(0, pd::fixed::voltage_mv(snk_pdos[1]), pd::fixed::current_ma(snk_pdos[1])) == wanted_pdo)) {
+        return STUSB_OK;
+    }
+
+    if((wanted_count == 2 && !update_pdo(2, choice.voltage_mv, choice.current_ma)) || !update_active_pdos(wanted_count)) {
+        //a failed write may still have landed, keep the local copy in step with the chip
+        read_sink_pdos();
+        return STUSB_ERROR_I2C;
+    }
+
+    //the source resends its capabilities and the chip requests again with the new PDOs
+    if(!send_soft_reset()) {
+        return STUSB_ERROR_I2C;
+    }
+    renegotiating = true;
+    return STUSB_OK;
+}
+
+void STUSB4500::set_state(pd_state new_state) {
+    if(new_state == state) {
+        return;
+    }
+    state = new_state;
+
+    if(new_state == PD_CONTRACT) {
+        events.set(PD_EVENT_CONTRACT);
+    } else if(new_state == PD_REJECTED) {
+        events.set(PD_EVENT_REJECTED);
+    } else if(new_state == PD_DETACHED) {
+        events.set(PD_EVENT_DETACHED);
+    }
+
+    //posted, so it runs on the event queue without the lock whichever thread changed the state
+    if(on_state_change) {
+        queue->call(on_state_change, new_state);
+    }
+}
+
+bool STUSB4500::send_control_message(uint8_t type) {
+    uint8_t header = type;
+    uint8_t cmd = STUSB_SEND_MESSAGE_CMD;
+    return write_regs(STUSB_TX_HEADER_REG, &header, 1) && write_regs(STUSB_CMD_CTRL_REG, &cmd, 1);
+}
+
+int STUSB4500::wait_for_contract(uint32_t timeout_ms) {
+    uint32_t result = events.wait_any(PD_EVENT_CONTRACT | PD_EVENT_REJECTED | PD_EVENT_DETACHED, timeout_ms);
+
+    if(result & osFlagsError) {
+        return STUSB_ERROR_TIMEOUT;
+    } else if(result & PD_EVENT_CONTRACT) {
+        return STUSB_OK;
+    } else if(result & PD_EVENT_REJECTED) {
+        return STUSB_ERROR_REJECTED;
+    }
+    return STUSB_ERROR_DETACHED;
+}
+
+bool STUSB4500::read_regs(uint8_t reg, uint8_t *dest, int len) {
+    char addr = reg;
+
+    //repeated start between the address write and the read, the register address auto-increments
+    bus.lock();
+    bool ok = bus.write(STUSB_I2C_ADDR, &addr, 1, true) == 0 && bus.read(STUSB_I2C_ADDR, (char*)dest, len) == 0;
+    bus.unlock();
+    return ok;
+}
+
+bool STUSB4500::write_regs(uint8_t reg, const uint8_t *src, int len) {
+    char buf[1 + STUSB_MAX_SNK_PDOS * 4];
+    if(len > (int)sizeof(buf) - 1) {
+        return false;
+    }
+
+    buf[0] = reg;
+    memcpy(&buf[1], src, len);
+    return bus.write(STUSB_I2C_ADDR, buf, len + 1) == 0;
+}
@@ -0,0 +1,108 @@
+#ifndef STUSB4500_H
+#define STUSB4500_H
+
+#include "mbed.h"
+#include "pd_negotiator.h"
+#include "pd_policy.h"
+
+#define STUSB_MAX_SRC_PDOS 7   //a Source_Capabilities message holds up to 7 PDOs
+#define STUSB_MAX_SNK_PDOS 3   //the STUSB4500 holds 3 sink PDOs
+
+#define STUSB_DEFAULT_TIMEOUT_MS 1000 //soft reset, capabilities, request and PS_RDY fit well within this
+
+//results of the blocking renegotiation calls
+enum stusb_error {
+    STUSB_OK = 0,
+    STUSB_ERROR_I2C = -1,           //chip didn't answer
+    STUSB_ERROR_TIMEOUT = -2,       //no contract (or no capabilities) within the timeout
+    STUSB_ERROR_REJECTED = -3,      //source rejected the request
+    STUSB_ERROR_NOT_OFFERED = -4,   //source doesn't offer the voltage within the limits
+    STUSB_ERROR_DETACHED = -5,      //nothing attached, or detached while waiting
+};
+
+//sink policy engine for the STUSB4500 (flow documented in pd_negotiator.h)
+//everything runs from the event queue when the ALERT pin goes low, nothing polls the chip
+class STUSB4500 {
+
+    public:
+        enum pd_state {
+            PD_DETACHED,        //nothing plugged in
+            PD_ATTACHED,        //cable attached, waiting for Source_Capabilities (stays here on a type-C only source)
+            PD_NEGOTIATING,     //sink PDOs fit the source, waiting for Accept/PS_RDY
+            PD_RENEGOTIATING,   //sink PDOs updated and soft reset sent, waiting for the source to resend its capabilities
+            PD_CONTRACT,        //PS_RDY received, contract in place
+            PD_REJECTED,        //source rejected our request
+        };
+
+        //queue is where the alert handling runs, it must be dispatched (the shared queue by default)
+        STUSB4500(I2C &i2c, PinName alert_pin, EventQueue *event_queue = mbed_event_queue());
+
+        bool init();    //check the device ID, unmask the alerts we handle and read the port state
+
+        //what the charger can take, the source PDO delivering the most charge power within it is requested
+        //only fixed supplies can be requested, the STUSB4500 sink PDOs are fixed (pd_charger_limits() by default)
+        void set_limits(const pd_sink_limits &sink_limits);
+
+        //posted to the event queue whenever the state changes, also when a blocking call below changed it
+        void attach(Callback<void(pd_state)> state_changed);
+
+        bool send_soft_reset();     //reset the contract, VBUS stays up and the source resends its capabilities
+        bool send_get_source_cap(); //ask the source to resend its capabilities, the contract stays as is
+        bool read_sink_pdos();      //refresh the local copy of the sink PDOs and the active PDO count
+        bool update_pdo(uint8_t pdo_number, uint32_t voltage_mv, uint32_t current_ma); //overwrite sink PDO 1-3 (PDO1 stays 5V)
+        bool update_active_pdos(uint8_t count); //sink PDOs the chip may request with, 1 - only 5V
+        bool read_rdo(uint32_t &rdo);           //request data object of the current contract
+        bool read_cc_status(CC_Reg_Map &cc);    //CC line state, for diagnostics
+
+        //source PDO to request within the limits, false if none is acceptable
+        bool find_high_power_pdo(pd_choice &choice);
+
+        //blocking renegotiation, these wait on the alert handling so they can't run on the event queue
+
+        //move the contract to a fixed PDO at voltage_mv without dropping VBUS (0 - back to the most power)
+        //voltages outside the limits are STUSB_ERROR_NOT_OFFERED
+        //if no contract at that voltage is reached within timeout_ms, or the source rejects it, the sink
+        //falls back to 5V, waiting up to timeout_ms more, and stays there until the next call
+        int change_pdo(uint32_t voltage_mv, uint32_t timeout_ms = STUSB_DEFAULT_TIMEOUT_MS);
+
+        //soft reset and wait for the new contract
+        int soft_reset(uint32_t timeout_ms = STUSB_DEFAULT_TIMEOUT_MS);
+
+        //get_source_pdos() holds fresh capabilities once this returns STUSB_OK
+        int get_source_caps(uint32_t timeout_ms = STUSB_DEFAULT_TIMEOUT_MS);
+
+        pd_state get_state();
+        uint8_t get_source_pdos(uint32_t *pdos);    //copies the last received source PDOs, returns how many
+        bool get_contract(uint32_t &voltage_mv, uint32_t &current_ma); //false without a contract
+
+    private:
+        I2C &bus;
+        InterruptIn alert;
+        EventQueue *queue;
+        PlatformMutex lock;
+        Callback<void(pd_state)> on_state_change;
+        EventFlags events;      //PD_EVENT_* from the alert handling, for the blocking calls
+
+        pd_state state;
+        uint32_t src_pdos[STUSB_MAX_SRC_PDOS];
+        uint8_t src_pdo_count;
+        uint32_t snk_pdos[STUSB_MAX_SNK_PDOS];
+        uint8_t snk_pdo_count;
+
+        pd_sink_limits limits;
+        uint32_t requested_mv;  //voltage asked for with change_pdo(), 0 - most power within the limits
+
+        void handle_alert();            //alert service routine, runs on the event queue
+        void handle_message();          //read the PD message the chip received
+        void evaluate_capabilities();   //pick a source PDO and update the sink PDOs if needed
+        int update_sink_pdos(bool &renegotiating); //renegotiating - the sink PDOs changed and a soft reset was sent
+        void set_state(pd_state new_state);
+        bool send_control_message(uint8_t type);
+        int wait_for_contract(uint32_t timeout_ms); //after the event flags were cleared and the request sent
+
+        bool read_regs(uint8_t reg, uint8_t *dest, int len);
+        bool write_regs(uint8_t reg, const uint8_t *src, int len);
+
+};
+
+#endif
@@ -0,0 +1,157 @@
+#ifndef PD_CODEC_H
+#define PD_CODEC_H
+
+#include <stdint.h>
+
+/*
+ constexpr encoder/decoder for PD message headers, PDOs and RDOs
+ fields are plain shifts and masks on the integer value, so unlike the bitfield unions this replaces
+ the layout doesn't depend on the compiler, and decoding a constant costs nothing
+ bytes on the wire (and in the STUSB4500 registers) are LSB first, use the le16/le32 helpers
+
+ bit positions are from the USB-PD R3.0 tables, the message type values are in pd_spec_defines.h
+ sticks to single-return constexpr functions so it builds as C++11
+*/
+
+namespace pd {
+
+//a field of Width bits starting at bit Shift of a Word
+template<unsigned Shift, unsigned Width, typename Word = uint32_t>
+struct field {
+    static constexpr uint32_t max() { return (Width >= 32) ? 0xFFFFFFFFu : ((1u << Width) - 1); }
+    static constexpr Word mask() { return (Word)(max() << Shift); }
+
+    static constexpr uint32_t get(Word word) { return (uint32_t)(word >> Shift) & max(); }
+    static constexpr Word put(uint32_t value) { return (Word)((value & max()) << Shift); }
+    static constexpr Word set(Word word, uint32_t value) { return (Word)((word & (Word)~mask()) | put(value)); }
+};
+
+//wire byte order
+constexpr uint16_t le16(const uint8_t *b) { return (uint16_t)(b[0] | (b[1] << 8)); }
+constexpr uint32_t le32(const uint8_t *b) {
+    return (uint32_t)b[0] | ((uint32_t)b[1] << 8) | ((uint32_t)b[2] << 16) | ((uint32_t)b[3] << 24);
+}
+inline void put_le32(uint8_t *b, uint32_t value) {
+    b[0] = value & 0xFF;
+    b[1] = (value >> 8) & 0xFF;
+    b[2] = (value >> 16) & 0xFF;
+    b[3] = (value >> 24) & 0xFF;
+}
+
+//Table 6-1 Message Header
+namespace header {
+    typedef field<15, 1, uint16_t> extended;
+    typedef field<12, 3, uint16_t> number_of_data_objects;  //0 - control message
+    typedef field<9, 3, uint16_t> message_id;
+    typedef field<8, 1, uint16_t> port_power_role;          //cable plug on SOP'/SOP''
+    typedef field<6, 2, uint16_t> spec_revision;
+    typedef field<5, 1, uint16_t> port_data_role;
+    typedef field<0, 5, uint16_t> message_type;             //USBPD_CTRLMSG_* or USBPD_DATAMSG_*
+
+    constexpr bool is_control(uint16_t h) { return number_of_data_objects::get(h) == 0 && extended::get(h) == 0; }
+
+    constexpr uint16_t make(uint32_t type, uint32_t objects, uint32_t id = 0, uint32_t power_role = 0,
+                            uint32_t revision = 1, uint32_t data_role = 0) {
+        return (uint16_t)(message_type::put(type) | number_of_data_objects::put(objects) | message_id::put(id) |
+                          port_power_role::put(power_role) | spec_revision::put(revision) | port_data_role::put(data_role));
+    }
+}
+
+//Table 6-7 Power Data Object, the type is common to all PDOs
+namespace pdo {
+    typedef field<30, 2> type;
+    enum { FIXED = 0, BATTERY = 1, VARIABLE = 2, AUGMENTED = 3 };
+}
+
+//Table 6-9 Fixed Supply PDO - Source, Table 6-14 Fixed Supply PDO - Sink share the low 20 bits
+namespace fixed {
+    typedef field<29, 1> dual_role_power;
+    typedef field<28, 1> usb_suspend;       //higher capability on sink PDOs
+    typedef field<27, 1> unconstrained_power;
+    typedef field<26, 1> usb_comm_capable;
+    typedef field<25, 1> dual_role_data;
+    typedef field<20, 2> peak_current;      //source only
+    typedef field<10, 10> voltage_50mv;
+    typedef field<0, 10> current_10ma;      //maximum on sources, operational on sinks
+
+    constexpr uint32_t voltage_mv(uint32_t p) { return voltage_50mv::get(p) * 50; }
+    constexpr uint32_t current_ma(uint32_t p) { return current_10ma::get(p) * 10; }
+
+    //voltage and current of an existing PDO replaced, the flags are kept
+    constexpr uint32_t with(uint32_t p, uint32_t mv, uint32_t ma) {
+        return current_10ma::set(voltage_50mv::set(p, mv / 50), ma / 10);
+    }
+    constexpr uint32_t make(uint32_t mv, uint32_t ma) { return pdo::type::put(pdo::FIXED) | with(0, mv, ma); }
+}
+
+//Table 6-11 Variable Supply (non-Battery) PDO - Source
+namespace variable {
+    typedef field<20, 10> max_voltage_50mv;
+    typedef field<10, 10> min_voltage_50mv;
+    typedef field<0, 10> max_current_10ma;
+
+    constexpr uint32_t max_voltage_mv(uint32_t p) { return max_voltage_50mv::get(p) * 50; }
+    constexpr uint32_t min_voltage_mv(uint32_t p) { return min_voltage_50mv::get(p) * 50; }
+    constexpr uint32_t max_current_ma(uint32_t p) { return max_current_10ma::get(p) * 10; }
+    constexpr uint32_t make(uint32_t min_mv, uint32_t max_mv, uint32_t ma) {
+        return pdo::type::put(pdo::VARIABLE) | max_voltage_50mv::put(max_mv / 50) |
+               min_voltage_50mv::put(min_mv / 50) | max_current_10ma::put(ma / 10);
+    }
+}
+
+//Table 6-12 Battery Supply PDO - Source
+namespace battery {
+    typedef field<20, 10> max_voltage_50mv;
+    typedef field<10, 10> min_voltage_50mv;
+    typedef field<0, 10> max_power_250mw;
+
+    constexpr uint32_t max_voltage_mv(uint32_t p) { return max_voltage_50mv::get(p) * 50; }
+    constexpr uint32_t min_voltage_mv(uint32_t p) { return min_voltage_50mv::get(p) * 50; }
+    constexpr uint32_t max_power_mw(uint32_t p) { return max_power_250mw::get(p) * 250; }
+    constexpr uint32_t make(uint32_t min_mv, uint32_t max_mv, uint32_t mw) {
+        return pdo::type::put(pdo::BATTERY) | max_voltage_50mv::put(max_mv / 50) |
+               min_voltage_50mv::put(min_mv / 50) | max_power_250mw::put(mw / 250);
+    }
+}
+
+//Table 6-18 Fixed and Variable Request Data Object
+namespace rdo {
+    typedef field<28, 3> object_position;   //1-7
+    typedef field<27, 1> giveback;
+    typedef field<26, 1> capability_mismatch;
+    typedef field<25, 1> usb_comm_capable;
+    typedef field<24, 1> no_usb_suspend;
+    typedef field<23, 1> unchunked_extended;
+    typedef field<10, 10> operating_current_10ma;
+    typedef field<0, 10> max_operating_current_10ma;
+
+    constexpr uint32_t operating_current_ma(uint32_t r) { return operating_current_10ma::get(r) * 10; }
+    constexpr uint32_t max_operating_current_ma(uint32_t r) { return max_operating_current_10ma::get(r) * 10; }
+    constexpr uint32_t make(uint32_t position, uint32_t ma, uint32_t max_ma) {
+        return object_position::put(position) | no_usb_suspend::put(1) |
+               operating_current_10ma::put(ma / 10) | max_operating_current_10ma::put(max_ma / 10);
+    }
+}
+
+//round trips, checked at every build on target and host alike
+static_assert(header::number_of_data_objects::get(header::make(1, 7)) == 7, "7 data objects need all 3 bits");
+static_assert(header::message_id::get(header::make(3, 0, 5)) == 5, "message ID is 3 bits");
+static_assert(header::message_type::get(header::make(0x0D, 0)) == 0x0D, "message type");
+static_assert(header::is_control(header::make(0x0D, 0)) && !header::is_control(header::make(1, 2)), "control vs data");
+static_assert(header::make(0x0D, 0) == 0x004D, "Soft_Reset header, rev 2.0");
+static_assert(fixed::make(5000, 3000) == 0x0001912C, "5V 3A fixed PDO");
+static_assert(fixed::voltage_mv(0x0002D12C) == 9000 && fixed::current_ma(0x0002D12C) == 3000, "9V 3A fixed PDO");
+static_assert(fixed::voltage_mv(fixed::with(0x3601912C, 15000, 2000)) == 15000, "voltage replaced");
+static_assert((fixed::with(0x3601912C, 15000, 2000) >> 20) == (0x3601912Cu >> 20), "flags kept");
+static_assert(pdo::type::get(variable::make(5000, 12000, 2000)) == pdo::VARIABLE, "variable PDO type");
+static_assert(variable::min_voltage_mv(variable::make(5000, 12000, 2000)) == 5000 &&
+              variable::max_voltage_mv(variable::make(5000, 12000, 2000)) == 12000 &&
+              variable::max_current_ma(variable::make(5000, 12000, 2000)) == 2000, "variable PDO round trip");
+static_assert(pdo::type::get(battery::make(9000, 20000, 45000)) == pdo::BATTERY &&
+              battery::max_power_mw(battery::make(9000, 20000, 45000)) == 45000, "battery PDO round trip");
+static_assert(rdo::object_position::get(rdo::make(2, 3000, 3000)) == 2 &&
+              rdo::operating_current_ma(rdo::make(2, 3000, 3000)) == 3000, "RDO round trip");
+
+}
+
+#endif
@@ -135,6 +135,33 @@ typedef union {
     } map;
 } Alt_S1Reg_Map;
 
+/*
+============================ ALERT register block ============================
+    registers 0x0B (ALERT_STATUS_1) through 0x16 (PRT_STATUS) are contiguous and the STUSB4500
+    auto-increments the register address, so they're fetched in a single burst read
+    reading them clears the alert line (same thing the ST init code does with its 12 byte read)
+*/
+#define ALERT_BLOCK_START_REG 0x0B
+#define ALERT_BLOCK_LEN 12
+
+typedef union {
+    uint8_t data[ALERT_BLOCK_LEN];
+    struct {
+        Alt_S1Reg_Map alert_status;     //0x0B, same layout as the mask, but 1 means asserted
+        Alt_S1Reg_Map alert_mask;       //0x0C
+        uint8_t port_status_0;          //0x0D, transitions
+        uint8_t port_status_1;          //0x0E, bit 0 is ATTACH
+        uint8_t typec_mon_status_0;     //0x0F, transitions
+        uint8_t typec_mon_status_1;     //0x10, VBUS valid/VSAFE0V
+        CC_Reg_Map cc_status;           //0x11
+        uint8_t cc_hw_fault_status_0;   //0x12, transitions
+        uint8_t cc_hw_fault_status_1;   //0x13
+        uint8_t pd_typec_status;        //0x14
+        uint8_t typec_status;           //0x15
+        uint8_t prt_status;             //0x16, bit 2 is MSG_RECEIVED
+    } map;
+} Alert_Block_Map;
+
 /*
 ============================ HEADER Structure ============================
 https://www.embedded.com/usb-type-c-and-power-delivery-101-power-delivery-protocol/
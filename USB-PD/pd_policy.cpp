@@ -0,0 +1,101 @@
+#include "pd_policy.h"
+#include "pd_codec.h"
+
+#define PD_CHARGER_MIN_VOLTAGE_MV 5000
+#define PD_CHARGER_MAX_VOLTAGE_MV 20000
+
+//limits of our charger: 5-20V in, 5A
+pd_sink_limits pd_charger_limits() {
+    pd_sink_limits limits;
+    limits.min_voltage_mv = PD_CHARGER_MIN_VOLTAGE_MV;
+    limits.max_voltage_mv = PD_CHARGER_MAX_VOLTAGE_MV;
+    limits.max_current_ma = PD_CHARGER_MAX_CURRENT_MA;
+    limits.min_power_mw = 0;
+    limits.type_mask = PD_ACCEPT_FIXED | PD_ACCEPT_VARIABLE | PD_ACCEPT_BATTERY;
+    return limits;
+}
+
+pd_src_pdo pd_decode_src_pdo(uint32_t pdo) {
+    pd_src_pdo d;
+    d.type = pd::pdo::type::get(pdo);
+    d.max_ma = 0;
+    d.max_mw = 0;
+
+    switch(d.type) {
+        case pd::pdo::FIXED:
+            d.min_mv = pd::fixed::voltage_mv(pdo);
+            d.max_mv = d.min_mv;
+            d.max_ma = pd::fixed::current_ma(pdo);
+            break;
+        case pd::pdo::VARIABLE:
+            d.min_mv = pd::variable::min_voltage_mv(pdo);
+            d.max_mv = pd::variable::max_voltage_mv(pdo);
+            d.max_ma = pd::variable::max_current_ma(pdo);
+            break;
+        case pd::pdo::BATTERY:
+            d.min_mv = pd::battery::min_voltage_mv(pdo);
+            d.max_mv = pd::battery::max_voltage_mv(pdo);
+            d.max_mw = pd::battery::max_power_mw(pdo);
+            break;
+        default: //augmented (PPS), not handled
+            d.min_mv = 0;
+            d.max_mv = 0;
+            break;
+    }
+    return d;
+}
+
+//charge power a PDO guarantees within the limits, 0 if the PDO can't be used
+uint32_t pd_deliverable_power(const pd_src_pdo &pdo, const pd_sink_limits &limits, uint32_t &current_ma) {
+    uint8_t accept = pdo.type == pd::pdo::FIXED ? PD_ACCEPT_FIXED :
+                     pdo.type == pd::pdo::VARIABLE ? PD_ACCEPT_VARIABLE :
+                     pdo.type == pd::pdo::BATTERY ? PD_ACCEPT_BATTERY : 0;
+    current_ma = 0;
+
+    //the whole range the source may output has to be safe for the charger
+    if(!(limits.type_mask & accept) || pdo.min_mv == 0 ||
+            pdo.min_mv < limits.min_voltage_mv || pdo.max_mv > limits.max_voltage_mv) {
+        return 0;
+    }
+
+    if(pdo.type == pd::pdo::BATTERY) {
+        //power limited, the current allowed is highest at the lowest voltage
+        current_ma = pdo.max_mw * 1000 / pdo.min_mv;
+    } else {
+        current_ma = pdo.max_ma;
+    }
+    current_ma = current_ma > limits.max_current_ma ? limits.max_current_ma : current_ma;
+
+    uint32_t power_mw = pdo.min_mv * current_ma / 1000;
+    if(power_mw < limits.min_power_mw) {
+        current_ma = 0;
+        return 0;
+    }
+    return power_mw;
+}
+
+//rank the PDOs of a Source_Capabilities message, false if none is acceptable
+bool pd_select_pdo(const uint32_t *pdos, int count, const pd_sink_limits &limits, pd_choice &choice) {
+    choice.index = 0;
+    choice.voltage_mv = 0;
+    choice.current_ma = 0;
+    choice.power_mw = 0;
+
+    for(int i = 0; i < count; i++) {
+        pd_src_pdo pdo = pd_decode_src_pdo(pdos[i]);
+        uint32_t current_ma;
+        uint32_t power_mw = pd_deliverable_power(pdo, limits, current_ma);
+
+        if(power_mw == 0) {
+            continue;
+        }
+        if(power_mw > choice.power_mw || (power_mw == choice.power_mw && pdo.min_mv > choice.voltage_mv)) {
+            choice.index = i + 1;
+            choice.voltage_mv = pdo.min_mv;
+            choice.current_ma = current_ma;
+            choice.power_mw = power_mw;
+        }
+    }
+
+    return choice.index != 0;
+}
@@ -0,0 +1,55 @@
+#ifndef PD_POLICY_H
+#define PD_POLICY_H
+
+#include <stdint.h>
+
+//PDO selection for the charger: decode the source PDOs and pick the one delivering the most charge power
+
+#define PD_CHARGER_MAX_CURRENT_MA 5000  //input current, the USB-PD maximum (5A needs an e-marked cable)
+                                        //not CHARGE_IMAX in DAC_test/Charger.cpp, that's the charging current
+
+//bits of pd_sink_limits.type_mask
+#define PD_ACCEPT_FIXED     (1 << 0)
+#define PD_ACCEPT_VARIABLE  (1 << 1)
+#define PD_ACCEPT_BATTERY   (1 << 2)
+
+//a source PDO of any type, decoded to plain units
+struct pd_src_pdo {
+    uint8_t type;           //pd::pdo::FIXED, BATTERY, VARIABLE or AUGMENTED
+    uint32_t min_mv;        //fixed supplies have min_mv == max_mv
+    uint32_t max_mv;
+    uint32_t max_ma;        //0 for batteries, they give a power limit instead
+    uint32_t max_mw;        //0 for fixed and variable supplies
+};
+
+//what the sink side can take
+struct pd_sink_limits {
+    uint32_t min_voltage_mv;    //lowest input voltage the charger works from
+    uint32_t max_voltage_mv;    //highest input voltage the charger is rated for
+    uint32_t max_current_ma;    //input current the charger draws at most
+    uint32_t min_power_mw;      //PDOs delivering less are not worth a contract
+    uint8_t type_mask;          //PD_ACCEPT_* types that can be requested
+};
+
+//the contract to request
+struct pd_choice {
+    int index;              //PDO position 1-7, 0 - nothing acceptable
+    uint32_t voltage_mv;    //worst case (lowest) voltage of the PDO
+    uint32_t current_ma;    //operating current to request
+    uint32_t power_mw;      //charge power guaranteed at that voltage and current
+};
+
+//limits of our charger: 5-20V in, 5A
+pd_sink_limits pd_charger_limits();
+
+pd_src_pdo pd_decode_src_pdo(uint32_t pdo);
+
+//charge power a PDO guarantees within the limits, 0 if the PDO can't be used
+//variable and battery supplies are rated at their lowest voltage, where the current is highest
+uint32_t pd_deliverable_power(const pd_src_pdo &pdo, const pd_sink_limits &limits, uint32_t &current_ma);
+
+//rank the PDOs of a Source_Capabilities message, false if none is acceptable
+//ties go to the higher voltage (less current, less loss in the cable), then to the lower index
+bool pd_select_pdo(const uint32_t *pdos, int count, const pd_sink_limits &limits, pd_choice &choice);
+
+#endif
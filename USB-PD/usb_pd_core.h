@@ -61,13 +61,7 @@ extern "C" {
 #define true 1
 #define false 0    
   
-#define LE16(addr) (((uint16_t)(*((uint8_t *)(addr))))\
-  + (((uint16_t)(*(((uint8_t *)(addr)) + 1))) << 8))
-
-#define LE32(addr) ((((uint32_t)(*(((uint8_t *)(addr)) + 0))) + \
-(((uint32_t)(*(((uint8_t *)(addr)) + 1))) << 8) + \
-  (((uint32_t)(*(((uint8_t *)(addr)) + 2))) << 16) + \
-    (((uint32_t)(*(((uint8_t *)(addr)) + 3))) << 24)))
+/* LE16/LE32 removed, use pd::le16/pd::le32 from pd_codec.h */
 
 
 typedef uint8_t bool;
@@ -121,80 +115,8 @@ typedef struct
     uint8_t Discharge_time_to0;
     uint8_t Discharge_time_transition;
   }USB_PD_CTRLTypeDef;
-/** @defgroup USBPD_MsgHeaderStructure_definition USB PD Message header Structure definition
-* @brief USB PD Message header Structure definition
-* @{
-*/
-typedef union
-  {
-    uint16_t d16;
-    struct
-      {
-#if defined(USBPD_REV30_SUPPORT)
-        uint16_t MessageType :                  /*!< Message Header's message Type                      */
-          5;
-#else /* USBPD_REV30_SUPPORT */
-          uint16_t MessageType :                  /*!< Message Header's message Type                      */
-            4;
-            uint16_t Reserved4 :                    /*!< Reserved                                           */
-              1;
-#endif /* USBPD_REV30_SUPPORT */
-              uint16_t PortDataRole :                 /*!< Message Header's Port Data Role                    */
-                1;                                    
-                uint16_t SpecificationRevision :        /*!< Message Header's Spec Revision                     */
-                  2;       
-                  uint16_t PortPowerRole_CablePlug :      /*!< Message Header's Port Power Role/Cable Plug field  */
-                    1;       
-                    uint16_t MessageID :                    /*!< Message Header's message ID                        */
-                      3;    
-                      uint16_t NumberOfDataObjects :          /*!< Message Header's Number of data object             */
-                        3;                
-                        uint16_t Extended :                     /*!< Reserved                                           */
-                          1; 
-      }
-    b;
-  } USBPD_MsgHeader_TypeDef;
-
-
-
-
-typedef union 
-  {
-    uint32_t d32;        
-    struct
-      {       
-        //Table 6-9 Fixed Supply PDO - Source
-        uint32_t Max_Operating_Current :10; //Bits 9..0
-        uint32_t Voltage :10;  //Bits 19..10
-        uint8_t PeakCurrent:2; //Bits 21..20
-        uint8_t Reserved :3;
-        uint8_t DataRoleSwap:1; //Bits 25
-        uint8_t Communication:1; //Bits 26
-        uint8_t ExternalyPowered:1; //Bits 27
-        uint8_t SuspendSuported:1;  //Bits 28
-        uint8_t DualRolePower :1;  //Bits 29
-        uint8_t FixedSupply:2;  //Bits 31..30
-      } fix;		
-    
-    struct
-      {
-        //Table 6-11 Variable Supply (non-Battery) PDO - Source
-        uint32_t Operating_Current :10;
-        uint32_t Min_Voltage:10;
-        uint32_t Max_Voltage:10;
-        uint8_t VariableSupply:2; 
-      }var;
-    
-    struct
-      {
-        //Table 6-12 Battery Supply PDO - Source
-        uint32_t Operating_Power :10;
-        uint32_t Min_Voltage:10;
-        uint32_t Max_Voltage:10;
-        uint8_t Battery:2; 
-      }bat;   
-    
-  } USB_PD_SRC_PDOTypeDef;
+/* Message header and PDO bitfield unions removed, their layout depends on the compiler.
+   Decode with pd_codec.h (pd::header, pd::fixed, pd::variable, pd::battery) instead. */
 
 
 
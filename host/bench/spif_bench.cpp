@@ -0,0 +1,88 @@
+//SPIFBlockDevicePD throughput on the simulated NOR flash, in simulated time
+//usage: spif_bench [spi_hz]
+//times come from the flash model (W25Q32JV typical values) and the bus cost model in sim_bus.h,
+//compare runs of the same build, not against a board
+
+#include <inttypes.h>
+#include "mbed.h"
+#include "SPIFBlockDevicePD.h"
+#include "nor_flash.h"
+#include "sim_kernel.h"
+
+using namespace sim;
+
+static uint8_t buffer[64 * 1024];
+
+struct sample {
+    uint64_t ns;
+    uint64_t transactions;
+    uint64_t calls;
+};
+
+static void start(sample &s)
+{
+    reset_bus_counters();
+    s.ns = now_ns();
+}
+
+static void stop(sample &s)
+{
+    s.ns = now_ns() - s.ns;
+    s.transactions = counters().spi_selects;
+    s.calls = counters().spi_calls;
+}
+
+static void report(const char *what, uint64_t bytes, const sample &s)
+{
+    double seconds = s.ns / 1e9;
+    printf("%-24s %8" PRIu64 " B %10.3f ms %9.3f MB/s %8" PRIu64 " transactions %8" PRIu64 " SPI calls\n",
+           what, bytes, seconds * 1e3, (bytes / 1e6) / seconds, s.transactions, s.calls);
+}
+
+int main(int argc, char **argv)
+{
+    int hz = (argc > 1) ? atoi(argv[1]) : 40000000;
+
+    nor_flash flash(nor_config_w25q32());
+    flash.attach(PA_5, PA_4);
+    SPIFBlockDevicePD bd(PA_7, PA_6, PA_5, PA_4, hz);
+    if (bd.init() != 0) {
+        printf("init failed\n");
+        return 1;
+    }
+    printf("%s, SPI %d Hz, %" PRIu32 " ns per SPI call\n", flash.config().name, hz, timing().spi_call_ns);
+
+    for (size_t i = 0; i < sizeof(buffer); i++) {
+        buffer[i] = (uint8_t)rand();
+    }
+
+    sample s;
+    start(s);
+    bd.erase(0, sizeof(buffer));
+    stop(s);
+    report("erase 64KB", sizeof(buffer), s);
+
+    start(s);
+    bd.program(buffer, 0, sizeof(buffer));
+    stop(s);
+    report("program 64KB", sizeof(buffer), s);
+
+    static const uint32_t read_sizes[] = {16, 256, 4096, 65536};
+    for (uint32_t size : read_sizes) {
+        uint32_t count = sizeof(buffer) / size;
+        char what[32];
+        snprintf(what, sizeof(what), "read %" PRIu32 " x %" PRIu32 "B", count, size);
+        start(s);
+        for (uint32_t i = 0; i < count; i++) {
+            bd.read(buffer, i * size, size);
+        }
+        stop(s);
+        report(what, sizeof(buffer), s);
+    }
+
+    bd.deinit();
+    printf("flash busy %.3f ms, %" PRIu32 " status polls, %" PRIu32 " violations\n",
+           flash.stats().busy_ns / 1e6, flash.stats().status_polls, flash.stats().violations());
+    flash.detach();
+    return flash.stats().violations() ? 1 : 0;
+}
@@ -0,0 +1,32 @@
+#ifndef MBED_DIGITALIN_H
+#define MBED_DIGITALIN_H
+
+//host stand-in for mbed-os drivers/DigitalIn.h, reads a sim pin
+
+#include "PinNames.h"
+
+namespace mbed {
+
+class DigitalIn {
+public:
+    DigitalIn(PinName pin, PinMode mode = PullDefault);
+
+    int read();
+    void mode(PinMode pull);
+    int is_connected()
+    {
+        return _pin != NC;
+    }
+
+    operator int()
+    {
+        return read();
+    }
+
+private:
+    PinName _pin;
+};
+
+}
+
+#endif
@@ -0,0 +1,43 @@
+#ifndef MBED_DIGITALOUT_H
+#define MBED_DIGITALOUT_H
+
+//host stand-in for mbed-os drivers/DigitalOut.h, drives a sim pin (chip selects reach the sim devices)
+
+#include "PinNames.h"
+
+namespace mbed {
+
+class DigitalOut {
+public:
+    DigitalOut(PinName pin);
+    DigitalOut(PinName pin, int value);
+
+    void write(int value);
+    int read();
+    int is_connected()
+    {
+        return _pin != NC;
+    }
+
+    DigitalOut &operator=(int value)
+    {
+        write(value);
+        return *this;
+    }
+    DigitalOut &operator=(DigitalOut &rhs)
+    {
+        write(rhs.read());
+        return *this;
+    }
+    operator int()
+    {
+        return read();
+    }
+
+private:
+    PinName _pin;
+};
+
+}
+
+#endif
@@ -0,0 +1,31 @@
+#ifndef MBED_I2C_H
+#define MBED_I2C_H
+
+//host stand-in for mbed-os drivers/I2C.h
+//transfers go to the sim device at the address on the data pin, costing the bus time at the set frequency
+
+#include "PinNames.h"
+
+namespace mbed {
+
+class I2C {
+public:
+    I2C(PinName sda, PinName scl);
+    virtual ~I2C() {}
+
+    void frequency(int hz);
+    //0 on ACK, non-0 on NACK
+    int read(int address, char *data, int length, bool repeated = false);
+    int write(int address, const char *data, int length, bool repeated = false);
+
+    virtual void lock(void);
+    virtual void unlock(void);
+
+private:
+    PinName _sda;
+    int _hz;
+};
+
+}
+
+#endif
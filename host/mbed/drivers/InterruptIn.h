@@ -0,0 +1,40 @@
+#ifndef MBED_INTERRUPTIN_H
+#define MBED_INTERRUPTIN_H
+
+//host stand-in for mbed-os drivers/InterruptIn.h
+//handlers run synchronously in the thread that changed the sim pin, as an interrupt would
+
+#include "PinNames.h"
+#include "platform/Callback.h"
+
+namespace mbed {
+
+class InterruptIn {
+public:
+    InterruptIn(PinName pin, PinMode mode = PullDefault);
+    virtual ~InterruptIn();
+
+    int read();
+    void rise(Callback<void()> func);
+    void fall(Callback<void()> func);
+    void mode(PinMode pull);
+    void enable_irq();
+    void disable_irq();
+
+    operator int()
+    {
+        return read();
+    }
+
+private:
+    void edge(int level);
+
+    PinName _pin;
+    Callback<void()> _rise;
+    Callback<void()> _fall;
+    bool _enabled;
+};
+
+}
+
+#endif
@@ -0,0 +1,50 @@
+#ifndef MBED_CRC_API_H
+#define MBED_CRC_API_H
+
+//host stand-in for mbed-os drivers/MbedCRC.h, only the CRC32 (POLY_32BIT_ANSI) the drivers use:
+//reflected, initial value and final XOR 0xFFFFFFFF, the same values the target computes
+
+#include <stdint.h>
+
+namespace mbed {
+
+typedef enum crc_polynomial {
+    POLY_32BIT_ANSI = 0x04C11DB7,
+} crc_polynomial_t;
+
+uint32_t crc32_ansi_update(uint32_t crc, const void *buffer, unsigned long long size);
+
+template <uint32_t polynomial = POLY_32BIT_ANSI, int width = 32>
+class MbedCRC {
+    static_assert(polynomial == POLY_32BIT_ANSI && width == 32, "only CRC32 ANSI is simulated");
+
+public:
+    int32_t compute(const void *buffer, unsigned long long size, uint32_t *crc)
+    {
+        compute_partial_start(crc);
+        compute_partial(buffer, size, crc);
+        return compute_partial_stop(crc);
+    }
+
+    int32_t compute_partial_start(uint32_t *crc)
+    {
+        *crc = 0xFFFFFFFF;
+        return 0;
+    }
+
+    int32_t compute_partial(const void *buffer, unsigned long long size, uint32_t *crc)
+    {
+        *crc = crc32_ansi_update(*crc, buffer, size);
+        return 0;
+    }
+
+    int32_t compute_partial_stop(uint32_t *crc)
+    {
+        *crc ^= 0xFFFFFFFF;
+        return 0;
+    }
+};
+
+}
+
+#endif
@@ -0,0 +1,35 @@
+#ifndef MBED_SPI_H
+#define MBED_SPI_H
+
+//host stand-in for mbed-os drivers/SPI.h
+//bytes go to the sim devices attached to the clock pin whose chip select is low, each call costs
+//the bus time at the set frequency plus the driver overhead (sim::spi_timing)
+
+#include "PinNames.h"
+
+namespace mbed {
+
+class SPI {
+public:
+    SPI(PinName mosi, PinName miso, PinName sclk, PinName ssel = NC);
+    virtual ~SPI() {}
+
+    void format(int bits, int mode = 0);
+    void frequency(int hz = 1000000);
+    virtual int write(int value);
+    virtual int write(const char *tx_buffer, int tx_length, char *rx_buffer, int rx_length);
+    void set_default_write_value(char data);
+
+    //shared by all SPI objects on the same bus, like the peripheral mutex on the target
+    virtual void lock(void);
+    virtual void unlock(void);
+
+private:
+    PinName _sclk;
+    int _hz;
+    char _write_fill;
+};
+
+}
+
+#endif
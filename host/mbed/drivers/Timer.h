@@ -0,0 +1,32 @@
+#ifndef MBED_TIMER_H
+#define MBED_TIMER_H
+
+//host stand-in for mbed-os drivers/Timer.h, measures sim time
+
+#include <stdint.h>
+
+namespace mbed {
+
+class Timer {
+public:
+    Timer() : _running(false), _start_ns(0), _elapsed_ns(0) {}
+
+    void start();
+    void stop();
+    void reset();
+    float read();
+    int read_ms();
+    int read_us();
+    uint64_t read_high_resolution_us();
+
+private:
+    uint64_t elapsed_ns();
+
+    bool _running;
+    uint64_t _start_ns;
+    uint64_t _elapsed_ns;
+};
+
+}
+
+#endif
@@ -0,0 +1,130 @@
+#ifndef EVENT_QUEUE_H
+#define EVENT_QUEUE_H
+
+//host stand-in for mbed-os events/EventQueue.h, dispatched in sim time
+//memory is accounted like the target: each event takes EVENTS_EVENT_SIZE plus its bound arguments
+//from the queue size, call() returns 0 once it is used up
+
+#include <stdint.h>
+#include <stddef.h>
+#include <functional>
+#include <list>
+#include "platform/Callback.h"
+
+#define EVENTS_EVENT_SIZE 64
+#define EVENTS_QUEUE_SIZE (32 * EVENTS_EVENT_SIZE)
+
+namespace events {
+
+template <typename... ArgTs>
+struct args_size;
+
+template <>
+struct args_size<> {
+    static const size_t value = 0;
+};
+
+template <typename A, typename... ArgTs>
+struct args_size<A, ArgTs...> {
+    static const size_t value = sizeof(A) + args_size<ArgTs...>::value;
+};
+
+class EventQueue {
+public:
+    EventQueue(unsigned size = EVENTS_QUEUE_SIZE, unsigned char *buffer = NULL);
+    ~EventQueue();
+
+    void dispatch(int ms = -1);
+    void dispatch_forever()
+    {
+        dispatch();
+    }
+    void break_dispatch();
+    bool cancel(int id);
+    int time_left(int id);
+
+    template <typename F, typename... ArgTs>
+    int call(F f, ArgTs... args)
+    {
+        return post([f, args...]() mutable { f(args...); }, args_size<ArgTs...>::value, 0, -1);
+    }
+
+    template <typename T, typename R, typename... BoundTs, typename... ArgTs>
+    int call(T *obj, R(T::*method)(BoundTs...), ArgTs... args)
+    {
+        return post([obj, method, args...]() { (obj->*method)(args...); }, args_size<ArgTs...>::value, 0, -1);
+    }
+
+    template <typename F, typename... ArgTs>
+    int call_in(int ms, F f, ArgTs... args)
+    {
+        return post([f, args...]() mutable { f(args...); }, args_size<ArgTs...>::value, ms, -1);
+    }
+
+    template <typename T, typename R, typename... BoundTs, typename... ArgTs>
+    int call_in(int ms, T *obj, R(T::*method)(BoundTs...), ArgTs... args)
+    {
+        return post([obj, method, args...]() { (obj->*method)(args...); }, args_size<ArgTs...>::value, ms, -1);
+    }
+
+    template <typename F, typename... ArgTs>
+    int call_every(int ms, F f, ArgTs... args)
+    {
+        return post([f, args...]() mutable { f(args...); }, args_size<ArgTs...>::value, ms, ms);
+    }
+
+    template <typename T, typename R, typename... BoundTs, typename... ArgTs>
+    int call_every(int ms, T *obj, R(T::*method)(BoundTs...), ArgTs... args)
+    {
+        return post([obj, method, args...]() { (obj->*method)(args...); }, args_size<ArgTs...>::value, ms, ms);
+    }
+
+    //callback posting the call each time it is called (from an interrupt handler typically)
+    template <typename T, typename R>
+    mbed::Callback<void()> event(T *obj, R(T::*method)())
+    {
+        return mbed::Callback<void()>([this, obj, method]() { call(obj, method); });
+    }
+
+    template <typename F>
+    mbed::Callback<void()> event(F f)
+    {
+        return mbed::Callback<void()>([this, f]() { call(f); });
+    }
+
+    //events dispatched and events call() refused for lack of memory, since construction
+    uint32_t dispatched_count() const
+    {
+        return _dispatched;
+    }
+    uint32_t refused_count() const
+    {
+        return _refused;
+    }
+
+private:
+    struct pending {
+        int id;
+        uint64_t due_ns;
+        int period_ms;
+        size_t cost;
+        std::function<void()> fn;
+    };
+
+    EventQueue(const EventQueue &);
+    EventQueue &operator=(const EventQueue &);
+
+    int post(std::function<void()> fn, size_t args_bytes, int delay_ms, int period_ms);
+
+    std::list<pending> _events;
+    size_t _size;
+    size_t _used;
+    int _next_id;
+    bool _break;
+    uint32_t _dispatched;
+    uint32_t _refused;
+};
+
+}
+
+#endif
@@ -0,0 +1,15 @@
+#ifndef MBED_SHARED_QUEUES_H
+#define MBED_SHARED_QUEUES_H
+
+//host stand-in for mbed-os events/mbed_shared_queues.h
+
+#include "events/EventQueue.h"
+
+namespace mbed {
+
+//shared queue, dispatched by its own sim thread started on first use
+events::EventQueue *mbed_event_queue();
+
+}
+
+#endif
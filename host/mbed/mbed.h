@@ -0,0 +1,36 @@
+#ifndef MBED_H
+#define MBED_H
+
+//host stand-in for mbed-os mbed.h, the parts of the API the drivers in this repo use
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stddef.h>
+
+#include "PinNames.h"
+#include "platform/Callback.h"
+#include "platform/PlatformMutex.h"
+#include "platform/mbed_wait_api.h"
+#include "platform/mbed_critical.h"
+#include "platform/mbed_debug.h"
+#include "rtos/rtos.h"
+#include "drivers/DigitalIn.h"
+#include "drivers/DigitalOut.h"
+#include "drivers/InterruptIn.h"
+#include "drivers/SPI.h"
+#include "drivers/I2C.h"
+#include "drivers/Timer.h"
+#include "drivers/MbedCRC.h"
+#include "events/EventQueue.h"
+#include "events/mbed_shared_queues.h"
+
+//mbed_thread.h
+void thread_sleep_for(uint32_t millisec);
+
+using namespace mbed;
+using namespace rtos;
+using namespace events;
+
+#endif
@@ -0,0 +1,677 @@
+//host implementation of the mbed shim on top of the sim kernel and buses
+
+#include "mbed.h"
+#include "mbed_trace.h"
+#include "sim_kernel.h"
+#include "sim_bus.h"
+
+#include <stdarg.h>
+#include <map>
+#include <vector>
+
+#define NS_PER_MS 1000000ULL
+
+/***************************************************/
+/********************** rtos ***********************/
+/***************************************************/
+namespace rtos {
+
+Mutex::Mutex() : _owner(NULL), _count(0)
+{
+}
+
+Mutex::Mutex(const char * /*name*/) : _owner(NULL), _count(0)
+{
+}
+
+osStatus Mutex::lock()
+{
+    sim::thread *me = sim::current_thread();
+    while ((_owner != NULL) && (_owner != me)) {
+        sim::block();
+    }
+    _owner = me;
+    _count++;
+    return osOK;
+}
+
+osStatus Mutex::lock(uint32_t millisec)
+{
+    return trylock_for(millisec) ? osOK : osErrorTimeout;
+}
+
+bool Mutex::trylock()
+{
+    return trylock_for(0);
+}
+
+bool Mutex::trylock_for(uint32_t millisec)
+{
+    sim::thread *me = sim::current_thread();
+    uint64_t deadline = (millisec == osWaitForever) ? SIM_NEVER : sim::now_ns() + millisec * NS_PER_MS;
+    while ((_owner != NULL) && (_owner != me)) {
+        if (sim::now_ns() >= deadline) {
+            return false;
+        }
+        sim::block(deadline);
+    }
+    _owner = me;
+    _count++;
+    return true;
+}
+
+osStatus Mutex::unlock()
+{
+    if ((_owner != sim::current_thread()) || (_count == 0)) {
+        return osErrorResource;
+    }
+    if (--_count == 0) {
+        _owner = NULL;
+        sim::notify();
+    }
+    return osOK;
+}
+
+osThreadId_t Mutex::get_owner()
+{
+    return _owner;
+}
+
+Thread::Thread(osPriority priority, uint32_t /*stack_size*/, unsigned char * /*stack_mem*/, const char *name)
+    : _priority(priority), _name(name), _thread(NULL)
+{
+}
+
+Thread::~Thread()
+{
+    terminate();
+}
+
+osStatus Thread::start(mbed::Callback<void()> task)
+{
+    if (_thread != NULL) {
+        return osErrorParameter;
+    }
+    _thread = sim::start_thread([task] { task(); }, _priority);
+    return osOK;
+}
+
+osStatus Thread::join()
+{
+    if (_thread != NULL) {
+        sim::join_thread(_thread);
+    }
+    return osOK;
+}
+
+osStatus Thread::terminate()
+{
+    if ((_thread != NULL) && (_thread != sim::current_thread()) && !sim::thread_done(_thread)) {
+        sim::abandon_thread(_thread);
+    }
+    return osOK;
+}
+
+osPriority Thread::get_priority() const
+{
+    return _priority;
+}
+
+const char *Thread::get_name() const
+{
+    return _name;
+}
+
+namespace ThisThread {
+
+void sleep_for(uint32_t millisec)
+{
+    sim::sleep_ns(millisec * NS_PER_MS);
+}
+
+void sleep_until(uint64_t millisec)
+{
+    uint64_t deadline = millisec * NS_PER_MS;
+    while (sim::now_ns() < deadline) {
+        sim::block(deadline);
+    }
+}
+
+void yield()
+{
+    sim::spend_ns(sim::timing().yield_ns);
+    sim::yield();
+}
+
+osThreadId_t get_id()
+{
+    return sim::current_thread();
+}
+
+}
+
+namespace Kernel {
+
+uint64_t get_ms_count()
+{
+    return sim::now_ns() / NS_PER_MS;
+}
+
+}
+
+EventFlags::EventFlags() : _flags(0)
+{
+}
+
+EventFlags::EventFlags(const char * /*name*/) : _flags(0)
+{
+}
+
+uint32_t EventFlags::set(uint32_t flags)
+{
+    _flags |= flags;
+    sim::notify();
+    return _flags;
+}
+
+uint32_t EventFlags::clear(uint32_t flags)
+{
+    uint32_t previous = _flags;
+    _flags &= ~flags;
+    return previous;
+}
+
+uint32_t EventFlags::get() const
+{
+    return _flags;
+}
+
+uint32_t EventFlags::wait_all(uint32_t flags, uint32_t millisec, bool clear)
+{
+    return wait(flags, osFlagsWaitAll, millisec, clear);
+}
+
+uint32_t EventFlags::wait_any(uint32_t flags, uint32_t millisec, bool clear)
+{
+    return wait(flags, osFlagsWaitAny, millisec, clear);
+}
+
+uint32_t EventFlags::wait(uint32_t flags, uint32_t opt, uint32_t millisec, bool clear)
+{
+    uint64_t deadline = (millisec == osWaitForever) ? SIM_NEVER : sim::now_ns() + millisec * NS_PER_MS;
+
+    while (true) {
+        bool satisfied = (opt & osFlagsWaitAll) ? ((_flags & flags) == flags) : ((_flags & flags) != 0);
+        if (satisfied) {
+            uint32_t result = _flags;
+            if (clear) {
+                _flags &= ~flags;
+            }
+            return result;
+        }
+        if (sim::now_ns() >= deadline) {
+            return (millisec == 0) ? osFlagsErrorResource : osFlagsErrorTimeout;
+        }
+        sim::block(deadline);
+    }
+}
+
+}
+
+/***************************************************/
+/********************* events **********************/
+/***************************************************/
+namespace events {
+
+EventQueue::EventQueue(unsigned size, unsigned char * /*buffer*/)
+    : _size(size), _used(0), _next_id(1), _break(false), _dispatched(0), _refused(0)
+{
+}
+
+EventQueue::~EventQueue()
+{
+}
+
+int EventQueue::post(std::function<void()> fn, size_t args_bytes, int delay_ms, int period_ms)
+{
+    size_t cost = EVENTS_EVENT_SIZE + args_bytes;
+    if ((_used + cost) > _size) {
+        _refused++;
+        return 0;
+    }
+    _used += cost;
+
+    pending ev;
+    ev.id = _next_id++;
+    ev.due_ns = sim::now_ns() + (uint64_t)delay_ms * NS_PER_MS;
+    ev.period_ms = period_ms;
+    ev.cost = cost;
+    ev.fn = fn;
+    _events.push_back(ev);
+
+    sim::notify();
+    return ev.id;
+}
+
+void EventQueue::dispatch(int ms)
+{
+    uint64_t deadline = (ms < 0) ? SIM_NEVER : sim::now_ns() + (uint64_t)ms * NS_PER_MS;
+
+    while (true) {
+        if (_break) {
+            _break = false;
+            return;
+        }
+
+        // Earliest due event, the first posted among equals
+        std::list<pending>::iterator next = _events.end();
+        for (std::list<pending>::iterator it = _events.begin(); it != _events.end(); ++it) {
+            if ((next == _events.end()) || (it->due_ns < next->due_ns)) {
+                next = it;
+            }
+        }
+
+        uint64_t now = sim::now_ns();
+        if ((next != _events.end()) && (next->due_ns <= now)) {
+            pending ev = *next;
+            _events.erase(next);
+            if (ev.period_ms >= 0) {
+                ev.due_ns = now + (uint64_t)ev.period_ms * NS_PER_MS;
+                _events.push_back(ev);
+            } else {
+                _used -= ev.cost;
+            }
+            _dispatched++;
+            ev.fn();
+            continue;
+        }
+
+        if (now >= deadline) {
+            return;
+        }
+        uint64_t wake = deadline;
+        if ((next != _events.end()) && (next->due_ns < wake)) {
+            wake = next->due_ns;
+        }
+        sim::block(wake);
+    }
+}
+
+void EventQueue::break_dispatch()
+{
+    _break = true;
+    sim::notify();
+}
+
+bool EventQueue::cancel(int id)
+{
+    for (std::list<pending>::iterator it = _events.begin(); it != _events.end(); ++it) {
+        if (it->id == id) {
+            _used -= it->cost;
+            _events.erase(it);
+            return true;
+        }
+    }
+    return false;
+}
+
+int EventQueue::time_left(int id)
+{
+    for (std::list<pending>::iterator it = _events.begin(); it != _events.end(); ++it) {
+        if (it->id == id) {
+            uint64_t now = sim::now_ns();
+            return (it->due_ns > now) ? (int)((it->due_ns - now) / NS_PER_MS) : 0;
+        }
+    }
+    return -1;
+}
+
+}
+
+namespace mbed {
+
+events::EventQueue *mbed_event_queue()
+{
+    static events::EventQueue *queue = NULL;
+    static rtos::Thread *thread = NULL;
+    if (queue == NULL) {
+        queue = new events::EventQueue();
+        thread = new rtos::Thread(osPriorityNormal, OS_STACK_SIZE, NULL, "shared_event_queue");
+        thread->start(mbed::callback(queue, &events::EventQueue::dispatch_forever));
+    }
+    return queue;
+}
+
+}
+
+void thread_sleep_for(uint32_t millisec)
+{
+    rtos::ThisThread::sleep_for(millisec);
+}
+
+/***************************************************/
+/******************** platform *********************/
+/***************************************************/
+extern "C" void wait_us(int us)
+{
+    if (us > 0) {
+        sim::spend_ns((uint64_t)us * 1000);
+    }
+}
+
+extern "C" void mbed_tracef(uint8_t dlevel, const char *grp, const char *fmt, ...)
+{
+    static int level = -1;
+    if (level < 0) {
+        const char *env = getenv("MBED_TRACE");
+        level = (env != NULL) ? atoi(env) : 0;
+    }
+    bool enabled = (level >= 2) || ((level == 1) && (dlevel & (TRACE_LEVEL_ERROR | TRACE_LEVEL_WARN)));
+    if (!enabled) {
+        return;
+    }
+
+    va_list args;
+    va_start(args, fmt);
+    fprintf(stderr, "[%llu us][%s] ", (unsigned long long)sim::now_us(), grp);
+    vfprintf(stderr, fmt, args);
+    fprintf(stderr, "\n");
+    va_end(args);
+}
+
+/***************************************************/
+/********************* drivers *********************/
+/***************************************************/
+namespace mbed {
+
+void Timer::start()
+{
+    if (!_running) {
+        _start_ns = sim::now_ns();
+        _running = true;
+    }
+}
+
+void Timer::stop()
+{
+    _elapsed_ns = elapsed_ns();
+    _running = false;
+}
+
+void Timer::reset()
+{
+    _start_ns = sim::now_ns();
+    _elapsed_ns = 0;
+}
+
+float Timer::read()
+{
+    return elapsed_ns() / 1e9f;
+}
+
+int Timer::read_ms()
+{
+    return (int)(elapsed_ns() / NS_PER_MS);
+}
+
+int Timer::read_us()
+{
+    return (int)(elapsed_ns() / 1000);
+}
+
+uint64_t Timer::read_high_resolution_us()
+{
+    return elapsed_ns() / 1000;
+}
+
+uint64_t Timer::elapsed_ns()
+{
+    return _elapsed_ns + (_running ? (sim::now_ns() - _start_ns) : 0);
+}
+
+uint32_t crc32_ansi_update(uint32_t crc, const void *buffer, unsigned long long size)
+{
+    static uint32_t table[256];
+    static bool table_ready = false;
+    if (!table_ready) {
+        for (uint32_t i = 0; i < 256; i++) {
+            uint32_t c = i;
+            for (int bit = 0; bit < 8; bit++) {
+                c = (c & 1) ? (0xEDB88320 ^ (c >> 1)) : (c >> 1);
+            }
+            table[i] = c;
+        }
+        table_ready = true;
+    }
+
+    const uint8_t *data = static_cast<const uint8_t *>(buffer);
+    for (unsigned long long i = 0; i < size; i++) {
+        crc = table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+    }
+    return crc;
+}
+
+DigitalOut::DigitalOut(PinName pin) : _pin(pin)
+{
+}
+
+DigitalOut::DigitalOut(PinName pin, int value) : _pin(pin)
+{
+    write(value);
+}
+
+void DigitalOut::write(int value)
+{
+    sim::spend_ns(sim::timing().pin_write_ns);
+    sim::pin_write(_pin, value);
+}
+
+int DigitalOut::read()
+{
+    return sim::pin_read(_pin);
+}
+
+DigitalIn::DigitalIn(PinName pin, PinMode /*mode*/) : _pin(pin)
+{
+}
+
+int DigitalIn::read()
+{
+    return sim::pin_read(_pin);
+}
+
+void DigitalIn::mode(PinMode /*pull*/)
+{
+}
+
+InterruptIn::InterruptIn(PinName pin, PinMode /*mode*/) : _pin(pin), _enabled(true)
+{
+    sim::pin_on_edge(pin, [this](int level) {
+        edge(level);
+    });
+}
+
+InterruptIn::~InterruptIn()
+{
+    sim::pin_clear_edge(_pin);
+}
+
+int InterruptIn::read()
+{
+    return sim::pin_read(_pin);
+}
+
+void InterruptIn::rise(Callback<void()> func)
+{
+    _rise = func;
+}
+
+void InterruptIn::fall(Callback<void()> func)
+{
+    _fall = func;
+}
+
+void InterruptIn::mode(PinMode /*pull*/)
+{
+}
+
+void InterruptIn::enable_irq()
+{
+    _enabled = true;
+}
+
+void InterruptIn::disable_irq()
+{
+    _enabled = false;
+}
+
+void InterruptIn::edge(int level)
+{
+    if (!_enabled) {
+        return;
+    }
+    if ((level == 0) && _fall) {
+        _fall();
+    } else if ((level != 0) && _rise) {
+        _rise();
+    }
+}
+
+static rtos::Mutex &spi_bus_mutex(PinName sclk)
+{
+    static std::map<int, rtos::Mutex *> *mutexes = new std::map<int, rtos::Mutex *>;
+    rtos::Mutex *&m = (*mutexes)[sclk];
+    if (m == NULL) {
+        m = new rtos::Mutex;
+    }
+    return *m;
+}
+
+SPI::SPI(PinName /*mosi*/, PinName /*miso*/, PinName sclk, PinName /*ssel*/)
+    : _sclk(sclk), _hz(1000000), _write_fill((char)0xFF)
+{
+}
+
+void SPI::format(int /*bits*/, int /*mode*/)
+{
+}
+
+void SPI::frequency(int hz)
+{
+    _hz = hz;
+}
+
+int SPI::write(int value)
+{
+    char tx = (char)value;
+    char rx = 0;
+    write(&tx, 1, &rx, 1);
+    return (uint8_t)rx;
+}
+
+int SPI::write(const char *tx_buffer, int tx_length, char *rx_buffer, int rx_length)
+{
+    int total = (tx_length > rx_length) ? tx_length : rx_length;
+    sim::bus_counters &counters = sim::counters();
+    counters.spi_calls++;
+    counters.spi_bytes += total;
+
+    // The bytes reach the device once they have been clocked out
+    sim::spend_ns(sim::timing().spi_call_ns + ((uint64_t)total * 8 * 1000000000ULL) / _hz);
+
+    std::vector<sim::spi_device *> devs;
+    sim::spi_selected(_sclk, devs);
+    for (sim::spi_device *dev : devs) {
+        dev->clock(_hz);
+    }
+
+    for (int i = 0; i < total; i++) {
+        uint8_t out = (i < tx_length) ? (uint8_t)tx_buffer[i] : (uint8_t)_write_fill;
+        // MISO floats high without a selected device, several devices pull it low together
+        uint8_t in = 0xFF;
+        for (sim::spi_device *dev : devs) {
+            in &= dev->transfer(out);
+        }
+        if (i < rx_length) {
+            rx_buffer[i] = (char)in;
+        }
+    }
+    return total;
+}
+
+void SPI::set_default_write_value(char data)
+{
+    _write_fill = data;
+}
+
+void SPI::lock()
+{
+    spi_bus_mutex(_sclk).lock();
+}
+
+void SPI::unlock()
+{
+    spi_bus_mutex(_sclk).unlock();
+}
+
+static rtos::Mutex &i2c_bus_mutex(PinName sda)
+{
+    static std::map<int, rtos::Mutex *> *mutexes = new std::map<int, rtos::Mutex *>;
+    rtos::Mutex *&m = (*mutexes)[sda];
+    if (m == NULL) {
+        m = new rtos::Mutex;
+    }
+    return *m;
+}
+
+I2C::I2C(PinName sda, PinName /*scl*/) : _sda(sda), _hz(100000)
+{
+}
+
+void I2C::frequency(int hz)
+{
+    _hz = hz;
+}
+
+int I2C::read(int address, char *data, int length, bool repeated)
+{
+    sim::bus_counters &counters = sim::counters();
+    counters.i2c_calls++;
+    counters.i2c_bytes += length + 1;
+
+    // Address byte and data bytes, 9 clocks each with the ACK
+    sim::spend_ns(sim::timing().i2c_call_ns + ((uint64_t)(length + 1) * 9 * 1000000000ULL) / _hz);
+
+    sim::i2c_device *dev = sim::i2c_find(_sda, address);
+    if ((dev == NULL) || !dev->read(reinterpret_cast<uint8_t *>(data), length, repeated)) {
+        return -1;
+    }
+    return 0;
+}
+
+int I2C::write(int address, const char *data, int length, bool repeated)
+{
+    sim::bus_counters &counters = sim::counters();
+    counters.i2c_calls++;
+    counters.i2c_bytes += length + 1;
+
+    sim::spend_ns(sim::timing().i2c_call_ns + ((uint64_t)(length + 1) * 9 * 1000000000ULL) / _hz);
+
+    sim::i2c_device *dev = sim::i2c_find(_sda, address);
+    if ((dev == NULL) || !dev->write(reinterpret_cast<const uint8_t *>(data), length, repeated)) {
+        return -1;
+    }
+    return 0;
+}
+
+void I2C::lock()
+{
+    i2c_bus_mutex(_sda).lock();
+}
+
+void I2C::unlock()
+{
+    i2c_bus_mutex(_sda).unlock();
+}
+
+}
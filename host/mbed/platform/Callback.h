@@ -0,0 +1,93 @@
+#ifndef MBED_CALLBACK_H
+#define MBED_CALLBACK_H
+
+//host stand-in for mbed-os platform/Callback.h, backed by std::function
+
+#include <stddef.h>
+#include <functional>
+#include <type_traits>
+
+namespace mbed {
+
+template <typename F>
+class Callback;
+
+template <typename R, typename... ArgTs>
+class Callback<R(ArgTs...)> {
+public:
+    Callback() {}
+
+    Callback(std::nullptr_t) {}
+
+    Callback(R(*func)(ArgTs...))
+    {
+        if (func) {
+            _func = func;
+        }
+    }
+
+    template <typename T, typename U>
+    Callback(U *obj, R(T::*method)(ArgTs...))
+        : _func([obj, method](ArgTs... args) -> R { return (obj->*method)(args...); })
+    {
+    }
+
+    template <typename T, typename U>
+    Callback(const U *obj, R(T::*method)(ArgTs...) const)
+        : _func([obj, method](ArgTs... args) -> R { return (obj->*method)(args...); })
+    {
+    }
+
+    //function objects, lambdas included
+    template <typename F, typename = typename std::enable_if<std::is_class<F>::value &&
+                                                              !std::is_same<typename std::decay<F>::type, Callback>::value>::type>
+    Callback(F f) : _func(f)
+    {
+    }
+
+    R call(ArgTs... args) const
+    {
+        return _func(args...);
+    }
+
+    R operator()(ArgTs... args) const
+    {
+        return _func(args...);
+    }
+
+    explicit operator bool() const
+    {
+        return static_cast<bool>(_func);
+    }
+
+private:
+    std::function<R(ArgTs...)> _func;
+};
+
+template <typename R, typename... ArgTs>
+Callback<R(ArgTs...)> callback(R(*func)(ArgTs...))
+{
+    return Callback<R(ArgTs...)>(func);
+}
+
+template <typename R, typename... ArgTs>
+Callback<R(ArgTs...)> callback(const Callback<R(ArgTs...)> &func)
+{
+    return func;
+}
+
+template <typename T, typename U, typename R, typename... ArgTs>
+Callback<R(ArgTs...)> callback(U *obj, R(T::*method)(ArgTs...))
+{
+    return Callback<R(ArgTs...)>(obj, method);
+}
+
+template <typename T, typename U, typename R, typename... ArgTs>
+Callback<R(ArgTs...)> callback(const U *obj, R(T::*method)(ArgTs...) const)
+{
+    return Callback<R(ArgTs...)>(obj, method);
+}
+
+}
+
+#endif
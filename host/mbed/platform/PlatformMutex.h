@@ -0,0 +1,10 @@
+#ifndef PLATFORM_MUTEX_H
+#define PLATFORM_MUTEX_H
+
+//host stand-in for mbed-os platform/PlatformMutex.h
+
+#include "rtos/Mutex.h"
+
+typedef rtos::Mutex PlatformMutex;
+
+#endif
@@ -0,0 +1,16 @@
+#ifndef MBED_CRITICAL_H
+#define MBED_CRITICAL_H
+
+//host stand-in for mbed-os platform/mbed_critical.h
+//nothing preempts the running sim thread, so critical sections have nothing to do
+
+#include <stdbool.h>
+
+inline void core_util_critical_section_enter(void) {}
+inline void core_util_critical_section_exit(void) {}
+inline bool core_util_in_critical_section(void)
+{
+    return false;
+}
+
+#endif
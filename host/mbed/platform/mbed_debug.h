@@ -0,0 +1,31 @@
+#ifndef MBED_DEBUG_H
+#define MBED_DEBUG_H
+
+//host stand-in for mbed-os platform/mbed_debug.h
+
+#include <stdio.h>
+#include <stdarg.h>
+
+#ifndef MBED_CONF_SPIF_DRIVER_DEBUG
+#define MBED_CONF_SPIF_DRIVER_DEBUG 0
+#endif
+
+static inline void debug(const char *format, ...)
+{
+    va_list args;
+    va_start(args, format);
+    vfprintf(stderr, format, args);
+    va_end(args);
+}
+
+static inline void debug_if(int condition, const char *format, ...)
+{
+    if (condition) {
+        va_list args;
+        va_start(args, format);
+        vfprintf(stderr, format, args);
+        va_end(args);
+    }
+}
+
+#endif
@@ -0,0 +1,17 @@
+#ifndef MBED_WAIT_API_H
+#define MBED_WAIT_API_H
+
+//host stand-in for mbed-os platform/mbed_wait_api.h
+//wait_us() spins: the sim time passes without letting other threads run
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void wait_us(int us);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,33 @@
+#ifndef EVENT_FLAG_H
+#define EVENT_FLAG_H
+
+//host stand-in for mbed-os rtos/EventFlags.h
+
+#include "rtos/mbed_rtos_types.h"
+
+namespace rtos {
+
+class EventFlags {
+public:
+    EventFlags();
+    EventFlags(const char *name);
+    ~EventFlags() {}
+
+    uint32_t set(uint32_t flags);
+    uint32_t clear(uint32_t flags = 0x7fffffff);
+    uint32_t get() const;
+    uint32_t wait_all(uint32_t flags = 0, uint32_t millisec = osWaitForever, bool clear = true);
+    uint32_t wait_any(uint32_t flags = 0, uint32_t millisec = osWaitForever, bool clear = true);
+
+private:
+    EventFlags(const EventFlags &);
+    EventFlags &operator=(const EventFlags &);
+
+    uint32_t wait(uint32_t flags, uint32_t opt, uint32_t millisec, bool clear);
+
+    uint32_t _flags;
+};
+
+}
+
+#endif
@@ -0,0 +1,16 @@
+#ifndef KERNEL_H
+#define KERNEL_H
+
+//host stand-in for mbed-os rtos/Kernel.h, counts sim time
+
+#include <stdint.h>
+
+namespace rtos {
+namespace Kernel {
+
+uint64_t get_ms_count();
+
+}
+}
+
+#endif
@@ -0,0 +1,37 @@
+#ifndef RTOS_MUTEX_H
+#define RTOS_MUTEX_H
+
+//host stand-in for mbed-os rtos/Mutex.h, recursive like the RTX mutex
+
+#include "rtos/mbed_rtos_types.h"
+
+namespace sim {
+struct thread;
+}
+
+namespace rtos {
+
+class Mutex {
+public:
+    Mutex();
+    Mutex(const char *name);
+    ~Mutex() {}
+
+    osStatus lock();
+    osStatus lock(uint32_t millisec);
+    bool trylock();
+    bool trylock_for(uint32_t millisec);
+    osStatus unlock();
+    osThreadId_t get_owner();
+
+private:
+    Mutex(const Mutex &);
+    Mutex &operator=(const Mutex &);
+
+    sim::thread *_owner;
+    uint32_t _count;
+};
+
+}
+
+#endif
@@ -0,0 +1,19 @@
+#ifndef THIS_THREAD_H
+#define THIS_THREAD_H
+
+//host stand-in for mbed-os rtos/ThisThread.h
+
+#include "rtos/mbed_rtos_types.h"
+
+namespace rtos {
+namespace ThisThread {
+
+void sleep_for(uint32_t millisec);
+void sleep_until(uint64_t millisec);
+void yield();
+osThreadId_t get_id();
+
+}
+}
+
+#endif
@@ -0,0 +1,38 @@
+#ifndef RTOS_THREAD_H
+#define RTOS_THREAD_H
+
+//host stand-in for mbed-os rtos/Thread.h, runs the task as a sim thread
+
+#include "rtos/mbed_rtos_types.h"
+#include "platform/Callback.h"
+
+namespace sim {
+struct thread;
+}
+
+namespace rtos {
+
+class Thread {
+public:
+    Thread(osPriority priority = osPriorityNormal, uint32_t stack_size = OS_STACK_SIZE,
+           unsigned char *stack_mem = NULL, const char *name = NULL);
+    ~Thread();
+
+    osStatus start(mbed::Callback<void()> task);
+    osStatus join();
+    osStatus terminate();
+    osPriority get_priority() const;
+    const char *get_name() const;
+
+private:
+    Thread(const Thread &);
+    Thread &operator=(const Thread &);
+
+    osPriority _priority;
+    const char *_name;
+    sim::thread *_thread;
+};
+
+}
+
+#endif
@@ -0,0 +1,45 @@
+#ifndef MBED_RTOS_TYPES_H
+#define MBED_RTOS_TYPES_H
+
+//host stand-in for the CMSIS-RTOS2 types mbed-os rtos/ uses
+
+#include <stdint.h>
+
+typedef enum {
+    osPriorityNone          =  0,
+    osPriorityIdle          =  1,
+    osPriorityLow           =  8,
+    osPriorityBelowNormal   = 16,
+    osPriorityNormal        = 24,
+    osPriorityAboveNormal   = 32,
+    osPriorityHigh          = 40,
+    osPriorityRealtime      = 48,
+} osPriority_t;
+typedef osPriority_t osPriority;
+
+typedef enum {
+    osOK                    =  0,
+    osError                 = -1,
+    osErrorTimeout          = -2,
+    osErrorResource         = -3,
+    osErrorParameter        = -4,
+    osErrorNoMemory         = -5,
+} osStatus_t;
+typedef int32_t osStatus;
+
+typedef void *osThreadId_t;
+typedef osThreadId_t osThreadId;
+
+#define osWaitForever           0xFFFFFFFFU
+#define osFlagsWaitAny          0x00000000U
+#define osFlagsWaitAll          0x00000001U
+#define osFlagsNoClear          0x00000002U
+#define osFlagsError            0x80000000U
+#define osFlagsErrorUnknown     0xFFFFFFFFU
+#define osFlagsErrorTimeout     0xFFFFFFFEU
+#define osFlagsErrorResource    0xFFFFFFFDU
+#define osFlagsErrorParameter   0xFFFFFFFCU
+
+#define OS_STACK_SIZE 4096
+
+#endif
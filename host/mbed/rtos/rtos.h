@@ -0,0 +1,12 @@
+#ifndef RTOS_H
+#define RTOS_H
+
+//host stand-in for mbed-os rtos/rtos.h
+
+#include "rtos/Thread.h"
+#include "rtos/ThisThread.h"
+#include "rtos/Mutex.h"
+#include "rtos/EventFlags.h"
+#include "rtos/Kernel.h"
+
+#endif
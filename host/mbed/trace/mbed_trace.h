@@ -0,0 +1,31 @@
+#ifndef MBED_TRACE_H_
+#define MBED_TRACE_H_
+
+//host stand-in for mbed-trace, traces go to stderr when MBED_TRACE is set in the environment
+//(error and warning at MBED_TRACE=1, everything at MBED_TRACE=2)
+
+#include <stdint.h>
+
+#define TRACE_LEVEL_DEBUG   0x10
+#define TRACE_LEVEL_INFO    0x08
+#define TRACE_LEVEL_WARN    0x04
+#define TRACE_LEVEL_ERROR   0x02
+
+#define tr_debug(...)   mbed_tracef(TRACE_LEVEL_DEBUG, TRACE_GROUP, __VA_ARGS__)
+#define tr_info(...)    mbed_tracef(TRACE_LEVEL_INFO, TRACE_GROUP, __VA_ARGS__)
+#define tr_warning(...) mbed_tracef(TRACE_LEVEL_WARN, TRACE_GROUP, __VA_ARGS__)
+#define tr_warn(...)    mbed_tracef(TRACE_LEVEL_WARN, TRACE_GROUP, __VA_ARGS__)
+#define tr_error(...)   mbed_tracef(TRACE_LEVEL_ERROR, TRACE_GROUP, __VA_ARGS__)
+#define tr_err(...)     mbed_tracef(TRACE_LEVEL_ERROR, TRACE_GROUP, __VA_ARGS__)
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void mbed_tracef(uint8_t dlevel, const char *grp, const char *fmt, ...) __attribute__((format(printf, 3, 4)));
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,119 @@
+#ifndef SIM_FAULT_BLOCK_DEVICE_H
+#define SIM_FAULT_BLOCK_DEVICE_H
+
+//BlockDevice in front of another one failing chosen reads, programs and erases with a given error
+//instead of passing them on, for the errors the flash model can't produce (bus and driver errors)
+
+#include "BlockDevice.h"
+
+namespace sim {
+
+class fault_block_device : public mbed::BlockDevice {
+public:
+    fault_block_device(mbed::BlockDevice *bd)
+        : _bd(bd)
+    {
+        clear_faults();
+    }
+
+    //the next count calls of the kind touching [addr, addr + size) return err, count < 0 - all of them
+    void fail_reads(mbed::bd_addr_t addr, mbed::bd_size_t size, int err, int count = -1)
+    {
+        _read = fault{addr, size, err, count};
+    }
+    void fail_programs(mbed::bd_addr_t addr, mbed::bd_size_t size, int err, int count = -1)
+    {
+        _program = fault{addr, size, err, count};
+    }
+    void fail_erases(mbed::bd_addr_t addr, mbed::bd_size_t size, int err, int count = -1)
+    {
+        _erase = fault{addr, size, err, count};
+    }
+    void clear_faults()
+    {
+        _read = fault{0, 0, 0, 0};
+        _program = fault{0, 0, 0, 0};
+        _erase = fault{0, 0, 0, 0};
+    }
+
+    virtual int init()
+    {
+        return _bd->init();
+    }
+    virtual int deinit()
+    {
+        return _bd->deinit();
+    }
+    virtual int sync()
+    {
+        return _bd->sync();
+    }
+    virtual int read(void *buffer, mbed::bd_addr_t addr, mbed::bd_size_t size)
+    {
+        return hit(_read, addr, size) ? _read.err : _bd->read(buffer, addr, size);
+    }
+    virtual int program(const void *buffer, mbed::bd_addr_t addr, mbed::bd_size_t size)
+    {
+        return hit(_program, addr, size) ? _program.err : _bd->program(buffer, addr, size);
+    }
+    virtual int erase(mbed::bd_addr_t addr, mbed::bd_size_t size)
+    {
+        return hit(_erase, addr, size) ? _erase.err : _bd->erase(addr, size);
+    }
+    virtual mbed::bd_size_t get_read_size() const
+    {
+        return _bd->get_read_size();
+    }
+    virtual mbed::bd_size_t get_program_size() const
+    {
+        return _bd->get_program_size();
+    }
+    virtual mbed::bd_size_t get_erase_size() const
+    {
+        return _bd->get_erase_size();
+    }
+    virtual mbed::bd_size_t get_erase_size(mbed::bd_addr_t addr) const
+    {
+        return _bd->get_erase_size(addr);
+    }
+    virtual int get_erase_value() const
+    {
+        return _bd->get_erase_value();
+    }
+    virtual mbed::bd_size_t size() const
+    {
+        return _bd->size();
+    }
+    virtual const char *get_type() const
+    {
+        return _bd->get_type();
+    }
+
+private:
+    struct fault {
+        mbed::bd_addr_t addr;
+        mbed::bd_size_t size;
+        int err;
+        int count;
+    };
+
+    static bool hit(fault &f, mbed::bd_addr_t addr, mbed::bd_size_t size)
+    {
+        if ((f.count == 0) || (f.size == 0) || (addr >= f.addr + f.size) || (f.addr >= addr + size)) {
+            return false;
+        }
+        if (f.count > 0) {
+            f.count--;
+        }
+        return true;
+    }
+
+    mbed::BlockDevice *_bd;
+    fault _read;
+    fault _program;
+    fault _erase;
+};
+
+}
+
+#endif
@@ -0,0 +1,876 @@
+#include "nor_flash.h"
+#include "sim_kernel.h"
+
+#include <string.h>
+
+#define NOR_SFDP_SIZE           0x200
+#define NOR_SFDP_BASIC_ADDR     0x30
+#define NOR_SFDP_MAP_ADDR       0x80
+#define NOR_SFDP_4BYTE_ADDR     0x100
+
+#define NOR_STATUS_WIP  0x01
+#define NOR_STATUS_WEL  0x02
+
+enum nor_opcode {
+    NOR_WRSR = 0x01,
+    NOR_PP = 0x02,
+    NOR_READ = 0x03,
+    NOR_WRDI = 0x04,
+    NOR_RDSR = 0x05,
+    NOR_WREN = 0x06,
+    NOR_FAST_READ = 0x0B,
+    NOR_4B_FAST_READ = 0x0C,
+    NOR_4B_PP = 0x12,
+    NOR_4B_READ = 0x13,
+    NOR_RDCR = 0x35,
+    NOR_SFDP = 0x5A,
+    NOR_CE_60 = 0x60,
+    NOR_RSTEN = 0x66,
+    NOR_SUSPEND = 0x75,
+    NOR_RESUME = 0x7A,
+    NOR_ULBPR = 0x98,
+    NOR_RST = 0x99,
+    NOR_RDID = 0x9F,
+    NOR_RES = 0xAB,
+    NOR_4BEN = 0xB7,
+    NOR_DPD = 0xB9,
+    NOR_CE_C7 = 0xC7,
+    NOR_4BDIS = 0xE9,
+};
+
+namespace sim {
+
+nor_config nor_config_w25q32()
+{
+    nor_config c;
+    memset(&c, 0, sizeof(c));
+    c.name = "W25Q32JV-like 4MB";
+    c.jedec_id[0] = 0xEF;
+    c.jedec_id[1] = 0x40;
+    c.jedec_id[2] = 0x16;
+    c.size_bytes = 4 * 1024 * 1024;
+    c.page_size = 256;
+    c.erase_types[0] = {4096, 0x20, 0x21, 45000};
+    c.erase_types[1] = {32768, 0x52, 0x5C, 120000};
+    c.erase_types[2] = {65536, 0xD8, 0xDC, 150000};
+    c.page_program_typ_us = 400;
+    c.chip_erase_typ_ms = 10000;
+    c.erase_max_multiplier = 14;
+    c.program_max_multiplier = 8;
+    c.time_min_percent = 100;
+    c.time_max_percent = 100;
+    c.basic_table_dwords = 16;
+    c.fast_read_modes = 0x01 | 0x10 | 0x20 | 0x40;
+    c.read_max_hz = 50000000;
+    c.fast_read_max_hz = 133000000;
+    c.address_bytes = 0;
+    c.suspend = true;
+    c.suspend_latency_us = 20;
+    c.resume_to_suspend_us = 64;
+    c.deep_power_down = true;
+    c.dpd_exit_us = 3;
+    return c;
+}
+
+nor_config nor_config_hybrid()
+{
+    nor_config c = nor_config_w25q32();
+    c.name = "hybrid sector 16MB";
+    c.jedec_id[0] = 0x01;
+    c.jedec_id[1] = 0x20;
+    c.jedec_id[2] = 0x18;
+    c.size_bytes = 16 * 1024 * 1024;
+    c.erase_types[0] = {4096, 0x20, 0x21, 50000};
+    c.erase_types[1] = {65536, 0xD8, 0xDC, 150000};
+    c.erase_types[2] = {0, 0xFF, 0xFF, 0};
+    c.chip_erase_typ_ms = 40000;
+    c.read_max_hz = 50000000;
+    c.fast_read_max_hz = 108000000;
+    c.suspend_latency_us = 40;
+    c.dpd_exit_us = 30;
+    c.regions_count = 2;
+    c.regions[0] = {128 * 1024, 0x03};
+    c.regions[1] = {16 * 1024 * 1024 - 128 * 1024, 0x02};
+    c.alt_regions_count = 2;
+    c.alt_regions[0] = {16 * 1024 * 1024 - 128 * 1024, 0x02};
+    c.alt_regions[1] = {128 * 1024, 0x03};
+    c.config_register = 0x00;
+    c.config_map_mask = 0x04;
+    return c;
+}
+
+nor_config nor_config_w25q256()
+{
+    nor_config c = nor_config_w25q32();
+    c.name = "W25Q256JV-like 32MB";
+    c.jedec_id[2] = 0x19;
+    c.size_bytes = 32 * 1024 * 1024;
+    c.erase_types[0].typ_us = 50000;
+    c.page_program_typ_us = 700;
+    c.chip_erase_typ_ms = 80000;
+    c.address_bytes = 1;
+    c.enter_4byte_methods = 0x01;
+    c.four_byte_inst_table = true;
+    return c;
+}
+
+nor_flash::nor_flash(const nor_config &config, uint32_t seed)
+    : _config(config), _mem(config.size_bytes, 0xFF), _seed(seed), _sclk(NC), _csel(NC), _attached(false),
+      _selected(false), _hz(1000000), _data_addr(0), _data_overclocked(false),
+      _wel(false), _four_byte_mode(false), _reset_enabled(false), _dpd(false), _busy(BUSY_NONE),
+      _busy_addr(0), _busy_size(0), _busy_start_ns(0), _busy_done_ns(0), _busy_accounted_ns(0), _busy_fails(false),
+      _suspended(false), _suspend_done_ns(0), _remaining_ns(0), _resumed_ns(0), _ever_resumed(false),
+      _powered(true), _power_fail_at_ns(SIM_NEVER)
+{
+    reset_stats();
+    clear_faults();
+    build_sfdp();
+}
+
+void nor_flash::attach(PinName sclk, PinName csel)
+{
+    _sclk = sclk;
+    _csel = csel;
+    _attached = true;
+    spi_attach(sclk, csel, this);
+}
+
+void nor_flash::detach()
+{
+    if (_attached) {
+        spi_detach(this);
+        _attached = false;
+    }
+}
+
+void nor_flash::fill(uint8_t value)
+{
+    memset(&_mem[0], value, _mem.size());
+}
+
+bool nor_flash::busy()
+{
+    return (status() & NOR_STATUS_WIP) != 0;
+}
+
+void nor_flash::reset_stats()
+{
+    memset(&_stats, 0, sizeof(_stats));
+}
+
+void nor_flash::fault_stuck_busy(uint64_t addr, uint64_t size, uint32_t extra_us)
+{
+    _stuck_busy_addr = addr;
+    _stuck_busy_size = size;
+    _stuck_busy_extra_us = extra_us;
+}
+
+void nor_flash::fault_stuck_bits(uint64_t addr, uint64_t size, uint8_t mask)
+{
+    _stuck_bits_addr = addr;
+    _stuck_bits_size = size;
+    _stuck_bits_mask = mask;
+}
+
+void nor_flash::fault_drop_wren(int count)
+{
+    _drop_wren = count;
+}
+
+void nor_flash::clear_faults()
+{
+    _stuck_busy_addr = 0;
+    _stuck_busy_size = 0;
+    _stuck_busy_extra_us = 0;
+    _stuck_bits_addr = 0;
+    _stuck_bits_size = 0;
+    _stuck_bits_mask = 0;
+    _drop_wren = 0;
+}
+
+void nor_flash::power_fail()
+{
+    update();
+    cut_power(now_ns());
+}
+
+void nor_flash::fault_power_fail_at(uint64_t at_ns)
+{
+    _power_fail_at_ns = at_ns;
+}
+
+void nor_flash::power_on()
+{
+    _powered = true;
+    _power_fail_at_ns = SIM_NEVER;
+}
+
+void nor_flash::cut_power(uint64_t at_ns)
+{
+    if ((_busy == BUSY_PROGRAM) || (_busy == BUSY_ERASE) || (_busy == BUSY_CHIP_ERASE)) {
+        uint64_t total = _busy_done_ns - _busy_start_ns;
+        uint64_t remaining = _suspended ? _remaining_ns : (_busy_done_ns - at_ns);
+        complete_busy((total == 0) ? 1.0 : (double)(total - remaining) / (double)total);
+    }
+    _busy = BUSY_NONE;
+    _suspended = false;
+    _wel = false;
+    _four_byte_mode = false;
+    _reset_enabled = false;
+    _dpd = false;
+    _cmd.clear();
+    _stats.power_fails++;
+}
+
+/***************************************************/
+/******************* SPI device ********************/
+/***************************************************/
+void nor_flash::clock(int hz)
+{
+    _hz = hz;
+}
+
+void nor_flash::select()
+{
+    update();
+    if (!_powered) {
+        return;
+    }
+    _selected = true;
+    _cmd.clear();
+    _data_overclocked = false;
+}
+
+void nor_flash::deselect()
+{
+    update();
+    if (!_powered) {
+        return;
+    }
+    _selected = false;
+    if (!_cmd.empty()) {
+        execute();
+    }
+    _cmd.clear();
+}
+
+uint8_t nor_flash::transfer(uint8_t mosi)
+{
+    update();
+    if (!_powered) {
+        return 0xFF;
+    }
+
+    size_t pos = _cmd.size();
+    _cmd.push_back(mosi);
+    if (pos == 0) {
+        return 0xFF;
+    }
+
+    uint8_t op = _cmd[0];
+    // Nothing is driven while powered down or waking up
+    if (_dpd || (_busy == BUSY_DPD_EXIT)) {
+        return 0xFF;
+    }
+
+    if (op == NOR_RDSR) {
+        return status();
+    }
+    if (op == NOR_RDID) {
+        return (pos <= 3) ? _config.jedec_id[pos - 1] : 0xFF;
+    }
+    if (op == NOR_RDCR) {
+        return _config.config_register;
+    }
+    if (!is_read(op)) {
+        return 0xFF;
+    }
+
+    size_t header = 1 + address_length(op) + dummy_length(op);
+    if (pos < header) {
+        return 0xFF;
+    }
+
+    if (pos == header) {
+        _data_addr = 0;
+        for (int i = 0; i < address_length(op); i++) {
+            _data_addr = (_data_addr << 8) | _cmd[1 + i];
+        }
+        int max_hz = ((op == NOR_READ) || (op == NOR_4B_READ)) ? _config.read_max_hz : _config.fast_read_max_hz;
+        _data_overclocked = (_hz > max_hz);
+        if (_data_overclocked) {
+            _stats.overclocked++;
+        }
+        if ((_busy != BUSY_NONE) && !_suspended) {
+            _stats.busy_commands++;
+        } else if (_suspended && (op != NOR_SFDP) && (_data_addr < _busy_addr + _busy_size) &&
+                   (_data_addr >= _busy_addr)) {
+            _stats.reads_in_erase++;
+        }
+    }
+
+    uint8_t value;
+    if (op == NOR_SFDP) {
+        value = (_data_addr < _sfdp.size()) ? _sfdp[_data_addr] : 0xFF;
+    } else if ((_busy != BUSY_NONE) && !_suspended) {
+        value = 0xFF;
+    } else {
+        value = _mem[_data_addr % _mem.size()];
+        _stats.bytes_read++;
+    }
+    _data_addr++;
+
+    // Sampled too early, every other bit is wrong
+    return _data_overclocked ? (value ^ 0x55) : value;
+}
+
+/***************************************************/
+/******************* Internals *********************/
+/***************************************************/
+void nor_flash::update()
+{
+    uint64_t now = now_ns();
+
+    // The scheduled power failure first, with the device as it was at that instant
+    if (now >= _power_fail_at_ns) {
+        uint64_t at = _power_fail_at_ns;
+        _power_fail_at_ns = SIM_NEVER;
+        update_to(at);
+        cut_power(at);
+        _powered = false;
+    }
+    update_to(now);
+}
+
+void nor_flash::update_to(uint64_t now)
+{
+
+    if ((_busy == BUSY_DPD_EXIT) && (now >= _busy_done_ns)) {
+        _busy = BUSY_NONE;
+    }
+
+    if ((_busy == BUSY_PROGRAM) || (_busy == BUSY_ERASE) || (_busy == BUSY_CHIP_ERASE)) {
+        if (!_suspended) {
+            uint64_t until = (now < _busy_done_ns) ? now : _busy_done_ns;
+            if (until > _busy_accounted_ns) {
+                _stats.busy_ns += until - _busy_accounted_ns;
+                _busy_accounted_ns = until;
+            }
+            if (now >= _busy_done_ns) {
+                complete_busy(1.0);
+            }
+        }
+    }
+}
+
+uint8_t nor_flash::status()
+{
+    update();
+    bool wip = false;
+    if ((_busy == BUSY_PROGRAM) || (_busy == BUSY_ERASE) || (_busy == BUSY_CHIP_ERASE)) {
+        // A suspended operation reads as done once tSUS has passed
+        wip = !_suspended || (now_ns() < _suspend_done_ns);
+    }
+    return (wip ? NOR_STATUS_WIP : 0) | (_wel ? NOR_STATUS_WEL : 0);
+}
+
+uint64_t nor_flash::op_time_ns(uint32_t typ_us)
+{
+    uint32_t percent = _config.time_min_percent;
+    if (_config.time_max_percent > _config.time_min_percent) {
+        _seed = _seed * 1103515245 + 12345;
+        percent += (_seed >> 16) % (_config.time_max_percent - _config.time_min_percent + 1);
+    }
+    return (uint64_t)typ_us * 10 * percent;
+}
+
+int nor_flash::address_length(uint8_t op) const
+{
+    if ((op == NOR_4B_READ) || (op == NOR_4B_FAST_READ) || (op == NOR_4B_PP)) {
+        return 4;
+    }
+    if (op == NOR_SFDP) {
+        return 3;
+    }
+    int wide = (_four_byte_mode || (_config.address_bytes == 2)) ? 4 : 3;
+    if ((op == NOR_READ) || (op == NOR_FAST_READ) || (op == NOR_PP)) {
+        return wide;
+    }
+    for (int i = 0; i < 4; i++) {
+        if (_config.erase_types[i].size == 0) {
+            continue;
+        }
+        if (_config.four_byte_inst_table && (op == _config.erase_types[i].inst_4b)) {
+            return 4;
+        }
+        if (op == _config.erase_types[i].inst) {
+            return wide;
+        }
+    }
+    return 0;
+}
+
+int nor_flash::dummy_length(uint8_t op) const
+{
+    return ((op == NOR_FAST_READ) || (op == NOR_4B_FAST_READ) || (op == NOR_SFDP)) ? 1 : 0;
+}
+
+int nor_flash::erase_type_of(uint8_t op) const
+{
+    for (int i = 0; i < 4; i++) {
+        if (_config.erase_types[i].size == 0) {
+            continue;
+        }
+        if ((op == _config.erase_types[i].inst) ||
+                (_config.four_byte_inst_table && (op == _config.erase_types[i].inst_4b))) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+bool nor_flash::is_read(uint8_t op) const
+{
+    return (op == NOR_READ) || (op == NOR_FAST_READ) || (op == NOR_4B_READ) || (op == NOR_4B_FAST_READ) ||
+           (op == NOR_SFDP);
+}
+
+bool nor_flash::erase_allowed(int type, uint64_t addr) const
+{
+    const nor_region *regions = _config.regions;
+    int count = _config.regions_count;
+    if ((_config.alt_regions_count != 0) && (_config.config_register & _config.config_map_mask)) {
+        regions = _config.alt_regions;
+        count = _config.alt_regions_count;
+    }
+    if (count == 0) {
+        return true;
+    }
+
+    uint64_t start = 0;
+    for (int i = 0; i < count; i++) {
+        uint64_t end = start + regions[i].size;
+        if ((addr >= start) && (addr < end)) {
+            // The whole unit has to be in the region
+            return (regions[i].erase_types & (1 << type)) && ((addr + _config.erase_types[type].size) <= end);
+        }
+        start = end;
+    }
+    return false;
+}
+
+bool nor_flash::stuck(uint64_t addr, uint64_t size) const
+{
+    return (_stuck_busy_size != 0) && (addr < _stuck_busy_addr + _stuck_busy_size) &&
+           (_stuck_busy_addr < addr + size);
+}
+
+void nor_flash::start_busy(busy_kind kind, uint64_t addr, uint64_t size, uint64_t duration_ns)
+{
+    uint64_t now = now_ns();
+    _busy_fails = stuck(addr, size);
+    if (_busy_fails) {
+        duration_ns += (uint64_t)_stuck_busy_extra_us * 1000;
+    }
+    _busy = kind;
+    _busy_addr = addr;
+    _busy_size = size;
+    _busy_start_ns = now;
+    _busy_done_ns = now + duration_ns;
+    _busy_accounted_ns = now;
+    _suspended = false;
+    _ever_resumed = false;
+}
+
+void nor_flash::complete_busy(double fraction)
+{
+    if (!_busy_fails) {
+        if (_busy == BUSY_PROGRAM) {
+            // Only the last page size bytes stay, the address wraps within the page
+            uint64_t page_base = _busy_addr - (_busy_addr % _config.page_size);
+            size_t length = _program_data.size();
+            size_t first = (length > _config.page_size) ? (length - _config.page_size) : 0;
+            size_t count = (size_t)((length - first) * fraction);
+            for (size_t i = 0; i < count; i++) {
+                uint64_t offset = ((_busy_addr % _config.page_size) + first + i) % _config.page_size;
+                uint64_t addr = page_base + offset;
+                uint8_t data = _program_data[first + i];
+                if ((_stuck_bits_size != 0) && (addr >= _stuck_bits_addr) && (addr < _stuck_bits_addr + _stuck_bits_size)) {
+                    data |= _stuck_bits_mask;
+                }
+                _mem[addr] &= data;
+            }
+        } else if ((_busy == BUSY_ERASE) || (_busy == BUSY_CHIP_ERASE)) {
+            memset(&_mem[_busy_addr], 0xFF, (size_t)(_busy_size * fraction));
+        }
+    }
+    _busy = BUSY_NONE;
+    _suspended = false;
+    _wel = false;
+    _program_data.clear();
+}
+
+void nor_flash::execute()
+{
+    uint8_t op = _cmd[0];
+    uint64_t now = now_ns();
+    bool op_running = (_busy == BUSY_PROGRAM) || (_busy == BUSY_ERASE) || (_busy == BUSY_CHIP_ERASE);
+    bool busy_now = op_running && !_suspended;
+    bool reset_enabled = _reset_enabled;
+
+    _stats.commands[op]++;
+    _reset_enabled = false;
+
+    if (_dpd) {
+        if (op == NOR_RES) {
+            _dpd = false;
+            _busy = BUSY_DPD_EXIT;
+            _busy_done_ns = now + (uint64_t)_config.dpd_exit_us * 1000;
+        } else {
+            _stats.dpd_commands++;
+        }
+        return;
+    }
+    if (_busy == BUSY_DPD_EXIT) {
+        _stats.dpd_commands++;
+        return;
+    }
+
+    if (op == NOR_RDSR) {
+        _stats.status_polls++;
+        return;
+    }
+    if (is_read(op) || (op == NOR_RDCR)) {
+        return;
+    }
+    if ((op == NOR_RDID) || (op == NOR_RES)) {
+        if (busy_now) {
+            _stats.busy_commands++;
+        }
+        return;
+    }
+
+    // Everything below changes the device state, ignored while an operation runs
+    if (busy_now && (op != NOR_SUSPEND) && (op != NOR_RSTEN) && (op != NOR_RST)) {
+        _stats.busy_commands++;
+        return;
+    }
+
+    int erase_type = erase_type_of(op);
+
+    if (op == NOR_WREN) {
+        if (_drop_wren > 0) {
+            _drop_wren--;
+        } else {
+            _wel = true;
+        }
+    } else if (op == NOR_WRDI) {
+        _wel = false;
+    } else if (op == NOR_RSTEN) {
+        _reset_enabled = true;
+    } else if (op == NOR_RST) {
+        if (reset_enabled) {
+            if (op_running) {
+                uint64_t total = _busy_done_ns - _busy_start_ns;
+                uint64_t remaining = _suspended ? _remaining_ns : (_busy_done_ns - now);
+                complete_busy((total == 0) ? 1.0 : (double)(total - remaining) / (double)total);
+            }
+            _wel = false;
+            _four_byte_mode = false;
+        }
+    } else if (op == NOR_DPD) {
+        if (_config.deep_power_down) {
+            _dpd = true;
+        }
+    } else if (op == NOR_4BEN) {
+        if (_config.address_bytes == 1) {
+            if (!(_config.enter_4byte_methods & 0x01) && !_wel) {
+                _stats.no_wel_writes++;
+            } else {
+                _four_byte_mode = true;
+            }
+        }
+    } else if (op == NOR_4BDIS) {
+        _four_byte_mode = false;
+    } else if (op == NOR_ULBPR) {
+        _wel = false;
+    } else if (op == NOR_SUSPEND) {
+        if (op_running && !_suspended && _config.suspend && (_busy != BUSY_CHIP_ERASE)) {
+            if (_ever_resumed && ((now - _resumed_ns) < (uint64_t)_config.resume_to_suspend_us * 1000)) {
+                _stats.early_suspends++;
+            }
+            update();
+            _suspended = true;
+            _remaining_ns = (_busy_done_ns > now) ? (_busy_done_ns - now) : 0;
+            _suspend_done_ns = now + (uint64_t)_config.suspend_latency_us * 1000;
+            _stats.suspends++;
+        }
+    } else if (op == NOR_RESUME) {
+        if (_suspended) {
+            _suspended = false;
+            _busy_done_ns = now + _remaining_ns;
+            _busy_accounted_ns = now;
+            _resumed_ns = now;
+            _ever_resumed = true;
+            _stats.resumes++;
+        }
+    } else if ((op == NOR_PP) || (op == NOR_4B_PP) || (erase_type >= 0) || (op == NOR_CE_60) || (op == NOR_CE_C7)) {
+        if (op_running) {
+            // Programming during a suspended erase isn't modelled
+            _stats.busy_commands++;
+            return;
+        }
+        if (!_wel) {
+            _stats.no_wel_writes++;
+            return;
+        }
+
+        size_t header = 1 + address_length(op);
+        if (_cmd.size() < header) {
+            _wel = false;
+            return;
+        }
+        uint64_t addr = 0;
+        for (size_t i = 1; i < header; i++) {
+            addr = (addr << 8) | _cmd[i];
+        }
+        addr %= _config.size_bytes;
+
+        if ((op == NOR_PP) || (op == NOR_4B_PP)) {
+            _program_data.assign(_cmd.begin() + header, _cmd.end());
+            _stats.page_programs++;
+            _stats.bytes_programmed += _program_data.size();
+            start_busy(BUSY_PROGRAM, addr, _program_data.size(), op_time_ns(_config.page_program_typ_us));
+        } else if (erase_type >= 0) {
+            uint64_t unit = _config.erase_types[erase_type].size;
+            addr -= addr % unit;
+            if (!erase_allowed(erase_type, addr)) {
+                _stats.bad_erases++;
+                _wel = false;
+                return;
+            }
+            _stats.erases[erase_type]++;
+            start_busy(BUSY_ERASE, addr, unit, op_time_ns(_config.erase_types[erase_type].typ_us));
+        } else {
+            _stats.chip_erases++;
+            start_busy(BUSY_CHIP_ERASE, 0, _config.size_bytes, op_time_ns(_config.chip_erase_typ_ms * 1000));
+        }
+    }
+}
+
+/***************************************************/
+/********************** SFDP ***********************/
+/***************************************************/
+
+//count (0 based, count_bits wide) and unit index above it, smallest unit the value fits in, rounded up
+static uint32_t encode_time(uint64_t value, const uint64_t *units, int units_count, int count_bits)
+{
+    for (int u = 0; u < units_count; u++) {
+        uint64_t count = (value + units[u] - 1) / units[u];
+        if (count == 0) {
+            count = 1;
+        }
+        if (count <= ((uint64_t)1 << count_bits)) {
+            return (uint32_t)((count - 1) | (u << count_bits));
+        }
+    }
+    return (1 << count_bits) - 1 + ((units_count - 1) << count_bits);
+}
+
+static void put_dword(std::vector<uint8_t> &area, size_t addr, uint32_t value)
+{
+    for (int i = 0; i < 4; i++) {
+        area[addr + i] = (value >> (8 * i)) & 0xFF;
+    }
+}
+
+static uint32_t region_dword(const nor_region &region)
+{
+    return (((region.size / 256) - 1) << 8) | 0xF0 | (region.erase_types & 0x0F);
+}
+
+void nor_flash::build_sfdp()
+{
+    static const uint64_t erase_units_us[4] = {1000, 16000, 128000, 1000000};
+    static const uint64_t program_units_us[2] = {8, 64};
+    static const uint64_t chip_units_ms[4] = {16, 256, 4000, 64000};
+    static const uint64_t latency_units_ns[4] = {128, 1000, 8000, 64000};
+
+    _sfdp.assign(NOR_SFDP_SIZE, 0xFF);
+
+    bool has_map = (_config.regions_count != 0);
+    int headers = 1 + (has_map ? 1 : 0) + (_config.four_byte_inst_table ? 1 : 0);
+
+    // SFDP header: signature, JESD216B, number of parameter headers - 1
+    memcpy(&_sfdp[0], "SFDP", 4);
+    _sfdp[4] = 0x06;
+    _sfdp[5] = 0x01;
+    _sfdp[6] = headers - 1;
+    _sfdp[7] = 0xFF;
+
+    // Parameter headers: ID LSB, minor, major, length in DWORDs, pointer, ID MSB
+    size_t header = 8;
+    uint8_t basic_header[8] = {0x00, (uint8_t)((_config.basic_table_dwords > 9) ? 0x06 : 0x00), 0x01,
+                               _config.basic_table_dwords, NOR_SFDP_BASIC_ADDR, 0x00, 0x00, 0xFF
+                              };
+    memcpy(&_sfdp[header], basic_header, 8);
+    header += 8;
+
+    // Sector map: a detection command reading the configuration register if there are two maps
+    if (has_map) {
+        size_t addr = NOR_SFDP_MAP_ADDR;
+        if (_config.alt_regions_count != 0) {
+            // Command descriptor: RDCR, no address, no latency, mask, end bit clear
+            put_dword(_sfdp, addr, 0xFC | (NOR_RDCR << 8) | (0x00 << 16) | ((uint32_t)_config.config_map_mask << 24));
+            put_dword(_sfdp, addr + 4, 0);
+            addr += 8;
+        }
+        // Map descriptor: map bit, configuration ID, regions - 1
+        bool last = (_config.alt_regions_count == 0);
+        put_dword(_sfdp, addr, 0xFC | 0x02 | (last ? 0x01 : 0x00) | (0 << 8) | ((_config.regions_count - 1) << 16) | 0xFF000000);
+        addr += 4;
+        for (int i = 0; i < _config.regions_count; i++) {
+            put_dword(_sfdp, addr, region_dword(_config.regions[i]));
+            addr += 4;
+        }
+        if (!last) {
+            put_dword(_sfdp, addr, 0xFC | 0x02 | 0x01 | (1 << 8) | ((_config.alt_regions_count - 1) << 16) | 0xFF000000);
+            addr += 4;
+            for (int i = 0; i < _config.alt_regions_count; i++) {
+                put_dword(_sfdp, addr, region_dword(_config.alt_regions[i]));
+                addr += 4;
+            }
+        }
+        uint8_t map_header[8] = {0x81, 0x00, 0x01, (uint8_t)((addr - NOR_SFDP_MAP_ADDR) / 4), NOR_SFDP_MAP_ADDR, 0x00, 0x00, 0xFF};
+        memcpy(&_sfdp[header], map_header, 8);
+        header += 8;
+    }
+
+    // 4-byte address instruction table: supported instructions, erase type instructions
+    if (_config.four_byte_inst_table) {
+        uint32_t support = 0x0001 | 0x0002 | 0x0040;
+        uint32_t erase_insts = 0;
+        for (int i = 0; i < 4; i++) {
+            uint8_t inst = 0xFF;
+            if (_config.erase_types[i].size != 0) {
+                support |= 0x0200 << i;
+                inst = _config.erase_types[i].inst_4b;
+            }
+            erase_insts |= (uint32_t)inst << (8 * i);
+        }
+        put_dword(_sfdp, NOR_SFDP_4BYTE_ADDR, support);
+        put_dword(_sfdp, NOR_SFDP_4BYTE_ADDR + 4, erase_insts);
+        uint8_t table_header[8] = {0x84, 0x00, 0x01, 0x02, (uint8_t)(NOR_SFDP_4BYTE_ADDR & 0xFF),
+                                   (uint8_t)(NOR_SFDP_4BYTE_ADDR >> 8), 0x00, 0xFF
+                                  };
+        memcpy(&_sfdp[header], table_header, 8);
+        header += 8;
+    }
+
+    // Basic Flash Parameter Table
+    uint8_t *t = &_sfdp[NOR_SFDP_BASIC_ADDR];
+    memset(t, 0, 64);
+    uint8_t erase4k = 0xFF;
+    for (int i = 0; i < 4; i++) {
+        if (_config.erase_types[i].size == 4096) {
+            erase4k = _config.erase_types[i].inst;
+        }
+    }
+
+    // DWORD 1: 4K erase, address bytes and fast read modes
+    t[0] = 0xE4 | ((erase4k != 0xFF) ? 0x01 : 0x03);
+    t[1] = erase4k;
+    t[2] = 0x80 | (_config.fast_read_modes & 0x71) | ((_config.address_bytes & 0x03) << 1);
+    t[3] = 0xFF;
+
+    // DWORD 2: density in bits - 1, or 2^N bits above 2Gbit
+    uint64_t bits = _config.size_bytes * 8;
+    uint32_t density;
+    if (bits <= 0x80000000ULL) {
+        density = (uint32_t)(bits - 1);
+    } else {
+        int n = 0;
+        while (((uint64_t)1 << n) < bits) {
+            n++;
+        }
+        density = 0x80000000 | n;
+    }
+    put_dword(_sfdp, NOR_SFDP_BASIC_ADDR + 4, density);
+
+    // DWORDs 3-4: 1-4-4, 1-1-4, 1-1-2 and 1-2-2 fast read instructions
+    t[8] = 0x44;
+    t[9] = (_config.fast_read_modes & 0x20) ? 0xEB : 0x00;
+    t[10] = 0x08;
+    t[11] = (_config.fast_read_modes & 0x40) ? 0x6B : 0x00;
+    t[12] = 0x08;
+    t[13] = (_config.fast_read_modes & 0x01) ? 0x3B : 0x00;
+    t[14] = 0x80;
+    t[15] = (_config.fast_read_modes & 0x10) ? 0xBB : 0x00;
+
+    // DWORDs 5-7: 2-2-2 / 4-4-4 not supported
+    t[16] = 0xEE;
+    t[17] = t[18] = t[19] = 0xFF;
+    t[20] = t[21] = 0xFF;
+    t[24] = t[25] = 0xFF;
+
+    // DWORDs 8-9: erase types, size as 2^N and instruction
+    for (int i = 0; i < 4; i++) {
+        const nor_erase_type &type = _config.erase_types[i];
+        int n = 0;
+        while ((type.size != 0) && (((uint32_t)1 << n) < type.size)) {
+            n++;
+        }
+        t[28 + 2 * i] = (type.size != 0) ? n : 0;
+        t[29 + 2 * i] = (type.size != 0) ? type.inst : 0;
+    }
+
+    if (_config.basic_table_dwords < 16) {
+        return;
+    }
+
+    // DWORD 10: erase times, 7 bits each, and the maximum multiplier
+    uint32_t erase_timing = (_config.erase_max_multiplier / 2 - 1) & 0x0F;
+    for (int i = 0; i < 4; i++) {
+        uint64_t typ_us = _config.erase_types[i].typ_us;
+        uint32_t field = (typ_us != 0) ? encode_time(typ_us, erase_units_us, 4, 5) : 0;
+        erase_timing |= field << (4 + 7 * i);
+    }
+    put_dword(_sfdp, NOR_SFDP_BASIC_ADDR + 36, erase_timing);
+
+    // DWORD 11: page size, page program and chip erase times, maximum multiplier
+    int page_n = 0;
+    while (((uint32_t)1 << page_n) < _config.page_size) {
+        page_n++;
+    }
+    uint32_t program_timing = ((_config.program_max_multiplier / 2 - 1) & 0x0F) | (page_n << 4);
+    program_timing |= encode_time(_config.page_program_typ_us, program_units_us, 2, 5) << 8;
+    program_timing |= encode_time(_config.chip_erase_typ_ms, chip_units_ms, 4, 5) << 24;
+    put_dword(_sfdp, NOR_SFDP_BASIC_ADDR + 40, program_timing);
+
+    // DWORDs 12-13: suspend/resume, bit 31 clear when supported
+    if (_config.suspend) {
+        uint32_t suspend = encode_time((uint64_t)_config.suspend_latency_us * 1000, latency_units_ns, 4, 5) << 24;
+        uint32_t resume_count = (_config.resume_to_suspend_us + 63) / 64;
+        suspend |= ((resume_count - 1) & 0x0F) << 20;
+        put_dword(_sfdp, NOR_SFDP_BASIC_ADDR + 44, suspend);
+        put_dword(_sfdp, NOR_SFDP_BASIC_ADDR + 48,
+                  NOR_RESUME | (NOR_SUSPEND << 8) | (NOR_RESUME << 16) | ((uint32_t)NOR_SUSPEND << 24));
+    } else {
+        put_dword(_sfdp, NOR_SFDP_BASIC_ADDR + 44, 0x80000000);
+        put_dword(_sfdp, NOR_SFDP_BASIC_ADDR + 48, 0);
+    }
+
+    // DWORD 14: Deep Power-Down instructions and exit delay, legacy status polling
+    if (_config.deep_power_down) {
+        uint32_t dpd = ((uint32_t)NOR_DPD << 23) | ((uint32_t)NOR_RES << 15) | 0x04;
+        dpd |= encode_time((uint64_t)_config.dpd_exit_us * 1000, latency_units_ns, 4, 5) << 8;
+        put_dword(_sfdp, NOR_SFDP_BASIC_ADDR + 52, dpd);
+    } else {
+        put_dword(_sfdp, NOR_SFDP_BASIC_ADDR + 52, 0x80000004);
+    }
+
+    // DWORD 16: 4 byte address entry methods, 66h/99h soft reset
+    put_dword(_sfdp, NOR_SFDP_BASIC_ADDR + 60, ((uint32_t)_config.enter_4byte_methods << 24) | (0x10 << 8));
+}
+
+}
@@ -0,0 +1,256 @@
+#ifndef SIM_NOR_FLASH_H
+#define SIM_NOR_FLASH_H
+
+//SPI NOR flash model for the host build, attached to a sim SPI bus
+//decodes the commands SPIFBlockDevicePD sends, serves an SFDP area generated from its configuration
+//and takes the program/erase times of the configuration in sim time (WIP set meanwhile).
+//Programs only clear bits and wrap within the page, erases set 0xFF. Commands the real part would
+//ignore or mishandle (busy, no WEL, overclocked, unsupported erase type in a region) are counted
+//as violations so tests can assert the driver never sends them
+
+#include <stdint.h>
+#include <vector>
+#include "sim_bus.h"
+
+namespace sim {
+
+#define NOR_MAX_REGIONS 4
+
+struct nor_erase_type {
+    uint32_t size;          //0 - type not supported
+    uint8_t inst;
+    uint8_t inst_4b;        //4 byte address version, reported in the 4-byte instruction table
+    uint32_t typ_us;
+};
+
+struct nor_region {
+    uint32_t size;
+    uint8_t erase_types;    //bit n - erase type n+1 works in the region
+};
+
+struct nor_config {
+    const char *name;
+    uint8_t jedec_id[3];
+    uint64_t size_bytes;
+    uint32_t page_size;
+
+    nor_erase_type erase_types[4];
+    uint32_t page_program_typ_us;
+    uint32_t chip_erase_typ_ms;
+    uint8_t erase_max_multiplier;   //maximum / typical time reported in SFDP, 2 to 32 in steps of 2
+    uint8_t program_max_multiplier;
+    //actual operation times are spread over [min, max] percent of the typical time (deterministic)
+    uint16_t time_min_percent;
+    uint16_t time_max_percent;
+
+    uint8_t basic_table_dwords;     //9 (JESD216) or 16 (JESD216A/B, timings, suspend, power-down)
+    uint8_t fast_read_modes;        //basic table byte 2 bits: 0x01 1-1-2, 0x10 1-2-2, 0x20 1-4-4, 0x40 1-1-4
+    int read_max_hz;                //Read (0x03/0x13) is only specified up to here
+    int fast_read_max_hz;           //every other command
+
+    uint8_t address_bytes;          //SFDP: 0 - 3 byte only, 1 - 3 or 4 byte, 2 - 4 byte only
+    uint8_t enter_4byte_methods;    //SFDP DWORD16 bits 31:24, 0x01 - B7h, 0x02 - WREN then B7h
+    bool four_byte_inst_table;
+
+    bool suspend;
+    uint32_t suspend_latency_us;    //tSUS, WIP clears this long after a suspend
+    uint32_t resume_to_suspend_us;  //the operation must run this long after a resume
+
+    bool deep_power_down;
+    uint32_t dpd_exit_us;           //tRES1
+
+    //sector map: regions from the bottom of the device, none - uniform
+    int regions_count;
+    nor_region regions[NOR_MAX_REGIONS];
+    //second map selected by a configuration register bit (top/bottom boot), read with RDCR (35h)
+    int alt_regions_count;
+    nor_region alt_regions[NOR_MAX_REGIONS];
+    uint8_t config_register;
+    uint8_t config_map_mask;
+};
+
+//4MB uniform part with the typical times of the Winbond W25Q32JV datasheet
+//(program 0.4ms, 4K/32K/64K erase 45/120/150ms, chip erase 10s, Read 0x03 up to 50MHz)
+nor_config nor_config_w25q32();
+//16MB part with 4KB sectors only in the bottom 128KB (or the top, config register bit 2), like the
+//Cypress S25FL hybrid sector parts, sector map with a detection command
+nor_config nor_config_hybrid();
+//32MB part reached with 4 byte addresses, entered with B7h, with 4 byte instructions reported too
+nor_config nor_config_w25q256();
+
+//activity since construction or reset_stats()
+struct nor_stats {
+    uint32_t commands[256];     //by opcode, counted at chip select rise
+    uint64_t bytes_read;        //data bytes out of Read/Fast Read
+    uint32_t page_programs;
+    uint64_t bytes_programmed;
+    uint32_t erases[4];         //by erase type
+    uint32_t chip_erases;
+    uint32_t status_polls;
+    uint32_t suspends;
+    uint32_t resumes;
+    uint64_t busy_ns;           //time with a program or erase running (not suspended)
+    //violations
+    uint32_t busy_commands;     //commands sent while WIP (not suspended), ignored
+    uint32_t no_wel_writes;     //program/erase without WEL, ignored
+    uint32_t bad_erases;        //erase type not supported in the region
+    uint32_t reads_in_erase;    //read of the area of a suspended erase
+    uint32_t early_suspends;    //suspend sooner than resume-to-suspend after a resume
+    uint32_t overclocked;       //commands clocked faster than specified, data is garbage
+    uint32_t dpd_commands;      //commands while in Deep Power-Down or before tRES1, ignored
+    uint32_t power_fails;
+
+    uint32_t violations() const
+    {
+        return busy_commands + no_wel_writes + bad_erases + reads_in_erase + early_suspends + overclocked + dpd_commands;
+    }
+};
+
+class nor_flash : public spi_device {
+public:
+    nor_flash(const nor_config &config, uint32_t seed = 1);
+
+    void attach(PinName sclk, PinName csel);
+    void detach();
+
+    const nor_config &config() const
+    {
+        return _config;
+    }
+    const std::vector<uint8_t> &sfdp() const
+    {
+        return _sfdp;
+    }
+
+    //raw contents, bypassing the bus and the timing
+    uint8_t *memory()
+    {
+        return &_mem[0];
+    }
+    void fill(uint8_t value);
+
+    bool busy();
+    bool suspended() const
+    {
+        return _suspended;
+    }
+    bool powered_down() const
+    {
+        return _dpd;
+    }
+    bool four_byte_mode() const
+    {
+        return _four_byte_mode;
+    }
+    void set_config_register(uint8_t value)
+    {
+        _config.config_register = value;
+    }
+
+    const nor_stats &stats() const
+    {
+        return _stats;
+    }
+    void reset_stats();
+    uint32_t command_count(uint8_t opcode) const
+    {
+        return _stats.commands[opcode];
+    }
+
+    //faults, cleared by clear_faults()
+    //programs and erases touching [addr, addr + size) take extra_us longer and then fail
+    //(contents unchanged), like a worn out block stuck busy
+    void fault_stuck_busy(uint64_t addr, uint64_t size, uint32_t extra_us);
+    //programs in [addr, addr + size) leave the bits of mask set (they don't program)
+    void fault_stuck_bits(uint64_t addr, uint64_t size, uint8_t mask);
+    //the next count WREN commands are lost
+    void fault_drop_wren(int count);
+    void clear_faults();
+
+    //power is lost now: a running program or erase is cut at the fraction of its time done,
+    //the device then comes back in its power-on state
+    void power_fail();
+    //power is lost once sim time reaches at_ns (applied on the next bus activity, as of at_ns),
+    //the part then stays off - ignores the bus, MISO floats high - until power_on()
+    void fault_power_fail_at(uint64_t at_ns);
+    void power_on();
+    bool powered() const
+    {
+        return _powered;
+    }
+
+    //spi_device
+    virtual void select();
+    virtual void deselect();
+    virtual uint8_t transfer(uint8_t mosi);
+    virtual void clock(int hz);
+
+private:
+    enum busy_kind { BUSY_NONE, BUSY_PROGRAM, BUSY_ERASE, BUSY_CHIP_ERASE, BUSY_RESET, BUSY_DPD_EXIT };
+
+    void build_sfdp();
+    void update();
+    void update_to(uint64_t now);
+    void cut_power(uint64_t at_ns);
+    uint64_t op_time_ns(uint32_t typ_us);
+    int address_length(uint8_t opcode) const;
+    int dummy_length(uint8_t opcode) const;
+    int erase_type_of(uint8_t opcode) const;
+    bool is_read(uint8_t opcode) const;
+    bool erase_allowed(int type, uint64_t addr) const;
+    void execute();
+    void start_busy(busy_kind kind, uint64_t addr, uint64_t size, uint64_t duration_ns);
+    void complete_busy(double fraction);
+    bool stuck(uint64_t addr, uint64_t size) const;
+    uint8_t status();
+
+    nor_config _config;
+    std::vector<uint8_t> _mem;
+    std::vector<uint8_t> _sfdp;
+    nor_stats _stats;
+    uint32_t _seed;
+    PinName _sclk;
+    PinName _csel;
+    bool _attached;
+
+    //transaction in progress
+    bool _selected;
+    int _hz;
+    std::vector<uint8_t> _cmd;
+    uint64_t _data_addr;
+    bool _data_overclocked;
+
+    //device state
+    bool _wel;
+    bool _four_byte_mode;
+    bool _reset_enabled;
+    bool _dpd;
+    busy_kind _busy;
+    uint64_t _busy_addr;
+    uint64_t _busy_size;
+    uint64_t _busy_start_ns;
+    uint64_t _busy_done_ns;
+    uint64_t _busy_accounted_ns;
+    bool _busy_fails;
+    std::vector<uint8_t> _program_data;
+    bool _suspended;
+    uint64_t _suspend_done_ns;
+    uint64_t _remaining_ns;
+    uint64_t _resumed_ns;
+    bool _ever_resumed;
+    bool _powered;
+    uint64_t _power_fail_at_ns;
+
+    //faults
+    uint64_t _stuck_busy_addr;
+    uint64_t _stuck_busy_size;
+    uint32_t _stuck_busy_extra_us;
+    uint64_t _stuck_bits_addr;
+    uint64_t _stuck_bits_size;
+    uint8_t _stuck_bits_mask;
+    int _drop_wren;
+};
+
+}
+
+#endif
@@ -0,0 +1,157 @@
+#include "sim_bus.h"
+
+#include <map>
+#include <vector>
+#include <algorithm>
+
+namespace sim {
+
+namespace {
+
+struct spi_slot {
+    PinName sclk;
+    PinName csel;
+    spi_device *dev;
+};
+
+struct i2c_slot {
+    PinName sda;
+    int address;
+    i2c_device *dev;
+};
+
+struct bus_state {
+    std::vector<spi_slot> spi;
+    std::vector<i2c_slot> i2c;
+    std::map<int, int> levels;
+    std::map<int, std::function<void(int)> > edges;
+    bus_timing timing;
+    bus_counters counters;
+};
+
+bus_state &state()
+{
+    static bus_state *s = new bus_state{{}, {}, {}, {}, {1500, 5000, 50, 1000}, {}};
+    return *s;
+}
+
+}
+
+void spi_attach(PinName sclk, PinName csel, spi_device *dev)
+{
+    state().spi.push_back(spi_slot{sclk, csel, dev});
+    // Chip selects idle high
+    if (state().levels.find(csel) == state().levels.end()) {
+        state().levels[csel] = 1;
+    }
+}
+
+void spi_detach(spi_device *dev)
+{
+    std::vector<spi_slot> &spi = state().spi;
+    spi.erase(std::remove_if(spi.begin(), spi.end(), [dev](const spi_slot &s) {
+        return s.dev == dev;
+    }), spi.end());
+}
+
+//devices on sclk whose chip select is low
+void spi_selected(PinName sclk, std::vector<spi_device *> &devs)
+{
+    devs.clear();
+    for (const spi_slot &s : state().spi) {
+        if ((s.sclk == sclk) && (pin_read(s.csel) == 0)) {
+            devs.push_back(s.dev);
+        }
+    }
+}
+
+void i2c_attach(PinName sda, int address, i2c_device *dev)
+{
+    state().i2c.push_back(i2c_slot{sda, address & 0xFE, dev});
+}
+
+void i2c_detach(i2c_device *dev)
+{
+    std::vector<i2c_slot> &i2c = state().i2c;
+    i2c.erase(std::remove_if(i2c.begin(), i2c.end(), [dev](const i2c_slot &s) {
+        return s.dev == dev;
+    }), i2c.end());
+}
+
+i2c_device *i2c_find(PinName sda, int address)
+{
+    for (const i2c_slot &s : state().i2c) {
+        if ((s.sda == sda) && (s.address == (address & 0xFE))) {
+            return s.dev;
+        }
+    }
+    return NULL;
+}
+
+bus_timing &timing()
+{
+    return state().timing;
+}
+
+bus_counters &counters()
+{
+    return state().counters;
+}
+
+void reset_bus_counters()
+{
+    state().counters = bus_counters();
+}
+
+int pin_read(PinName pin)
+{
+    std::map<int, int>::iterator it = state().levels.find(pin);
+    // Unconnected inputs read high (pull ups on the board)
+    return (it == state().levels.end()) ? 1 : it->second;
+}
+
+void pin_write(PinName pin, int level)
+{
+    level = level ? 1 : 0;
+    int previous = pin_read(pin);
+    state().levels[pin] = level;
+    if (previous == level) {
+        return;
+    }
+    for (const spi_slot &s : state().spi) {
+        if (s.csel == pin) {
+            if (level == 0) {
+                state().counters.spi_selects++;
+                s.dev->select();
+            } else {
+                s.dev->deselect();
+            }
+        }
+    }
+}
+
+void pin_drive(PinName pin, int level)
+{
+    level = level ? 1 : 0;
+    int previous = pin_read(pin);
+    state().levels[pin] = level;
+    if (previous == level) {
+        return;
+    }
+    std::map<int, std::function<void(int)> >::iterator it = state().edges.find(pin);
+    if (it != state().edges.end()) {
+        it->second(level);
+    }
+}
+
+void pin_on_edge(PinName pin, std::function<void(int)> handler)
+{
+    state().edges[pin] = handler;
+}
+
+void pin_clear_edge(PinName pin)
+{
+    state().edges.erase(pin);
+}
+
+}
@@ -0,0 +1,77 @@
+#ifndef SIM_BUS_H
+#define SIM_BUS_H
+
+//pins and buses connecting the mbed shim (SPI, I2C, DigitalOut, InterruptIn) to simulated devices
+
+#include <stdint.h>
+#include <functional>
+#include <vector>
+#include "PinNames.h"
+
+namespace sim {
+
+//device on a SPI bus, selected while its chip select pin is low
+class spi_device {
+public:
+    virtual ~spi_device() {}
+    virtual void select() {}
+    virtual void deselect() {}
+    //one byte each way, MSB first on the wire
+    virtual uint8_t transfer(uint8_t mosi) = 0;
+    //clock the device is running at, set by the bus before the bytes of a call
+    virtual void clock(int /*hz*/) {}
+};
+
+void spi_attach(PinName sclk, PinName csel, spi_device *dev);
+void spi_detach(spi_device *dev);
+
+//device on an I2C bus, at a 8 bit address (R/W bit 0)
+class i2c_device {
+public:
+    virtual ~i2c_device() {}
+    //false to NACK, repeated - no stop condition after the transfer
+    virtual bool write(const uint8_t *data, int length, bool repeated) = 0;
+    virtual bool read(uint8_t *data, int length, bool repeated) = 0;
+};
+
+void i2c_attach(PinName sda, int address, i2c_device *dev);
+void i2c_detach(i2c_device *dev);
+
+//software cost of the driver calls, on top of the time the bits take on the wire
+struct bus_timing {
+    uint32_t spi_call_ns;       //each SPI::write() call (HAL setup, polling the last byte out)
+    uint32_t i2c_call_ns;       //each I2C::read()/write() call
+    uint32_t pin_write_ns;      //each DigitalOut write (chip select)
+    uint32_t yield_ns;          //each ThisThread::yield() (scheduler call, context switches)
+};
+
+//defaults: 1.5us per SPI call, 5us per I2C call, 50ns per pin write, 1us per yield, measured orders
+//of magnitude for the STM32 HAL and RTX at 80MHz, change them to see how sensitive a result is
+bus_timing &timing();
+
+//bus traffic since start or the last reset_bus_counters()
+struct bus_counters {
+    uint64_t spi_calls;
+    uint64_t spi_bytes;
+    uint64_t spi_selects;       //chip select assertions, i.e. SPI transactions
+    uint64_t i2c_calls;
+    uint64_t i2c_bytes;
+};
+
+bus_counters &counters();
+void reset_bus_counters();
+
+//pin levels: outputs written by the MCU side, inputs driven by the devices
+int pin_read(PinName pin);
+void pin_write(PinName pin, int level);   //MCU output, chip selects notify the SPI devices
+void pin_drive(PinName pin, int level);   //device output, edges run the InterruptIn handlers
+void pin_on_edge(PinName pin, std::function<void(int)> handler);
+void pin_clear_edge(PinName pin);
+
+//for the shim: devices on the bus of sclk whose chip select is low, device at an I2C address
+void spi_selected(PinName sclk, std::vector<spi_device *> &devs);
+i2c_device *i2c_find(PinName sda, int address);
+
+}
+
+#endif
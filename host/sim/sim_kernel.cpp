@@ -0,0 +1,257 @@
+#include "sim_kernel.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <inttypes.h>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#define SIM_DEFAULT_PRIORITY 24 //osPriorityNormal
+
+namespace sim {
+
+struct thread {
+    std::condition_variable cv;
+    std::function<void()> fn;
+    int priority;
+    size_t index;
+    bool blocked;
+    bool done;
+    uint64_t deadline;
+};
+
+namespace {
+
+struct kernel_state {
+    std::mutex m;
+    std::vector<thread *> threads;
+    thread *running;
+    uint64_t now;
+    void (*deadlock_handler)();
+};
+
+//never destroyed, threads still blocked when main() returns keep waiting on it
+kernel_state &kernel()
+{
+    static kernel_state *state = new kernel_state{{}, {}, NULL, 0, NULL};
+    return *state;
+}
+
+thread_local thread *self = NULL;
+
+thread *new_thread(int priority)
+{
+    kernel_state &k = kernel();
+    thread *t = new thread;
+    t->priority = priority;
+    t->index = k.threads.size();
+    t->blocked = false;
+    t->done = false;
+    t->deadline = SIM_NEVER;
+    k.threads.push_back(t);
+    return t;
+}
+
+//the first thread calling into the kernel (main) is adopted, it holds the run token from then on
+thread *adopt(std::unique_lock<std::mutex> &lk)
+{
+    kernel_state &k = kernel();
+    if (self == NULL) {
+        self = new_thread(SIM_DEFAULT_PRIORITY);
+        if (k.running == NULL) {
+            k.running = self;
+        }
+    }
+    thread *me = self;
+    me->cv.wait(lk, [&] { return kernel().running == me; });
+    return me;
+}
+
+void deadlock()
+{
+    kernel_state &k = kernel();
+    fprintf(stderr, "sim: deadlock at %" PRIu64 " us, every thread is blocked without a timeout\n", k.now / 1000);
+    if (k.deadlock_handler) {
+        k.deadlock_handler();
+    }
+    abort();
+}
+
+//next thread to run: the highest priority runnable one, round robin among equal priorities
+//starting after the current one. Moves time to the earliest timeout when nothing is runnable
+thread *pick_next()
+{
+    kernel_state &k = kernel();
+    size_t count = k.threads.size();
+    size_t start = (k.running != NULL) ? (k.running->index + 1) : 0;
+
+    while (true) {
+        for (thread *t : k.threads) {
+            if (t->blocked && !t->done && (t->deadline <= k.now)) {
+                t->blocked = false;
+            }
+        }
+
+        thread *best = NULL;
+        for (size_t i = 0; i < count; i++) {
+            thread *t = k.threads[(start + i) % count];
+            if (!t->blocked && !t->done && ((best == NULL) || (t->priority > best->priority))) {
+                best = t;
+            }
+        }
+        if (best != NULL) {
+            return best;
+        }
+
+        uint64_t earliest = SIM_NEVER;
+        for (thread *t : k.threads) {
+            if (t->blocked && !t->done && (t->deadline < earliest)) {
+                earliest = t->deadline;
+            }
+        }
+        if (earliest == SIM_NEVER) {
+            deadlock();
+        }
+        k.now = earliest;
+    }
+}
+
+//hand the run token to the next thread and wait until it comes back to me
+void switch_from(std::unique_lock<std::mutex> &lk, thread *me)
+{
+    kernel_state &k = kernel();
+    thread *next = pick_next();
+    k.running = next;
+    if (next != me) {
+        next->cv.notify_one();
+        me->cv.wait(lk, [&] { return kernel().running == me; });
+    }
+}
+
+}
+
+uint64_t now_ns()
+{
+    kernel_state &k = kernel();
+    std::lock_guard<std::mutex> lk(k.m);
+    return k.now;
+}
+
+void spend_ns(uint64_t ns)
+{
+    kernel_state &k = kernel();
+    std::unique_lock<std::mutex> lk(k.m);
+    adopt(lk);
+    k.now += ns;
+}
+
+void block(uint64_t deadline_ns)
+{
+    kernel_state &k = kernel();
+    std::unique_lock<std::mutex> lk(k.m);
+    thread *me = adopt(lk);
+    me->blocked = true;
+    me->deadline = deadline_ns;
+    switch_from(lk, me);
+}
+
+void notify()
+{
+    kernel_state &k = kernel();
+    std::lock_guard<std::mutex> lk(k.m);
+    for (thread *t : k.threads) {
+        if (t->blocked && !t->done) {
+            t->blocked = false;
+        }
+    }
+}
+
+void yield()
+{
+    kernel_state &k = kernel();
+    std::unique_lock<std::mutex> lk(k.m);
+    thread *me = adopt(lk);
+    switch_from(lk, me);
+}
+
+void sleep_ns(uint64_t ns)
+{
+    uint64_t deadline = now_ns() + ns;
+    while (now_ns() < deadline) {
+        block(deadline);
+    }
+}
+
+thread *start_thread(std::function<void()> fn, int priority)
+{
+    kernel_state &k = kernel();
+    std::unique_lock<std::mutex> lk(k.m);
+    adopt(lk);
+
+    thread *t = new_thread(priority);
+    t->fn = fn;
+
+    std::thread([t] {
+        kernel_state &k = kernel();
+        {
+            std::unique_lock<std::mutex> lk(k.m);
+            self = t;
+            t->cv.wait(lk, [&] { return kernel().running == t; });
+        }
+
+        t->fn();
+
+        std::unique_lock<std::mutex> lk(k.m);
+        t->done = true;
+        // Joiners re-check
+        for (thread *other : k.threads) {
+            if (other->blocked && !other->done) {
+                other->blocked = false;
+            }
+        }
+        thread *next = pick_next();
+        k.running = next;
+        next->cv.notify_one();
+    }).detach();
+
+    return t;
+}
+
+void join_thread(thread *t)
+{
+    while (!thread_done(t)) {
+        block();
+    }
+}
+
+bool thread_done(thread *t)
+{
+    kernel_state &k = kernel();
+    std::lock_guard<std::mutex> lk(k.m);
+    return t->done;
+}
+
+void abandon_thread(thread *t)
+{
+    kernel_state &k = kernel();
+    std::lock_guard<std::mutex> lk(k.m);
+    t->done = true;
+}
+
+thread *current_thread()
+{
+    kernel_state &k = kernel();
+    std::unique_lock<std::mutex> lk(k.m);
+    return adopt(lk);
+}
+
+void set_deadlock_handler(void (*handler)())
+{
+    kernel_state &k = kernel();
+    std::lock_guard<std::mutex> lk(k.m);
+    k.deadlock_handler = handler;
+}
+
+}
@@ -0,0 +1,52 @@
+#ifndef SIM_KERNEL_H
+#define SIM_KERNEL_H
+
+//virtual time kernel behind the host mbed shim
+//sim threads are real threads, but only the one holding the run token executes: it keeps running
+//until it blocks or yields, like equal priority threads on the target without time slicing.
+//time only moves when a thread spends it (SPI transfers, wait_us) or when every thread is blocked,
+//then it jumps to the earliest timeout. Runs are deterministic and a 30s chip erase takes no real time
+
+#include <stdint.h>
+#include <functional>
+
+namespace sim {
+
+#define SIM_NEVER UINT64_MAX
+
+struct thread;
+
+uint64_t now_ns();
+inline uint64_t now_us() { return now_ns() / 1000; }
+
+//the running thread is busy for ns (CPU or bus time), nothing else runs meanwhile
+void spend_ns(uint64_t ns);
+
+//block the running thread until notify() is called or the deadline (absolute, ns) passes
+//callers re-check what they wait for, wake ups may be spurious
+void block(uint64_t deadline_ns = SIM_NEVER);
+
+//wake every blocked thread so it re-checks its condition
+void notify();
+
+//let other runnable threads of the same or higher priority run, the caller stays runnable
+void yield();
+
+//sleep the running thread for ns
+void sleep_ns(uint64_t ns);
+
+//start fn as a new sim thread, it runs once the creator blocks or yields
+thread *start_thread(std::function<void()> fn, int priority);
+void join_thread(thread *t);
+bool thread_done(thread *t);
+//stop scheduling t (rtos::Thread::terminate()), t must not be the running thread
+void abandon_thread(thread *t);
+
+thread *current_thread();
+
+//how a deadlock (every thread blocked without a timeout) is reported, aborts by default
+void set_deadlock_handler(void (*handler)());
+
+}
+
+#endif
@@ -0,0 +1,361 @@
+#include "stusb4500_model.h"
+
+#include <string.h>
+
+namespace sim {
+
+#define REG_ALERT_STATUS_1 0x0B
+#define REG_ALERT_STATUS_1_MASK 0x0C
+#define REG_PORT_STATUS_0 0x0D
+#define REG_PORT_STATUS_1 0x0E
+#define REG_TYPEC_MON_STATUS_0 0x0F
+#define REG_CC_STATUS 0x11
+#define REG_CC_HW_FAULT_STATUS_0 0x12
+#define REG_PRT_STATUS 0x16
+#define REG_CMD_CTRL 0x1A
+#define REG_DEVICE_ID 0x2F
+#define REG_RX_BYTE_CNT 0x30
+#define REG_RX_HEADER 0x31
+#define REG_RX_DATA_OBJ 0x33
+#define REG_TX_HEADER 0x51
+#define REG_DPM_PDO_NUMB 0x70
+#define REG_DPM_SNK_PDO1 0x85
+#define REG_RDO_STATUS 0x91
+
+#define ALERT_PRT (1 << 1)
+#define ALERT_CC_DETECT (1 << 6)
+
+#define PRT_MSG_RECEIVED (1 << 2)
+#define CC_STATUS_ATTACHED 0x13     //sink, source at 3A on CC1
+#define CC_STATUS_LOOKING 0x20
+#define SEND_MESSAGE_CMD 0x26
+
+//message types, Table 6-5 and 6-6
+#define MSG_ACCEPT 0x03
+#define MSG_REJECT 0x04
+#define MSG_PS_RDY 0x06
+#define MSG_GET_SOURCE_CAP 0x07
+#define MSG_SOFT_RESET 0x0D
+#define MSG_SOURCE_CAPABILITIES 0x01
+
+//above every firmware thread, the chip and the source are hardware
+#define MODEL_THREAD_PRIORITY 48
+
+namespace {
+
+uint32_t le32(const uint8_t *b)
+{
+    return (uint32_t)b[0] | ((uint32_t)b[1] << 8) | ((uint32_t)b[2] << 16) | ((uint32_t)b[3] << 24);
+}
+
+void put_le32(uint8_t *b, uint32_t value)
+{
+    for (int i = 0; i < 4; i++) {
+        b[i] = (value >> (8 * i)) & 0xFF;
+    }
+}
+
+//fixed supply PDO fields, Table 6-9 and 6-14
+bool is_fixed(uint32_t pdo)
+{
+    return (pdo >> 30) == 0;
+}
+
+uint32_t fixed_mv(uint32_t pdo)
+{
+    return ((pdo >> 10) & 0x3FF) * 50;
+}
+
+uint32_t fixed_ma(uint32_t pdo)
+{
+    return (pdo & 0x3FF) * 10;
+}
+
+uint32_t make_fixed(uint32_t mv, uint32_t ma)
+{
+    return ((mv / 50) << 10) | (ma / 10);
+}
+
+//read registers holding transitions, cleared once read
+bool clears_on_read(uint8_t addr)
+{
+    return (addr == REG_ALERT_STATUS_1) || (addr == REG_PORT_STATUS_0) || (addr == REG_TYPEC_MON_STATUS_0) ||
+           (addr == REG_CC_HW_FAULT_STATUS_0) || (addr == REG_PRT_STATUS);
+}
+
+}
+
+stusb4500_model::stusb4500_model(PinName sda, PinName alert)
+    : _pointer(0), _sda(sda), _alert(alert), _attached(false), _responsive(true), _reject_mv(0),
+      _contract_mv(0), _contract_ma(0), _message_id(0), _generation(0), _stop(false)
+{
+    memset(_regs, 0, sizeof(_regs));
+    reset_stats();
+
+    // Power-on state, sink PDOs of the default NVM: 5V 1.5A, 15V 1.5A, 20V 1A
+    _regs[REG_ALERT_STATUS_1_MASK] = 0xFF;
+    _regs[REG_DEVICE_ID] = 0x25;
+    _regs[REG_CC_STATUS] = CC_STATUS_LOOKING;
+    _regs[REG_DPM_PDO_NUMB] = 3;
+    put_le32(&_regs[REG_DPM_SNK_PDO1], make_fixed(5000, 1500));
+    put_le32(&_regs[REG_DPM_SNK_PDO1 + 4], make_fixed(15000, 1500));
+    put_le32(&_regs[REG_DPM_SNK_PDO1 + 8], make_fixed(20000, 1000));
+
+    pin_drive(_alert, 1);
+    i2c_attach(_sda, STUSB_MODEL_I2C_ADDR, this);
+    _thread = start_thread([this] {
+        run();
+    }, MODEL_THREAD_PRIORITY);
+}
+
+stusb4500_model::~stusb4500_model()
+{
+    _stop = true;
+    notify();
+    join_thread(_thread);
+    i2c_detach(this);
+    pin_drive(_alert, 1);
+}
+
+void stusb4500_model::plug(const std::vector<uint32_t> &pdos)
+{
+    _pdos = pdos;
+    _attached = true;
+    _generation++;
+
+    _regs[REG_PORT_STATUS_0] |= 0x01;
+    _regs[REG_PORT_STATUS_1] |= 0x01;
+    _regs[REG_CC_STATUS] = CC_STATUS_ATTACHED;
+    raise(ALERT_CC_DETECT);
+
+    if (!_pdos.empty()) {
+        after(STUSB_MODEL_FIRST_CAPS_MS, [this] {
+            send_caps();
+        });
+    }
+}
+
+void stusb4500_model::unplug()
+{
+    _attached = false;
+    _generation++;
+    _contract_mv = 0;
+    _contract_ma = 0;
+
+    _regs[REG_PORT_STATUS_0] |= 0x01;
+    _regs[REG_PORT_STATUS_1] &= ~0x01;
+    _regs[REG_CC_STATUS] = CC_STATUS_LOOKING;
+    put_le32(&_regs[REG_RDO_STATUS], 0);
+    raise(ALERT_CC_DETECT);
+}
+
+void stusb4500_model::send_caps()
+{
+    if (!_attached || _pdos.empty()) {
+        return;
+    }
+
+    _stats.caps_sent++;
+    receive(MSG_SOURCE_CAPABILITIES, &_pdos[0], (int)_pdos.size());
+    after(STUSB_MODEL_REQUEST_MS, [this] {
+        chip_request();
+    });
+}
+
+uint32_t stusb4500_model::sink_pdo(int number) const
+{
+    return le32(&_regs[REG_DPM_SNK_PDO1 + (number - 1) * 4]);
+}
+
+void stusb4500_model::reset_stats()
+{
+    memset(&_stats, 0, sizeof(_stats));
+}
+
+bool stusb4500_model::write(const uint8_t *data, int length, bool repeated)
+{
+    if (!repeated) {
+        _stats.transactions++;
+    }
+    if (length < 1) {
+        return true;
+    }
+
+    _pointer = data[0];
+    for (int i = 1; i < length; i++) {
+        write_reg(_pointer++, data[i]);
+    }
+    return true;
+}
+
+bool stusb4500_model::read(uint8_t *data, int length, bool repeated)
+{
+    if (!repeated) {
+        _stats.transactions++;
+    }
+    if (_pointer == REG_ALERT_STATUS_1) {
+        _stats.alert_reads++;
+    }
+
+    for (int i = 0; i < length; i++) {
+        data[i] = _regs[_pointer];
+        if (clears_on_read(_pointer)) {
+            _regs[_pointer] = 0;
+        }
+        _pointer++;
+    }
+    update_alert();
+    return true;
+}
+
+void stusb4500_model::run()
+{
+    while (!_stop) {
+        // Earliest due event of the current negotiation, the first scheduled among equals
+        uint32_t generation = _generation;
+        _events.remove_if([generation](const scheduled &s) {
+            return s.generation != generation;
+        });
+
+        std::list<scheduled>::iterator next = _events.end();
+        for (std::list<scheduled>::iterator it = _events.begin(); it != _events.end(); ++it) {
+            if ((next == _events.end()) || (it->due_ns < next->due_ns)) {
+                next = it;
+            }
+        }
+
+        if ((next != _events.end()) && (next->due_ns <= now_ns())) {
+            std::function<void()> fn = next->fn;
+            _events.erase(next);
+            fn();
+            continue;
+        }
+        block((next != _events.end()) ? next->due_ns : SIM_NEVER);
+    }
+}
+
+void stusb4500_model::after(uint32_t ms, std::function<void()> fn)
+{
+    _events.push_back(scheduled{now_ns() + (uint64_t)ms * 1000000, _generation, fn});
+    notify();
+}
+
+void stusb4500_model::raise(uint8_t alert_bits)
+{
+    _regs[REG_ALERT_STATUS_1] |= alert_bits;
+    update_alert();
+}
+
+void stusb4500_model::update_alert()
+{
+    bool pending = (_regs[REG_ALERT_STATUS_1] & ~_regs[REG_ALERT_STATUS_1_MASK]) != 0;
+    if (pending && !alert_low()) {
+        _stats.alerts++;
+    }
+    pin_drive(_alert, pending ? 0 : 1);
+}
+
+void stusb4500_model::receive(uint8_t type, const uint32_t *objects, int count)
+{
+    // Source power role, revision 2.0
+    uint16_t header = type | (count << 12) | (_message_id << 9) | (1 << 8) | (1 << 6);
+    _message_id = (_message_id + 1) & 0x07;
+
+    _regs[REG_RX_BYTE_CNT] = count * 4;
+    _regs[REG_RX_HEADER] = header & 0xFF;
+    _regs[REG_RX_HEADER + 1] = header >> 8;
+    for (int i = 0; i < count; i++) {
+        put_le32(&_regs[REG_RX_DATA_OBJ + i * 4], objects[i]);
+    }
+    _regs[REG_PRT_STATUS] |= PRT_MSG_RECEIVED;
+    raise(ALERT_PRT);
+}
+
+void stusb4500_model::chip_request()
+{
+    // Highest active sink PDO matched by a fixed source PDO at its voltage with enough current,
+    // otherwise 5V with what PDO1 asks for
+    int count = _regs[REG_DPM_PDO_NUMB] & 0x03;
+    uint32_t position = 1;
+    uint32_t ma = fixed_ma(sink_pdo(1));
+    bool found = false;
+
+    for (int n = count; (n >= 1) && !found; n--) {
+        uint32_t snk = sink_pdo(n);
+        for (size_t j = 0; (j < _pdos.size()) && !found; j++) {
+            if (is_fixed(_pdos[j]) && (fixed_mv(_pdos[j]) == fixed_mv(snk)) && (fixed_ma(_pdos[j]) >= fixed_ma(snk))) {
+                position = j + 1;
+                ma = fixed_ma(snk);
+                found = true;
+            }
+        }
+    }
+    if (!found && (fixed_ma(_pdos[0]) < ma)) {
+        ma = fixed_ma(_pdos[0]);
+    }
+
+    _stats.requests++;
+    if (!_responsive) {
+        return;
+    }
+
+    uint32_t mv = fixed_mv(_pdos[position - 1]);
+    if (_reject_mv && (mv == _reject_mv)) {
+        after(STUSB_MODEL_ACCEPT_MS, [this] {
+            _stats.rejects++;
+            receive(MSG_REJECT, NULL, 0);
+        });
+        return;
+    }
+
+    uint32_t rdo = (position << 28) | ((ma / 10) << 10) | (ma / 10);
+    after(STUSB_MODEL_ACCEPT_MS, [this, mv, ma, rdo] {
+        receive(MSG_ACCEPT, NULL, 0);
+        after(STUSB_MODEL_PS_RDY_MS, [this, mv, ma, rdo] {
+            _contract_mv = mv;
+            _contract_ma = ma;
+            put_le32(&_regs[REG_RDO_STATUS], rdo);
+            receive(MSG_PS_RDY, NULL, 0);
+        });
+    });
+}
+
+void stusb4500_model::sink_sent(uint8_t type)
+{
+    if (type == MSG_SOFT_RESET) {
+        _stats.soft_resets++;
+    } else if (type == MSG_GET_SOURCE_CAP) {
+        _stats.get_source_caps++;
+    }
+    if (!_attached || !_responsive) {
+        return;
+    }
+
+    if (type == MSG_SOFT_RESET) {
+        // The negotiation in flight is dropped, the contract stays until the next PS_RDY
+        _generation++;
+        after(STUSB_MODEL_ACCEPT_MS, [this] {
+            receive(MSG_ACCEPT, NULL, 0);
+            after(STUSB_MODEL_RESEND_CAPS_MS, [this] {
+                send_caps();
+            });
+        });
+    } else if (type == MSG_GET_SOURCE_CAP) {
+        after(STUSB_MODEL_GET_CAPS_MS, [this] {
+            send_caps();
+        });
+    }
+}
+
+void stusb4500_model::write_reg(uint8_t addr, uint8_t value)
+{
+    _regs[addr] = value;
+
+    if (addr == REG_ALERT_STATUS_1_MASK) {
+        update_alert();
+    } else if ((addr == REG_CMD_CTRL) && (value == SEND_MESSAGE_CMD)) {
+        sink_sent(_regs[REG_TX_HEADER] & 0x1F);
+    }
+}
+
+}
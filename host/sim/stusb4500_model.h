@@ -0,0 +1,135 @@
+#ifndef SIM_STUSB4500_MODEL_H
+#define SIM_STUSB4500_MODEL_H
+
+//STUSB4500 register model for the host build, with the USB-PD source at the other end of the cable
+//I2C registers auto-increment, ALERT_STATUS_1 and the transition registers clear when read and
+//ALERT is held low while an unmasked alert is pending. Like the real chip it answers Source_Capabilities
+//on its own, requesting with the highest sink PDO a fixed source PDO can supply (5V otherwise).
+//The source runs in sim time on a thread of the model: capabilities after attach, after a Soft_Reset
+//or a Get_Source_Cap, Accept and PS_RDY (or Reject) after each Request. PD fields are decoded here with
+//plain shifts, independently of pd_codec.h
+
+#include <stdint.h>
+#include <functional>
+#include <list>
+#include <vector>
+#include "sim_bus.h"
+#include "sim_kernel.h"
+
+namespace sim {
+
+#define STUSB_MODEL_I2C_ADDR (0x28 << 1)
+
+//times of the source side, from the USB-PD R3.0 ranges
+#define STUSB_MODEL_FIRST_CAPS_MS 150   //tFirstSourceCap after attach
+#define STUSB_MODEL_REQUEST_MS 1        //chip sends its Request after the capabilities
+#define STUSB_MODEL_ACCEPT_MS 2         //source answers a Request or a Soft_Reset
+#define STUSB_MODEL_PS_RDY_MS 30        //tSrcTransition and the VBUS slew after Accept
+#define STUSB_MODEL_RESEND_CAPS_MS 15   //capabilities after the Accept of a Soft_Reset
+#define STUSB_MODEL_GET_CAPS_MS 5       //capabilities after Get_Source_Cap
+
+//activity since construction or reset_stats()
+struct stusb4500_stats {
+    uint32_t transactions;      //I2C transactions, ended by a stop condition
+    uint32_t alert_reads;       //reads starting at ALERT_STATUS_1
+    uint32_t alerts;            //falling edges of ALERT
+    uint32_t caps_sent;         //Source_Capabilities messages from the source
+    uint32_t requests;          //Requests the chip sent
+    uint32_t rejects;           //Requests the source rejected
+    uint32_t soft_resets;       //Soft_Reset sent by the MCU
+    uint32_t get_source_caps;   //Get_Source_Cap sent by the MCU
+};
+
+class stusb4500_model : public i2c_device {
+public:
+    stusb4500_model(PinName sda, PinName alert);
+    virtual ~stusb4500_model();
+
+    //a source offering pdos is plugged in, it sends its capabilities after tFirstSourceCap
+    //no PDOs - a type-C only source, attached but never sending capabilities
+    void plug(const std::vector<uint32_t> &pdos);
+    void unplug();
+
+    //Requests for a PDO at mv are rejected (0 - none are)
+    void set_reject_mv(uint32_t mv)
+    {
+        _reject_mv = mv;
+    }
+    //the source ignores the messages of the sink (Soft_Reset, Get_Source_Cap, Request) while false
+    void set_responsive(bool responsive)
+    {
+        _responsive = responsive;
+    }
+    //sends Source_Capabilities now, as after a change of its own (e.g. another port unplugged)
+    void send_caps();
+
+    //contract the source is at, 0 - none
+    uint32_t contract_mv() const
+    {
+        return _contract_mv;
+    }
+    uint32_t contract_ma() const
+    {
+        return _contract_ma;
+    }
+
+    uint8_t reg(uint8_t addr) const
+    {
+        return _regs[addr];
+    }
+    //sink PDO 1-3 as held by the chip
+    uint32_t sink_pdo(int number) const;
+    bool alert_low() const
+    {
+        return pin_read(_alert) == 0;
+    }
+
+    const stusb4500_stats &stats() const
+    {
+        return _stats;
+    }
+    void reset_stats();
+
+    //i2c_device
+    virtual bool write(const uint8_t *data, int length, bool repeated);
+    virtual bool read(uint8_t *data, int length, bool repeated);
+
+private:
+    struct scheduled {
+        uint64_t due_ns;
+        uint32_t generation;    //events of an older negotiation are dropped
+        std::function<void()> fn;
+    };
+
+    void run();
+    void after(uint32_t ms, std::function<void()> fn);
+    void raise(uint8_t alert_bits);
+    void update_alert();
+    void receive(uint8_t type, const uint32_t *objects, int count);
+    void chip_request();
+    void sink_sent(uint8_t type);
+    void write_reg(uint8_t addr, uint8_t value);
+
+    uint8_t _regs[256];
+    uint8_t _pointer;
+    PinName _sda;
+    PinName _alert;
+    stusb4500_stats _stats;
+
+    std::vector<uint32_t> _pdos;
+    bool _attached;
+    bool _responsive;
+    uint32_t _reject_mv;
+    uint32_t _contract_mv;
+    uint32_t _contract_ma;
+    uint8_t _message_id;
+
+    std::list<scheduled> _events;
+    uint32_t _generation;
+    bool _stop;
+    thread *_thread;
+};
+
+}
+
+#endif
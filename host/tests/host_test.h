@@ -0,0 +1,45 @@
+#ifndef HOST_TEST_H
+#define HOST_TEST_H
+
+//minimal test harness of the host build: each tests/*.cpp is one executable,
+//main() runs its test functions with RUN_TEST and returns test_result()
+
+#include <stdio.h>
+#include <inttypes.h>
+
+static int host_test_failures = 0;
+static int host_test_checks = 0;
+
+#define TEST_ASSERT_MESSAGE(cond, msg) do { \
+    host_test_checks++; \
+    if (!(cond)) { \
+        host_test_failures++; \
+        printf("%s:%d: FAIL: %s (%s)\n", __FILE__, __LINE__, #cond, msg); \
+    } \
+} while (0)
+
+#define TEST_ASSERT(cond) TEST_ASSERT_MESSAGE(cond, "")
+
+#define TEST_ASSERT_EQUAL(expected, actual) do { \
+    long long _e = (long long)(expected); \
+    long long _a = (long long)(actual); \
+    host_test_checks++; \
+    if (_e != _a) { \
+        host_test_failures++; \
+        printf("%s:%d: FAIL: %s == %s (expected %lld, got %lld)\n", __FILE__, __LINE__, #expected, #actual, _e, _a); \
+    } \
+} while (0)
+
+#define RUN_TEST(fn) do { \
+    int _before = host_test_failures; \
+    fn(); \
+    printf("%s: %s\n", #fn, (host_test_failures == _before) ? "PASS" : "FAIL"); \
+} while (0)
+
+static inline int test_result()
+{
+    printf("%d checks, %d failures\n", host_test_checks, host_test_failures);
+    return host_test_failures ? 1 : 0;
+}
+
+#endif
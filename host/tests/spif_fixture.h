@@ -0,0 +1,34 @@
+#ifndef SPIF_FIXTURE_H
+#define SPIF_FIXTURE_H
+
+//a SPIFBlockDevicePD wired to a simulated NOR flash, on its own bus so several can coexist
+
+#include "mbed.h"
+#include "SPIFBlockDevicePD.h"
+#include "nor_flash.h"
+#include "sim_kernel.h"
+
+struct spif_fixture {
+    sim::nor_flash flash;
+    SPIFBlockDevicePD bd;
+
+    spif_fixture(const sim::nor_config &config, int hz = 40000000, PinName sclk = PA_5, PinName csel = PA_4)
+        : flash(config), bd(PA_7, PA_6, sclk, csel, hz)
+    {
+        flash.attach(sclk, csel);
+    }
+
+    ~spif_fixture()
+    {
+        bd.deinit();
+        flash.detach();
+    }
+};
+
+//simulated MB/s of size bytes moved in ns
+static inline double mb_per_s(uint64_t bytes, uint64_t ns)
+{
+    return (ns == 0) ? 0.0 : (bytes * 1e3) / ns;
+}
+
+#endif
@@ -0,0 +1,57 @@
+#ifndef STUSB_FIXTURE_H
+#define STUSB_FIXTURE_H
+
+//the STUSB4500 driver wired to the register model as on the board (pindefs.h), with its own event
+//queue so tests dispatch the alert handling themselves
+
+#include "mbed.h"
+#include "pindefs.h"
+#include "STUSB4500.h"
+#include "pd_codec.h"
+#include "stusb4500_model.h"
+#include "sim_kernel.h"
+
+struct stusb_fixture {
+    sim::stusb4500_model chip;
+    I2C bus;
+    EventQueue queue;
+    STUSB4500 pd;
+
+    //states posted by the driver, with the sim time they ran at
+    std::vector<STUSB4500::pd_state> states;
+    std::vector<uint64_t> state_ns;
+
+    stusb_fixture()
+        : chip(SDA_PIN, USB_ALT), bus(SDA_PIN, SCL_PIN), pd(bus, USB_ALT, &queue)
+    {
+        bus.frequency(100000);
+        pd.attach(callback(this, &stusb_fixture::state_changed));
+    }
+
+    void state_changed(STUSB4500::pd_state state)
+    {
+        states.push_back(state);
+        state_ns.push_back(sim::now_ns());
+    }
+
+    //dispatch the queue until the driver reaches state, false after ms
+    bool run_until(STUSB4500::pd_state state, int ms)
+    {
+        uint64_t deadline = sim::now_ns() + (uint64_t)ms * 1000000;
+        while (pd.get_state() != state) {
+            if (sim::now_ns() >= deadline) {
+                return false;
+            }
+            queue.dispatch(1);
+        }
+        return true;
+    }
+};
+
+//fixed supply source PDO
+static inline uint32_t src_fixed(uint32_t mv, uint32_t ma)
+{
+    return pd::fixed::make(mv, ma);
+}
+
+#endif
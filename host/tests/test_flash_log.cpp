@@ -0,0 +1,193 @@
+//FlashLog on SPIFBlockDevicePD: records read back in order across remounts and wrap around,
+//power cut at any point of an append loses at most that record, records/s and write amplification
+
+#include "spif_fixture.h"
+#include "FlashLog.h"
+#include "host_test.h"
+
+using namespace sim;
+
+#define LOG_SECTORS 4
+
+//record n: its number, then bytes derived from it, 8 to 59 bytes long
+static uint32_t make_record(uint32_t n, uint8_t *record)
+{
+    uint32_t length = 8 + (n * 7) % 52;
+    memcpy(record, &n, sizeof(n));
+    for (uint32_t i = sizeof(n); i < length; i++) {
+        record[i] = (uint8_t)(n + i);
+    }
+    return length;
+}
+
+//reads from the oldest record, which must be followed by consecutive numbers,
+//returns how many were read, first is set to the oldest number
+static uint32_t check_records(FlashLog &log, uint32_t &first)
+{
+    uint8_t record[64];
+    uint8_t expected[64];
+    uint32_t length;
+    uint32_t count = 0;
+
+    TEST_ASSERT_EQUAL(0, log.rewind());
+    while (log.read_next(record, sizeof(record), length) == 0) {
+        uint32_t n;
+        memcpy(&n, record, sizeof(n));
+        if (count == 0) {
+            first = n;
+        }
+        TEST_ASSERT_EQUAL(first + count, n);
+        TEST_ASSERT_EQUAL(make_record(n, expected), length);
+        TEST_ASSERT(memcmp(record, expected, length) == 0);
+        count++;
+    }
+    return count;
+}
+
+static void test_append_and_remount()
+{
+    spif_fixture f(nor_config_w25q32());
+    TEST_ASSERT_EQUAL(0, f.bd.init());
+    uint8_t record[64];
+
+    FlashLog log(&f.bd, 0, LOG_SECTORS * 4096);
+    TEST_ASSERT_EQUAL(0, log.mount());
+    for (uint32_t n = 0; n < 100; n++) {
+        TEST_ASSERT_EQUAL(0, log.append(record, make_record(n, record)));
+    }
+    uint32_t first = 0;
+    TEST_ASSERT_EQUAL(100, check_records(log, first));
+    TEST_ASSERT_EQUAL(0, first);
+    TEST_ASSERT_EQUAL(0, log.unmount());
+
+    // Found again, appends continue after the last record
+    FlashLog again(&f.bd, 0, LOG_SECTORS * 4096);
+    TEST_ASSERT_EQUAL(0, again.mount());
+    TEST_ASSERT_EQUAL(100, check_records(again, first));
+    TEST_ASSERT_EQUAL(0, again.append(record, make_record(100, record)));
+    TEST_ASSERT_EQUAL(101, check_records(again, first));
+    TEST_ASSERT_EQUAL(0, first);
+    TEST_ASSERT_EQUAL(0, f.flash.stats().violations());
+}
+
+static void test_wrap_drops_oldest_sector()
+{
+    spif_fixture f(nor_config_w25q32());
+    TEST_ASSERT_EQUAL(0, f.bd.init());
+    uint8_t record[64];
+
+    FlashLog log(&f.bd, 0, LOG_SECTORS * 4096);
+    TEST_ASSERT_EQUAL(0, log.mount());
+    // About 3 times the log area
+    for (uint32_t n = 0; n < 1200; n++) {
+        TEST_ASSERT_EQUAL(0, log.append(record, make_record(n, record)));
+    }
+
+    flash_log_stats stats;
+    log.get_stats(stats);
+    TEST_ASSERT(stats.sectors_dropped >= 7);
+    uint32_t first = 0;
+    uint32_t count = check_records(log, first);
+    TEST_ASSERT_EQUAL(1199, first + count - 1);
+    // At least the sectors but the one being recycled
+    TEST_ASSERT(count * 40 > (LOG_SECTORS - 1) * 4096 - 1000);
+    TEST_ASSERT(first > 0);
+
+    // The same after a remount
+    FlashLog again(&f.bd, 0, LOG_SECTORS * 4096);
+    TEST_ASSERT_EQUAL(0, again.mount());
+    uint32_t first_again = 0;
+    TEST_ASSERT_EQUAL(count, check_records(again, first_again));
+    TEST_ASSERT_EQUAL(first, first_again);
+    TEST_ASSERT_EQUAL(0, f.flash.stats().violations());
+}
+
+static void test_power_cut_recovery()
+{
+    spif_fixture f(nor_config_w25q32());
+    TEST_ASSERT_EQUAL(0, f.bd.init());
+    uint8_t record[64];
+    int cuts = 0;
+
+    // Cut at points spread over page programs, sector opening erases and the gaps between
+    for (uint64_t cut_us = 3000; cut_us < 2000000; cut_us = cut_us * 5 / 4 + 37) {
+        f.flash.fill(0xFF);
+        FlashLog log(&f.bd, 0, LOG_SECTORS * 4096);
+        TEST_ASSERT_EQUAL(0, log.mount());
+
+        // Append until the power goes, the MCU goes down with it
+        uint32_t n = 0;
+        uint32_t acknowledged = 0;
+        bool any = false;
+        f.flash.fault_power_fail_at(now_ns() + cut_us * 1000);
+        while (f.flash.powered()) {
+            int err = log.append(record, make_record(n, record));
+            if ((err == 0) && f.flash.powered()) {
+                acknowledged = n;
+                any = true;
+            }
+            n++;
+        }
+
+        // Power back, the MCU restarts
+        f.flash.power_on();
+        TEST_ASSERT_EQUAL(0, f.bd.deinit());
+        TEST_ASSERT_EQUAL(0, f.bd.init());
+        FlashLog after(&f.bd, 0, LOG_SECTORS * 4096);
+        TEST_ASSERT_EQUAL(0, after.mount());
+
+        // Everything acknowledged before the cut, possibly the interrupted one too, nothing damaged
+        uint32_t first = 0;
+        uint32_t count = check_records(after, first);
+        if (any) {
+            TEST_ASSERT(count > 0);
+            uint32_t newest = first + count - 1;
+            TEST_ASSERT((newest == acknowledged) || (newest == acknowledged + 1));
+        }
+
+        // And the log takes appends again
+        TEST_ASSERT_EQUAL(0, after.append(record, make_record(1000000, record)));
+        cuts++;
+    }
+    printf("  %d power cuts recovered\n", cuts);
+    TEST_ASSERT_EQUAL(0, f.flash.stats().violations());
+}
+
+static void test_throughput()
+{
+    // Record sizes of typical sensor samples, each on a fresh log
+    static const uint32_t sizes[] = {16, 32, 48, 64};
+    uint8_t record[64];
+    memset(record, 0x5A, sizeof(record));
+
+    for (uint32_t size : sizes) {
+        spif_fixture f(nor_config_w25q32());
+        TEST_ASSERT_EQUAL(0, f.bd.init());
+        FlashLog log(&f.bd, 0, 64 * 4096);
+        TEST_ASSERT_EQUAL(0, log.mount());
+        log.reset_stats();
+        uint64_t start = now_ns();
+        for (int i = 0; i < 4000; i++) {
+            TEST_ASSERT_EQUAL(0, log.append(record, size));
+        }
+        uint64_t ns = now_ns() - start;
+
+        flash_log_stats stats;
+        log.get_stats(stats);
+        double amplification = (double)stats.programmed_bytes / stats.payload_bytes;
+        printf("  %2" PRIu32 "B records: %.0f records/s, write amplification %.2f, %" PRIu32 " sectors erased\n",
+               size, stats.records_written * 1e9 / ns, amplification, stats.sectors_erased);
+        TEST_ASSERT_EQUAL(4000, stats.records_written);
+        // An 8 byte header per record, sector headers add little
+        TEST_ASSERT(amplification < (size + 8) * 1.05 / size);
+    }
+}
+
+int main()
+{
+    RUN_TEST(test_append_and_remount);
+    RUN_TEST(test_wrap_drops_oldest_sector);
+    RUN_TEST(test_power_cut_recovery);
+    RUN_TEST(test_throughput);
+    return test_result();
+}
@@ -0,0 +1,271 @@
+//PageCacheBlockDevice over SPIFBlockDevicePD: small reads hit cached pages, small programs are
+//coalesced into one page program at sync() or eviction, erases drop pending pages. In write-through
+//mode programs reach the device in order, and the accesses littlefs makes for boot_count hit
+
+#include "spif_fixture.h"
+#include "PageCacheBlockDevice.h"
+#include "host_test.h"
+
+using namespace sim;
+
+static uint8_t record[16];
+static uint8_t buffer[4096];
+
+static void test_programs_coalesce()
+{
+    spif_fixture f(nor_config_w25q32());
+    PageCacheBlockDevice cache(&f.bd, 4, 256);
+    TEST_ASSERT_EQUAL(0, cache.init());
+    TEST_ASSERT_EQUAL(0, cache.erase(0, 4096));
+    f.flash.reset_stats();
+
+    for (int i = 0; i < 16; i++) {
+        memset(record, i, sizeof(record));
+        TEST_ASSERT_EQUAL(0, cache.program(record, i * sizeof(record), sizeof(record)));
+    }
+    TEST_ASSERT_EQUAL(0, f.flash.stats().page_programs);
+    TEST_ASSERT_EQUAL(0xFF, f.flash.memory()[0]);
+
+    TEST_ASSERT_EQUAL(0, cache.sync());
+    TEST_ASSERT_EQUAL(1, f.flash.stats().page_programs);
+    for (int i = 0; i < 256; i++) {
+        TEST_ASSERT_EQUAL(i / 16, f.flash.memory()[i]);
+    }
+
+    page_cache_stats stats;
+    cache.get_cache_stats(stats);
+    TEST_ASSERT_EQUAL(15, stats.program_hits);
+    TEST_ASSERT_EQUAL(1, stats.program_misses);
+    TEST_ASSERT_EQUAL(1, stats.page_fills);
+    TEST_ASSERT_EQUAL(1, stats.page_flushes);
+
+    // Nothing left to write back
+    TEST_ASSERT_EQUAL(0, cache.sync());
+    TEST_ASSERT_EQUAL(1, f.flash.stats().page_programs);
+    TEST_ASSERT_EQUAL(0, cache.deinit());
+    TEST_ASSERT_EQUAL(0, f.flash.stats().violations());
+}
+
+static void test_reads_hit()
+{
+    spif_fixture f(nor_config_w25q32());
+    PageCacheBlockDevice cache(&f.bd, 4, 256);
+    TEST_ASSERT_EQUAL(0, cache.init());
+    for (int i = 0; i < 256; i++) {
+        f.flash.memory()[i] = (uint8_t)(255 - i);
+    }
+
+    reset_bus_counters();
+    for (int i = 0; i < 16; i++) {
+        TEST_ASSERT_EQUAL(0, cache.read(record, i * sizeof(record), sizeof(record)));
+        TEST_ASSERT_EQUAL(255 - i * 16, record[0]);
+    }
+    // One page fill on the bus
+    TEST_ASSERT_EQUAL(1, counters().spi_selects);
+
+    page_cache_stats stats;
+    cache.get_cache_stats(stats);
+    TEST_ASSERT_EQUAL(15, stats.read_hits);
+    TEST_ASSERT_EQUAL(1, stats.read_misses);
+    TEST_ASSERT_EQUAL(0, cache.deinit());
+}
+
+static void test_eviction_writes_back()
+{
+    spif_fixture f(nor_config_w25q32());
+    PageCacheBlockDevice cache(&f.bd, 2, 256);
+    TEST_ASSERT_EQUAL(0, cache.init());
+    TEST_ASSERT_EQUAL(0, cache.erase(0, 4096));
+    f.flash.reset_stats();
+
+    memset(record, 0x11, sizeof(record));
+    for (int page = 0; page < 3; page++) {
+        TEST_ASSERT_EQUAL(0, cache.program(record, page * 256, sizeof(record)));
+    }
+    // The least recently used page made room for the third
+    page_cache_stats stats;
+    cache.get_cache_stats(stats);
+    TEST_ASSERT_EQUAL(1, stats.evictions);
+    TEST_ASSERT_EQUAL(1, f.flash.stats().page_programs);
+    TEST_ASSERT_EQUAL(0x11, f.flash.memory()[0]);
+    TEST_ASSERT_EQUAL(0xFF, f.flash.memory()[256]);
+
+    // deinit() writes back the rest
+    TEST_ASSERT_EQUAL(0, cache.deinit());
+    TEST_ASSERT_EQUAL(3, f.flash.stats().page_programs);
+    TEST_ASSERT_EQUAL(0x11, f.flash.memory()[512]);
+    TEST_ASSERT_EQUAL(0, f.flash.stats().violations());
+}
+
+static void test_erase_drops_pending()
+{
+    spif_fixture f(nor_config_w25q32());
+    PageCacheBlockDevice cache(&f.bd, 4, 256);
+    TEST_ASSERT_EQUAL(0, cache.init());
+    TEST_ASSERT_EQUAL(0, cache.erase(0, 4096));
+    f.flash.reset_stats();
+
+    memset(record, 0x22, sizeof(record));
+    TEST_ASSERT_EQUAL(0, cache.program(record, 0, sizeof(record)));
+    TEST_ASSERT_EQUAL(0, cache.erase(0, 4096));
+    TEST_ASSERT_EQUAL(0, cache.read(record, 0, sizeof(record)));
+    TEST_ASSERT_EQUAL(0xFF, record[0]);
+    TEST_ASSERT_EQUAL(0, cache.sync());
+    TEST_ASSERT_EQUAL(0, f.flash.stats().page_programs);
+    TEST_ASSERT_EQUAL(0, cache.deinit());
+}
+
+static void test_small_record_throughput()
+{
+    spif_fixture direct(nor_config_w25q32(), 40000000, PA_5, PA_4);
+    spif_fixture cached(nor_config_w25q32(), 40000000, PB_3, PB_4);
+    PageCacheBlockDevice cache(&cached.bd, 16, 256);
+    TEST_ASSERT_EQUAL(0, direct.bd.init());
+    TEST_ASSERT_EQUAL(0, cache.init());
+    TEST_ASSERT_EQUAL(0, direct.bd.erase(0, 4096));
+    TEST_ASSERT_EQUAL(0, cache.erase(0, 4096));
+
+    for (size_t i = 0; i < sizeof(buffer); i++) {
+        buffer[i] = (uint8_t)(i * 3);
+    }
+
+    uint64_t start = now_ns();
+    for (uint32_t addr = 0; addr < sizeof(buffer); addr += sizeof(record)) {
+        TEST_ASSERT_EQUAL(0, direct.bd.program(buffer + addr, addr, sizeof(record)));
+    }
+    uint64_t direct_ns = now_ns() - start;
+
+    start = now_ns();
+    for (uint32_t addr = 0; addr < sizeof(buffer); addr += sizeof(record)) {
+        TEST_ASSERT_EQUAL(0, cache.program(buffer + addr, addr, sizeof(record)));
+    }
+    TEST_ASSERT_EQUAL(0, cache.sync());
+    uint64_t cached_ns = now_ns() - start;
+
+    printf("  4KB in 16B programs: %.3f MB/s direct, %.3f MB/s through the cache\n",
+           mb_per_s(sizeof(buffer), direct_ns), mb_per_s(sizeof(buffer), cached_ns));
+    TEST_ASSERT(memcmp(cached.flash.memory(), buffer, sizeof(buffer)) == 0);
+    TEST_ASSERT(memcmp(direct.flash.memory(), buffer, sizeof(buffer)) == 0);
+    TEST_ASSERT_EQUAL(16, cached.flash.stats().page_programs);
+    TEST_ASSERT(cached_ns * 4 < direct_ns);
+    TEST_ASSERT_EQUAL(0, cache.deinit());
+}
+
+static void test_write_through_keeps_order()
+{
+    spif_fixture f(nor_config_w25q32());
+    PageCacheBlockDevice cache(&f.bd, 4, 256, PAGE_CACHE_WRITE_THROUGH);
+    TEST_ASSERT_EQUAL(0, cache.init());
+    TEST_ASSERT_EQUAL(0, cache.erase(0, 4096));
+    TEST_ASSERT_EQUAL(0, cache.read(buffer, 0, 64));
+    f.flash.reset_stats();
+
+    // Each program is on the device when the call returns
+    for (int i = 0; i < 3; i++) {
+        memset(record, 0x30 + i, sizeof(record));
+        TEST_ASSERT_EQUAL(0, cache.program(record, i * sizeof(record), sizeof(record)));
+        TEST_ASSERT_EQUAL(i + 1, f.flash.stats().page_programs);
+        TEST_ASSERT_EQUAL(0x30 + i, f.flash.memory()[i * sizeof(record)]);
+    }
+
+    // The programmed page was dropped: reading it back reads the device, once
+    reset_bus_counters();
+    TEST_ASSERT_EQUAL(0, cache.read(buffer, 0, 3 * sizeof(record)));
+    TEST_ASSERT_EQUAL(0, cache.read(buffer + 64, 64, 64));
+    TEST_ASSERT_EQUAL(1, counters().spi_selects);
+    TEST_ASSERT(memcmp(buffer, f.flash.memory(), 3 * sizeof(record)) == 0);
+
+    page_cache_stats stats;
+    cache.get_cache_stats(stats);
+    TEST_ASSERT_EQUAL(3, stats.write_throughs);
+    TEST_ASSERT_EQUAL(0, stats.page_flushes);
+    TEST_ASSERT_EQUAL(0, cache.sync());
+    TEST_ASSERT_EQUAL(0, cache.deinit());
+    TEST_ASSERT_EQUAL(3, f.flash.stats().page_programs);
+    TEST_ASSERT_EQUAL(0, f.flash.stats().violations());
+}
+
+// One boot of main.cpp, modelled on how littlefs (64 byte caches, 4KB blocks) drives the device:
+// mount fetches both superblock blocks, reading each metadata log from its start in 64 byte reads,
+// opening and closing boot_count fetch the root in block 0 again, the close commits an attribute,
+// the file and the CRC at the end of the log, each program read back to check it. Returns the new
+// log end
+static uint32_t boot_count_boot(mbed::BlockDevice &bd, uint32_t log_end)
+{
+    static uint8_t data[64];
+    static const uint32_t commit[] = {12, 8, 20, 8};
+
+    for (int fetch = 0; fetch < 4; fetch++) {
+        uint32_t block = (fetch == 1) ? 4096 : 0;
+        uint32_t end = (fetch == 1) ? 64 : log_end;
+        for (uint32_t off = 0; off < end; off += sizeof(data)) {
+            TEST_ASSERT_EQUAL(0, bd.read(data, block + off, sizeof(data)));
+        }
+    }
+
+    for (size_t i = 0; i < sizeof(commit) / sizeof(commit[0]); i++) {
+        memset(data, (int)(log_end + i), commit[i]);
+        TEST_ASSERT_EQUAL(0, bd.program(data, log_end, commit[i]));
+        TEST_ASSERT_EQUAL(0, bd.read(data, log_end, commit[i]));
+        log_end += commit[i];
+    }
+    return log_end;
+}
+
+static void test_boot_count_replay()
+{
+    spif_fixture direct(nor_config_w25q32(), 24000000, PA_5, PA_4);
+    spif_fixture cached(nor_config_w25q32(), 24000000, PB_3, PB_4);
+    PageCacheBlockDevice cache(&cached.bd, 16, 256, PAGE_CACHE_WRITE_THROUGH);
+    TEST_ASSERT_EQUAL(0, direct.bd.init());
+    TEST_ASSERT_EQUAL(0, cache.init());
+    TEST_ASSERT_EQUAL(0, direct.bd.erase(0, 2 * 4096));
+    TEST_ASSERT_EQUAL(0, cache.erase(0, 2 * 4096));
+
+    // 40 boots, the log of block 0 grows to 2KB
+    uint32_t direct_end = 64;
+    uint32_t cached_end = 64;
+    reset_bus_counters();
+    uint64_t start = now_ns();
+    for (int boot = 0; boot < 40; boot++) {
+        direct_end = boot_count_boot(direct.bd, direct_end);
+    }
+    uint64_t direct_ns = now_ns() - start;
+    uint64_t direct_selects = counters().spi_selects;
+
+    reset_bus_counters();
+    start = now_ns();
+    for (int boot = 0; boot < 40; boot++) {
+        cached_end = boot_count_boot(cache, cached_end);
+    }
+    uint64_t cached_ns = now_ns() - start;
+    uint64_t cached_selects = counters().spi_selects;
+
+    page_cache_stats stats;
+    cache.get_cache_stats(stats);
+    printf("  boot_count x40: %" PRIu32 " read hits, %" PRIu32 " misses, %" PRIu64 " bus transactions "
+           "(raw %" PRIu64 "), %.1fms (raw %.1fms)\n", stats.read_hits, stats.read_misses, cached_selects,
+           direct_selects, cached_ns / 1e6, direct_ns / 1e6);
+
+    // The same programs in the same order, far fewer transactions for the fetches
+    TEST_ASSERT(memcmp(cached.flash.memory(), direct.flash.memory(), 2 * 4096) == 0);
+    TEST_ASSERT_EQUAL(direct.flash.stats().page_programs, cached.flash.stats().page_programs);
+    TEST_ASSERT_EQUAL(40 * 4, stats.write_throughs);
+    TEST_ASSERT(stats.read_hits > 4 * stats.read_misses);
+    TEST_ASSERT(cached_selects * 2 < direct_selects);
+    TEST_ASSERT(cached_ns < direct_ns);
+    TEST_ASSERT_EQUAL(0, cache.deinit());
+    TEST_ASSERT_EQUAL(0, cached.flash.stats().violations());
+}
+
+int main()
+{
+    RUN_TEST(test_programs_coalesce);
+    RUN_TEST(test_reads_hit);
+    RUN_TEST(test_eviction_writes_back);
+    RUN_TEST(test_erase_drops_pending);
+    RUN_TEST(test_small_record_throughput);
+    RUN_TEST(test_write_through_keeps_order);
+    RUN_TEST(test_boot_count_replay);
+    return test_result();
+}
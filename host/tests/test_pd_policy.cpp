@@ -0,0 +1,215 @@
+//PDO ranking over the Source_Capabilities of real chargers (as they report them), each under the
+//charger limits and a few variants of them: the PDO picked, its voltage, current and charge power
+
+#include "pd_policy.h"
+#include "pd_codec.h"
+#include "host_test.h"
+
+#define MAX_PDOS 7
+
+struct capability_set {
+    const char *label;
+    int count;
+    uint32_t pdos[MAX_PDOS];
+};
+
+using namespace pd;
+
+// Raw Source_Capabilities words as the chargers send them: PDO1 carries the unconstrained power,
+// USB communications, dual role and suspend flags, fixed PDOs may set a peak current, and the
+// PPS APDOs (type 11b) are never requested
+static const capability_set apple_96w = {"Apple 96W", 4, {
+        0x0A01912C, // 5V 3A, unconstrained, dual role data
+        0x0002D12C, // 9V 3A
+        0x0004B12C, // 15V 3A
+        0x000641D6  // 20V 4.7A
+    }
+};
+static const capability_set anker_65w_pps = {"Anker 65W with PPS", 5, {
+        0x0E01912C, // 5V 3A, unconstrained, USB communications, dual role data
+        0x0002D12C, // 9V 3A
+        0x0004B12C, // 15V 3A
+        0x00064145, // 20V 3.25A
+        0xC0DC2164  // PPS 3.3-11V 5A
+    }
+};
+static const capability_set samsung_25w = {"Samsung 25W", 4, {
+        0x0A01912C, // 5V 3A, unconstrained, dual role data
+        0x0002D115, // 9V 2.77A
+        0xC076213C, // PPS 3.3-5.9V 3A
+        0xC0DC212D  // PPS 3.3-11V 2.25A
+    }
+};
+static const capability_set rpi_27w = {"Raspberry Pi 27W", 4, {
+        0x080199F4, // 5.1V 5A, unconstrained
+        0x0002D12C, // 9V 3A
+        0x0003C0E1, // 12V 2.25A
+        0x0004B0B4  // 15V 1.8A
+    }
+};
+static const capability_set dock_100w = {"100W dock, 5A cable", 4, {
+        0x3E01912C, // 5V 3A, dual role power, USB suspend, unconstrained, USB communications, dual role data
+        0x0002D12C, // 9V 3A
+        0x0004B12C, // 15V 3A
+        0x001641F4  // 20V 5A, 150% peak current
+    }
+};
+static const capability_set bench_variable = {"Bench supply, variable 9-12V", 2, {
+        0x0801912C, // 5V 3A, unconstrained
+        0x8F02D12C  // variable 9-12V 3A
+    }
+};
+static const capability_set power_bank_battery = {"Power bank, battery 9-20V 45W", 2, {
+        0x320190C8, // 5V 2A, dual role power, USB suspend, dual role data
+        0x5902D0B4  // battery 9-20V 45W
+    }
+};
+static const capability_set variable_21v = {"Laptop brick, variable up to 21V", 2, {
+        0x0801912C, // 5V 3A, unconstrained
+        0x9A41912C  // variable 5-21V 3A
+    }
+};
+static const capability_set phone_5v = {"Phone charger, 5V 0.9A", 1, {
+        0x0001905A  // 5V 0.9A
+    }
+};
+static const capability_set no_pdos = {"No PDOs", 0, {}};
+
+struct limits_variant {
+    const char *label;
+    pd_sink_limits limits;
+};
+
+static const limits_variant charger = {"charger", {5000, 20000, PD_CHARGER_MAX_CURRENT_MA, 0,
+                                                   PD_ACCEPT_FIXED | PD_ACCEPT_VARIABLE | PD_ACCEPT_BATTERY
+                                                  }
+};
+static const limits_variant fixed_only = {"fixed only (STUSB4500)", {5000, 20000, PD_CHARGER_MAX_CURRENT_MA, 0,
+                                                                     PD_ACCEPT_FIXED
+                                                                    }
+};
+static const limits_variant at_least_30w = {"30W minimum", {5000, 20000, PD_CHARGER_MAX_CURRENT_MA, 30000,
+                                                            PD_ACCEPT_FIXED | PD_ACCEPT_VARIABLE | PD_ACCEPT_BATTERY
+                                                           }
+};
+static const limits_variant up_to_12v = {"12V maximum", {5000, 12000, PD_CHARGER_MAX_CURRENT_MA, 0,
+                                                         PD_ACCEPT_FIXED | PD_ACCEPT_VARIABLE | PD_ACCEPT_BATTERY
+                                                        }
+};
+static const limits_variant cable_3a = {"3A cable", {5000, 20000, 3000, 0,
+                                                     PD_ACCEPT_FIXED | PD_ACCEPT_VARIABLE | PD_ACCEPT_BATTERY
+                                                    }
+};
+
+struct selection_case {
+    const capability_set *caps;
+    const limits_variant *limits;
+    int index;              //0 - nothing acceptable
+    uint32_t voltage_mv;
+    uint32_t current_ma;
+    uint32_t power_mw;
+};
+
+static const selection_case cases[] = {
+    {&apple_96w, &charger, 4, 20000, 4700, 94000},
+    {&apple_96w, &at_least_30w, 4, 20000, 4700, 94000},
+    {&apple_96w, &up_to_12v, 2, 9000, 3000, 27000},
+    {&apple_96w, &cable_3a, 4, 20000, 3000, 60000},
+    // PPS isn't decoded, the fixed 20V wins
+    {&anker_65w_pps, &charger, 4, 20000, 3250, 65000},
+    {&samsung_25w, &charger, 2, 9000, 2770, 24930},
+    {&samsung_25w, &at_least_30w, 0, 0, 0, 0},
+    // 27W three ways, the highest voltage draws the least current
+    {&rpi_27w, &charger, 4, 15000, 1800, 27000},
+    {&rpi_27w, &up_to_12v, 3, 12000, 2250, 27000},
+    {&dock_100w, &charger, 4, 20000, 5000, 100000},
+    {&dock_100w, &cable_3a, 4, 20000, 3000, 60000},
+    // Variable and battery supplies are rated at their lowest voltage
+    {&bench_variable, &charger, 2, 9000, 3000, 27000},
+    {&bench_variable, &fixed_only, 1, 5000, 3000, 15000},
+    {&power_bank_battery, &charger, 2, 9000, 5000, 45000},
+    {&power_bank_battery, &cable_3a, 2, 9000, 3000, 27000},
+    {&power_bank_battery, &fixed_only, 1, 5000, 2000, 10000},
+    // A range reaching above the charger's rating is never safe to request
+    {&variable_21v, &charger, 1, 5000, 3000, 15000},
+    {&phone_5v, &charger, 1, 5000, 900, 4500},
+    {&phone_5v, &at_least_30w, 0, 0, 0, 0},
+    {&no_pdos, &charger, 0, 0, 0, 0},
+};
+
+static void test_selection_table()
+{
+    for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+        const selection_case &c = cases[i];
+        int before = host_test_failures;
+
+        pd_choice choice;
+        bool found = pd_select_pdo(c.caps->pdos, c.caps->count, c.limits->limits, choice);
+        TEST_ASSERT_EQUAL(c.index != 0, found);
+        TEST_ASSERT_EQUAL(c.index, choice.index);
+        TEST_ASSERT_EQUAL(c.voltage_mv, choice.voltage_mv);
+        TEST_ASSERT_EQUAL(c.current_ma, choice.current_ma);
+        TEST_ASSERT_EQUAL(c.power_mw, choice.power_mw);
+
+        if (host_test_failures != before) {
+            printf("  in %s, %s limits\n", c.caps->label, c.limits->label);
+        }
+    }
+}
+
+static void test_charger_limits()
+{
+    // The table above spells them out, they must not drift apart
+    pd_sink_limits limits = pd_charger_limits();
+    TEST_ASSERT_EQUAL(charger.limits.min_voltage_mv, limits.min_voltage_mv);
+    TEST_ASSERT_EQUAL(charger.limits.max_voltage_mv, limits.max_voltage_mv);
+    TEST_ASSERT_EQUAL(charger.limits.max_current_ma, limits.max_current_ma);
+    TEST_ASSERT_EQUAL(charger.limits.min_power_mw, limits.min_power_mw);
+    TEST_ASSERT_EQUAL(charger.limits.type_mask, limits.type_mask);
+}
+
+static void test_decode()
+{
+    pd_src_pdo d = pd_decode_src_pdo(fixed::make(20000, 4700));
+    TEST_ASSERT_EQUAL(pdo::FIXED, d.type);
+    TEST_ASSERT_EQUAL(20000, d.min_mv);
+    TEST_ASSERT_EQUAL(20000, d.max_mv);
+    TEST_ASSERT_EQUAL(4700, d.max_ma);
+    TEST_ASSERT_EQUAL(0, d.max_mw);
+
+    d = pd_decode_src_pdo(variable::make(9000, 12000, 3000));
+    TEST_ASSERT_EQUAL(pdo::VARIABLE, d.type);
+    TEST_ASSERT_EQUAL(9000, d.min_mv);
+    TEST_ASSERT_EQUAL(12000, d.max_mv);
+    TEST_ASSERT_EQUAL(3000, d.max_ma);
+
+    d = pd_decode_src_pdo(battery::make(9000, 20000, 45000));
+    TEST_ASSERT_EQUAL(pdo::BATTERY, d.type);
+    TEST_ASSERT_EQUAL(9000, d.min_mv);
+    TEST_ASSERT_EQUAL(20000, d.max_mv);
+    TEST_ASSERT_EQUAL(0, d.max_ma);
+    TEST_ASSERT_EQUAL(45000, d.max_mw);
+
+    // Not handled, decodes to nothing usable
+    // The flags of PDO1 and the peak current don't change what's offered
+    d = pd_decode_src_pdo(anker_65w_pps.pdos[0]);
+    TEST_ASSERT_EQUAL(pdo::FIXED, d.type);
+    TEST_ASSERT_EQUAL(5000, d.max_mv);
+    TEST_ASSERT_EQUAL(3000, d.max_ma);
+    TEST_ASSERT_EQUAL(fixed::make(20000, 5000), dock_100w.pdos[3] & ~fixed::peak_current::mask());
+
+    d = pd_decode_src_pdo(anker_65w_pps.pdos[4]);
+    TEST_ASSERT_EQUAL(pdo::AUGMENTED, d.type);
+    TEST_ASSERT_EQUAL(0, d.min_mv);
+    uint32_t current_ma;
+    TEST_ASSERT_EQUAL(0, pd_deliverable_power(d, pd_charger_limits(), current_ma));
+    TEST_ASSERT_EQUAL(0, current_ma);
+}
+
+int main()
+{
+    RUN_TEST(test_selection_table);
+    RUN_TEST(test_charger_limits);
+    RUN_TEST(test_decode);
+    return test_result();
+}
@@ -0,0 +1,237 @@
+//RemappingBlockDevice over a simulated chip with injected faults: units failing an erase or a
+//program (SPIF_BD_PROGRAM_VERIFY) are retired to spares with their data, the mapping survives
+//a remount, spares failing in turn use the pool up, and bus errors or a device that stays busy
+//retire nothing
+
+#include "spif_fixture.h"
+#include "RemappingBlockDevice.h"
+#include "fault_block_device.h"
+#include "host_test.h"
+
+using namespace sim;
+
+#define UNIT 4096
+#define SPARES 16
+// w25q32: 1024 units, the two table copies, then the data area, then the spares
+#define SPARE_BASE (1024 - SPARES)
+
+// The erase times out at twice the SFDP maximum (14 x 48ms), sync() then waits as long again:
+// a block giving up half a second after the timeout is done within it, one taking 10s isn't
+#define ERASE_TIMEOUT_US (2 * 14 * 48000)
+#define ERASE_EXTRA_US (ERASE_TIMEOUT_US + 500000)
+#define ERASE_NEVER_US 10000000
+
+static uint8_t pattern[UNIT];
+static uint8_t check[UNIT];
+
+static void fill_pattern(uint32_t seed)
+{
+    for (size_t i = 0; i < sizeof(pattern); i++) {
+        pattern[i] = (uint8_t)((i * 13) ^ (i >> 7) ^ seed);
+    }
+}
+
+static uint32_t physical(uint32_t logical)
+{
+    return 2 + logical;
+}
+
+static void test_erase_failure_retires_unit()
+{
+    spif_fixture f(nor_config_w25q32());
+    RemappingBlockDevice bd(&f.bd, SPARES);
+    TEST_ASSERT_EQUAL(0, bd.init());
+    TEST_ASSERT_EQUAL((1024 - 2 - SPARES) * UNIT, bd.size());
+    TEST_ASSERT_EQUAL(SPARES, bd.get_spares_left());
+
+    // Unit 5 in the middle of an erased run, the run is erased again unit by unit
+    f.flash.fault_stuck_busy(physical(5) * UNIT, UNIT, ERASE_EXTRA_US);
+    TEST_ASSERT_EQUAL(0, bd.erase(4 * UNIT, 3 * UNIT));
+
+    remap_bd_stats stats;
+    bd.get_remap_stats(stats);
+    TEST_ASSERT_EQUAL(1, stats.erase_failures);
+    TEST_ASSERT_EQUAL(0, stats.spares_failed);
+    TEST_ASSERT_EQUAL(SPARES - 1, bd.get_spares_left());
+
+    fill_pattern(5);
+    TEST_ASSERT_EQUAL(0, bd.program(pattern, 5 * UNIT, UNIT));
+    TEST_ASSERT(memcmp(f.flash.memory() + SPARE_BASE * UNIT, pattern, UNIT) == 0);
+    TEST_ASSERT_EQUAL(0, bd.read(check, 5 * UNIT, UNIT));
+    TEST_ASSERT(memcmp(check, pattern, UNIT) == 0);
+
+    // The mapping is read back from the table
+    TEST_ASSERT_EQUAL(0, bd.deinit());
+    f.flash.clear_faults();
+    TEST_ASSERT_EQUAL(0, bd.init());
+    TEST_ASSERT_EQUAL(SPARES - 1, bd.get_spares_left());
+    memset(check, 0, sizeof(check));
+    TEST_ASSERT_EQUAL(0, bd.read(check, 5 * UNIT, UNIT));
+    TEST_ASSERT(memcmp(check, pattern, UNIT) == 0);
+
+    TEST_ASSERT_EQUAL(0, bd.deinit());
+    TEST_ASSERT_EQUAL(0, f.flash.stats().violations());
+}
+
+static void test_program_failure_moves_data()
+{
+    spif_fixture f(nor_config_w25q32());
+    f.bd.set_program_mode(SPIF_BD_PROGRAM_VERIFY);
+    RemappingBlockDevice bd(&f.bd, SPARES);
+    TEST_ASSERT_EQUAL(0, bd.init());
+    TEST_ASSERT_EQUAL(0, bd.erase(9 * UNIT, UNIT));
+
+    // First half programmed fine, then the second half has a bit that won't program
+    fill_pattern(9);
+    TEST_ASSERT_EQUAL(0, bd.program(pattern, 9 * UNIT, UNIT / 2));
+    f.flash.fault_stuck_bits(physical(9) * UNIT + UNIT / 2, UNIT / 2, 0x01);
+    TEST_ASSERT_EQUAL(0, bd.program(pattern + UNIT / 2, 9 * UNIT + UNIT / 2, UNIT / 2));
+
+    remap_bd_stats stats;
+    bd.get_remap_stats(stats);
+    TEST_ASSERT_EQUAL(1, stats.program_failures);
+    TEST_ASSERT_EQUAL(UNIT / 256, stats.pages_copied);
+    TEST_ASSERT_EQUAL(SPARES - 1, bd.get_spares_left());
+
+    // Both halves on the spare
+    TEST_ASSERT_EQUAL(0, bd.read(check, 9 * UNIT, UNIT));
+    TEST_ASSERT(memcmp(check, pattern, UNIT) == 0);
+    TEST_ASSERT(memcmp(f.flash.memory() + SPARE_BASE * UNIT, pattern, UNIT) == 0);
+
+    TEST_ASSERT_EQUAL(0, bd.deinit());
+    TEST_ASSERT_EQUAL(0, f.flash.stats().violations());
+}
+
+static void test_failing_spares_use_pool_up()
+{
+    spif_fixture f(nor_config_w25q32());
+    f.bd.set_program_mode(SPIF_BD_PROGRAM_VERIFY);
+    RemappingBlockDevice bd(&f.bd, 2);
+    TEST_ASSERT_EQUAL(0, bd.init());
+
+    // The last data unit and both spares after it have a bit that won't program
+    uint32_t last = 1024 - 2 - 2 - 1;
+    TEST_ASSERT_EQUAL(0, bd.erase(last * UNIT, UNIT));
+    f.flash.fault_stuck_bits(physical(last) * UNIT, 3 * UNIT, 0x01);
+    fill_pattern(3);
+    TEST_ASSERT_EQUAL(REMAP_BD_ERROR_NO_SPARES, bd.program(pattern, last * UNIT, UNIT));
+
+    remap_bd_stats stats;
+    bd.get_remap_stats(stats);
+    TEST_ASSERT_EQUAL(1, stats.program_failures);
+    TEST_ASSERT_EQUAL(2, stats.spares_failed);
+    TEST_ASSERT_EQUAL(0, bd.get_spares_left());
+
+    TEST_ASSERT_EQUAL(0, bd.deinit());
+    TEST_ASSERT_EQUAL(0, f.flash.stats().violations());
+}
+
+static void test_bus_errors_retire_nothing()
+{
+    spif_fixture f(nor_config_w25q32());
+    f.bd.set_program_mode(SPIF_BD_PROGRAM_VERIFY);
+    fault_block_device faulty(&f.bd);
+    RemappingBlockDevice bd(&faulty, SPARES);
+    TEST_ASSERT_EQUAL(0, bd.init());
+    TEST_ASSERT_EQUAL(0, bd.erase(0, 2 * UNIT));
+
+    // Errors that would fail on any unit are returned as they are
+    fill_pattern(1);
+    faulty.fail_programs(physical(0) * UNIT, UNIT, BD_ERROR_DEVICE_ERROR, 1);
+    TEST_ASSERT_EQUAL(BD_ERROR_DEVICE_ERROR, bd.program(pattern, 0, UNIT));
+    faulty.fail_erases(physical(0) * UNIT, UNIT, SPIF_BD_ERROR_WREN_FAILED, 1);
+    TEST_ASSERT_EQUAL(SPIF_BD_ERROR_WREN_FAILED, bd.erase(0, UNIT));
+    TEST_ASSERT_EQUAL(SPARES, bd.get_spares_left());
+
+    // A unit failure whose copy can't be read back: the read error is returned, no spare counted as failed
+    TEST_ASSERT_EQUAL(0, bd.program(pattern, UNIT, UNIT / 2));
+    f.flash.fault_stuck_bits(physical(1) * UNIT + UNIT / 2, UNIT / 2, 0x01);
+    faulty.fail_reads(physical(1) * UNIT, UNIT, BD_ERROR_DEVICE_ERROR);
+    TEST_ASSERT_EQUAL(BD_ERROR_DEVICE_ERROR, bd.program(pattern + UNIT / 2, UNIT + UNIT / 2, UNIT / 2));
+
+    remap_bd_stats stats;
+    bd.get_remap_stats(stats);
+    TEST_ASSERT_EQUAL(0, stats.erase_failures);
+    TEST_ASSERT_EQUAL(1, stats.program_failures);
+    TEST_ASSERT_EQUAL(0, stats.spares_failed);
+
+    TEST_ASSERT_EQUAL(0, bd.deinit());
+    TEST_ASSERT_EQUAL(0, f.flash.stats().violations());
+}
+
+static void test_stuck_unit_retires_nothing()
+{
+    spif_fixture f(nor_config_w25q32());
+    RemappingBlockDevice bd(&f.bd, SPARES);
+    TEST_ASSERT_EQUAL(0, bd.init());
+
+    // Still busy after the second wait: neither the unit nor a spare can be judged
+    f.flash.fault_stuck_busy(physical(5) * UNIT, UNIT, ERASE_NEVER_US);
+    TEST_ASSERT_EQUAL(SPIF_BD_ERROR_READY_FAILED, bd.erase(5 * UNIT, UNIT));
+
+    remap_bd_stats stats;
+    bd.get_remap_stats(stats);
+    TEST_ASSERT_EQUAL(0, stats.erase_failures);
+    TEST_ASSERT_EQUAL(0, stats.spares_failed);
+    TEST_ASSERT_EQUAL(SPARES, bd.get_spares_left());
+    TEST_ASSERT_EQUAL(SPIF_BD_ERROR_READY_FAILED, f.bd.sync());
+
+    // Once the erase is over the device works again, the unit is still where it was
+    ThisThread::sleep_for(ERASE_NEVER_US / 1000);
+    f.flash.clear_faults();
+    TEST_ASSERT_EQUAL(0, f.bd.sync());
+    TEST_ASSERT_EQUAL(0, bd.erase(6 * UNIT, UNIT));
+    fill_pattern(6);
+    TEST_ASSERT_EQUAL(0, bd.program(pattern, 6 * UNIT, UNIT));
+    TEST_ASSERT(memcmp(f.flash.memory() + physical(6) * UNIT, pattern, UNIT) == 0);
+    TEST_ASSERT_EQUAL(SPARES, bd.get_spares_left());
+
+    TEST_ASSERT_EQUAL(0, bd.deinit());
+    TEST_ASSERT_EQUAL(0, f.flash.stats().violations());
+}
+
+static void test_table_read_error_fails_init()
+{
+    spif_fixture f(nor_config_w25q32());
+    fault_block_device faulty(&f.bd);
+    RemappingBlockDevice bd(&faulty, SPARES);
+
+    // Format, retire a unit so there is a mapping to lose
+    TEST_ASSERT_EQUAL(0, bd.init());
+    f.flash.fault_stuck_busy(physical(3) * UNIT, UNIT, ERASE_EXTRA_US);
+    TEST_ASSERT_EQUAL(0, bd.erase(3 * UNIT, UNIT));
+    f.flash.clear_faults();
+    TEST_ASSERT_EQUAL(0, bd.deinit());
+
+    static uint8_t tables[2 * UNIT];
+    memcpy(tables, f.flash.memory(), sizeof(tables));
+
+    // A copy that can't be read may be the valid one: init fails, the device isn't formatted
+    faulty.fail_reads(0, UNIT, BD_ERROR_DEVICE_ERROR, 1);
+    TEST_ASSERT_EQUAL(BD_ERROR_DEVICE_ERROR, bd.init());
+    faulty.fail_reads(UNIT, UNIT, BD_ERROR_DEVICE_ERROR, 1);
+    TEST_ASSERT_EQUAL(BD_ERROR_DEVICE_ERROR, bd.init());
+    TEST_ASSERT(memcmp(tables, f.flash.memory(), sizeof(tables)) == 0);
+
+    // Once the reads work the mapping is still there
+    TEST_ASSERT_EQUAL(0, bd.init());
+    TEST_ASSERT_EQUAL(SPARES - 1, bd.get_spares_left());
+    TEST_ASSERT_EQUAL(0, bd.deinit());
+
+    // Two readable copies holding no table format the device
+    f.flash.fill(0x00);
+    TEST_ASSERT_EQUAL(0, bd.init());
+    TEST_ASSERT_EQUAL(SPARES, bd.get_spares_left());
+    TEST_ASSERT_EQUAL(0, bd.deinit());
+}
+
+int main()
+{
+    RUN_TEST(test_erase_failure_retires_unit);
+    RUN_TEST(test_program_failure_moves_data);
+    RUN_TEST(test_failing_spares_use_pool_up);
+    RUN_TEST(test_bus_errors_retire_nothing);
+    RUN_TEST(test_stuck_unit_retires_nothing);
+    RUN_TEST(test_table_read_error_fails_init);
+    return test_result();
+}
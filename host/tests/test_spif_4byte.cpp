@@ -0,0 +1,97 @@
+//parts above 16MB: init() takes the dedicated 4 byte address instructions from the SFDP 4-byte
+//address instruction table (0x0C/0x13 read, 0x12 program, 0x21/0xDC erase) and only enters 4 byte
+//address mode (0xB7) without one, data above 16MB never aliases to the bottom of the device
+
+#include "spif_fixture.h"
+#include "host_test.h"
+
+using namespace sim;
+
+#define ABOVE_16MB (20 * 1024 * 1024)
+#define ALIAS (ABOVE_16MB - 16 * 1024 * 1024)
+
+static uint8_t out[4096];
+static uint8_t in[4096];
+
+//erase a 4KB and a 64KB block above 16MB, program across pages, read back
+static void round_trip(spif_fixture &f)
+{
+    for (size_t i = 0; i < sizeof(out); i++) {
+        out[i] = (uint8_t)((i * 7) ^ (i >> 8));
+    }
+    f.flash.fill(0x00);
+
+    TEST_ASSERT_EQUAL(0, f.bd.erase(ABOVE_16MB, 65536));
+    TEST_ASSERT_EQUAL(0, f.bd.erase(ABOVE_16MB + 65536, 4096));
+    TEST_ASSERT_EQUAL(0, f.bd.program(out, ABOVE_16MB + 100, sizeof(out)));
+    TEST_ASSERT_EQUAL(0, f.bd.read(in, ABOVE_16MB + 100, sizeof(in)));
+    TEST_ASSERT(memcmp(in, out, sizeof(in)) == 0);
+    TEST_ASSERT(memcmp(f.flash.memory() + ABOVE_16MB + 100, out, sizeof(out)) == 0);
+    TEST_ASSERT_EQUAL(0xFF, f.flash.memory()[ABOVE_16MB + 65536 + 4095]);
+
+    // The same addresses with the top byte dropped are untouched
+    for (uint32_t i = 0; i < 65536 + 4096; i += 512) {
+        TEST_ASSERT_EQUAL(0x00, f.flash.memory()[ALIAS + i]);
+    }
+}
+
+static void test_dedicated_instructions()
+{
+    spif_fixture f(nor_config_w25q256());
+    TEST_ASSERT_EQUAL(0, f.bd.init());
+    TEST_ASSERT_EQUAL(32 * 1024 * 1024, f.bd.size());
+
+    f.flash.reset_stats();
+    round_trip(f);
+    TEST_ASSERT_EQUAL(1, f.flash.command_count(0xDC));
+    TEST_ASSERT_EQUAL(1, f.flash.command_count(0x21));
+    TEST_ASSERT_EQUAL(sizeof(out) / 256 + 1, f.flash.command_count(0x12));
+    TEST_ASSERT_EQUAL(1, f.flash.command_count(0x0C) + f.flash.command_count(0x13));
+    // No 3 byte address instruction and no address mode
+    TEST_ASSERT_EQUAL(0, f.flash.command_count(0x03) + f.flash.command_count(0x0B) + f.flash.command_count(0x02));
+    TEST_ASSERT_EQUAL(0, f.flash.command_count(0x20) + f.flash.command_count(0xD8));
+    TEST_ASSERT_EQUAL(0, f.flash.command_count(0xB7));
+
+    // Warm init: identified only, the instructions are still the 4 byte ones
+    TEST_ASSERT_EQUAL(0, f.bd.deinit());
+    f.flash.reset_stats();
+    TEST_ASSERT_EQUAL(0, f.bd.init());
+    TEST_ASSERT_EQUAL(0, f.flash.command_count(0x5A));
+    TEST_ASSERT_EQUAL(1, f.flash.command_count(0x9F));
+    round_trip(f);
+    TEST_ASSERT_EQUAL(1, f.flash.command_count(0xDC));
+    TEST_ASSERT_EQUAL(0, f.flash.command_count(0x03) + f.flash.command_count(0x0B) + f.flash.command_count(0x02));
+    TEST_ASSERT_EQUAL(0, f.flash.stats().violations());
+}
+
+static void test_address_mode_without_table()
+{
+    nor_config config = nor_config_w25q256();
+    config.four_byte_inst_table = false;
+    spif_fixture f(config);
+    f.flash.reset_stats();
+    TEST_ASSERT_EQUAL(0, f.bd.init());
+    TEST_ASSERT_EQUAL(1, f.flash.command_count(0xB7));
+
+    f.flash.reset_stats();
+    round_trip(f);
+    TEST_ASSERT_EQUAL(1, f.flash.command_count(0xD8));
+    TEST_ASSERT_EQUAL(1, f.flash.command_count(0x20));
+    TEST_ASSERT_EQUAL(0, f.flash.command_count(0x12) + f.flash.command_count(0xDC));
+
+    // The mode is entered again on a warm init
+    TEST_ASSERT_EQUAL(0, f.bd.deinit());
+    f.flash.reset_stats();
+    TEST_ASSERT_EQUAL(0, f.bd.init());
+    TEST_ASSERT_EQUAL(1, f.flash.command_count(0xB7));
+    TEST_ASSERT_EQUAL(0, f.flash.command_count(0x5A));
+    round_trip(f);
+    TEST_ASSERT_EQUAL(0, f.flash.stats().violations());
+}
+
+int main()
+{
+    RUN_TEST(test_dedicated_instructions);
+    RUN_TEST(test_address_mode_without_table);
+    return test_result();
+}
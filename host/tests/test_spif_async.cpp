@@ -0,0 +1,108 @@
+//program_async()/erase_async(): the caller isn't blocked, operations complete in submission order
+//on the worker thread, and the queue refuses more than SPIF_ASYNC_QUEUE_DEPTH pending operations
+
+#include "spif_fixture.h"
+#include "host_test.h"
+
+using namespace sim;
+
+struct completion {
+    static int order[32];
+    static int done_count;
+    int id;
+    int status;
+
+    void done(int result)
+    {
+        status = result;
+        order[done_count++] = id;
+    }
+};
+
+int completion::order[32];
+int completion::done_count;
+
+static void wait_done(int count)
+{
+    for (int i = 0; (i < 100000) && (completion::done_count < count); i++) {
+        thread_sleep_for(1);
+    }
+}
+
+static uint8_t page[256];
+
+static void test_completes_in_order()
+{
+    spif_fixture f(nor_config_w25q32());
+    TEST_ASSERT_EQUAL(0, f.bd.init());
+    completion::done_count = 0;
+    completion c[4] = {{0, -1}, {1, -1}, {2, -1}, {3, -1}};
+    for (size_t i = 0; i < sizeof(page); i++) {
+        page[i] = (uint8_t)(0xA0 + i);
+    }
+    f.flash.fill(0x00);
+
+    uint64_t start = now_ns();
+    TEST_ASSERT_EQUAL(0, f.bd.erase_async(0, 4096, callback(&c[0], &completion::done)));
+    TEST_ASSERT_EQUAL(0, f.bd.program_async(page, 0, sizeof(page), callback(&c[1], &completion::done)));
+    TEST_ASSERT_EQUAL(0, f.bd.erase_async(4096, 4096, callback(&c[2], &completion::done)));
+    TEST_ASSERT_EQUAL(0, f.bd.program_async(page, 4096 + 256, sizeof(page), callback(&c[3], &completion::done)));
+    // Queuing doesn't touch the bus
+    TEST_ASSERT((now_ns() - start) < 100000);
+    TEST_ASSERT_EQUAL(0, completion::done_count);
+
+    wait_done(4);
+    TEST_ASSERT_EQUAL(4, completion::done_count);
+    for (int i = 0; i < 4; i++) {
+        TEST_ASSERT_EQUAL(i, completion::order[i]);
+        TEST_ASSERT_EQUAL(0, c[i].status);
+    }
+    TEST_ASSERT(memcmp(f.flash.memory(), page, sizeof(page)) == 0);
+    TEST_ASSERT_EQUAL(0xFF, f.flash.memory()[256]);
+    TEST_ASSERT_EQUAL(0xFF, f.flash.memory()[4096]);
+    TEST_ASSERT(memcmp(f.flash.memory() + 4096 + 256, page, sizeof(page)) == 0);
+    TEST_ASSERT_EQUAL(0x00, f.flash.memory()[8192]);
+    TEST_ASSERT_EQUAL(0, f.flash.stats().violations());
+}
+
+static void test_queue_full()
+{
+    spif_fixture f(nor_config_w25q32());
+    TEST_ASSERT_EQUAL(0, f.bd.init());
+    completion::done_count = 0;
+    completion c[SPIF_ASYNC_QUEUE_DEPTH + 1];
+
+    // The worker doesn't get to run until this thread sleeps
+    for (int i = 0; i < SPIF_ASYNC_QUEUE_DEPTH; i++) {
+        c[i].id = i;
+        TEST_ASSERT_EQUAL(0, f.bd.erase_async(i * 4096, 4096, callback(&c[i], &completion::done)));
+    }
+    c[SPIF_ASYNC_QUEUE_DEPTH].id = SPIF_ASYNC_QUEUE_DEPTH;
+    TEST_ASSERT_EQUAL(SPIF_BD_ERROR_ASYNC_QUEUE_FULL,
+                      f.bd.erase_async(0, 4096, callback(&c[SPIF_ASYNC_QUEUE_DEPTH], &completion::done)));
+
+    wait_done(SPIF_ASYNC_QUEUE_DEPTH);
+    TEST_ASSERT_EQUAL(SPIF_ASYNC_QUEUE_DEPTH, completion::done_count);
+    TEST_ASSERT_EQUAL(SPIF_ASYNC_QUEUE_DEPTH, f.flash.stats().erases[0]);
+
+    // Room again once they ran
+    TEST_ASSERT_EQUAL(0, f.bd.erase_async(0, 4096, callback(&c[0], &completion::done)));
+    wait_done(SPIF_ASYNC_QUEUE_DEPTH + 1);
+    TEST_ASSERT_EQUAL(SPIF_ASYNC_QUEUE_DEPTH + 1, completion::done_count);
+    TEST_ASSERT_EQUAL(0, f.flash.stats().violations());
+}
+
+static void test_not_initialized()
+{
+    spif_fixture f(nor_config_w25q32());
+    completion c = {0, -1};
+    TEST_ASSERT_EQUAL(SPIF_BD_ERROR_DEVICE_ERROR, f.bd.erase_async(0, 4096, callback(&c, &completion::done)));
+}
+
+int main()
+{
+    RUN_TEST(test_completes_in_order);
+    RUN_TEST(test_queue_full);
+    RUN_TEST(test_not_initialized);
+    return test_result();
+}
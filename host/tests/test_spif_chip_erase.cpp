@@ -0,0 +1,95 @@
+//erase(0, size()) is a single Chip Erase waited for with the SFDP chip erase time, the lock released
+//meanwhile: other threads get through to the driver and a read of the device waits for the erase
+//without sending a command to the busy chip
+
+#include "spif_fixture.h"
+#include "host_test.h"
+
+using namespace sim;
+
+static SPIFBlockDevicePD *eraser_bd;
+static volatile bool erasing;
+static int erase_status;
+static uint64_t erase_ns;
+static uint64_t erase_end_ns;
+
+static void eraser()
+{
+    uint64_t start = now_ns();
+    erase_status = eraser_bd->erase(0, eraser_bd->size());
+    erase_end_ns = now_ns();
+    erase_ns = erase_end_ns - start;
+    erasing = false;
+}
+
+static void test_single_chip_erase()
+{
+    spif_fixture f(nor_config_w25q32());
+    TEST_ASSERT_EQUAL(0, f.bd.init());
+    f.flash.fill(0x00);
+    f.flash.reset_stats();
+
+    spif_bd_sfdp_descriptor desc;
+    TEST_ASSERT_EQUAL(0, f.bd.get_sfdp_descriptor(desc));
+    uint32_t typ_us = desc.op_typ_time_us_arr[SPIF_BD_OP_CHIP_ERASE];
+
+    eraser_bd = &f.bd;
+    erasing = true;
+    erase_status = -1;
+    rtos::Thread thread;
+    thread.start(callback(eraser));
+    thread_sleep_for(1000);
+    TEST_ASSERT(erasing);
+
+    // The lock is free while the chip erases
+    uint64_t start = now_ns();
+    spif_bd_bus_stats bus;
+    f.bd.get_bus_stats(bus);
+    TEST_ASSERT(now_ns() - start < 1000000);
+
+    // A read of any address is in the erased area, it is served once the erase is done
+    uint8_t in[256];
+    memset(in, 0, sizeof(in));
+    TEST_ASSERT_EQUAL(0, f.bd.read(in, 1024 * 1024, sizeof(in)));
+    uint64_t read_done_ns = now_ns();
+    thread.join();
+    TEST_ASSERT_EQUAL(0, erase_status);
+    // Within the 1ms the waiting reader sleeps between looks at the busy operation
+    TEST_ASSERT(read_done_ns + 2000000 >= erase_end_ns);
+    TEST_ASSERT(read_done_ns <= erase_end_ns + 2000000);
+    for (size_t i = 0; i < sizeof(in); i++) {
+        TEST_ASSERT_EQUAL(0xFF, in[i]);
+    }
+
+    // One command, no block erases, done within the SFDP typical time rounded up as encoded
+    const nor_stats &stats = f.flash.stats();
+    TEST_ASSERT_EQUAL(1, stats.commands[0x60] + stats.commands[0xC7]);
+    TEST_ASSERT_EQUAL(1, stats.chip_erases);
+    TEST_ASSERT_EQUAL(0, stats.erases[0] + stats.erases[1] + stats.erases[2] + stats.erases[3]);
+    TEST_ASSERT(erase_ns >= (uint64_t)nor_config_w25q32().chip_erase_typ_ms * 1000000);
+    TEST_ASSERT(erase_ns <= (uint64_t)typ_us * 1000);
+    TEST_ASSERT_EQUAL(0xFF, f.flash.memory()[f.bd.size() - 1]);
+    TEST_ASSERT_EQUAL(0, stats.violations());
+    printf("  chip erase: %" PRIu64 "ms, SFDP typical %" PRIu32 "ms, %" PRIu32 " status polls\n",
+           erase_ns / 1000000, typ_us / 1000, stats.status_polls);
+}
+
+static void test_partial_range_erases_blocks()
+{
+    spif_fixture f(nor_config_w25q32());
+    TEST_ASSERT_EQUAL(0, f.bd.init());
+    f.flash.reset_stats();
+
+    // Everything but the last 64KB block
+    TEST_ASSERT_EQUAL(0, f.bd.erase(0, f.bd.size() - 65536));
+    TEST_ASSERT_EQUAL(0, f.flash.stats().commands[0x60] + f.flash.stats().commands[0xC7]);
+    TEST_ASSERT_EQUAL(0, f.flash.stats().chip_erases);
+    TEST_ASSERT_EQUAL(0, f.flash.stats().violations());
+}
+
+int main()
+{
+    RUN_TEST(test_single_chip_erase);
+    RUN_TEST(test_partial_range_erases_blocks);
+    return test_result();
+}
@@ -0,0 +1,90 @@
+//erase() covers a range with the fewest commands: the largest erase type aligned at the address
+//that fits in what is left, on a 4KB/32KB/64KB part and across hybrid sector regions
+
+#include "spif_fixture.h"
+#include "host_test.h"
+
+using namespace sim;
+
+struct plan_case {
+    uint32_t addr;
+    uint32_t size;
+    uint32_t erases_4k;
+    uint32_t erases_32k;
+    uint32_t erases_64k;
+};
+
+static const plan_case plans[] = {
+    {0, 4096, 1, 0, 0},
+    {0, 65536, 0, 0, 1},
+    {0, 32768, 0, 1, 0},
+    {4096, 124 * 1024, 7, 1, 1},        // up to 32K in 4K, 32K to 64K in one 32K, then a 64K
+    {60 * 1024, 72 * 1024, 2, 0, 1},    // a 4K either side of a 64K
+    {32 * 1024, 96 * 1024, 0, 1, 1},
+    {0, 1024 * 1024, 0, 0, 16},
+};
+
+static void test_command_counts()
+{
+    spif_fixture f(nor_config_w25q32());
+    TEST_ASSERT_EQUAL(0, f.bd.init());
+
+    for (const plan_case &p : plans) {
+        f.flash.fill(0x00);
+        f.flash.reset_stats();
+        TEST_ASSERT_EQUAL(0, f.bd.erase(p.addr, p.size));
+        TEST_ASSERT_EQUAL(p.erases_4k, f.flash.stats().erases[0]);
+        TEST_ASSERT_EQUAL(p.erases_32k, f.flash.stats().erases[1]);
+        TEST_ASSERT_EQUAL(p.erases_64k, f.flash.stats().erases[2]);
+        // Exactly the range, nothing around it
+        TEST_ASSERT_EQUAL(0xFF, f.flash.memory()[p.addr]);
+        TEST_ASSERT_EQUAL(0xFF, f.flash.memory()[p.addr + p.size - 1]);
+        TEST_ASSERT_EQUAL(0x00, f.flash.memory()[p.addr + p.size]);
+        if (p.addr != 0) {
+            TEST_ASSERT_EQUAL(0x00, f.flash.memory()[p.addr - 1]);
+        }
+        TEST_ASSERT_EQUAL(0, f.flash.stats().violations());
+    }
+}
+
+static void test_time_against_4k_units()
+{
+    spif_fixture f(nor_config_w25q32());
+    TEST_ASSERT_EQUAL(0, f.bd.init());
+
+    uint64_t start = now_ns();
+    TEST_ASSERT_EQUAL(0, f.bd.erase(0, 256 * 1024));
+    uint64_t planned_ms = (now_ns() - start) / 1000000;
+
+    // The same range sector by sector
+    start = now_ns();
+    for (uint32_t addr = 256 * 1024; addr < 512 * 1024; addr += 4096) {
+        TEST_ASSERT_EQUAL(0, f.bd.erase(addr, 4096));
+    }
+    uint64_t sectors_ms = (now_ns() - start) / 1000000;
+
+    printf("  256KB erase: %" PRIu64 " ms planned, %" PRIu64 " ms in 4KB sectors\n", planned_ms, sectors_ms);
+    // 4 x 150ms against 64 x 45ms
+    TEST_ASSERT(planned_ms < 700);
+    TEST_ASSERT(sectors_ms > 4 * planned_ms);
+}
+
+static void test_hybrid_regions()
+{
+    spif_fixture f(nor_config_hybrid());
+    TEST_ASSERT_EQUAL(0, f.bd.init());
+
+    // 64KB units on both sides of the region boundary, 4KB units only below it
+    TEST_ASSERT_EQUAL(0, f.bd.erase(60 * 1024, 132 * 1024));
+    TEST_ASSERT_EQUAL(1, f.flash.stats().erases[0]);
+    TEST_ASSERT_EQUAL(2, f.flash.stats().erases[1]);
+    TEST_ASSERT_EQUAL(0, f.flash.stats().violations());
+}
+
+int main()
+{
+    RUN_TEST(test_command_counts);
+    RUN_TEST(test_time_against_4k_units);
+    RUN_TEST(test_hybrid_regions);
+    return test_result();
+}
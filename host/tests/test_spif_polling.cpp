@@ -0,0 +1,100 @@
+//_is_mem_ready() sleeps through the SFDP typical time and then polls at a fraction of it:
+//few status polls per operation, completion noticed soon after the device is done,
+//and a device that never gets ready times out at twice the SFDP maximum
+
+#include "spif_fixture.h"
+#include "host_test.h"
+
+using namespace sim;
+
+static uint8_t buffer[4096];
+
+static void test_erase_polls()
+{
+    spif_fixture f(nor_config_w25q32());
+    TEST_ASSERT_EQUAL(0, f.bd.init());
+    f.bd.reset_latency_histograms();
+    f.flash.reset_stats();
+
+    for (int i = 0; i < 16; i++) {
+        TEST_ASSERT_EQUAL(0, f.bd.erase(i * 4096, 4096));
+    }
+
+    spif_bd_latency_histogram hist;
+    TEST_ASSERT_EQUAL(0, f.bd.get_latency_histogram(SPIF_BD_OP_ERASE_TYPE_1, hist));
+    TEST_ASSERT_EQUAL(16, hist.count);
+    TEST_ASSERT_EQUAL(0, hist.timeouts);
+    // 45ms erase: the first poll, one after sleeping the 48ms SFDP typical time, a 1ms poll used to take 46
+    TEST_ASSERT(hist.max_polls <= 3);
+    TEST_ASSERT(hist.max_us < 45000 + 6000 + 1000);
+    TEST_ASSERT(hist.max_us >= 45000);
+    printf("  4KB erase: %" PRIu64 " polls, %" PRIu64 " us average\n", hist.total_polls, hist.total_us / hist.count);
+    TEST_ASSERT_EQUAL(0, f.flash.stats().violations());
+}
+
+static void test_slow_parts_poll_at_a_fraction()
+{
+    // Every operation takes 80 to 200% of the typical time
+    nor_config config = nor_config_w25q32();
+    config.time_min_percent = 80;
+    config.time_max_percent = 200;
+    spif_fixture f(config);
+    TEST_ASSERT_EQUAL(0, f.bd.init());
+
+    for (size_t i = 0; i < sizeof(buffer); i++) {
+        buffer[i] = (uint8_t)(i ^ 0x5A);
+    }
+    for (int i = 0; i < 8; i++) {
+        TEST_ASSERT_EQUAL(0, f.bd.erase(i * 4096, 4096));
+        TEST_ASSERT_EQUAL(0, f.bd.program(buffer, i * 4096, 4096));
+    }
+
+    spif_bd_latency_histogram erase;
+    spif_bd_latency_histogram program;
+    f.bd.get_latency_histogram(SPIF_BD_OP_ERASE_TYPE_1, erase);
+    f.bd.get_latency_histogram(SPIF_BD_OP_PROGRAM, program);
+    TEST_ASSERT_EQUAL(0, erase.timeouts + program.timeouts);
+    TEST_ASSERT_EQUAL(8, erase.count);
+    TEST_ASSERT_EQUAL(8 * 16, program.count);
+    // Past the typical time the interval is an eighth of it: 2x typical is at most 8 more polls
+    TEST_ASSERT(erase.max_polls <= 11);
+    TEST_ASSERT(program.max_polls <= 11);
+    uint32_t bucket_total = 0;
+    for (int i = 0; i < SPIF_LATENCY_HISTOGRAM_BUCKETS; i++) {
+        bucket_total += program.bucket[i];
+    }
+    TEST_ASSERT_EQUAL(program.count, bucket_total);
+    printf("  program: %.1f polls average, erase: %.1f polls average\n",
+           (double)program.total_polls / program.count, (double)erase.total_polls / erase.count);
+    TEST_ASSERT_EQUAL(0, f.flash.stats().violations());
+}
+
+static void test_stuck_device_times_out()
+{
+    spif_fixture f(nor_config_w25q32());
+    TEST_ASSERT_EQUAL(0, f.bd.init());
+    f.bd.reset_latency_histograms();
+
+    // Never ready within twice the SFDP maximum (14 x 48ms)
+    f.flash.fault_stuck_busy(0, 4096, 5000000);
+    uint64_t start = now_ns();
+    TEST_ASSERT_EQUAL(SPIF_BD_ERROR_READY_FAILED, f.bd.erase(0, 4096));
+    uint64_t waited_us = (now_ns() - start) / 1000;
+    TEST_ASSERT(waited_us >= 2 * 14 * 48000);
+    TEST_ASSERT(waited_us < 2 * 14 * 48000 + 48000);
+
+    spif_bd_latency_histogram hist;
+    f.bd.get_latency_histogram(SPIF_BD_OP_ERASE_TYPE_1, hist);
+    TEST_ASSERT_EQUAL(1, hist.timeouts);
+    // Let the device finish before the fixture deinits it
+    f.flash.clear_faults();
+    thread_sleep_for(6000);
+}
+
+int main()
+{
+    RUN_TEST(test_erase_polls);
+    RUN_TEST(test_slow_parts_poll_at_a_fraction);
+    RUN_TEST(test_stuck_device_times_out);
+    return test_result();
+}
@@ -0,0 +1,80 @@
+//idle manager: after set_idle_timeout() without access the chip is put in Deep Power-Down (0xB9),
+//the next access releases it (0xAB) and waits tRES1 before its first command, without parsing
+//SFDP again, and a device in use never powers down
+
+#include "spif_fixture.h"
+#include "host_test.h"
+
+using namespace sim;
+
+#define IDLE_MS 100
+
+static uint8_t out[512];
+static uint8_t in[512];
+
+static void test_powers_down_when_idle()
+{
+    spif_fixture f(nor_config_w25q32());
+    TEST_ASSERT_EQUAL(0, f.bd.init());
+    for (size_t i = 0; i < sizeof(out); i++) {
+        out[i] = (uint8_t)(i * 5 + 1);
+    }
+    memcpy(f.flash.memory() + 8192, out, sizeof(out));
+
+    TEST_ASSERT_EQUAL(0, f.bd.set_idle_timeout(IDLE_MS));
+    f.flash.reset_stats();
+    thread_sleep_for(IDLE_MS / 2);
+    TEST_ASSERT(!f.flash.powered_down());
+    thread_sleep_for(IDLE_MS);
+    TEST_ASSERT(f.flash.powered_down());
+    TEST_ASSERT_EQUAL(1, f.flash.command_count(0xB9));
+
+    // Released once, the read is correct and nothing was sent before tRES1
+    f.flash.reset_stats();
+    memset(in, 0, sizeof(in));
+    TEST_ASSERT_EQUAL(0, f.bd.read(in, 8192, sizeof(in)));
+    TEST_ASSERT(memcmp(in, out, sizeof(in)) == 0);
+    TEST_ASSERT(!f.flash.powered_down());
+    TEST_ASSERT_EQUAL(1, f.flash.command_count(0xAB));
+    TEST_ASSERT_EQUAL(0, f.flash.stats().dpd_commands);
+    TEST_ASSERT_EQUAL(0, f.flash.command_count(0x5A));
+
+    // Programs and erases after the next power down work the same
+    thread_sleep_for(2 * IDLE_MS);
+    TEST_ASSERT(f.flash.powered_down());
+    TEST_ASSERT_EQUAL(0, f.bd.erase(0, 4096));
+    TEST_ASSERT_EQUAL(0, f.bd.program(out, 0, sizeof(out)));
+    TEST_ASSERT(memcmp(f.flash.memory(), out, sizeof(out)) == 0);
+    TEST_ASSERT_EQUAL(2, f.flash.command_count(0xAB));
+    TEST_ASSERT_EQUAL(0, f.flash.command_count(0x5A));
+    TEST_ASSERT_EQUAL(0, f.flash.stats().violations());
+}
+
+static void test_stays_up_while_used()
+{
+    spif_fixture f(nor_config_w25q32());
+    TEST_ASSERT_EQUAL(0, f.bd.init());
+    TEST_ASSERT_EQUAL(0, f.bd.set_idle_timeout(IDLE_MS));
+    f.flash.reset_stats();
+
+    // A read every half timeout for ten timeouts
+    for (int i = 0; i < 20; i++) {
+        TEST_ASSERT_EQUAL(0, f.bd.read(in, 0, sizeof(in)));
+        thread_sleep_for(IDLE_MS / 2);
+    }
+    TEST_ASSERT_EQUAL(0, f.flash.command_count(0xB9));
+    TEST_ASSERT_EQUAL(0, f.flash.command_count(0xAB));
+
+    // A timeout of 0 turns the manager off
+    TEST_ASSERT_EQUAL(0, f.bd.set_idle_timeout(0));
+    thread_sleep_for(5 * IDLE_MS);
+    TEST_ASSERT(!f.flash.powered_down());
+    TEST_ASSERT_EQUAL(0, f.flash.stats().violations());
+}
+
+int main()
+{
+    RUN_TEST(test_powers_down_when_idle);
+    RUN_TEST(test_stays_up_while_used);
+    return test_result();
+}
@@ -0,0 +1,91 @@
+//set_program_mode(): with SPIF_BD_PROGRAM_SKIP_UNCHANGED pages already holding the data cost a read
+//and no Page Program, with SPIF_BD_PROGRAM_VERIFY a page whose bits didn't program fails the call
+
+#include "spif_fixture.h"
+#include "host_test.h"
+
+using namespace sim;
+
+#define PAGES 16
+
+static uint8_t out[PAGES * 256];
+
+static void fill_out()
+{
+    // Bit 0 always clear, so a page with bit 0 stuck at 1 can't hold it
+    for (size_t i = 0; i < sizeof(out); i++) {
+        out[i] = (uint8_t)((i * 11) ^ (i >> 8)) & 0xFE;
+    }
+}
+
+static void test_skip_unchanged()
+{
+    spif_fixture f(nor_config_w25q32());
+    TEST_ASSERT_EQUAL(0, f.bd.init());
+    fill_out();
+    TEST_ASSERT_EQUAL(0, f.bd.erase(0, 4096));
+    TEST_ASSERT_EQUAL(0, f.bd.program(out, 0, sizeof(out)));
+
+    // Same data again: read, compared, nothing programmed
+    f.bd.set_program_mode(SPIF_BD_PROGRAM_SKIP_UNCHANGED);
+    f.bd.reset_program_stats();
+    f.flash.reset_stats();
+    TEST_ASSERT_EQUAL(0, f.bd.program(out, 0, sizeof(out)));
+    spif_bd_program_stats stats;
+    f.bd.get_program_stats(stats);
+    TEST_ASSERT_EQUAL(0, f.flash.command_count(0x02));
+    TEST_ASSERT_EQUAL(0, f.flash.command_count(0x06));
+    TEST_ASSERT_EQUAL(PAGES, stats.pages_skipped);
+    TEST_ASSERT_EQUAL(0, stats.pages_programmed);
+
+    // One byte of page 5 changed: only that page is programmed
+    out[5 * 256 + 17] = 0x00;
+    f.bd.reset_program_stats();
+    f.flash.reset_stats();
+    TEST_ASSERT_EQUAL(0, f.bd.program(out, 0, sizeof(out)));
+    f.bd.get_program_stats(stats);
+    TEST_ASSERT_EQUAL(1, f.flash.command_count(0x02));
+    TEST_ASSERT_EQUAL(1, f.flash.stats().page_programs);
+    TEST_ASSERT_EQUAL(PAGES - 1, stats.pages_skipped);
+    TEST_ASSERT_EQUAL(1, stats.pages_programmed);
+    TEST_ASSERT(memcmp(f.flash.memory(), out, sizeof(out)) == 0);
+    TEST_ASSERT_EQUAL(0, f.flash.stats().violations());
+}
+
+static void test_verify()
+{
+    spif_fixture f(nor_config_w25q32());
+    TEST_ASSERT_EQUAL(0, f.bd.init());
+    fill_out();
+    f.bd.set_program_mode(SPIF_BD_PROGRAM_VERIFY);
+
+    // Page 3 keeps bit 0 of every byte at 1: the pages before it verify, the call stops there
+    TEST_ASSERT_EQUAL(0, f.bd.erase(0, 4096));
+    f.flash.fault_stuck_bits(3 * 256, 256, 0x01);
+    f.bd.reset_program_stats();
+    TEST_ASSERT_EQUAL(SPIF_BD_ERROR_VERIFY_FAILED, f.bd.program(out, 0, sizeof(out)));
+    spif_bd_program_stats stats;
+    f.bd.get_program_stats(stats);
+    TEST_ASSERT_EQUAL(1, stats.verify_failures);
+    TEST_ASSERT_EQUAL(3, stats.pages_verified);
+    TEST_ASSERT_EQUAL(4, stats.pages_programmed);
+    TEST_ASSERT(memcmp(f.flash.memory() + 3 * 256, out + 3 * 256, 256) != 0);
+
+    // A sound block verifies every page
+    f.flash.clear_faults();
+    TEST_ASSERT_EQUAL(0, f.bd.erase(0, 4096));
+    f.bd.reset_program_stats();
+    TEST_ASSERT_EQUAL(0, f.bd.program(out, 0, sizeof(out)));
+    f.bd.get_program_stats(stats);
+    TEST_ASSERT_EQUAL(0, stats.verify_failures);
+    TEST_ASSERT_EQUAL(PAGES, stats.pages_verified);
+    TEST_ASSERT(memcmp(f.flash.memory(), out, sizeof(out)) == 0);
+    TEST_ASSERT_EQUAL(0, f.flash.stats().violations());
+}
+
+int main()
+{
+    RUN_TEST(test_skip_unchanged);
+    RUN_TEST(test_verify);
+    return test_result();
+}
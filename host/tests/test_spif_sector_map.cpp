@@ -0,0 +1,83 @@
+//SFDP sector map parsing on a hybrid sector part: regions and erase types come from the map
+//selected by the detection command (configuration register bit 2, bottom or top 4KB sectors)
+
+#include "spif_fixture.h"
+#include "host_test.h"
+
+using namespace sim;
+
+static void test_bottom_map()
+{
+    spif_fixture f(nor_config_hybrid());
+    TEST_ASSERT_EQUAL(0, f.bd.init());
+    TEST_ASSERT_EQUAL(1, f.flash.command_count(0x35));
+
+    TEST_ASSERT_EQUAL(16 * 1024 * 1024, f.bd.size());
+    TEST_ASSERT_EQUAL(4096, f.bd.get_erase_size(0));
+    TEST_ASSERT_EQUAL(4096, f.bd.get_erase_size(128 * 1024 - 1));
+    TEST_ASSERT_EQUAL(65536, f.bd.get_erase_size(128 * 1024));
+    TEST_ASSERT_EQUAL(65536, f.bd.get_erase_size(16 * 1024 * 1024 - 1));
+
+    spif_bd_sfdp_descriptor desc;
+    TEST_ASSERT_EQUAL(0, f.bd.get_sfdp_descriptor(desc));
+    TEST_ASSERT_EQUAL(2, desc.regions_count);
+    TEST_ASSERT_EQUAL(128 * 1024, desc.region_size_bytes[0]);
+    TEST_ASSERT_EQUAL(16 * 1024 * 1024 - 128 * 1024, desc.region_size_bytes[1]);
+    TEST_ASSERT_EQUAL(0x03, desc.region_erase_types_bitfield[0]);
+    TEST_ASSERT_EQUAL(0x02, desc.region_erase_types_bitfield[1]);
+    TEST_ASSERT_EQUAL(0, f.flash.stats().violations());
+}
+
+static void test_top_map()
+{
+    spif_fixture f(nor_config_hybrid());
+    f.flash.set_config_register(0x04);
+    TEST_ASSERT_EQUAL(0, f.bd.init());
+
+    uint64_t top = 16 * 1024 * 1024 - 128 * 1024;
+    TEST_ASSERT_EQUAL(65536, f.bd.get_erase_size(0));
+    TEST_ASSERT_EQUAL(65536, f.bd.get_erase_size(top - 1));
+    TEST_ASSERT_EQUAL(4096, f.bd.get_erase_size(top));
+    TEST_ASSERT_EQUAL(4096, f.bd.get_erase_size(16 * 1024 * 1024 - 1));
+    TEST_ASSERT_EQUAL(0, f.flash.stats().violations());
+}
+
+static void test_erases_follow_the_map()
+{
+    spif_fixture f(nor_config_hybrid());
+    TEST_ASSERT_EQUAL(0, f.bd.init());
+    f.flash.fill(0x00);
+
+    // 4KB units in the bottom region, 64KB above, none of them refused by the device
+    TEST_ASSERT_EQUAL(0, f.bd.erase(120 * 1024, 8 * 1024 + 64 * 1024));
+    TEST_ASSERT_EQUAL(0, f.flash.stats().bad_erases);
+    TEST_ASSERT_EQUAL(2, f.flash.stats().erases[0]);
+    TEST_ASSERT_EQUAL(1, f.flash.stats().erases[1]);
+    TEST_ASSERT_EQUAL(0x00, f.flash.memory()[120 * 1024 - 1]);
+    TEST_ASSERT_EQUAL(0xFF, f.flash.memory()[120 * 1024]);
+    TEST_ASSERT_EQUAL(0xFF, f.flash.memory()[192 * 1024 - 1]);
+    TEST_ASSERT_EQUAL(0x00, f.flash.memory()[192 * 1024]);
+
+    // 4KB isn't an erase unit above the bottom region
+    TEST_ASSERT_EQUAL(SPIF_BD_ERROR_INVALID_ERASE_PARAMS, f.bd.erase(128 * 1024, 4096));
+    TEST_ASSERT_EQUAL(0, f.flash.stats().violations());
+}
+
+static void test_uniform_part_single_region()
+{
+    spif_fixture f(nor_config_w25q32());
+    TEST_ASSERT_EQUAL(0, f.bd.init());
+    spif_bd_sfdp_descriptor desc;
+    TEST_ASSERT_EQUAL(0, f.bd.get_sfdp_descriptor(desc));
+    TEST_ASSERT_EQUAL(1, desc.regions_count);
+    TEST_ASSERT_EQUAL(0, f.flash.command_count(0x35));
+}
+
+int main()
+{
+    RUN_TEST(test_bottom_map);
+    RUN_TEST(test_top_map);
+    RUN_TEST(test_erases_follow_the_map);
+    RUN_TEST(test_uniform_part_single_region);
+    return test_result();
+}
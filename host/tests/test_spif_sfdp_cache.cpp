@@ -0,0 +1,132 @@
+//warm init(): a device whose JEDEC ID matches the cached SFDP configuration is only identified,
+//its SFDP tables aren't read and it isn't reset. A descriptor of another device, or one with a
+//wrong version or CRC, falls back to the full parse
+
+#include "spif_fixture.h"
+#include "host_test.h"
+
+using namespace sim;
+
+static uint8_t out[256];
+static uint8_t in[256];
+
+//init() of a device with nothing cached: SFDP read, reset sent
+static bool parsed(const nor_flash &flash)
+{
+    return (flash.command_count(0x5A) > 0) && (flash.command_count(0x66) == 1) && (flash.command_count(0x99) == 1);
+}
+
+static void round_trip(spif_fixture &f)
+{
+    for (size_t i = 0; i < sizeof(out); i++) {
+        out[i] = (uint8_t)(i ^ 0xA5);
+    }
+    TEST_ASSERT_EQUAL(0, f.bd.erase(0, 4096));
+    TEST_ASSERT_EQUAL(0, f.bd.program(out, 0, sizeof(out)));
+    TEST_ASSERT_EQUAL(0, f.bd.read(in, 0, sizeof(in)));
+    TEST_ASSERT(memcmp(in, out, sizeof(in)) == 0);
+}
+
+static void test_warm_init()
+{
+    spif_fixture f(nor_config_w25q32());
+    TEST_ASSERT_EQUAL(0, f.bd.init());
+    TEST_ASSERT(parsed(f.flash));
+    spif_bd_sfdp_descriptor cold;
+    TEST_ASSERT_EQUAL(0, f.bd.get_sfdp_descriptor(cold));
+
+    // Only identified
+    TEST_ASSERT_EQUAL(0, f.bd.deinit());
+    f.flash.reset_stats();
+    TEST_ASSERT_EQUAL(0, f.bd.init());
+    TEST_ASSERT_EQUAL(1, f.flash.command_count(0x9F));
+    TEST_ASSERT_EQUAL(0, f.flash.command_count(0x5A));
+    TEST_ASSERT_EQUAL(0, f.flash.command_count(0x66));
+    TEST_ASSERT_EQUAL(0, f.flash.command_count(0x99));
+
+    spif_bd_sfdp_descriptor warm;
+    TEST_ASSERT_EQUAL(0, f.bd.get_sfdp_descriptor(warm));
+    TEST_ASSERT(memcmp(&cold, &warm, sizeof(cold)) == 0);
+    TEST_ASSERT_EQUAL(4 * 1024 * 1024, f.bd.size());
+    round_trip(f);
+    TEST_ASSERT_EQUAL(0, f.flash.stats().violations());
+}
+
+static void test_saved_descriptor()
+{
+    spif_bd_sfdp_descriptor desc;
+    {
+        spif_fixture f(nor_config_w25q32());
+        TEST_ASSERT_EQUAL(0, f.bd.init());
+        TEST_ASSERT_EQUAL(0, f.bd.get_sfdp_descriptor(desc));
+    }
+
+    // As restored after a reset: the first init() is already warm
+    spif_fixture f(nor_config_w25q32());
+    spif_bd_sfdp_descriptor none;
+    TEST_ASSERT_EQUAL(SPIF_BD_ERROR_DEVICE_ERROR, f.bd.get_sfdp_descriptor(none));
+    TEST_ASSERT_EQUAL(0, f.bd.set_sfdp_descriptor(desc));
+    TEST_ASSERT_EQUAL(0, f.bd.init());
+    TEST_ASSERT_EQUAL(1, f.flash.command_count(0x9F));
+    TEST_ASSERT_EQUAL(0, f.flash.command_count(0x5A));
+    round_trip(f);
+    TEST_ASSERT_EQUAL(0, f.flash.stats().violations());
+}
+
+static void test_other_device_parses()
+{
+    // A valid descriptor of a part with another device ID
+    nor_config other = nor_config_w25q32();
+    other.jedec_id[2] = 0x17;
+    spif_bd_sfdp_descriptor desc;
+    {
+        spif_fixture f(other);
+        TEST_ASSERT_EQUAL(0, f.bd.init());
+        TEST_ASSERT_EQUAL(0, f.bd.get_sfdp_descriptor(desc));
+    }
+
+    spif_fixture f(nor_config_w25q32());
+    TEST_ASSERT_EQUAL(0, f.bd.set_sfdp_descriptor(desc));
+    TEST_ASSERT_EQUAL(0, f.bd.init());
+    TEST_ASSERT(parsed(f.flash));
+    spif_bd_sfdp_descriptor parsed_desc;
+    TEST_ASSERT_EQUAL(0, f.bd.get_sfdp_descriptor(parsed_desc));
+    TEST_ASSERT_EQUAL(0x16, parsed_desc.jedec_id[2]);
+    round_trip(f);
+    TEST_ASSERT_EQUAL(0, f.flash.stats().violations());
+}
+
+static void test_corrupted_descriptor_parses()
+{
+    spif_bd_sfdp_descriptor good;
+    {
+        spif_fixture f(nor_config_w25q32());
+        TEST_ASSERT_EQUAL(0, f.bd.init());
+        TEST_ASSERT_EQUAL(0, f.bd.get_sfdp_descriptor(good));
+    }
+
+    // A flipped bit, then an older version
+    spif_bd_sfdp_descriptor bad = good;
+    bad.erase_type_size_arr[0] ^= 0x10;
+    for (int i = 0; i < 2; i++) {
+        spif_fixture f(nor_config_w25q32());
+        TEST_ASSERT_EQUAL(SPIF_BD_ERROR_PARSING_FAILED, f.bd.set_sfdp_descriptor(bad));
+        TEST_ASSERT_EQUAL(0, f.bd.init());
+        TEST_ASSERT(parsed(f.flash));
+        TEST_ASSERT_EQUAL(4096, f.bd.get_erase_size());
+        round_trip(f);
+        TEST_ASSERT_EQUAL(0, f.flash.stats().violations());
+
+        bad = good;
+        bad.version = SPIF_SFDP_DESCRIPTOR_VERSION - 1;
+    }
+}
+
+int main()
+{
+    RUN_TEST(test_warm_init);
+    RUN_TEST(test_saved_descriptor);
+    RUN_TEST(test_other_device_parses);
+    RUN_TEST(test_corrupted_descriptor_parses);
+    return test_result();
+}
@@ -0,0 +1,75 @@
+//SPIFBlockDevicePD against the simulated NOR flash: init, SFDP parsing and a data round trip,
+//without the model counting a single command the real part would ignore
+
+#include "mbed.h"
+#include "SPIFBlockDevicePD.h"
+#include "nor_flash.h"
+#include "sim_kernel.h"
+#include "host_test.h"
+
+using namespace sim;
+
+static void test_init_parses_sfdp()
+{
+    nor_flash flash(nor_config_w25q32());
+    flash.attach(PA_5, PA_4);
+    SPIFBlockDevicePD bd(PA_7, PA_6, PA_5, PA_4, 40000000);
+
+    TEST_ASSERT_EQUAL(0, bd.init());
+    TEST_ASSERT_EQUAL(4 * 1024 * 1024, bd.size());
+    TEST_ASSERT_EQUAL(4096, bd.get_erase_size());
+    TEST_ASSERT_EQUAL(1, bd.get_program_size());
+
+    spif_bd_sfdp_descriptor desc;
+    TEST_ASSERT_EQUAL(0, bd.get_sfdp_descriptor(desc));
+    TEST_ASSERT_EQUAL(256, desc.page_size_bytes);
+    TEST_ASSERT_EQUAL(0x20, desc.erase4k_inst);
+    TEST_ASSERT_EQUAL(0x75, desc.suspend_inst);
+    TEST_ASSERT_EQUAL(0x7A, desc.resume_inst);
+    TEST_ASSERT_EQUAL(0xB9, desc.dpd_enter_inst);
+    TEST_ASSERT_EQUAL(0xAB, desc.dpd_exit_inst);
+    // SFDP rounds up to its units: 45ms in 16ms steps, 0.4ms in 64us steps
+    TEST_ASSERT_EQUAL(48000, desc.op_typ_time_us_arr[SPIF_BD_OP_ERASE_TYPE_1]);
+    TEST_ASSERT_EQUAL(448, desc.op_typ_time_us_arr[SPIF_BD_OP_PROGRAM]);
+
+    TEST_ASSERT_EQUAL(0, bd.deinit());
+    TEST_ASSERT_EQUAL(0, flash.stats().violations());
+    flash.detach();
+}
+
+static void test_round_trip()
+{
+    nor_flash flash(nor_config_w25q32());
+    flash.attach(PA_5, PA_4);
+    SPIFBlockDevicePD bd(PA_7, PA_6, PA_5, PA_4, 40000000);
+    TEST_ASSERT_EQUAL(0, bd.init());
+
+    static uint8_t out[8192];
+    static uint8_t in[8192];
+    for (size_t i = 0; i < sizeof(out); i++) {
+        out[i] = (uint8_t)(i * 7 + 3);
+    }
+    flash.fill(0x00);
+    TEST_ASSERT_EQUAL(0, bd.erase(4096, 8192));
+    TEST_ASSERT_EQUAL(0xFF, flash.memory()[4096]);
+    TEST_ASSERT_EQUAL(0x00, flash.memory()[4095]);
+    TEST_ASSERT_EQUAL(0x00, flash.memory()[4096 + 8192]);
+
+    // Unaligned start, crossing pages
+    TEST_ASSERT_EQUAL(0, bd.program(out, 4096 + 100, 5000));
+    TEST_ASSERT_EQUAL(0, bd.read(in, 4096 + 100, 5000));
+    TEST_ASSERT(memcmp(in, out, 5000) == 0);
+    TEST_ASSERT(memcmp(flash.memory() + 4096 + 100, out, 5000) == 0);
+
+    TEST_ASSERT_EQUAL(2, flash.stats().erases[0]);
+    TEST_ASSERT_EQUAL(0, bd.deinit());
+    TEST_ASSERT_EQUAL(0, flash.stats().violations());
+    flash.detach();
+}
+
+int main()
+{
+    RUN_TEST(test_init_parses_sfdp);
+    RUN_TEST(test_round_trip);
+    return test_result();
+}
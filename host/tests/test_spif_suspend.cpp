@@ -0,0 +1,121 @@
+//reads while another thread erases: the erase runs with the lock released and is suspended for
+//reads of other areas, so a read takes microseconds instead of waiting out the erase.
+//Prints the worst case read latency with and without suspend support
+
+#include "spif_fixture.h"
+#include "host_test.h"
+
+using namespace sim;
+
+static SPIFBlockDevicePD *eraser_bd;
+static volatile bool erasing;
+static int erase_status;
+
+static void eraser()
+{
+    // 4 x 150ms block erases of the first 256KB
+    erase_status = eraser_bd->erase(0, 256 * 1024);
+    erasing = false;
+}
+
+static uint8_t out[256];
+static uint8_t in[256];
+
+//worst read() latency in us of reads of a page above the erased range, one every 2ms
+static uint32_t worst_read_during_erase(spif_fixture &f, int &reads)
+{
+    for (size_t i = 0; i < sizeof(out); i++) {
+        out[i] = (uint8_t)(i + 7);
+    }
+    memcpy(f.flash.memory() + 1024 * 1024, out, sizeof(out));
+
+    eraser_bd = &f.bd;
+    erasing = true;
+    erase_status = -1;
+    rtos::Thread thread;
+    thread.start(callback(eraser));
+    thread_sleep_for(1);
+
+    uint64_t worst_ns = 0;
+    reads = 0;
+    while (erasing) {
+        uint64_t start = now_ns();
+        TEST_ASSERT_EQUAL(0, f.bd.read(in, 1024 * 1024, sizeof(in)));
+        uint64_t ns = now_ns() - start;
+        worst_ns = (ns > worst_ns) ? ns : worst_ns;
+        TEST_ASSERT(memcmp(in, out, sizeof(in)) == 0);
+        reads++;
+        thread_sleep_for(2);
+    }
+    thread.join();
+    TEST_ASSERT_EQUAL(0, erase_status);
+    TEST_ASSERT_EQUAL(4, f.flash.stats().erases[2]);
+    TEST_ASSERT_EQUAL(0xFF, f.flash.memory()[256 * 1024 - 1]);
+    return worst_ns / 1000;
+}
+
+static void test_reads_suspend_erase()
+{
+    spif_fixture f(nor_config_w25q32());
+    TEST_ASSERT_EQUAL(0, f.bd.init());
+    f.flash.fill(0x00);
+
+    int reads;
+    uint32_t worst_us = worst_read_during_erase(f, reads);
+    printf("  with suspend: %d reads, worst %" PRIu32 " us\n", reads, worst_us);
+    TEST_ASSERT(reads > 200);
+    TEST_ASSERT(f.flash.stats().suspends > 0);
+    TEST_ASSERT_EQUAL(f.flash.stats().suspends, f.flash.stats().resumes);
+    // tSUS, the read itself and waiting out resume-to-suspend (64us)
+    TEST_ASSERT(worst_us < 200);
+    // No reads of the suspended area, no suspends too soon after a resume
+    TEST_ASSERT_EQUAL(0, f.flash.stats().violations());
+}
+
+static void test_reads_wait_without_suspend()
+{
+    nor_config config = nor_config_w25q32();
+    config.suspend = false;
+    spif_fixture f(config);
+    TEST_ASSERT_EQUAL(0, f.bd.init());
+    f.flash.fill(0x00);
+
+    int reads;
+    uint32_t worst_us = worst_read_during_erase(f, reads);
+    printf("  without suspend: %d reads, worst %" PRIu32 " us\n", reads, worst_us);
+    TEST_ASSERT_EQUAL(0, f.flash.stats().suspends);
+    // Waits out a 150ms block erase, but not the rest of the range after it
+    TEST_ASSERT(worst_us > 100000);
+    TEST_ASSERT(worst_us < 170000);
+    TEST_ASSERT(reads > 1);
+    TEST_ASSERT_EQUAL(0, f.flash.stats().violations());
+}
+
+static void test_read_of_erased_area_waits()
+{
+    spif_fixture f(nor_config_w25q32());
+    TEST_ASSERT_EQUAL(0, f.bd.init());
+    f.flash.fill(0x00);
+
+    eraser_bd = &f.bd;
+    erasing = true;
+    rtos::Thread thread;
+    thread.start(callback(eraser));
+    thread_sleep_for(1);
+
+    // Inside the block being erased: only once it is done, and then erased
+    TEST_ASSERT_EQUAL(0, f.bd.read(in, 0, sizeof(in)));
+    TEST_ASSERT_EQUAL(0xFF, in[0]);
+    TEST_ASSERT_EQUAL(0xFF, in[sizeof(in) - 1]);
+    thread.join();
+    TEST_ASSERT_EQUAL(0, f.flash.stats().reads_in_erase);
+    TEST_ASSERT_EQUAL(0, f.flash.stats().violations());
+}
+
+int main()
+{
+    RUN_TEST(test_reads_suspend_erase);
+    RUN_TEST(test_reads_wait_without_suspend);
+    RUN_TEST(test_read_of_erased_area_waits);
+    return test_result();
+}
@@ -0,0 +1,125 @@
+//read() and program() move their data in block transfers: one SPI transaction per read,
+//one header and one data call per chunk, and close to the wire rate for large transfers.
+//readv()/programv() gather their buffers the same way, a page program never crosses a page
+
+#include "spif_fixture.h"
+#include "host_test.h"
+
+using namespace sim;
+
+static uint8_t buffer[65536];
+
+static void test_read_is_one_transaction()
+{
+    spif_fixture f(nor_config_w25q32());
+    TEST_ASSERT_EQUAL(0, f.bd.init());
+
+    static const uint32_t sizes[] = {1, 16, 256, 4096, 0x8000, 0x8001, 65536};
+    for (uint32_t size : sizes) {
+        reset_bus_counters();
+        uint64_t start = now_ns();
+        TEST_ASSERT_EQUAL(0, f.bd.read(buffer, 0, size));
+        uint64_t ns = now_ns() - start;
+
+        TEST_ASSERT_EQUAL(1, counters().spi_selects);
+        TEST_ASSERT_EQUAL(1 + (size + 0x7FFF) / 0x8000, counters().spi_calls);
+        printf("  read %6" PRIu32 " B: %.3f MB/s\n", size, mb_per_s(size, ns));
+    }
+    TEST_ASSERT_EQUAL(0, f.flash.stats().violations());
+}
+
+static void test_read_near_wire_rate()
+{
+    spif_fixture f(nor_config_w25q32(), 40000000);
+    TEST_ASSERT_EQUAL(0, f.bd.init());
+
+    // 40MHz is 5MB/s on the wire, only the header and the per call cost come on top
+    uint64_t start = now_ns();
+    TEST_ASSERT_EQUAL(0, f.bd.read(buffer, 0, 4096));
+    double rate = mb_per_s(4096, now_ns() - start);
+    TEST_ASSERT_MESSAGE(rate > 4.5, "4KB read below 90% of the wire rate");
+}
+
+static void test_program_page_calls()
+{
+    spif_fixture f(nor_config_w25q32());
+    TEST_ASSERT_EQUAL(0, f.bd.init());
+    TEST_ASSERT_EQUAL(0, f.bd.erase(0, 4096));
+
+    for (size_t i = 0; i < 256; i++) {
+        buffer[i] = (uint8_t)i;
+    }
+    TEST_ASSERT_EQUAL(0, f.bd.program(buffer, 0, 256));
+    // Page Program: the header and the page, in one transaction
+    TEST_ASSERT_EQUAL(1, f.flash.command_count(0x02));
+    TEST_ASSERT_EQUAL(256, f.flash.stats().bytes_programmed);
+    TEST_ASSERT(memcmp(f.flash.memory(), buffer, 256) == 0);
+    TEST_ASSERT_EQUAL(0, f.flash.stats().violations());
+}
+
+static uint8_t gathered[1024];
+
+//pieces of gathered, empty ones between them and one straddling the page boundary above addr 200
+static int split(spif_bd_iovec *iov)
+{
+    static const uint32_t lens[] = {10, 0, 300, 0, 0, 46, 500, 44, 0};
+    uint32_t offset = 0;
+    for (int i = 0; i < 9; i++) {
+        iov[i].base = lens[i] ? gathered + offset : NULL;
+        iov[i].len = lens[i];
+        offset += lens[i];
+    }
+    return 9;
+}
+
+static void test_readv_is_one_transaction()
+{
+    spif_fixture f(nor_config_w25q32());
+    TEST_ASSERT_EQUAL(0, f.bd.init());
+    for (size_t i = 0; i < 2048; i++) {
+        f.flash.memory()[i] = (uint8_t)(i * 3 + (i >> 8));
+    }
+
+    spif_bd_iovec iov[9];
+    int count = split(iov);
+    memset(gathered, 0, sizeof(gathered));
+    reset_bus_counters();
+    TEST_ASSERT_EQUAL(0, f.bd.readv(iov, count, 200));
+    TEST_ASSERT_EQUAL(1, counters().spi_selects);
+    TEST_ASSERT(memcmp(gathered, f.flash.memory() + 200, 900) == 0);
+    TEST_ASSERT_EQUAL(0, f.flash.stats().violations());
+}
+
+static void test_programv_splits_at_pages()
+{
+    spif_fixture f(nor_config_w25q32());
+    TEST_ASSERT_EQUAL(0, f.bd.init());
+    TEST_ASSERT_EQUAL(0, f.bd.erase(0, 4096));
+    for (size_t i = 0; i < sizeof(gathered); i++) {
+        gathered[i] = (uint8_t)(i ^ 0x3C);
+    }
+
+    // 900 bytes from 200: the end of page 0, pages 1 to 3, the start of page 4
+    spif_bd_iovec iov[9];
+    int count = split(iov);
+    f.flash.reset_stats();
+    TEST_ASSERT_EQUAL(0, f.bd.programv(iov, count, 200));
+    TEST_ASSERT_EQUAL(5, f.flash.command_count(0x02));
+    TEST_ASSERT_EQUAL(5, f.flash.stats().page_programs);
+    TEST_ASSERT_EQUAL(900, f.flash.stats().bytes_programmed);
+    TEST_ASSERT(memcmp(f.flash.memory() + 200, gathered, 900) == 0);
+    // Nothing wrapped to the start of a page or ran past the end
+    TEST_ASSERT_EQUAL(0xFF, f.flash.memory()[199]);
+    TEST_ASSERT_EQUAL(0xFF, f.flash.memory()[1100]);
+    TEST_ASSERT_EQUAL(0, f.flash.stats().violations());
+}
+
+int main()
+{
+    RUN_TEST(test_read_is_one_transaction);
+    RUN_TEST(test_read_near_wire_rate);
+    RUN_TEST(test_program_page_calls);
+    RUN_TEST(test_readv_is_one_transaction);
+    RUN_TEST(test_programv_splits_at_pages);
+    return test_result();
+}
@@ -0,0 +1,70 @@
+//_set_write_enable() once the last operation was seen complete: WREN right away, then a single
+//status read checking WEL, no ready wait before it. A WREN the chip drops fails the program
+//instead of leaving the page unprogrammed
+
+#include "spif_fixture.h"
+#include "host_test.h"
+
+using namespace sim;
+
+#define PAGES 256
+
+static uint8_t out[PAGES * 256];
+
+static void test_commands_per_page()
+{
+    spif_fixture f(nor_config_w25q32(), 40000000);
+    TEST_ASSERT_EQUAL(0, f.bd.init());
+    for (size_t i = 0; i < sizeof(out); i++) {
+        out[i] = (uint8_t)(i ^ (i >> 8));
+    }
+    TEST_ASSERT_EQUAL(0, f.bd.erase(0, sizeof(out)));
+
+    f.bd.reset_latency_histograms();
+    f.flash.reset_stats();
+    uint64_t start = now_ns();
+    TEST_ASSERT_EQUAL(0, f.bd.program(out, 0, sizeof(out)));
+    uint64_t ns = now_ns() - start;
+
+    // Every status read is either the WEL check or a poll of the program's own ready wait
+    spif_bd_latency_histogram hist;
+    TEST_ASSERT_EQUAL(0, f.bd.get_latency_histogram(SPIF_BD_OP_PROGRAM, hist));
+    TEST_ASSERT_EQUAL(PAGES, hist.count);
+    TEST_ASSERT_EQUAL(PAGES, f.flash.command_count(0x06));
+    TEST_ASSERT_EQUAL(PAGES, f.flash.command_count(0x02));
+    TEST_ASSERT_EQUAL(PAGES + hist.total_polls, f.flash.command_count(0x05));
+    TEST_ASSERT(memcmp(f.flash.memory(), out, sizeof(out)) == 0);
+    TEST_ASSERT_EQUAL(0, f.flash.stats().violations());
+    printf("  %d pages: %.3f MB/s sustained, %.2f status reads per page\n", PAGES, mb_per_s(sizeof(out), ns),
+           (double)f.flash.command_count(0x05) / PAGES);
+}
+
+static void test_dropped_wren_fails()
+{
+    spif_fixture f(nor_config_w25q32());
+    TEST_ASSERT_EQUAL(0, f.bd.init());
+    TEST_ASSERT_EQUAL(0, f.bd.erase(0, 4096));
+    memset(out, 0x5A, 512);
+
+    // The WEL check sees the WREN didn't take, the page program isn't sent
+    f.flash.reset_stats();
+    f.flash.fault_drop_wren(1);
+    TEST_ASSERT_EQUAL(SPIF_BD_ERROR_WREN_FAILED, f.bd.program(out, 0, 256));
+    TEST_ASSERT_EQUAL(1, f.flash.command_count(0x06));
+    TEST_ASSERT_EQUAL(0, f.flash.command_count(0x02));
+    TEST_ASSERT_EQUAL(0xFF, f.flash.memory()[0]);
+
+    // Only that WREN was lost, the same program goes through again
+    TEST_ASSERT_EQUAL(0, f.bd.program(out, 0, 512));
+    TEST_ASSERT_EQUAL(3, f.flash.command_count(0x06));
+    TEST_ASSERT_EQUAL(2, f.flash.command_count(0x02));
+    TEST_ASSERT(memcmp(f.flash.memory(), out, 512) == 0);
+    TEST_ASSERT_EQUAL(0, f.flash.stats().violations());
+}
+
+int main()
+{
+    RUN_TEST(test_commands_per_page);
+    RUN_TEST(test_dropped_wren_fails);
+    return test_result();
+}
@@ -0,0 +1,166 @@
+//StripedBlockDevice over two simulated chips: stripe mapping, errors, init rollback,
+//and program/erase throughput against a single chip (the chips work in parallel)
+
+#include "spif_fixture.h"
+#include "StripedBlockDevice.h"
+#include "host_test.h"
+
+using namespace sim;
+
+#define STRIPE (64 * 1024)
+
+static uint8_t buffer[4 * STRIPE];
+static uint8_t check[4 * STRIPE];
+
+static void fill_pattern()
+{
+    for (size_t i = 0; i < sizeof(buffer); i++) {
+        buffer[i] = (uint8_t)((i >> 8) ^ (i * 11));
+    }
+}
+
+static void test_stripe_mapping()
+{
+    // Two chips sharing one bus
+    spif_fixture a(nor_config_w25q32(), 40000000, PA_5, PA_4);
+    spif_fixture b(nor_config_w25q32(), 40000000, PA_5, PB_6);
+    SPIFBlockDevicePD *bds[2] = {&a.bd, &b.bd};
+
+    // Stripes default to the erase size of the devices
+    StripedBlockDevice defaults(bds, 2);
+    TEST_ASSERT_EQUAL(0, defaults.init());
+    TEST_ASSERT_EQUAL(4096, defaults.get_erase_size());
+    TEST_ASSERT_EQUAL(0, defaults.deinit());
+
+    StripedBlockDevice striped(bds, 2, STRIPE);
+    TEST_ASSERT_EQUAL(0, striped.init());
+    TEST_ASSERT_EQUAL(2 * 4 * 1024 * 1024, striped.size());
+    TEST_ASSERT_EQUAL(STRIPE, striped.get_erase_size());
+
+    fill_pattern();
+    TEST_ASSERT_EQUAL(0, striped.erase(0, sizeof(buffer)));
+    TEST_ASSERT_EQUAL(0, striped.program(buffer, 0, sizeof(buffer)));
+
+    // Even stripes on the first chip, odd ones on the second
+    TEST_ASSERT(memcmp(a.flash.memory(), buffer, STRIPE) == 0);
+    TEST_ASSERT(memcmp(b.flash.memory(), buffer + STRIPE, STRIPE) == 0);
+    TEST_ASSERT(memcmp(a.flash.memory() + STRIPE, buffer + 2 * STRIPE, STRIPE) == 0);
+    TEST_ASSERT(memcmp(b.flash.memory() + STRIPE, buffer + 3 * STRIPE, STRIPE) == 0);
+
+    // Reads across stripe boundaries
+    TEST_ASSERT_EQUAL(0, striped.read(check, 100, sizeof(check) - 200));
+    TEST_ASSERT(memcmp(check, buffer + 100, sizeof(check) - 200) == 0);
+
+    // Nothing past the striped area reaches the devices
+    uint32_t commands = a.flash.stats().commands[0x03] + a.flash.stats().commands[0x0B] +
+                        b.flash.stats().commands[0x03] + b.flash.stats().commands[0x0B];
+    TEST_ASSERT_EQUAL(BD_ERROR_DEVICE_ERROR, striped.read(check, striped.size() - 256, 512));
+    TEST_ASSERT_EQUAL(BD_ERROR_DEVICE_ERROR, striped.program(buffer, striped.size(), 256));
+    TEST_ASSERT_EQUAL(commands, a.flash.stats().commands[0x03] + a.flash.stats().commands[0x0B] +
+                      b.flash.stats().commands[0x03] + b.flash.stats().commands[0x0B]);
+    TEST_ASSERT_EQUAL(sizeof(buffer) / 256, a.flash.stats().page_programs + b.flash.stats().page_programs);
+
+    TEST_ASSERT_EQUAL(0, striped.deinit());
+    TEST_ASSERT_EQUAL(0, a.flash.stats().violations() + b.flash.stats().violations());
+}
+
+static void test_device_error()
+{
+    spif_fixture a(nor_config_w25q32(), 40000000, PA_5, PA_4);
+    spif_fixture b(nor_config_w25q32(), 40000000, PA_5, PB_6);
+    SPIFBlockDevicePD *bds[2] = {&a.bd, &b.bd};
+    StripedBlockDevice striped(bds, 2, STRIPE);
+    TEST_ASSERT_EQUAL(0, striped.init());
+
+    // The second chip never finishes its erase: reported, the first chip's part still done
+    a.flash.fill(0x00);
+    b.flash.fill(0x00);
+    b.flash.fault_stuck_busy(0, STRIPE, 5000000);
+    TEST_ASSERT(striped.erase(0, 2 * STRIPE) != 0);
+    TEST_ASSERT_EQUAL(0xFF, a.flash.memory()[0]);
+    TEST_ASSERT_EQUAL(0x00, b.flash.memory()[0]);
+
+    b.flash.clear_faults();
+    thread_sleep_for(6000);
+    TEST_ASSERT_EQUAL(0, striped.deinit());
+}
+
+static void test_init_rollback()
+{
+    // Nothing answers on the second chip select
+    spif_fixture a(nor_config_w25q32(), 40000000, PA_5, PA_4);
+    SPIFBlockDevicePD missing(PA_7, PA_6, PA_5, PB_6);
+    SPIFBlockDevicePD *bds[2] = {&a.bd, &missing};
+    StripedBlockDevice striped(bds, 2);
+
+    TEST_ASSERT(striped.init() != 0);
+    // The first chip was deinitialized again (powered down) and can be initialized on its own
+    TEST_ASSERT(a.flash.powered_down());
+    TEST_ASSERT_EQUAL(0, a.bd.init());
+    TEST_ASSERT_EQUAL(0, a.bd.deinit());
+}
+
+struct op_times {
+    double erase_ms;
+    double program_ms;
+    double read_ms;
+};
+
+static void time_device(mbed::BlockDevice &bd, op_times &t)
+{
+    uint64_t start = now_ns();
+    TEST_ASSERT_EQUAL(0, bd.erase(0, sizeof(buffer)));
+    t.erase_ms = (now_ns() - start) / 1e6;
+
+    start = now_ns();
+    TEST_ASSERT_EQUAL(0, bd.program(buffer, 0, sizeof(buffer)));
+    t.program_ms = (now_ns() - start) / 1e6;
+
+    start = now_ns();
+    TEST_ASSERT_EQUAL(0, bd.read(check, 0, sizeof(check)));
+    t.read_ms = (now_ns() - start) / 1e6;
+    TEST_ASSERT(memcmp(check, buffer, sizeof(check)) == 0);
+}
+
+static void test_throughput_two_chips()
+{
+    fill_pattern();
+
+    op_times single;
+    {
+        spif_fixture one(nor_config_w25q32(), 40000000, PA_5, PA_4);
+        TEST_ASSERT_EQUAL(0, one.bd.init());
+        time_device(one.bd, single);
+    }
+
+    op_times two;
+    {
+        spif_fixture a(nor_config_w25q32(), 40000000, PA_5, PA_4);
+        spif_fixture b(nor_config_w25q32(), 40000000, PA_5, PB_6);
+        SPIFBlockDevicePD *bds[2] = {&a.bd, &b.bd};
+        StripedBlockDevice striped(bds, 2, STRIPE);
+        TEST_ASSERT_EQUAL(0, striped.init());
+        time_device(striped, two);
+        TEST_ASSERT_EQUAL(0, striped.deinit());
+        TEST_ASSERT_EQUAL(0, a.flash.stats().violations() + b.flash.stats().violations());
+    }
+
+    double erase_speedup = single.erase_ms / two.erase_ms;
+    double program_speedup = single.program_ms / two.program_ms;
+    printf("  256KB erase: %.1f ms on one chip, %.1f ms striped (x%.2f)\n", single.erase_ms, two.erase_ms, erase_speedup);
+    printf("  256KB program: %.1f ms on one chip, %.1f ms striped (x%.2f)\n", single.program_ms, two.program_ms,
+           program_speedup);
+    printf("  256KB read: %.1f ms on one chip, %.1f ms striped (shared bus)\n", single.read_ms, two.read_ms);
+    // The bus is shared, but programs and erases are bound by the chips
+    TEST_ASSERT(erase_speedup > 1.8);
+    TEST_ASSERT(program_speedup > 1.8);
+}
+
+int main()
+{
+    RUN_TEST(test_stripe_mapping);
+    RUN_TEST(test_device_error);
+    RUN_TEST(test_init_rollback);
+    RUN_TEST(test_throughput_two_chips);
+    return test_result();
+}
@@ -0,0 +1,146 @@
+//STUSB4500 sink policy engine against the register model: the contract at the PDO delivering the
+//most charge power, one capabilities exchange once the sink PDOs fit the source, type-C only
+//sources, rejects, detach, and no I2C traffic between alerts
+
+#include "stusb_fixture.h"
+#include "host_test.h"
+
+using namespace sim;
+
+static std::vector<uint32_t> charger_65w()
+{
+    std::vector<uint32_t> pdos;
+    pdos.push_back(src_fixed(5000, 3000));
+    pdos.push_back(src_fixed(9000, 3000));
+    pdos.push_back(src_fixed(15000, 3000));
+    pdos.push_back(src_fixed(20000, 3250));
+    return pdos;
+}
+
+static void test_negotiates_most_power()
+{
+    stusb_fixture f;
+    TEST_ASSERT(f.pd.init());
+    f.queue.dispatch(10);
+
+    f.chip.plug(charger_65w());
+    TEST_ASSERT(f.run_until(STUSB4500::PD_CONTRACT, 1000));
+    f.queue.dispatch(10);
+
+    // The default sink PDOs would only get 20V 1A: PDO2 is pointed at 20V and the capabilities come again
+    TEST_ASSERT_EQUAL(20000, f.chip.contract_mv());
+    TEST_ASSERT_EQUAL(3250, f.chip.contract_ma());
+    TEST_ASSERT_EQUAL(2, f.chip.reg(0x70));
+    TEST_ASSERT_EQUAL(pd::fixed::make(20000, 3250), f.chip.sink_pdo(2) & 0x000FFFFF);
+    TEST_ASSERT_EQUAL(1, f.chip.stats().soft_resets);
+    TEST_ASSERT_EQUAL(2, f.chip.stats().caps_sent);
+
+    uint32_t mv = 0;
+    uint32_t ma = 0;
+    TEST_ASSERT(f.pd.get_contract(mv, ma));
+    TEST_ASSERT_EQUAL(20000, mv);
+    TEST_ASSERT_EQUAL(3250, ma);
+
+    // Every state posted, in order
+    STUSB4500::pd_state expected[] = {STUSB4500::PD_ATTACHED, STUSB4500::PD_RENEGOTIATING,
+                                      STUSB4500::PD_NEGOTIATING, STUSB4500::PD_CONTRACT
+                                     };
+    TEST_ASSERT_EQUAL(4, f.states.size());
+    for (size_t i = 0; (i < 4) && (i < f.states.size()); i++) {
+        TEST_ASSERT_EQUAL(expected[i], f.states[i]);
+    }
+
+    // Nothing polls the chip once the contract is there
+    reset_bus_counters();
+    f.queue.dispatch(5000);
+    TEST_ASSERT_EQUAL(0, counters().i2c_calls);
+    TEST_ASSERT_EQUAL(STUSB4500::PD_CONTRACT, f.pd.get_state());
+}
+
+static void test_one_exchange_when_pdos_fit()
+{
+    stusb_fixture f;
+    TEST_ASSERT(f.pd.init());
+    f.chip.plug(charger_65w());
+    TEST_ASSERT(f.run_until(STUSB4500::PD_CONTRACT, 1000));
+
+    f.chip.unplug();
+    TEST_ASSERT(f.run_until(STUSB4500::PD_DETACHED, 100));
+    TEST_ASSERT_EQUAL(0, f.chip.contract_mv());
+    uint32_t pdos[STUSB_MAX_SRC_PDOS];
+    TEST_ASSERT_EQUAL(0, f.pd.get_source_pdos(pdos));
+
+    // Same charger again, the sink PDOs already ask for 20V: a single Source_Capabilities
+    f.chip.reset_stats();
+    uint64_t start = now_ns();
+    f.chip.plug(charger_65w());
+    TEST_ASSERT(f.run_until(STUSB4500::PD_CONTRACT, 1000));
+    uint64_t took_ms = (now_ns() - start) / 1000000;
+
+    TEST_ASSERT_EQUAL(20000, f.chip.contract_mv());
+    TEST_ASSERT_EQUAL(1, f.chip.stats().caps_sent);
+    TEST_ASSERT_EQUAL(0, f.chip.stats().soft_resets);
+    // The protocol times plus a few ms of alert handling at 100kHz, a second exchange would add 50ms
+    TEST_ASSERT(took_ms <= STUSB_MODEL_FIRST_CAPS_MS + STUSB_MODEL_REQUEST_MS + STUSB_MODEL_ACCEPT_MS +
+                STUSB_MODEL_PS_RDY_MS + 10);
+    printf("  attach to contract: %" PRIu64 "ms\n", took_ms);
+}
+
+static void test_limits_and_type_c_only()
+{
+    stusb_fixture f;
+    pd_sink_limits limits = pd_charger_limits();
+    limits.max_voltage_mv = 12000;
+    f.pd.set_limits(limits);
+    TEST_ASSERT(f.pd.init());
+
+    // Nothing above 12V for this charger
+    f.chip.plug(charger_65w());
+    TEST_ASSERT(f.run_until(STUSB4500::PD_CONTRACT, 1000));
+    TEST_ASSERT_EQUAL(9000, f.chip.contract_mv());
+    TEST_ASSERT_EQUAL(3000, f.chip.contract_ma());
+
+    f.chip.unplug();
+    TEST_ASSERT(f.run_until(STUSB4500::PD_DETACHED, 100));
+
+    // A source without PD leaves the sink attached, waiting
+    f.chip.plug(std::vector<uint32_t>());
+    f.queue.dispatch(1000);
+    TEST_ASSERT_EQUAL(STUSB4500::PD_ATTACHED, f.pd.get_state());
+    TEST_ASSERT_EQUAL(0, f.chip.contract_mv());
+}
+
+static void test_reject_and_detach()
+{
+    stusb_fixture f;
+    TEST_ASSERT(f.pd.init());
+
+    f.chip.set_reject_mv(20000);
+    f.chip.plug(charger_65w());
+    TEST_ASSERT(f.run_until(STUSB4500::PD_REJECTED, 1000));
+    TEST_ASSERT_EQUAL(1, f.chip.stats().rejects);
+    uint32_t mv;
+    uint32_t ma;
+    TEST_ASSERT(!f.pd.get_contract(mv, ma));
+
+    // Unplugged while negotiating
+    f.chip.set_reject_mv(0);
+    f.chip.unplug();
+    TEST_ASSERT(f.run_until(STUSB4500::PD_DETACHED, 100));
+    f.chip.plug(charger_65w());
+    TEST_ASSERT(f.run_until(STUSB4500::PD_NEGOTIATING, 1000));
+    f.chip.unplug();
+    TEST_ASSERT(f.run_until(STUSB4500::PD_DETACHED, 100));
+    f.queue.dispatch(100);
+    TEST_ASSERT_EQUAL(STUSB4500::PD_DETACHED, f.pd.get_state());
+    TEST_ASSERT(!f.chip.alert_low());
+}
+
+int main()
+{
+    RUN_TEST(test_negotiates_most_power);
+    RUN_TEST(test_one_exchange_when_pdos_fit);
+    RUN_TEST(test_limits_and_type_c_only);
+    RUN_TEST(test_reject_and_detach);
+    return test_result();
+}
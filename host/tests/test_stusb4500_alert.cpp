@@ -0,0 +1,114 @@
+//alert service of the STUSB4500 driver on the register model at 100kHz: one ALERT costs a single
+//burst of ALERT_STATUS_1 through PRT_STATUS, against the register by register reads it replaced
+//(12 reads and CC_STATUS again, each a write and a read), and alerts raised together share a burst
+
+#include "stusb_fixture.h"
+#include "host_test.h"
+
+using namespace sim;
+
+#define ALERT_BLOCK_REGS 12
+#define CC_STATUS_REG 0x11
+
+static void test_alert_is_one_burst(uint64_t &latency_ns, uint64_t &calls)
+{
+    stusb_fixture f;
+    TEST_ASSERT(f.pd.init());
+    f.queue.dispatch(10);
+    TEST_ASSERT_EQUAL(STUSB4500::PD_DETACHED, f.pd.get_state());
+    TEST_ASSERT(!f.chip.alert_low());
+
+    // Type-C only source: the attach alert and nothing after it
+    reset_bus_counters();
+    f.chip.reset_stats();
+    uint64_t start = now_ns();
+    f.chip.plug(std::vector<uint32_t>());
+    TEST_ASSERT(f.chip.alert_low());
+    f.queue.dispatch(10);
+
+    TEST_ASSERT_EQUAL(STUSB4500::PD_ATTACHED, f.pd.get_state());
+    TEST_ASSERT(!f.chip.alert_low());
+    TEST_ASSERT_EQUAL(1, f.chip.stats().alerts);
+    TEST_ASSERT_EQUAL(1, f.chip.stats().alert_reads);
+    // Register address write and the burst read, with a repeated start between them
+    TEST_ASSERT_EQUAL(1, f.chip.stats().transactions);
+    TEST_ASSERT_EQUAL(2, counters().i2c_calls);
+    TEST_ASSERT_EQUAL(1 + 1 + 1 + ALERT_BLOCK_REGS, counters().i2c_bytes);
+
+    TEST_ASSERT(!f.state_ns.empty());
+    latency_ns = f.state_ns.back() - start;
+    calls = counters().i2c_calls;
+}
+
+static void test_register_loop_reference(uint64_t &latency_ns, uint64_t &calls)
+{
+    // What the alert cost before: each register on its own, then CC_STATUS again
+    stusb4500_model chip(SDA_PIN, USB_ALT);
+    I2C bus(SDA_PIN, SCL_PIN);
+    bus.frequency(100000);
+
+    chip.plug(std::vector<uint32_t>());
+    reset_bus_counters();
+    uint64_t start = now_ns();
+    for (int i = 0; i <= ALERT_BLOCK_REGS; i++) {
+        char reg = (i < ALERT_BLOCK_REGS) ? (char)(0x0B + i) : (char)CC_STATUS_REG;
+        char value;
+        TEST_ASSERT_EQUAL(0, bus.write(STUSB_MODEL_I2C_ADDR, &reg, 1, true));
+        TEST_ASSERT_EQUAL(0, bus.read(STUSB_MODEL_I2C_ADDR, &value, 1));
+    }
+    latency_ns = now_ns() - start;
+    calls = counters().i2c_calls;
+    TEST_ASSERT_EQUAL(2 * (ALERT_BLOCK_REGS + 1), calls);
+}
+
+static void test_alerts_share_a_burst()
+{
+    stusb_fixture f;
+    TEST_ASSERT(f.pd.init());
+    f.queue.dispatch(10);
+
+    // Attach and capabilities pending before the queue gets to the first one: ALERT falls once
+    // and one burst sees both
+    f.chip.reset_stats();
+    std::vector<uint32_t> pdos;
+    pdos.push_back(src_fixed(5000, 3000));
+    f.chip.plug(pdos);
+    f.chip.send_caps();
+    f.queue.dispatch(1);
+
+    TEST_ASSERT_EQUAL(1, f.chip.stats().alerts);
+    TEST_ASSERT_EQUAL(1, f.chip.stats().alert_reads);
+    TEST_ASSERT(f.pd.get_state() == STUSB4500::PD_NEGOTIATING || f.pd.get_state() == STUSB4500::PD_RENEGOTIATING);
+    TEST_ASSERT_EQUAL(1, f.pd.get_source_pdos(&pdos[0]));
+
+    // Through to the contract each alert is serviced by exactly one burst
+    TEST_ASSERT(f.run_until(STUSB4500::PD_CONTRACT, 1000));
+    f.queue.dispatch(10);
+    TEST_ASSERT_EQUAL(f.chip.stats().alerts, f.chip.stats().alert_reads);
+    TEST_ASSERT(!f.chip.alert_low());
+}
+
+static void test_alert_cost()
+{
+    uint64_t burst_ns = 0;
+    uint64_t burst_calls = 0;
+    uint64_t loop_ns = 0;
+    uint64_t loop_calls = 0;
+
+    test_alert_is_one_burst(burst_ns, burst_calls);
+    test_register_loop_reference(loop_ns, loop_calls);
+
+    printf("  alert to state change: %" PRIu64 "us in %" PRIu64 " I2C calls, register loop: %" PRIu64
+           "us in %" PRIu64 " calls\n", burst_ns / 1000, burst_calls, loop_ns / 1000, loop_calls);
+    TEST_ASSERT(burst_calls * 10 < loop_calls);
+    // The bytes on the wire dominate at 100kHz, the burst still saves an address byte and a
+    // register byte per register
+    TEST_ASSERT(burst_ns * 3 < loop_ns);
+}
+
+int main()
+{
+    RUN_TEST(test_alert_cost);
+    RUN_TEST(test_alerts_share_a_burst);
+    return test_result();
+}
@@ -0,0 +1,160 @@
+//blocking renegotiation of the STUSB4500 driver against the register model, the alert handling
+//dispatched by its own thread: voltage changes under a live contract, voltages not offered,
+//rejects and unanswered soft resets falling back to 5V within the timeouts
+
+#include "stusb_fixture.h"
+#include "host_test.h"
+
+using namespace sim;
+
+//soft reset, Accept, capabilities, Request, Accept, PS_RDY and the alert handling of each
+#define RENEGOTIATION_MAX_MS 100
+
+struct renegotiation_fixture : stusb_fixture {
+    rtos::Thread dispatcher;
+
+    renegotiation_fixture()
+    {
+        dispatcher.start(callback(&queue, &EventQueue::dispatch_forever));
+    }
+
+    ~renegotiation_fixture()
+    {
+        queue.break_dispatch();
+        dispatcher.join();
+    }
+
+    //plug the charger and wait for the first contract
+    bool start(const std::vector<uint32_t> &pdos)
+    {
+        if (!pd.init()) {
+            return false;
+        }
+        chip.plug(pdos);
+        for (int i = 0; (i < 1000) && (pd.get_state() != STUSB4500::PD_CONTRACT); i++) {
+            ThisThread::sleep_for(1);
+        }
+        return pd.get_state() == STUSB4500::PD_CONTRACT;
+    }
+};
+
+static std::vector<uint32_t> charger_45w()
+{
+    std::vector<uint32_t> pdos;
+    pdos.push_back(src_fixed(5000, 3000));
+    pdos.push_back(src_fixed(9000, 3000));
+    pdos.push_back(src_fixed(15000, 3000));
+    pdos.push_back(src_fixed(20000, 2250));
+    return pdos;
+}
+
+static void test_change_voltage_live()
+{
+    renegotiation_fixture f;
+    TEST_ASSERT(f.start(charger_45w()));
+    TEST_ASSERT_EQUAL(20000, f.chip.contract_mv());
+
+    // Down to 9V, then up to 15V, VBUS never drops in between
+    uint64_t start = now_ns();
+    TEST_ASSERT_EQUAL(STUSB_OK, f.pd.change_pdo(9000));
+    uint64_t took_ms = (now_ns() - start) / 1000000;
+    TEST_ASSERT_EQUAL(9000, f.chip.contract_mv());
+    TEST_ASSERT_EQUAL(3000, f.chip.contract_ma());
+    TEST_ASSERT(took_ms < RENEGOTIATION_MAX_MS);
+    printf("  20V to 9V: %" PRIu64 "ms\n", took_ms);
+
+    TEST_ASSERT_EQUAL(STUSB_OK, f.pd.change_pdo(15000));
+    TEST_ASSERT_EQUAL(15000, f.chip.contract_mv());
+    uint32_t mv = 0;
+    uint32_t ma = 0;
+    TEST_ASSERT(f.pd.get_contract(mv, ma));
+    TEST_ASSERT_EQUAL(15000, mv);
+    TEST_ASSERT_EQUAL(3000, ma);
+
+    // Back to the most power
+    TEST_ASSERT_EQUAL(STUSB_OK, f.pd.change_pdo(0));
+    TEST_ASSERT_EQUAL(20000, f.chip.contract_mv());
+    TEST_ASSERT_EQUAL(2250, f.chip.contract_ma());
+
+    // Already there: no message sent
+    f.chip.reset_stats();
+    TEST_ASSERT_EQUAL(STUSB_OK, f.pd.change_pdo(20000));
+    TEST_ASSERT_EQUAL(0, f.chip.stats().soft_resets);
+
+    // Fresh capabilities on request, the contract stays
+    TEST_ASSERT_EQUAL(STUSB_OK, f.pd.get_source_caps());
+    uint32_t pdos[STUSB_MAX_SRC_PDOS];
+    TEST_ASSERT_EQUAL(4, f.pd.get_source_pdos(pdos));
+    TEST_ASSERT_EQUAL(1, f.chip.stats().get_source_caps);
+    TEST_ASSERT_EQUAL(0, f.chip.stats().soft_resets);
+}
+
+static void test_not_offered()
+{
+    renegotiation_fixture f;
+    TEST_ASSERT(f.start(charger_45w()));
+    f.chip.reset_stats();
+
+    // Not in the capabilities, or outside the charger limits: nothing changes
+    TEST_ASSERT_EQUAL(STUSB_ERROR_NOT_OFFERED, f.pd.change_pdo(12000));
+    TEST_ASSERT_EQUAL(STUSB_ERROR_NOT_OFFERED, f.pd.change_pdo(28000));
+    TEST_ASSERT_EQUAL(0, f.chip.stats().soft_resets);
+    TEST_ASSERT_EQUAL(20000, f.chip.contract_mv());
+    TEST_ASSERT_EQUAL(STUSB4500::PD_CONTRACT, f.pd.get_state());
+}
+
+static void test_rejected_falls_back()
+{
+    renegotiation_fixture f;
+    TEST_ASSERT(f.start(charger_45w()));
+
+    f.chip.set_reject_mv(15000);
+    TEST_ASSERT_EQUAL(STUSB_ERROR_REJECTED, f.pd.change_pdo(15000));
+    TEST_ASSERT_EQUAL(STUSB4500::PD_CONTRACT, f.pd.get_state());
+    TEST_ASSERT_EQUAL(5000, f.chip.contract_mv());
+    TEST_ASSERT_EQUAL(1, f.chip.stats().rejects);
+
+    // Stays at 5V until asked again
+    ThisThread::sleep_for(500);
+    TEST_ASSERT_EQUAL(5000, f.chip.contract_mv());
+    TEST_ASSERT_EQUAL(STUSB_OK, f.pd.change_pdo(9000));
+    TEST_ASSERT_EQUAL(9000, f.chip.contract_mv());
+}
+
+static void test_timeout_falls_back()
+{
+    renegotiation_fixture f;
+    TEST_ASSERT(f.start(charger_45w()));
+
+    // The source stops answering: the change and the 5V fallback each time out
+    f.chip.set_responsive(false);
+    uint64_t start = now_ns();
+    TEST_ASSERT_EQUAL(STUSB_ERROR_TIMEOUT, f.pd.change_pdo(9000, 200));
+    uint64_t took_ms = (now_ns() - start) / 1000000;
+    TEST_ASSERT(took_ms >= 2 * 200);
+    TEST_ASSERT(took_ms < 2 * 200 + 20);
+    TEST_ASSERT_EQUAL(STUSB4500::PD_RENEGOTIATING, f.pd.get_state());
+    // Only PDO1 left, whatever the source does next ends at 5V
+    TEST_ASSERT_EQUAL(1, f.chip.reg(0x70));
+
+    // Once it answers again a soft reset gets the 5V contract
+    f.chip.set_responsive(true);
+    TEST_ASSERT_EQUAL(STUSB_OK, f.pd.soft_reset());
+    TEST_ASSERT_EQUAL(5000, f.chip.contract_mv());
+
+    // Gone while waiting
+    f.chip.set_responsive(false);
+    f.queue.call_in(50, callback(&f.chip, &stusb4500_model::unplug));
+    TEST_ASSERT_EQUAL(STUSB_ERROR_DETACHED, f.pd.change_pdo(9000, 200));
+    TEST_ASSERT_EQUAL(STUSB4500::PD_DETACHED, f.pd.get_state());
+    TEST_ASSERT_EQUAL(STUSB_ERROR_DETACHED, f.pd.change_pdo(9000, 200));
+}
+
+int main()
+{
+    RUN_TEST(test_change_voltage_live);
+    RUN_TEST(test_not_offered);
+    RUN_TEST(test_rejected_falls_back);
+    RUN_TEST(test_timeout_falls_back);
+    return test_result();
+}